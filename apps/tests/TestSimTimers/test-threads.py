@@ -0,0 +1,76 @@
+from TOSSIM import *
+import sys
+import threading
+import time
+
+# Checks that TOSSIM releases the GIL while it runs events, so that other
+# Python threads make progress during a long simulation. The worker thread
+# below only counts loop iterations. Its rate during the run is compared
+# with its rate while the main thread sleeps: if the GIL were held for the
+# whole run it would barely advance until the run returned.
+#
+# No channels are added, so the continue predicate is only called before
+# the first event. A predicate called during the run would let the worker
+# in whenever Python code runs, even without the GIL being released.
+
+# simulated seconds, enough for the run to take a while
+RUN_TIME = 24 * 60 * 60
+# the worker must keep at least this share of its idle rate
+MIN_SHARE = 0.25
+
+t = Tossim({})
+
+m1 = t.getNode(0)
+m1.bootAtTime(345321)
+
+stop = threading.Event()
+progress = [0]
+
+def worker():
+    while not stop.is_set():
+        progress[0] += 1
+
+predicate_calls = [0]
+
+def continue_events():
+    predicate_calls[0] += 1
+    return True
+
+thread = threading.Thread(target=worker)
+thread.start()
+
+before = progress[0]
+start = time.time()
+events = t.runAllEventsWithTriggeredMaxTime(RUN_TIME, RUN_TIME, continue_events)
+elapsed = time.time() - start
+during_run = progress[0] - before
+
+# the baseline: the worker alone for as long as the run took
+before = progress[0]
+start = time.time()
+time.sleep(elapsed)
+idle = time.time() - start
+during_idle = progress[0] - before
+
+for i in range(0, 10000):
+    t.runNextEvent()
+
+stop.set()
+thread.join()
+
+run_rate = during_run / elapsed if elapsed > 0 else 0.0
+idle_rate = during_idle / idle if idle > 0 else 0.0
+
+print("Ran %d events in %.3fs, predicate called %d times" % (abs(events), elapsed, predicate_calls[0]))
+print("Worker iterations/s: %.0f during the run, %.0f idle" % (run_rate, idle_rate))
+
+if predicate_calls[0] > 1:
+    print("Predicate called during the run, the test proves nothing")
+    sys.exit(1)
+
+if idle_rate == 0 or run_rate < MIN_SHARE * idle_rate:
+    print("Worker thread made %.0f%% of its idle progress while the simulation ran"
+          % (100.0 * run_rate / idle_rate if idle_rate else 0.0))
+    sys.exit(1)
+
+print("Worker thread ran concurrently with the simulation")
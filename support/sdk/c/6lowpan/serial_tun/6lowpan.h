@@ -135,6 +135,8 @@ typedef struct __attribute__ ((__packed__)) _ip_6_addr_t {
 
 
 #define FRAG_BUFS 1
+#define FRAG_BUFS_MAX 256
+// datagrams serial_tun reassembles at once
 #define FRAG_BUF_SIZE 1280
 #define FRAG_TIMEOUT 60
 // 60 seconds
@@ -42,6 +42,11 @@
 #include <netinet/ip.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <net/if.h>
 
 #include <stdarg.h>
 
@@ -49,6 +54,7 @@
 #include "serialsource.h"
 #include "serialpacket.h"
 #include "6lowpan.h"
+#include "lowpan_reasm.h"
 
 #define min(a,b) ( (a>b) ? b : a )
 #define max(a,b) ( (a>b) ? a : b )
@@ -67,52 +73,102 @@ static char *msgs[] = {
 };
 
 /* global variables */
-lowpan_pkt_t *fragments = NULL; /* fragment reassembly of received frames */
-//lowpan_pkt_t *send_queue = NULL;
-int g_send_pending = 0;
+hw_addr_t hw_addr; /* shared by all basestations */
+int verbose = 0;
 
-hw_addr_t hw_addr;
+/* datagrams reassembled at once, their buffer space and timeout (ms) */
+const struct lowpan_reasm_config reasm_config = {
+    FRAG_BUFS_MAX, FRAG_BUFS_MAX * LOWPAN_MTU, FRAG_TIMEOUT * 1000
+};
 
-serial_source ser_src;
-int tun_fd = 0; /* tunnel device */
-//int ser_fd = 0; /* serial device */
+#define TUN_BATCH 32    /* packets read from a tun queue per wakeup */
+#define SERIAL_BATCH 32 /* frames read from a serial port at once */
+#define TXQ_LEN 256     /* frames waiting for a serial port */
+/* frames of the largest datagram: a first fragment of 96 bytes and
+ * subsequent fragments of 88 bytes */
+#define DGRAM_FRAMES_MAX (2 + (LOWPAN_MTU - 96) / 88)
+/* bytes a frame takes on the serial line besides the packet: the two
+ * sync bytes, protocol, sequence number and crc (escapes not counted) */
+#define SERIAL_FRAMING 6
+/* frames the pacing lets out back to back */
+#define PACING_BURST 2
+
+struct counters {
+    unsigned long tun_in, tun_in_bytes;         /* datagrams from tun */
+    unsigned long frames_out, frames_out_bytes;
+    unsigned long send_errors;                  /* frames not written */
+    unsigned long tun_paused;                   /* times the txq filled */
+    unsigned long frames_in, frames_in_bytes;
+    unsigned long frames_dropped;               /* not for us or invalid */
+    unsigned long tun_out, tun_out_bytes;       /* datagrams to tun */
+};
 
-uint16_t g_dgram_tag = 0; /* datagram_tag for sending fragmented packets */
+/*
+ * An attached basestation mote: its serial port, its queue of the tun
+ * device and the state of the data path between them. Each one is served
+ * by its own thread, so nothing here is locked; the counters are only
+ * read by the main thread to print them.
+ */
+struct basestation {
+    const char *device;
+    serial_source ser_src;
+    int tun_fd;
+    int epoll_fd;
+    int tun_polled; /* whether epoll waits for tun_fd to be readable */
+
+    struct lowpan_reasm *fragments; /* fragment reassembly */
+    uint16_t dgram_tag; /* datagram_tag for sending fragmented packets */
+
+    /* frames waiting for the serial port (a ring), sent within the send
+     * window of the mote and paced to the serial line by a token bucket
+     * of bytes, refilled at rate bytes per second */
+    struct {
+	am_packet_t frame;
+	int len;
+    } txq[TXQ_LEN];
+    int txq_head, txq_count;
+    int rate;
+    double tokens;
+    uint64_t refilled; /* us */
+
+    struct counters count;
+    pthread_t thread;
+};
+
+struct basestation *basestations;
+int n_basestations;
 
 /* ------------------------------------------------------------------------- */
 /* function pre-declarations */
-int serial_output_am_payload(uint8_t *buf, int len,
+int serial_output_am_payload(struct basestation *bs, uint8_t *buf, int len,
 			     const hw_addr_t *hw_src_addr,
 			     const hw_addr_t *hw_dst_addr);
 
-int serial_input_layer3(uint8_t *buf, int len,
+int serial_input_layer3(struct basestation *bs, uint8_t *buf, int len,
 			const hw_addr_t *hw_src_addr,
 			const hw_addr_t *hw_dst_addr);
 
-int serial_input_ipv6_uncompressed(uint8_t *buf, int len,
+int serial_input_ipv6_uncompressed(struct basestation *bs,
+				   uint8_t *buf, int len,
 				   const hw_addr_t *hw_src_addr,
 				   const hw_addr_t *hw_dst_addr);
 
-int serial_input_ipv6_compressed(uint8_t *buf, int len,
+int serial_input_ipv6_compressed(struct basestation *bs,
+				 uint8_t *buf, int len,
 				 const hw_addr_t *hw_src_addr,
 				 const hw_addr_t *hw_dst_addr);
 
 /* ------------------------------------------------------------------------- */
 /* utility functions */
-int get_ser_fd()
-{
-    return serial_source_fd(ser_src);
-}
-
-void increment_g_dgram_tag()
+void increment_dgram_tag(struct basestation *bs)
 {
-    uint16_t tmp = ntohs(g_dgram_tag);
+    uint16_t tmp = ntohs(bs->dgram_tag);
     if (tmp == 0xFFFF) {
 	tmp = 0;
     } else {
 	tmp++;
     }
-    g_dgram_tag = htons(tmp);
+    bs->dgram_tag = htons(tmp);
 }
 
 void stderr_msg(serial_source_msg problem)
@@ -120,11 +176,14 @@ void stderr_msg(serial_source_msg problem)
   fprintf(stderr, "Note: %s\n", msgs[problem]);
 }
 
+/* only with -v, so that the data path does not wait for the terminal */
 int
 debug(const char *fmt, ...)
 {
     int result;
     va_list ap;
+    if (!verbose)
+	return 0;
     va_start(ap, fmt);
     result = vfprintf(stderr, fmt, ap);
     va_end(ap);
@@ -148,6 +207,8 @@ ssystem(const char *fmt, ...)
 /* print char* in hex format */
 void dump_serial_packet(const unsigned char *packet, const int len) {
     int i;
+    if (!verbose)
+	return;
     printf("len: %d\n", len);
     if (!packet)
 	return;
@@ -227,68 +288,57 @@ void clear_pkt(lowpan_pkt_t *pkt)
     pkt->buf_begin = pkt->buf + LOWPAN_OVERHEAD;
 }
 
-void free_frag_list(frag_info_t *p)
+/* fragments are identified by both 802.15.4 addresses, the tag and size */
+void fragment_key(struct lowpan_reasm_key *key,
+		  const hw_addr_t *hw_src_addr, const hw_addr_t *hw_dst_addr,
+		  uint16_t dgram_size, uint16_t dgram_tag)
 {
-    frag_info_t *q;
-    while (p) {
-	q = p->next;
-	free(p);
-	p = q;
+    const hw_addr_t *addrs[2] = { hw_src_addr, hw_dst_addr };
+    int i, len;
+
+    key->addr_len = 0;
+    for (i = 0; i < 2; i++) {
+	len = addrs[i]->type == HW_ADDR_SHORT ? 2 : 8;
+	key->addr[key->addr_len++] = addrs[i]->type;
+	memcpy(key->addr + key->addr_len, addrs[i]->addr_long, len);
+	key->addr_len += len;
     }
+    key->tag = dgram_tag;
+    key->size = dgram_size;
 }
 
-void free_lowpan_pkt(lowpan_pkt_t *pkt)
+/* in ms, for the fragment reassembly timeouts */
+uint32_t now_ms()
 {
-    lowpan_pkt_t *p;
-    lowpan_pkt_t **q;
-
-    if (!fragments) return;
-    for(q=&fragments; *q; q=&(*q)->next) {
-	if (*q == pkt) {
-	    p = *q;
-	    *q = p->next;
-	    free_frag_list(p->frag_list);
-	    free(p);
-	    return;
-	}
-    }
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
-lowpan_pkt_t * find_fragment(hw_addr_t *hw_src_addr, hw_addr_t *hw_dst_addr,
-			     uint16_t dgram_size, uint16_t dgram_tag)
+/* in us, for the pacing of the serial ports */
+uint64_t now_us()
 {
-    lowpan_pkt_t *p;
-    for(p=fragments; p; p=p->next) {
-	if ((p->dgram_tag == dgram_tag)
-	    && (p->dgram_size == dgram_size)
-	    && cmp_hw_addr(&p->hw_src_addr, hw_src_addr) == 0
-	    && cmp_hw_addr(&p->hw_dst_addr, hw_dst_addr) == 0
-	    ) {
-	    return p;
-	}
-    }
-    return NULL;
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
+
 /* ------------------------------------------------------------------------- */
 /* HC1 and HC2 compression and decompresstion functions */
 
-/* the caller has to free() new_buf */
+/* new_buf has to hold len + sizeof(struct ip6_hdr) + sizeof(struct udp_hdr) */
 int lowpan_decompress(uint8_t *buf, int len,
 		       const hw_addr_t *hw_src_addr,
 		       const hw_addr_t *hw_dst_addr,
-		       uint8_t **new_buf, int *new_len)
+		       uint8_t *new_buf, int *new_len)
 {
     uint8_t hc1_enc;
     uint8_t hc2_enc;
     struct ip6_hdr *ip_hdr = NULL;
     struct udp_hdr *udp_hdr = NULL;
-    
-    *new_buf = malloc(len + sizeof(*ip_hdr) + sizeof(*udp_hdr));
-    if (!*new_buf) {
-	fprintf(stderr, "%s: out of memory\n", __func__);
-	*new_len = 0;
-	return 1;
-    }
+
     hc1_enc = *buf;
     buf += sizeof(hc1_enc);
     len -= sizeof(hc1_enc);
@@ -301,7 +351,7 @@ int lowpan_decompress(uint8_t *buf, int len,
     }
 
     /* IP header fields */
-    ip_hdr = (struct ip6_hdr *) *new_buf;
+    ip_hdr = (struct ip6_hdr *) new_buf;
     memset(ip_hdr, 0, sizeof(struct ip6_hdr));
 
     ip_hdr->vtc |= IPV6_VERSION;
@@ -374,7 +424,7 @@ int lowpan_decompress(uint8_t *buf, int len,
     if ((hc1_enc & HC1_HC2_MASK) == HC1_HC2_PRESENT
 	&& (hc1_enc & HC1_NEXTHDR_MASK) == HC1_NEXTHDR_UDP) {
 	
-	udp_hdr = (struct udp_hdr *) ((*new_buf) + sizeof(struct ip6_hdr));
+	udp_hdr = (struct udp_hdr *) (new_buf + sizeof(struct ip6_hdr));
 	//udp_hdr = (struct udp_hdr *) (ip_hdr + 1);
 	memset(udp_hdr, 0, sizeof(struct udp_hdr));
 
@@ -411,17 +461,28 @@ int lowpan_decompress(uint8_t *buf, int len,
 	buf += sizeof(udp_hdr->chksum);
 	len -= sizeof(udp_hdr->chksum);
 	
+	/* frames shorter than their compressed headers */
+	if (len < 0) {
+	    *new_len = 0;
+	    return 1;
+	}
+
 	/* IPv6 Payload Length */
 	ip_hdr->plen = htons(len + sizeof(struct udp_hdr));
 	
-	memcpy((*new_buf) + sizeof(struct ip6_hdr) + sizeof(struct udp_hdr),
+	memcpy(new_buf + sizeof(struct ip6_hdr) + sizeof(struct udp_hdr),
 	       buf, len);
 	*new_len = len + sizeof(struct ip6_hdr) + sizeof(struct udp_hdr);
     } else {
+    if (len < 0) {
+	*new_len = 0;
+	return 1;
+    }
+
     /* IPv6 Payload Length */
     ip_hdr->plen = htons(len);
 
-    memcpy((*new_buf) + sizeof(struct ip6_hdr), buf, len);
+    memcpy(new_buf + sizeof(struct ip6_hdr), buf, len);
     *new_len = len + sizeof(struct ip6_hdr);
     }
     
@@ -594,18 +655,15 @@ int lowpan_compress(uint8_t **buf_begin, int *len,
 /* handling of data arriving on the tun interface */
 
 /*
- * encapsulate buf as an Active Message payload
- * fragments packets if needed
+ * encapsulate buf as an Active Message payload and queue it for the
+ * serial port, the caller checks that there is room in the queue
  */
-int serial_output_am_payload(uint8_t *buf, int len,
+int serial_output_am_payload(struct basestation *bs, uint8_t *buf, int len,
 			     const hw_addr_t *hw_src_addr,
 			     const hw_addr_t *hw_dst_addr)
 {
-    am_packet_t AMpacket;
-    int result;
-    
-    //debug("%s: dumping buf (len: %d)...\n", __func__, len);
-    //dump_serial_packet(buf, len);
+    am_packet_t *AMpacket;
+    int slot;
 
     if (len > LINK_DATA_MTU) {
 	fprintf(stderr, "%s: requested to send more than LINK_DATA_MTU"\
@@ -614,50 +672,76 @@ int serial_output_am_payload(uint8_t *buf, int len,
 	//       and only print a warning
 	return -1;
     }
-    memset(&AMpacket, 0, sizeof(AMpacket));
-    AMpacket.pkt_type = 0;
+    slot = (bs->txq_head + bs->txq_count) % TXQ_LEN;
+    AMpacket = &bs->txq[slot].frame;
+    AMpacket->pkt_type = 0;
     // TODO: make the dst addr handling more general
-    //AMpacket.dst = htons(0x14);
-    AMpacket.dst = htons(0xFFFF);
-    //AMpacket.src = htons(0x12);
+    AMpacket->dst = htons(0xFFFF);
     // TODO: make the src addr handling more general
-    memcpy(&AMpacket.src, hw_addr.addr_short, 2);
-    AMpacket.group = 0;
-    AMpacket.type = 0x41;
-    AMpacket.length = min(len,LINK_DATA_MTU);
-    //AMpacket.data = buf;
-    memcpy(AMpacket.data, buf, AMpacket.length);
-    
-    len = AMpacket.length + 8; // data + header
+    memcpy(&AMpacket->src, hw_addr.addr_short, 2);
+    AMpacket->group = 0;
+    AMpacket->type = 0x41;
+    AMpacket->length = len;
+    memcpy(AMpacket->data, buf, len);
+
+    len += 8; // data + header
+    bs->txq[slot].len = len;
+    bs->txq_count++;
+
+    debug("queued for serial port %s...\n", bs->device);
+    dump_serial_packet((unsigned char *)AMpacket, len);
+    return len;
+}
+
+/*
+ * sends the queued frames as long as the send window of the mote is open
+ * and the pacing allows
+ * returns in how many ms the pacing allows the next frame, -1 if no
+ * frame waits for it
+ */
+int txq_flush(struct basestation *bs)
+{
+    uint64_t now = now_us();
+    double burst = PACING_BURST * (sizeof(am_packet_t) + SERIAL_FRAMING);
 
-    debug("sending to serial port...\n");
-    dump_serial_packet((unsigned char *)&AMpacket, len);
+    bs->tokens += (double)(now - bs->refilled) * bs->rate / 1000000;
+    if (bs->tokens > burst)
+	bs->tokens = burst;
+    bs->refilled = now;
 
-    result = write_serial_packet(ser_src, &AMpacket, len);
-    /*
-     * Returns: 0 if packet successfully written, 1 if successfully
-     * written but not acknowledged, -1 otherwise
-     */
-    debug("write_serial_packet returned %d\n", result);
+    while (bs->txq_count && serial_source_window_open(bs->ser_src)) {
+	int len = bs->txq[bs->txq_head].len;
 
-    if (result < 0) {
-	perror ("sendto");
-	return -1;
+	if (bs->tokens < len + SERIAL_FRAMING)
+	    return (len + SERIAL_FRAMING - bs->tokens) * 1000 / bs->rate + 1;
+	bs->tokens -= len + SERIAL_FRAMING;
+
+	if (send_serial_packet(bs->ser_src, &bs->txq[bs->txq_head].frame,
+			       len) < 0) {
+	    perror("send_serial_packet");
+	    bs->count.send_errors++;
+	} else {
+	    bs->count.frames_out++;
+	    bs->count.frames_out_bytes += len;
+	}
+	bs->txq_head = (bs->txq_head + 1) % TXQ_LEN;
+	bs->txq_count--;
     }
-    return len;
+    return -1;
 }
 
 /*
- * read data from the tun device and send it to the serial port
+ * read a packet from the tun queue and queue it for the serial port
  * does also fragmentation
+ * returns 0 once the tun queue is empty
  */
-int tun_input()
+int tun_input(struct basestation *bs)
 {
     uint8_t buf[LOWPAN_MTU + LOWPAN_OVERHEAD];
     uint8_t *buf_begin = buf + LOWPAN_OVERHEAD;
     int len;
     int result;
-    
+
     struct lowpan_frag_hdr *frag_hdr;
     uint8_t dgram_offset = 0;
     uint16_t dgram_size;
@@ -666,19 +750,22 @@ int tun_input()
 
     uint8_t *frame_begin; /* begin of the frame payload */
     uint8_t frame_len; /* length of the frame payload */
-    
-    len = tun_read (tun_fd, (char*) buf_begin, LOWPAN_MTU);
+
+    len = tun_read (bs->tun_fd, (char*) buf_begin, LOWPAN_MTU);
     if (len <= 0) {
-	perror ("read");
+	if (len < 0 && errno != EAGAIN)
+	    perror ("read");
 	return 0;
     }
-    printf("data on tun interface\n");
+    debug("data on tun interface\n");
+    bs->count.tun_in++;
+    bs->count.tun_in_bytes += len;
 
     /* set 802.15.4 destination address */
     hw_dst_addr.type = HW_ADDR_SHORT;
     hw_dst_addr.addr_short[0] =0xFF;
     hw_dst_addr.addr_short[1] =0xFF;
-    
+
     /* HC compression */
     lowpan_compress(&buf_begin, &len,
 		    &hw_addr, &hw_dst_addr);
@@ -691,9 +778,9 @@ int tun_input()
     /* determine if fragmentation is needed */
     if (len > LINK_DATA_MTU) {
 	/* fragmentation needed */
-	increment_g_dgram_tag();
+	increment_dgram_tag(bs);
 	dgram_size = htons(len);
-	
+
 	/* first fragment */
 	debug("first fragment... (len: %d, offset: %d)\n",
 	      len, dgram_offset);
@@ -702,24 +789,23 @@ int tun_input()
 	frag_hdr = (struct lowpan_frag_hdr *) frame_begin;
 	frag_hdr->dgram_size = dgram_size;
 	frag_hdr->dispatch |= DISPATCH_FIRST_FRAG;
-	frag_hdr->dgram_tag = g_dgram_tag;
+	frag_hdr->dgram_tag = bs->dgram_tag;
 	/* align fragment length at an 8-byte multiple */
 	frag_len = LINK_DATA_MTU - sizeof(struct lowpan_frag_hdr);
 	frag_len -= frag_len%8;
 	frame_len = frag_len + sizeof(struct lowpan_frag_hdr);
-	result = serial_output_am_payload(frame_begin, frame_len,
+	result = serial_output_am_payload(bs, frame_begin, frame_len,
 					  &hw_addr, &hw_dst_addr);
 	if (result < 0) {
-	    perror("serial_output_am_payload() failed\n");
-	    return -1;
+	    fprintf(stderr, "serial_output_am_payload() failed\n");
+	    return 1;
 	}
 	buf_begin += frag_len;
 	len -= frag_len;
 	dgram_offset += frag_len/8; /* in 8-byte multiples */
-    
-	/* subseq fragment */
+
+	/* subseq fragment, paced by txq_flush() */
 	while (len > 0) {
-	    usleep(10000); /* workaround to prevent loosing fragments */
 	    debug("subsequent fragment... (len: %d, offset: %d)\n",
 		  len, dgram_offset);
 	    /* dgram_offset */
@@ -730,7 +816,7 @@ int tun_input()
 	    frag_hdr = (struct lowpan_frag_hdr *) frame_begin;
 	    frag_hdr->dgram_size = dgram_size;
 	    frag_hdr->dispatch |= DISPATCH_SUBSEQ_FRAG;
-	    frag_hdr->dgram_tag = g_dgram_tag;
+	    frag_hdr->dgram_tag = bs->dgram_tag;
 	    if (len <= LINK_DATA_MTU  - sizeof(struct lowpan_frag_hdr)
 		- sizeof(uint8_t)) {
 		/*
@@ -746,11 +832,10 @@ int tun_input()
 	    }
 	    frame_len = frag_len + sizeof(struct lowpan_frag_hdr)
 		                 + sizeof(uint8_t);
-	    result = serial_output_am_payload(frame_begin, frame_len,
+	    result = serial_output_am_payload(bs, frame_begin, frame_len,
 					      &hw_addr, &hw_dst_addr);
 	    if (result < 0) {
-		perror("serial_output_am_payload() failed\n");
-		//return -1;
+		fprintf(stderr, "serial_output_am_payload() failed\n");
 	    }
 	    buf_begin += frag_len;
 	    len -= frag_len;
@@ -760,7 +845,7 @@ int tun_input()
 
     } else {
 	/* no need for fragmentation */
-	serial_output_am_payload(buf_begin, len,
+	serial_output_am_payload(bs, buf_begin, len,
 				 &hw_addr, &hw_dst_addr);
 	return 1;
     }
@@ -770,16 +855,15 @@ int tun_input()
 /* ------------------------------------------------------------------------- */
 /* handling of data arriving on the serial port */
 
-/* 
- * read data on serial port and send it to the tun interface
+/*
+ * process a frame read from the serial port and send its datagram to the
+ * tun interface
  * does fragment reassembly
  */
-int serial_input()
+int serial_input(struct basestation *bs, void *ser_data, int ser_len)
 {
     int result = 0;
 
-    void *ser_data; /* data read from serial port */
-    int ser_len;    /* length of data read from serial port */
     uint8_t *buf;
     int len;
 
@@ -793,278 +877,187 @@ int serial_input()
     uint16_t dgram_tag;
     uint16_t dgram_size;
     uint8_t dgram_offset;
-    struct timeval tv;
-    frag_info_t *p;
-    frag_info_t **q;
-    int last_frag;
-    lowpan_pkt_t *pkt;
-
-    printf("serial_input()\n");
-    /* read data from serial port */
-    ser_data = read_serial_packet(ser_src, &ser_len);
-
-    /* process the packet we have received */
-    if (ser_len && ser_data) {
-	printf("dumping data on serial port...\n");
-	dump_serial_packet(ser_data, ser_len);
-	AMpacket = ser_data;
-
-	/* copy 802.15.4 addresses */
-	// TODO: check if I got the byte ordering right
-	hw_src_addr.type = HW_ADDR_SHORT;
-	memcpy(hw_src_addr.addr_short, &AMpacket->src,
-	       sizeof(hw_src_addr.addr_short));
-	hw_dst_addr.type = HW_ADDR_SHORT;
-	memcpy(hw_dst_addr.addr_short, &AMpacket->dst,
-	       sizeof(hw_dst_addr.addr_short));
-
-	/* --- 6lowpan optional headers --- */
-	buf = AMpacket->data;
-	len = AMpacket->length;
-	if (len != ser_len - 8) {
-	    fprintf(stderr,
-		    "warning: mismatch between AMpacket->length(%d)"\
-		    " and ser_len - 8(%d)", AMpacket->length, ser_len - 8);
+    struct lowpan_reasm_key key;
+    struct lowpan_reasm_entry *entry;
+
+    debug("dumping data on serial port %s...\n", bs->device);
+    dump_serial_packet(ser_data, ser_len);
+    bs->count.frames_in++;
+    bs->count.frames_in_bytes += ser_len;
+    if (ser_len < 8) {
+	goto discard_packet;
+    }
+    AMpacket = ser_data;
+
+    /* copy 802.15.4 addresses */
+    // TODO: check if I got the byte ordering right
+    hw_src_addr.type = HW_ADDR_SHORT;
+    memcpy(hw_src_addr.addr_short, &AMpacket->src,
+	   sizeof(hw_src_addr.addr_short));
+    hw_dst_addr.type = HW_ADDR_SHORT;
+    memcpy(hw_dst_addr.addr_short, &AMpacket->dst,
+	   sizeof(hw_dst_addr.addr_short));
+
+    /* --- 6lowpan optional headers --- */
+    buf = AMpacket->data;
+    len = AMpacket->length;
+    if (len != ser_len - 8) {
+	fprintf(stderr,
+		"warning: mismatch between AMpacket->length(%d)"\
+		" and ser_len - 8(%d)", AMpacket->length, ser_len - 8);
+	len = min(len, ser_len - 8);
+    }
+    // TODO: check if length has a sensible value
+    dispatch = AMpacket->data;
+    /* Mesh Addressing header */
+    if ( (*dispatch & DISPATCH_MESH_MASK) == DISPATCH_MESH) {
+	/* move over the dispatch field */
+	buf += sizeof(*dispatch);
+	len -= sizeof(*dispatch);
+
+	/* Hops Left */
+	if ((*dispatch & 0x0F) == 0) {
+	  goto discard_packet;
 	}
-	// TODO: check if length has a sensible value
-	dispatch = AMpacket->data;
-	/* Mesh Addressing header */
-	if ( (*dispatch & DISPATCH_MESH_MASK) == DISPATCH_MESH) {
-	    /* move over the dispatch field */
-	    buf += sizeof(*dispatch);
-	    len -= sizeof(*dispatch);
-
-	    /* Hops Left */
-	    if ((*dispatch & 0x0F) == 0) {
-	      goto discard_packet;
-	    }
-	    
-	    /* Final Destination Address */
-	    if (*dispatch & DISPATCH_MESH_F_FLAG) {
-		hw_dst_addr.type = HW_ADDR_LONG;
-		memcpy(&hw_dst_addr.addr_long, buf,
-		       sizeof(hw_dst_addr.addr_long));
-		buf += sizeof(hw_dst_addr.addr_long);
-		len -= sizeof(hw_dst_addr.addr_long);
-	    } else {
-		hw_dst_addr.type = HW_ADDR_SHORT;
-		memcpy(&hw_dst_addr.addr_short, buf,
-		       sizeof(hw_dst_addr.addr_short));
-		buf += sizeof(hw_dst_addr.addr_short);
-		len -= sizeof(hw_dst_addr.addr_short);
-	    }
-	    
-	    /* check if we're the recipient */
-	    if (cmp_hw_addr(&hw_dst_addr, &hw_addr) != 0
-		&& !hw_addr_is_broadcat(&hw_dst_addr)) {
-		// TODO: if mesh forwarding enabled, then forward
-		goto discard_packet;
-	    }
-	    
-	    /* Originator Address */
-	    if (*dispatch & DISPATCH_MESH_O_FLAG) {
-		hw_src_addr.type = HW_ADDR_LONG;
-		memcpy(&hw_src_addr.addr_long, buf,
-		       sizeof(hw_src_addr.addr_long));
-		buf += sizeof(hw_src_addr.addr_long);
-		len -= sizeof(hw_src_addr.addr_long);
-	    } else {
-		hw_src_addr.type = HW_ADDR_SHORT;
-		memcpy(&hw_src_addr.addr_short, buf,
-		       sizeof(hw_src_addr.addr_short));
-		buf += sizeof(hw_src_addr.addr_short);
-		len -= sizeof(hw_src_addr.addr_short);
-	    }
-	    
-	    dispatch = buf;
+
+	/* Final Destination Address */
+	if (*dispatch & DISPATCH_MESH_F_FLAG) {
+	    hw_dst_addr.type = HW_ADDR_LONG;
+	    memcpy(&hw_dst_addr.addr_long, buf,
+		   sizeof(hw_dst_addr.addr_long));
+	    buf += sizeof(hw_dst_addr.addr_long);
+	    len -= sizeof(hw_dst_addr.addr_long);
+	} else {
+	    hw_dst_addr.type = HW_ADDR_SHORT;
+	    memcpy(&hw_dst_addr.addr_short, buf,
+		   sizeof(hw_dst_addr.addr_short));
+	    buf += sizeof(hw_dst_addr.addr_short);
+	    len -= sizeof(hw_dst_addr.addr_short);
 	}
-	/* Broadcast header */
-	if (*dispatch == DISPATCH_BC0) {
-	    bc_hdr = (struct lowpan_broadcast_hdr *) buf;
-	    // do something usefull with bc_hdr->seq_no...
-	    
-	    buf += (sizeof(struct lowpan_broadcast_hdr));
-	    len -= (sizeof(struct lowpan_broadcast_hdr));
-	    dispatch = buf;
+
+	/* check if we're the recipient */
+	if (cmp_hw_addr(&hw_dst_addr, &hw_addr) != 0
+	    && !hw_addr_is_broadcat(&hw_dst_addr)) {
+	    // TODO: if mesh forwarding enabled, then forward
+	    goto discard_packet;
 	}
 
-	/* fragment header */
-	if ((*dispatch & DISPATCH_FRAG_MASK)
-	    == DISPATCH_FIRST_FRAG
-	    || (*dispatch & DISPATCH_FRAG_MASK)
-	    == DISPATCH_SUBSEQ_FRAG
-	    ) {
-	    frag_hdr = (struct lowpan_frag_hdr *) buf;
-	    buf += sizeof(struct lowpan_frag_hdr);
-	    len -= sizeof(struct lowpan_frag_hdr);
-
-	    /* collect information about the fragment */
-	    dgram_tag = frag_hdr->dgram_tag;
-	    dgram_size = frag_hdr->dgram_size & htons(0x07FF);
-	    //dgram_size = frag_hdr->dgram_size8[1];
-	    //dgram_size += ((uint16_t) (frag_hdr->dgram_size8[0] & 0x07)) << 8;
-	    if ((*dispatch & DISPATCH_FRAG_MASK) == DISPATCH_SUBSEQ_FRAG) {
-		dgram_offset = *buf;
-		buf += 1;
-		len -= 1;
-	    } else {
-		dgram_offset = 0;
-	    }
-	    
-	    debug("fragment reassembly: tag: 0x%04X, size: %d, offset: %d"\
-		  "(*8=%d)\n",
-		  ntohs(dgram_tag), ntohs(dgram_size),
-		  dgram_offset, dgram_offset*8);
-
-	    pkt = find_fragment(&hw_src_addr, &hw_dst_addr,
-				dgram_size, dgram_tag);
-	    if (pkt) {
-		debug("found an existing reassembly buffer\n");
-		/* fragment reassembly buffer found */
-		/* check for overlap */
-		for (p = pkt->frag_list; p; p=p->next) {
-		    if (dgram_offset == p->offset && len == p->len) {
-			/* duplicate - discard it */
-			result = 0;
-			goto discard_packet;
-		    } else if ((dgram_offset == p->offset && len < p->len) ||
-			       (dgram_offset > p->offset
-				&& dgram_offset < p->offset + p->len/8)
-			       ) {
-			goto frag_overlap;
-		    }
-		}
-		/* no overlap found */
-		goto frag_reassemble;
-	    } else {
-		debug("starting a new reassembly buffer\n");
-		/* fragment reassembly buffer not found - set up a new one */
-		pkt = malloc(sizeof(lowpan_pkt_t));
-		if (!pkt) {
-		    // no free slot for reassembling fragments
-		    fprintf(stderr, "out of memory - dropping a fragment\n");
-		    result = -1;
-		    goto discard_packet;
-		}
-		pkt->next = fragments;
-		fragments = pkt;
-		clear_pkt(pkt);
-		memcpy(&pkt->hw_src_addr, &hw_src_addr, sizeof(hw_src_addr));
-		memcpy(&pkt->hw_dst_addr, &hw_dst_addr, sizeof(hw_dst_addr));
-		pkt->dgram_tag = dgram_tag;
-		pkt->dgram_size = dgram_size;
-		gettimeofday(&tv, NULL);
-		pkt->frag_timeout = tv.tv_sec + FRAG_TIMEOUT;
-		goto frag_reassemble;
-	    }
-	    
-	frag_overlap:
-	    /* overlap - discard previous frags
-	     * and restart freagment reassembly
-	     */
-	    free_frag_list(pkt->frag_list);
-	    pkt->frag_list = NULL;
-	    /* not sure if we want to clear the whole buf */
-	    //memset(&pkt->buf, 0, sizeof(pkt->buf));
-	    gettimeofday(&tv, NULL);
-	    pkt->frag_timeout = tv.tv_sec + FRAG_TIMEOUT;
-	    goto frag_reassemble;
-	    
-	frag_reassemble:
-	    /* copy buf data */
-	    debug("dgram_offset: %d\n", dgram_offset);
-	    memcpy(pkt->buf_begin + dgram_offset*8, buf, len);
-	    //TODO: make sure a large len does not cause a buffer overflow
-
-	    /* update frag_info */
-	    p = malloc(sizeof(frag_info_t));
-	    if (!p) {
-		fprintf(stderr, "out of memory - fragment "\
-			"reassembly failing\n");
-	    } else {
-		p->offset = dgram_offset;
-		p->len = len;
-
-		/* insert frag_info into the orderer list */
-		if (pkt->frag_list) {
-		    for(q = &(pkt->frag_list); (*q)->next; q=&((*q)->next)) {
-			if (p->offset > (*q)->offset) {
-			    break;
-			}
-		    }
-		    if ((*q)) {
-			debug("inserting frag_info before offset %d\n",
-			      (*q)->offset);
-		    } else {
-			debug("inserting frag_info at the beginning/end\n");
-		    }
-
-		    p->next = *q;
-		    *q = p;
-		} else {
-		    debug("inserting frag_info to the beginning "
-			  "of the list\n");
-		    p->next = pkt->frag_list;
-		    pkt->frag_list = p;
-		}
-	    }
+	/* Originator Address */
+	if (*dispatch & DISPATCH_MESH_O_FLAG) {
+	    hw_src_addr.type = HW_ADDR_LONG;
+	    memcpy(&hw_src_addr.addr_long, buf,
+		   sizeof(hw_src_addr.addr_long));
+	    buf += sizeof(hw_src_addr.addr_long);
+	    len -= sizeof(hw_src_addr.addr_long);
+	} else {
+	    hw_src_addr.type = HW_ADDR_SHORT;
+	    memcpy(&hw_src_addr.addr_short, buf,
+		   sizeof(hw_src_addr.addr_short));
+	    buf += sizeof(hw_src_addr.addr_short);
+	    len -= sizeof(hw_src_addr.addr_short);
+	}
 
-	    /* check if this is not the last fragment */
-	    if (!dgram_offset) {
-		/* the first fragment cannot be the last one */
-		last_frag = 0;
-	    } else {
-		debug("checking last_frag...\n");
-		last_frag=1;
-		dgram_offset = ntohs(dgram_size)/8;
-		for(p=pkt->frag_list; p && dgram_offset; p=p->next) {
-		    debug("dgram_offset: %d, p->offset: %d, p->len: %d\n",
-			  dgram_offset, p->offset, p->len);
-		    if (p->offset + p->len/8 != dgram_offset) {
-			debug("offset mismatch - not the last fragment\n");
-			last_frag = 0;
-			break;
-		    }
-		    dgram_offset = p->offset;
-		}
-	    }
+	dispatch = buf;
+    }
+    /* Broadcast header */
+    if (*dispatch == DISPATCH_BC0) {
+	bc_hdr = (struct lowpan_broadcast_hdr *) buf;
+	// do something usefull with bc_hdr->seq_no...
+
+	buf += (sizeof(struct lowpan_broadcast_hdr));
+	len -= (sizeof(struct lowpan_broadcast_hdr));
+	dispatch = buf;
+    }
 
-	    if (last_frag) {
-		debug("last fragment, reassembly done\n");
-		pkt->len = ntohs(dgram_size);
-		
-		debug("dumping reassembled datagram...\n");
-		dump_serial_packet(pkt->buf_begin, pkt->len);
-		
-		/* pass up the complete packet */
-		result = serial_input_layer3(pkt->buf_begin, pkt->len,
-					     &hw_src_addr, &hw_dst_addr);
-		/* deallocate pkt and all fragment info */
-		free_lowpan_pkt(pkt);
-	    } else {
-		result = 0;
-	    }
-	} else { /* no fragment header present */
-	    result =  serial_input_layer3(buf, len,
-					  &hw_src_addr, &hw_dst_addr);
+    /* fragment header */
+    if ((*dispatch & DISPATCH_FRAG_MASK)
+	== DISPATCH_FIRST_FRAG
+	|| (*dispatch & DISPATCH_FRAG_MASK)
+	== DISPATCH_SUBSEQ_FRAG
+	) {
+	frag_hdr = (struct lowpan_frag_hdr *) buf;
+	buf += sizeof(struct lowpan_frag_hdr);
+	len -= sizeof(struct lowpan_frag_hdr);
+
+	/* collect information about the fragment */
+	dgram_tag = frag_hdr->dgram_tag;
+	dgram_size = frag_hdr->dgram_size & htons(0x07FF);
+	if ((*dispatch & DISPATCH_FRAG_MASK) == DISPATCH_SUBSEQ_FRAG) {
+	    dgram_offset = *buf;
+	    buf += 1;
+	    len -= 1;
+	} else {
+	    dgram_offset = 0;
 	}
-	
-    } else {
-	//printf("no data on serial port, but FD trigerred select\n");
+
+	debug("fragment reassembly: tag: 0x%04X, size: %d, offset: %d"\
+	      "(*8=%d)\n",
+	      ntohs(dgram_tag), ntohs(dgram_size),
+	      dgram_offset, dgram_offset*8);
+
+	/* fragments may arrive out of order and more than once */
+	fragment_key(&key, &hw_src_addr, &hw_dst_addr,
+		     ntohs(dgram_size), dgram_tag);
+	switch (lowpan_reasm_add(bs->fragments, &key, dgram_offset * 8,
+				 buf, len, now_ms(), &entry)) {
+	case LOWPAN_REASM_COMPLETE:
+	    debug("last fragment, reassembly done\n");
+	    debug("dumping reassembled datagram...\n");
+	    dump_serial_packet(lowpan_reasm_data(entry),
+			       lowpan_reasm_size(entry));
+
+	    /* pass up the complete packet */
+	    result = serial_input_layer3(bs, lowpan_reasm_data(entry),
+					 lowpan_reasm_size(entry),
+					 &hw_src_addr, &hw_dst_addr);
+	    lowpan_reasm_release(bs->fragments, entry);
+	    break;
+	case LOWPAN_REASM_DUPLICATE:
+	    debug("duplicate fragment\n");
+	    result = 0;
+	    break;
+	case LOWPAN_REASM_NO_MEMORY:
+	    debug("out of memory - dropping a fragment\n");
+	    bs->count.frames_dropped++;
+	    result = -1;
+	    break;
+	case LOWPAN_REASM_INVALID:
+	    debug("invalid fragment - dropping it\n");
+	    bs->count.frames_dropped++;
+	    result = -1;
+	    break;
+	default:
+	    result = 0;
+	}
+    } else { /* no fragment header present */
+	result =  serial_input_layer3(bs, buf, len,
+				      &hw_src_addr, &hw_dst_addr);
     }
+    return result;
+
  discard_packet:
-    if (ser_data) {
-	free(ser_data);
-    }
-    if (ser_data && ser_len > 0) {
-	return 1;
-    } else {
-	return 0;
+    bs->count.frames_dropped++;
+    return 0;
+}
+
+/* read all frames available on the serial port, a batch at a time */
+void serial_input_batch(struct basestation *bs)
+{
+    uint8_t arena[SERIAL_BATCH * PACKET_BATCH_MIN_SIZE];
+    packet_desc packets[SERIAL_BATCH];
+    packet_batch batch;
+    int i;
+
+    packet_batch_init(&batch, arena, sizeof(arena), packets, SERIAL_BATCH);
+    while (read_serial_packets(bs->ser_src, &batch, 1) > 0) {
+	for (i = 0; i < batch.count; i++) {
+	    serial_input(bs, PACKET_BATCH_DATA(&batch, i),
+			 batch.packets[i].len);
+	}
     }
-    //return result;
 }
 
-int serial_input_layer3(uint8_t *buf, int len,
+int serial_input_layer3(struct basestation *bs, uint8_t *buf, int len,
 			const hw_addr_t *hw_src_addr,
 			const hw_addr_t *hw_dst_addr)
 {
@@ -1076,174 +1069,326 @@ int serial_input_layer3(uint8_t *buf, int len,
 
     /* uncompressed IPv6 */
     if (*dispatch == 0x41) {
-	return serial_input_ipv6_uncompressed(buf+1, len-1,
+	return serial_input_ipv6_uncompressed(bs, buf+1, len-1,
 					      hw_src_addr, hw_dst_addr);
 
     }
     /* LOWPAN_HC1 compressed IPv6 */
     else if (*dispatch == 0x42) {
-	return serial_input_ipv6_compressed(buf+1, len-1,
+	return serial_input_ipv6_compressed(bs, buf+1, len-1,
 					    hw_src_addr, hw_dst_addr);
     }
     /* unknown dispatch value if we got here */
     else {
 	debug("unknown dispatch value: %X\n", *dispatch);
-	return tun_write(tun_fd, (char*) buf+1, len-1);
+	return serial_input_ipv6_uncompressed(bs, buf+1, len-1,
+					      hw_src_addr, hw_dst_addr);
     }
 }
 
-int serial_input_ipv6_uncompressed(uint8_t *buf, int len,
+int serial_input_ipv6_uncompressed(struct basestation *bs,
+				   uint8_t *buf, int len,
 				   const hw_addr_t *hw_src_addr,
 				   const hw_addr_t *hw_dst_addr)
 {
+    int ret;
+
     debug("%s()\n", __func__);
     //dump_serial_packet(buf, len);
     // TODO: update neighbor table
-    return tun_write(tun_fd, (char*) buf, len);
+    ret = tun_write(bs->tun_fd, (char*) buf, len);
+    if (ret > 0) {
+	bs->count.tun_out++;
+	bs->count.tun_out_bytes += ret;
+    }
+    return ret;
 }
 
-int serial_input_ipv6_compressed(uint8_t *buf, int len,
+int serial_input_ipv6_compressed(struct basestation *bs,
+				 uint8_t *buf, int len,
 				 const hw_addr_t *hw_src_addr,
 				 const hw_addr_t *hw_dst_addr)
 {
-    int ret=0;
+    uint8_t new_buf[LOWPAN_MTU + sizeof(struct ip6_hdr)
+		    + sizeof(struct udp_hdr)];
     int new_len;
-    uint8_t *new_buf;
 
     debug("%s()\n", __func__);
+    if (len > LOWPAN_MTU) {
+	return 0;
+    }
     if (0 == lowpan_decompress(buf, len,
 			       hw_src_addr, hw_dst_addr,
-			       &new_buf, &new_len)
+			       new_buf, &new_len)
 	) {
 	// TODO: update neighbor table
-	buf = new_buf;
-	len = new_len;
-	ret =  tun_write(tun_fd, (char*) buf, len);
-	
-	if (new_buf && new_len) {
-	    free(new_buf);
-	}
+	return serial_input_ipv6_uncompressed(bs, new_buf, new_len,
+					      hw_src_addr, hw_dst_addr);
     }
-    
-    return ret;
+
+    return 0;
 }
 
 /* ------------------------------------------------------------------------- */
 
-void timer_fired()
+/* wait for the tun queue only while the transmit queue has room */
+void tun_poll(struct basestation *bs, int poll)
 {
-    struct timeval tv;
-    lowpan_pkt_t *p;
-    lowpan_pkt_t **q;
+    struct epoll_event ev;
 
-    /* time out old fragments */
-    (void) gettimeofday(&tv, NULL);
-    for(q = &fragments; *q; ) {
-	if ((*q)->frag_timeout > tv.tv_sec) {
-	    p = (*q)->next;
-	    free(*q);
-	    *q = p;
-	} else {
-	    q = &((*q)->next);
-	}
+    if (poll == bs->tun_polled)
+	return;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = poll ? EPOLLIN : 0;
+    ev.data.fd = bs->tun_fd;
+    epoll_ctl(bs->epoll_fd, EPOLL_CTL_MOD, bs->tun_fd, &ev);
+    bs->tun_polled = poll;
+    if (!poll)
+	bs->count.tun_paused++;
+}
+
+/*
+ * process acknowledgements and retransmissions, send what the window and
+ * the pacing allow and time out old fragments
+ * returns the epoll_wait() timeout (ms) until this is needed again
+ */
+int timer_fired(struct basestation *bs)
+{
+    struct timeval rto;
+    uint32_t next;
+    int timeout, wait;
+
+    timeout = -1;
+    switch (serial_source_service(bs->ser_src, &rto)) {
+    case -1:
+	bs->count.send_errors++;
+	break;
+    case 0:
+	break;
+    default:
+	timeout = rto.tv_sec * 1000 + rto.tv_usec / 1000 + 1;
     }
+    /* frames queued while servicing the serial source */
+    if (!serial_source_empty(bs->ser_src))
+	serial_input_batch(bs);
+
+    wait = txq_flush(bs);
+    if (wait >= 0 && (timeout < 0 || wait < timeout))
+	timeout = wait;
+
+    /* time out old fragments */
+    lowpan_reasm_expire(bs->fragments, now_ms(), &next);
+    if (timeout < 0 || next < timeout)
+	timeout = next;
     // TODO: ND retransmission
     // TODO: neighbor table timeouts
-}
 
-/* shifts data between the serial port and the tun interface */
-int serial_tunnel(serial_source ser_src, int tun_fd) {
-    //int result;
-    fd_set fs;
-    
-    while (1) {
-	FD_ZERO (&fs);
-	FD_SET (tun_fd, &fs);
-	FD_SET (serial_source_fd(ser_src), &fs);
-
-	select (tun_fd>serial_source_fd(ser_src)?
-		tun_fd+1 : serial_source_fd(ser_src)+1,
-		&fs, NULL, NULL, NULL);
+    tun_poll(bs, TXQ_LEN - bs->txq_count >= DGRAM_FRAMES_MAX);
+    return timeout;
+}
 
-	debug("--- select() fired ---\n");
+/* shifts data between the serial port and the tun queue of bs */
+void *serial_tunnel(void *arg)
+{
+    struct basestation *bs = arg;
+    struct epoll_event events[2];
+    int i, j, n, timeout;
 
-	/* data available on tunnel device */
-	if (FD_ISSET (tun_fd, &fs)) {
-	    //result = tun_input();
-	    while( tun_input() );
+    while (1) {
+	timeout = timer_fired(bs);
+	n = epoll_wait(bs->epoll_fd, events, 2, timeout);
+	if (n < 0 && errno != EINTR) {
+	    perror("epoll_wait");
+	    break;
 	}
-	
-	/* data available on serial port */
-	if (FD_ISSET (serial_source_fd(ser_src), &fs)) {
-	    /* more packets may be queued so process them all */
-	    while (serial_input());
-	    /* using serial_source_empty() seems to make select()
-	     * fire way too often, so the above solution is better */
-	    //while(! serial_source_empty(ser_src)) {
-	    //result = serial_input();
-		//}
+
+	for (i = 0; i < n; i++) {
+	    /* data available on the tun queue */
+	    if (events[i].data.fd == bs->tun_fd) {
+		for (j = 0; j < TUN_BATCH
+			 && TXQ_LEN - bs->txq_count >= DGRAM_FRAMES_MAX
+			 && tun_input(bs); j++)
+		    /* the first frames may already fit the pacing */
+		    txq_flush(bs);
+	    }
+	    /* data available on the serial port */
+	    else {
+		serial_input_batch(bs);
+	    }
 	}
-	/* end of data available */
     }
-    /* end of while(1) */
-    
-    return 0;
+
+    return NULL;
 }
 
-int main(int argc, char **argv) {
-    char dev[16];
-    
-    if (argc != 3)
-	{
-	    fprintf(stderr, "Usage: %s <device> <rate>\n", argv[0]);
-	    exit(2);
-	}
-    
-    hw_addr.type = HW_ADDR_SHORT;
-    hw_addr.addr_short[0] = 0x00; // network byte order
-    hw_addr.addr_short[1] = 0x12;
+int basestation_open(struct basestation *bs, char *dev, const char *device,
+		     char *rate, int multi_queue)
+{
+    struct epoll_event ev;
+    int baud = platform_baud_rate(rate);
+
+    memset(bs, 0, sizeof(*bs));
+    bs->device = device;
+    bs->fragments = lowpan_reasm_new(&reasm_config);
+    if (!bs->fragments) {
+	fprintf(stderr, "out of memory\n");
+	return -1;
+    }
 
-    /* create the tunnel device */
-    dev[0] = 0;
-    tun_fd = tun_open(dev);
-    if (tun_fd < 1) {
+    /* one queue of the tunnel device for each basestation */
+    bs->tun_fd = tun_open_queue(dev, multi_queue);
+    if (bs->tun_fd < 0) {
 	printf("Could not create tunnel device. Fatal.\n");
-		return 1;
-    }
-    else {
-	printf("Created tunnel device: %s\n", dev);
+	return -1;
     }
-    
+
     /* open the serial port */
-    ser_src = open_serial_source(argv[1], platform_baud_rate(argv[2]),
-				 1, stderr_msg);
+    bs->ser_src = open_serial_source(device, baud, 1, stderr_msg);
     /* 0 - blocking reads
      * 1 - non-blocking reads
      */
-    
-    if (!ser_src) {
-	debug("Couldn't open serial port at %s:%s\n",
-		argv[1], argv[2]);
+    if (!bs->ser_src) {
+	fprintf(stderr, "Couldn't open serial port at %s:%s\n",
+		device, rate);
+	return -1;
+    }
+    /* motes with an older serial stack keep a window of 1 */
+    printf("%s: send window %d\n", device,
+	   serial_source_set_window(bs->ser_src, SERIAL_MAX_WINDOW));
+
+    /* 10 bits on the line per byte */
+    bs->rate = baud / 10;
+    bs->refilled = now_us();
+
+    bs->epoll_fd = epoll_create(2);
+    if (bs->epoll_fd < 0) {
+	perror("epoll_create");
+	return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = bs->tun_fd;
+    bs->tun_polled = 1;
+    if (epoll_ctl(bs->epoll_fd, EPOLL_CTL_ADD, bs->tun_fd, &ev) < 0) {
+	perror("epoll_ctl");
+	return -1;
+    }
+    ev.data.fd = serial_source_fd(bs->ser_src);
+    if (epoll_ctl(bs->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+	perror("epoll_ctl");
+	return -1;
+    }
+    return 0;
+}
+
+void print_counters()
+{
+    struct lowpan_reasm_stats reasm;
+    int i;
+
+    for (i = 0; i < n_basestations; i++) {
+	struct basestation *bs = &basestations[i];
+	struct counters *c = &bs->count;
+
+	lowpan_reasm_get_stats(bs->fragments, &reasm);
+	printf("%s: tun in %lu packets %lu bytes, "
+	       "serial out %lu frames %lu bytes, %lu errors, "
+	       "paused %lu times\n",
+	       bs->device, c->tun_in, c->tun_in_bytes,
+	       c->frames_out, c->frames_out_bytes, c->send_errors,
+	       c->tun_paused);
+	printf("%s: serial in %lu frames %lu bytes, %lu dropped, "
+	       "tun out %lu packets %lu bytes, "
+	       "reassembly %lu completed %lu timed out %lu evicted\n",
+	       bs->device, c->frames_in, c->frames_in_bytes,
+	       c->frames_dropped, c->tun_out, c->tun_out_bytes,
+	       reasm.completed, reasm.timed_out, reasm.evicted);
+    }
+    fflush(stdout);
+}
+
+void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s [-v] <device> <rate> [<device> <rate>...]\n",
+	    name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    char dev[IFNAMSIZ];
+    sigset_t signals;
+    int i, sig;
+
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+	verbose = 1;
+	argv++;
+	argc--;
+    }
+    if (argc < 3 || argc % 2 != 1)
+	usage(argv[0]);
+
+    hw_addr.type = HW_ADDR_SHORT;
+    hw_addr.addr_short[0] = 0x00; // network byte order
+    hw_addr.addr_short[1] = 0x12;
+
+    /* create the tunnel device, with a queue for each basestation */
+    n_basestations = (argc - 1) / 2;
+    basestations = calloc(n_basestations, sizeof(struct basestation));
+    if (!basestations) {
+	fprintf(stderr, "out of memory\n");
 	exit(1);
     }
-    
+    dev[0] = 0;
+    for (i = 0; i < n_basestations; i++) {
+	if (basestation_open(&basestations[i], dev, argv[1 + 2 * i],
+			     argv[2 + 2 * i], n_basestations > 1) < 0)
+	    exit(1);
+    }
+    printf("Created tunnel device: %s\n", dev);
+
     /* set up the tun interface */
     printf("\n");
-    ssystem("ifconfig tun0 up");
-    ssystem("ifconfig tun0 mtu 1280");
-    ssystem("ifconfig tun0 inet6 add 2001:0638:0709:1234::fffe:12/64");
-    ssystem("ifconfig tun0 inet6 add fe80::fffe:12/64");
+    ssystem("ifconfig %s up", dev);
+    ssystem("ifconfig %s mtu 1280", dev);
+    ssystem("ifconfig %s inet6 add 2001:0638:0709:1234::fffe:12/64", dev);
+    ssystem("ifconfig %s inet6 add fe80::fffe:12/64", dev);
     printf("\n");
 
     printf("try:\n\tsudo ping6 -s 0 2001:0638:0709:1234::fffe:14\n"
 	   "\tnc6 -u 2001:0638:0709:1234::fffe:14 1234\n\n");
 
+    /* the signals are taken by the main thread only */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
     /* start tunneling */
-    serial_tunnel(ser_src, tun_fd);
-    
+    for (i = 0; i < n_basestations; i++) {
+	if (pthread_create(&basestations[i].thread, NULL, serial_tunnel,
+			   &basestations[i]) != 0) {
+	    fprintf(stderr, "Couldn't start a thread for %s\n",
+		    basestations[i].device);
+	    exit(1);
+	}
+    }
+
+    /* SIGUSR1 prints the counters, SIGINT and SIGTERM also stop */
+    for (;;) {
+	if (sigwait(&signals, &sig) != 0)
+	    continue;
+	print_counters();
+	if (sig != SIGUSR1)
+	    break;
+    }
+
     /* clean up */
-    close_serial_source(ser_src);
-    //close(ser_fd);
-    tun_close(tun_fd, dev);
+    for (i = 0; i < n_basestations; i++) {
+	pthread_cancel(basestations[i].thread);
+	pthread_join(basestations[i].thread, NULL);
+	close_serial_source(basestations[i].ser_src);
+	tun_close(basestations[i].tun_fd, dev);
+    }
     return 0;
 }
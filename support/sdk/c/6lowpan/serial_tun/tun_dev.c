@@ -40,6 +40,7 @@
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <linux/if_ether.h>
@@ -47,11 +48,21 @@
 #include "tun_dev.h"
 
 
-int tun_open(char *dev)
+/*
+ * opens one queue of the tun device dev (named by the kernel if dev is
+ * empty). With multi_queue set, every call for the same dev adds a queue
+ * and the kernel spreads the packets sent to the interface over the
+ * queues by flow.
+ */
+int tun_open_queue(char *dev, int multi_queue)
 {
     struct ifreq ifr;
     int fd;
 
+#ifndef IFF_MULTI_QUEUE
+    if (multi_queue)
+	return -1;
+#endif
     if ((fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK)) < 0)
        return -1;
 
@@ -61,6 +72,10 @@ int tun_open(char *dev)
      */
     //ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
     ifr.ifr_flags = IFF_TUN;
+#ifdef IFF_MULTI_QUEUE
+    if (multi_queue)
+	ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif
     if (*dev)
        strncpy(ifr.ifr_name, dev, IFNAMSIZ);
 
@@ -75,6 +90,11 @@ failed:
     return -1;
 }
 
+int tun_open(char *dev)
+{
+    return tun_open_queue(dev, 0);
+}
+
 int tun_close(int fd, char *dev)
 {
     return close(fd);
@@ -92,38 +112,31 @@ int tun_read(int fd, char *buf, int len)
     return read(fd, buf, len);
 }
 */
+/* the struct tun_pi is written and read with the packet, without copying */
 int tun_write(int fd, char *buf, int len)
 {
-    int out;
     struct tun_pi pi = {0, htons(ETH_P_IPV6)};
-    char *nbuf = malloc(len+sizeof(struct tun_pi));
-    if (!nbuf) {
-	fprintf(stderr, "tun_write: out of memory!");
-	return -1;
-    }
-    memcpy(nbuf, &pi, sizeof(struct tun_pi));
-    memcpy(nbuf+sizeof(struct tun_pi), buf, len);
-    out = write(fd, nbuf, len+sizeof(struct tun_pi));
-    free(nbuf);
-    return out;
+    struct iovec iov[2];
+    int out;
+
+    iov[0].iov_base = &pi;
+    iov[0].iov_len = sizeof(pi);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+    out = writev(fd, iov, 2);
+    return out < (int)sizeof(pi) ? -1 : out - sizeof(pi);
 }
 
 int tun_read(int fd, char *buf, int len)
 {
+    struct tun_pi pi;
+    struct iovec iov[2];
     int out;
-    char *nbuf = malloc(len+sizeof(struct tun_pi));
-    if (!nbuf) {
-	fprintf(stderr, "tun_read: out of memory!");
-	return -1;
-    }
-    out=read(fd, nbuf, len+sizeof(struct tun_pi));
-    if (out > 0 && out >= sizeof(struct tun_pi)) {
-	out-=sizeof(struct tun_pi);
-	memcpy(buf, nbuf+sizeof(struct tun_pi), out);
-	free(nbuf);
-	return out;
-    } else {
-	free(nbuf);
-	return -1;
-    }
+
+    iov[0].iov_base = &pi;
+    iov[0].iov_len = sizeof(pi);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+    out = readv(fd, iov, 2);
+    return out < (int)sizeof(pi) ? -1 : out - sizeof(pi);
 }
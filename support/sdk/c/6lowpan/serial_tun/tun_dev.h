@@ -33,6 +33,7 @@
 #define _TUN_DEV_H
 
 int tun_open(char *dev);
+int tun_open_queue(char *dev, int multi_queue);
 int tun_close(int fd, char *dev);
 int tun_write(int fd, char *buf, int len);
 int tun_read(int fd, char *buf, int len);
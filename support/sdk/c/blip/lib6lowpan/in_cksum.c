@@ -58,139 +58,112 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "in_cksum.h"
 #include "lib6lowpan.h"
 #include "nwbyte.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * The sum is computed in the host's byte order, a word at a time, and
+ * swapped into network byte order at the end: the one's complement sum
+ * does not depend on byte order (RFC 1071).  A segment that starts at an
+ * odd offset of the datagram has its bytes in the other half of the
+ * 16-bit words, so its sum is byte swapped before it is added.
+ *
+ * Hosts (and TOSSIM) add 32-bit words into a 64-bit accumulator, 16 bytes
+ * at a time with SSE2; 16-bit motes add 16-bit words into 32 bits.
+ */
+#if defined(__SIZEOF_POINTER__) && __SIZEOF_POINTER__ >= 4
+#define CKSUM_WIDE 1
+typedef uint64_t cksum_acc_t;
+typedef uint32_t cksum_word_t;
+#else
+typedef uint32_t cksum_acc_t;
+typedef uint16_t cksum_word_t;
+#endif
+
+static uint16_t cksum_fold(cksum_acc_t sum) {
+  while (sum > 0xffff)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return sum;
+}
+
+/* the one's complement sum of len bytes at p, as if p were 16-bit aligned */
+static uint16_t cksum_bytes(const uint8_t *p, size_t len) {
+  cksum_acc_t sum = 0;
+  cksum_word_t w[4];
+  uint16_t last = 0;
+
+#if CKSUM_WIDE && defined(__SSE2__)
+  if (len >= 64) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    uint64_t lanes[2];
+
+    /* each 32-bit word is added to a 64-bit lane, which can't overflow */
+    while (len >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)p);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+      p += 16;
+      len -= 16;
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = (cksum_acc_t)cksum_fold(lanes[0]) + cksum_fold(lanes[1]);
+  }
+#endif
 
-#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
+  /* the words may be unaligned, memcpy turns into plain loads */
+  while (len >= sizeof(w)) {
+    memcpy(w, p, sizeof(w));
+    sum += (cksum_acc_t)w[0] + w[1] + w[2] + w[3];
+    p += sizeof(w);
+    len -= sizeof(w);
+#if !CKSUM_WIDE
+    /* keep the 32-bit accumulator from overflowing */
+    sum = (sum & 0xffff) + (sum >> 16);
+#endif
+  }
+  while (len >= 2) {
+    memcpy(&last, p, 2);
+    sum += last;
+    p += 2;
+    len -= 2;
+  }
+  if (len) {
+    /* pad the odd byte with a zero, in the second half of its word */
+    last = 0;
+    memcpy(&last, p, 1);
+    sum += last;
+  }
+  return cksum_fold(sum);
+}
 
 int
 in_cksum(const struct ip_iovec *vec) {
-#if 1
-  /* This will break horribly if the length of any but the last ip_iovec is odd! */
-
-  uint32_t sum = 0;
-  uint16_t cur = 0;
-  int i;
-  uint8_t *w;
- 
+  cksum_acc_t sum = 0;
+  size_t offset = 0;
+  uint16_t s;
+  uint8_t *b = (uint8_t *)&s;
+
   for (; vec != NULL;  vec = vec->iov_next) {
     if (vec->iov_len == 0)
       continue;
-   
-    w = vec->iov_base;
-    for (i = 0; i < vec->iov_len; i++) {
-      if (i % 2 == 0) {
-        cur |= ((uint16_t)w[i]) << 8;
-        if (i + 1 == vec->iov_len) {
-          goto finish;
-        }
-      } else {
-        cur |= w[i];
-      finish:
-        sum += cur;
-        cur = 0;
-      }
-    }
-  }
-  while (sum > 0xffff) {
-    sum = (sum & 0xffff) + (sum >> 16);
+
+    s = cksum_bytes(vec->iov_base, vec->iov_len);
+    if (offset & 1)
+      s = (s << 8) | (s >> 8);
+    sum += s;
+    offset += vec->iov_len;
   }
-  return ~((uint16_t)sum);
-#else
-	register const uint16_t *w;
-	register uint32_t sum = 0;
-	register uint32_t mlen = 0;
-	int byte_swapped = 0;
-
-	union {
-		uint8_t	c[2];
-		uint16_t	s;
-	} s_util;
-	union {
-		uint16_t s[2];
-		uint32_t	l;
-	} l_util;
-
-	for (; vec != NULL; vec = vec->iov_next) {
-
-		if (vec->iov_len == 0)
-			continue;
-		w = (const uint16_t *)vec->iov_base;
-		if (mlen == -1) {
-			/*
-			 * The first byte of this chunk is the continuation
-			 * of a word spanning between this chunk and the
-			 * last chunk.
-			 *
-			 * s_util.c[0] is already saved when scanning previous
-			 * chunk.
-			 */
-			s_util.c[1] = *(const uint8_t *)w;
-			sum += s_util.s;
-			w = (const uint16_t *)((const uint8_t *)w + 1);
-			mlen = vec->iov_len - 1;
-		} else
-			mlen = vec->iov_len;
-		/*
-		 * Force to even boundary.
-		 */
-		if ((1 & (int) w) && (mlen > 0)) {
-			REDUCE;
-			sum <<= 8;
-			s_util.c[0] = *(const uint8_t *)w;
-			w = (const uint16_t *)((const uint8_t *)w + 1);
-			mlen--;
-			byte_swapped = 1;
-		}
-		/*
-		 * Unroll the loop to make overhead from
-		 * branches &c small.
-		 */
-		while ((mlen -= 32) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-			sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-			sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-			w += 16;
-		}
-		mlen += 32;
-		while ((mlen -= 8) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			w += 4;
-		}
-		mlen += 8;
-		if (mlen == 0 && byte_swapped == 0)
-			continue;
-		REDUCE;
-		while ((mlen -= 2) >= 0) {
-			sum += *w++;
-		}
-		if (byte_swapped) {
-			REDUCE;
-			sum <<= 8;
-			byte_swapped = 0;
-			if (mlen == -1) {
-				s_util.c[1] = *(const uint8_t *)w;
-				sum += s_util.s;
-				mlen = 0;
-			} else
-				mlen = -1;
-		} else if (mlen == -1)
-			s_util.c[0] = *(const uint8_t *)w;
-	}
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		   standard (the odd byte may be shifted left by 8 bits
-		   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
-	}
-	REDUCE;
-	return (~sum & 0xffff);
-#endif
+  s = cksum_fold(sum);
+
+  /* the sum of the words as the datagram holds them (big endian) */
+  return ~((b[0] << 8) | b[1]) & 0xffff;
 }
 
 /* SDH : Added to allow for friendly message checksumming */
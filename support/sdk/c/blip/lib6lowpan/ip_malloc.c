@@ -22,71 +22,200 @@
 #ifndef NO_IP_MALLOC
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include "ip_malloc.h"
 
-uint8_t heap[IP_MALLOC_HEAP_SIZE];
+/*
+ * Segregated-fit allocator with boundary tags.
+ *
+ * Every block starts with a header word holding its length (including
+ * the header) and the IP_MALLOC_INUSE bit, so the heap can still be
+ * walked from the start.  A free block also ends with a footer holding
+ * its length, and has IP_MALLOC_PREV_FREE set in the header of the block
+ * after it, so that ip_free finds both neighbours in constant time and
+ * coalesces with them: there are never two free blocks next to each
+ * other.
+ *
+ * Free blocks are kept on one doubly linked list per size class, the
+ * links being heap offsets stored in the free block itself.  Class c
+ * holds blocks of IP_MALLOC_MIN_BLOCK << c bytes up to twice that, and
+ * the last class everything bigger.  ip_malloc searches only the list of
+ * the class of the request, since it may hold blocks which are too
+ * small, and otherwise takes the first block of the next non-empty
+ * class, all of which are big enough.
+ */
+
+#define NIL 0xffff
+#define MIN_BLOCK IP_MALLOC_MIN_BLOCK
+
+#define HDR(off)    (*(bndrt_t *)(heap + (off)))
+#define SIZE(off)   (HDR(off) & IP_MALLOC_LEN)
+#define FTR(off)    (*(bndrt_t *)(heap + (off) + SIZE(off) - sizeof(bndrt_t)))
+#define NEXT(off)   (*(uint16_t *)(heap + (off) + sizeof(bndrt_t)))
+#define PREV(off)   (*(uint16_t *)(heap + (off) + sizeof(bndrt_t) + sizeof(uint16_t)))
+
+uint8_t heap[IP_MALLOC_HEAP_SIZE] __attribute__((aligned(IP_MALLOC_ALIGN)));
+
+static uint16_t free_lists[IP_MALLOC_CLASSES];
+static uint8_t  free_classes;   /* bit c is set if free_lists[c] is not empty */
+static struct ip_malloc_stats stats;
+
+static uint8_t size_class(uint16_t sz) {
+  uint8_t c = 0;
+  sz /= MIN_BLOCK * 2;
+  while (sz && c < IP_MALLOC_CLASSES - 1) {
+    sz >>= 1;
+    c++;
+  }
+  return c;
+}
+
+static void insert_free(uint16_t b) {
+  uint8_t c = size_class(SIZE(b));
+
+  FTR(b) = SIZE(b);
+  PREV(b) = NIL;
+  NEXT(b) = free_lists[c];
+  if (free_lists[c] != NIL)
+    PREV(free_lists[c]) = b;
+  free_lists[c] = b;
+  free_classes |= 1 << c;
+  stats.free_blocks++;
+}
+
+static void remove_free(uint16_t b) {
+  uint8_t c = size_class(SIZE(b));
+
+  if (PREV(b) != NIL)
+    NEXT(PREV(b)) = NEXT(b);
+  else
+    free_lists[c] = NEXT(b);
+  if (NEXT(b) != NIL)
+    PREV(NEXT(b)) = PREV(b);
+  if (free_lists[c] == NIL)
+    free_classes &= ~(1 << c);
+  stats.free_blocks--;
+}
 
 void ip_malloc_init() {
-  bndrt_t *b = (bndrt_t *)heap;
-  *b = IP_MALLOC_HEAP_SIZE  & IP_MALLOC_LEN;
+  uint8_t c;
+  for (c = 0; c < IP_MALLOC_CLASSES; c++)
+    free_lists[c] = NIL;
+  free_classes = 0;
+  memset(&stats, 0, sizeof(stats));
+
+  HDR(0) = IP_MALLOC_HEAP_SIZE & IP_MALLOC_LEN;
+  insert_free(0);
+  stats.free_bytes = IP_MALLOC_HEAP_SIZE;
 }
 
 void *ip_malloc(uint16_t sz) {
-  bndrt_t *cur = (bndrt_t *)heap;
+  uint16_t need, b, rest;
+  uint16_t steps = 1;
+  uint8_t c, mask;
 
-  sz += sizeof(bndrt_t) * 2;
-  sz += (sz % IP_MALLOC_ALIGN);
+  if (sz == 0 || sz > IP_MALLOC_LEN - sizeof(bndrt_t) - IP_MALLOC_ALIGN)
+    goto fail;
+  need = sz + sizeof(bndrt_t);
+  need += (need % IP_MALLOC_ALIGN);
+  if (need < MIN_BLOCK)
+    need = MIN_BLOCK;
 
-  while (((*cur & IP_MALLOC_LEN) < sz || (*cur & IP_MALLOC_INUSE) != 0) 
-         && (uint8_t *)cur - heap < IP_MALLOC_HEAP_SIZE) {
-    cur = (bndrt_t *)(((uint8_t *)cur) + ((*cur) & IP_MALLOC_LEN));
-  }
+  /* the request's own class may hold blocks which are too small */
+  c = size_class(need);
+  for (b = free_lists[c]; b != NIL; b = NEXT(b), steps++)
+    if (SIZE(b) >= need)
+      goto found;
 
-  if ((uint8_t *)cur < heap + IP_MALLOC_HEAP_SIZE) {
-    uint16_t oldsize = *cur & IP_MALLOC_LEN;
-    bndrt_t *next;
-    sz -= sizeof(bndrt_t);
-    next = ((bndrt_t *)(((uint8_t *)cur) + sz));
+  /* any block of a bigger class is big enough */
+  mask = free_classes & ~((2 << c) - 1);
+  if (!mask)
+    goto fail;
+  for (c++; !(mask & (1 << c)); c++)
+    ;
+  b = free_lists[c];
 
-    *cur = (sz & IP_MALLOC_LEN) | IP_MALLOC_INUSE;
-    *next = (oldsize - sz) & IP_MALLOC_LEN;
+ found:
+  remove_free(b);
+  rest = SIZE(b) - need;
+  if (rest >= MIN_BLOCK) {
+    /* the previous block is in use, as free blocks are coalesced, and
+       the block after the rest already has IP_MALLOC_PREV_FREE */
+    HDR(b) = need | IP_MALLOC_INUSE;
+    HDR(b + need) = rest;
+    insert_free(b + need);
+  } else {
+    need = SIZE(b);
+    HDR(b) |= IP_MALLOC_INUSE;
+    if (b + need < IP_MALLOC_HEAP_SIZE)
+      HDR(b + need) &= ~IP_MALLOC_PREV_FREE;
+  }
 
-    return cur + 1;
-  } else return NULL;
+  stats.allocs++;
+  stats.free_bytes -= need;
+  if (IP_MALLOC_HEAP_SIZE - stats.free_bytes > stats.peak_used)
+    stats.peak_used = IP_MALLOC_HEAP_SIZE - stats.free_bytes;
+  stats.steps += steps;
+  if (steps > stats.max_steps)
+    stats.max_steps = steps;
+  return heap + b + sizeof(bndrt_t);
+
+ fail:
+  stats.failures++;
+  return NULL;
 }
 
 void ip_free(void *ptr) {
-  bndrt_t *prev = NULL, *cur, *next = NULL;
-  cur = (bndrt_t *)heap;
+  uint16_t b, sz;
 
-  while (cur + 1 != ptr && (uint8_t *)cur - heap < IP_MALLOC_HEAP_SIZE) {
-    prev = cur;
-    cur = (bndrt_t *)(((uint8_t *)cur) + ((*cur) & IP_MALLOC_LEN));
-  }
-  if (cur + 1 == ptr) {
-    next = (bndrt_t *)((*cur & IP_MALLOC_LEN) + ((uint8_t *)cur));
+  if ((uint8_t *)ptr < heap + sizeof(bndrt_t) ||
+      (uint8_t *)ptr >= heap + IP_MALLOC_HEAP_SIZE)
+    return;
+  b = (uint8_t *)ptr - heap - sizeof(bndrt_t);
+  if (!(HDR(b) & IP_MALLOC_INUSE))
+    return;
 
-    *cur &= ~IP_MALLOC_INUSE;
-    if ((((uint8_t *)next) - heap) < IP_MALLOC_HEAP_SIZE && 
-        (*next & IP_MALLOC_INUSE) == 0) {
-      *cur = (*cur & IP_MALLOC_LEN) + (*next & IP_MALLOC_LEN);
-    }
-    if (prev != NULL && (*prev & IP_MALLOC_INUSE) == 0) {
-      *prev = (*prev & IP_MALLOC_LEN) + (*cur & IP_MALLOC_LEN);
-    }
+  sz = SIZE(b);
+  stats.frees++;
+  stats.free_bytes += sz;
+
+  /* coalesce with the next block */
+  if (b + sz < IP_MALLOC_HEAP_SIZE && !(HDR(b + sz) & IP_MALLOC_INUSE)) {
+    remove_free(b + sz);
+    sz += SIZE(b + sz);
   }
+  /* and with the previous one, found through its footer */
+  if (HDR(b) & IP_MALLOC_PREV_FREE) {
+    uint16_t prev = b - (*(bndrt_t *)(heap + b - sizeof(bndrt_t)) & IP_MALLOC_LEN);
+    remove_free(prev);
+    sz += SIZE(prev);
+    b = prev;
+  }
+
+  HDR(b) = sz;
+  insert_free(b);
+  if (b + sz < IP_MALLOC_HEAP_SIZE)
+    HDR(b + sz) |= IP_MALLOC_PREV_FREE;
 }
 
 uint16_t ip_malloc_freespace() {
-  uint16_t ret = 0;
-  bndrt_t *cur = (bndrt_t *)heap;
+  return stats.free_bytes;
+}
 
-  while ((uint8_t *)cur - heap < IP_MALLOC_HEAP_SIZE) {
-    if ((*cur & IP_MALLOC_INUSE) == 0)
-      ret += *cur & IP_MALLOC_LEN;
-    cur = (bndrt_t *)(((uint8_t *)cur) + ((*cur) & IP_MALLOC_LEN));
+void ip_malloc_get_stats(struct ip_malloc_stats *s) {
+  uint16_t b;
+  int8_t c;
+
+  /* the largest free block is on the highest non-empty list */
+  stats.largest_free = 0;
+  for (c = IP_MALLOC_CLASSES - 1; c >= 0; c--) {
+    for (b = free_lists[c]; b != NIL; b = NEXT(b))
+      if (SIZE(b) > stats.largest_free)
+        stats.largest_free = SIZE(b);
+    if (stats.largest_free)
+      break;
   }
-  return ret;
+  *s = stats;
 }
 
 #ifdef PC
@@ -104,17 +233,27 @@ void dump_heap() {
 
 void ip_print_heap() {
   bndrt_t *cur = (bndrt_t *)heap;
+  struct ip_malloc_stats s;
+
   while (((uint8_t *)cur)  - heap < IP_MALLOC_HEAP_SIZE) {
-    printf ("heap region start: 0x%x length: %i used: %i\n", 
-            cur, (*cur & IP_MALLOC_LEN), (*cur & IP_MALLOC_INUSE) >> 15);
+    printf ("heap region start: %p length: %i used: %i\n",
+            (void *)cur, (*cur & IP_MALLOC_LEN), (*cur & IP_MALLOC_INUSE) >> 15);
     if ((*cur & IP_MALLOC_LEN) == 0) {
       printf("ERROR: zero length cell detected!\n");
       dump_heap();
       exit(1);
     }
     cur = (bndrt_t *)(((uint8_t *)cur) + ((*cur) & IP_MALLOC_LEN));
-
   }
+
+  ip_malloc_get_stats(&s);
+  printf("free: %i bytes in %i blocks, largest %i (fragmentation %i%%), peak used %i\n",
+         s.free_bytes, s.free_blocks, s.largest_free,
+         s.free_bytes ? 100 - 100 * s.largest_free / s.free_bytes : 0, s.peak_used);
+  printf("allocs: %lu frees: %lu failures: %lu, list steps per alloc: %lu.%02lu (max %i)\n",
+         s.allocs, s.frees, s.failures,
+         s.allocs ? s.steps / s.allocs : 0,
+         s.allocs ? s.steps * 100 / s.allocs % 100 : 0, s.max_steps);
 }
 #endif
 #endif
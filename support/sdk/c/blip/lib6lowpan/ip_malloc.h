@@ -30,15 +30,35 @@
 #define IP_MALLOC_LEN     0x0fff
 #define IP_MALLOC_FLAGS   0x7000
 #define IP_MALLOC_INUSE   0x8000
+// set if the block before is free; its length is then in its last word
+#define IP_MALLOC_PREV_FREE 0x4000
 #define IP_MALLOC_HEAP_SIZE 1500
 
+// free blocks are kept in IP_MALLOC_CLASSES lists of blocks of
+// IP_MALLOC_MIN_BLOCK << c up to twice as many bytes
+#define IP_MALLOC_CLASSES  8
+#define IP_MALLOC_MIN_BLOCK 8
+
 extern uint8_t heap[IP_MALLOC_HEAP_SIZE];
 typedef uint16_t bndrt_t;
 
+struct ip_malloc_stats {
+  unsigned long allocs;
+  unsigned long frees;
+  unsigned long failures;       // ip_malloc returned NULL
+  unsigned long steps;          // free blocks looked at by ip_malloc
+  uint16_t max_steps;           //   and the most by a single call
+  uint16_t free_bytes;
+  uint16_t free_blocks;
+  uint16_t largest_free;        // including its header
+  uint16_t peak_used;
+};
+
 void ip_malloc_init();
 void *ip_malloc(uint16_t sz);
 void ip_free(void *ptr);
 uint16_t ip_malloc_freespace();
+void ip_malloc_get_stats(struct ip_malloc_stats *stats);
 
 #ifdef PC
 void ip_print_heap();
@@ -31,23 +31,19 @@
 
 /* UTILITY MACROS AND FUNCTIONS */
 
+/* the fields are or-ed together to test them with a single branch */
+
 /* test if the first 64-bits are fe80::/64 */
 #define IS_LINKLOCAL(ADDR) \
   ((ADDR)->s6_addr16[0] == htons(0xfe80) && \
-   (ADDR)->s6_addr16[1] == 0 && \
-   (ADDR)->s6_addr16[2] == 0 && \
-   (ADDR)->s6_addr16[3] == 0)
+   ((ADDR)->s6_addr16[1] | (ADDR)->s6_addr16[2] | (ADDR)->s6_addr16[3]) == 0)
 
 /* test if the address is all zeroes */
 #define IS_UNSPECIFIED(ADDR) \
-  ((ADDR)->s6_addr16[0] == 0 && \
-   (ADDR)->s6_addr16[1] == 0 && \
-   (ADDR)->s6_addr16[2] == 0 && \
-   (ADDR)->s6_addr16[3] == 0 && \
-   (ADDR)->s6_addr16[4] == 0 && \
-   (ADDR)->s6_addr16[5] == 0 && \
-   (ADDR)->s6_addr16[6] == 0 && \
-   (ADDR)->s6_addr16[7] == 0)
+  (((ADDR)->s6_addr16[0] | (ADDR)->s6_addr16[1] | \
+    (ADDR)->s6_addr16[2] | (ADDR)->s6_addr16[3] | \
+    (ADDR)->s6_addr16[4] | (ADDR)->s6_addr16[5] | \
+    (ADDR)->s6_addr16[6] | (ADDR)->s6_addr16[7]) == 0)
 
 #if ! defined(HAVE_LOWPAN_EXTERN_MATCH_CONTEXT)
 int lowpan_extern_read_context(struct in6_addr *addr, int context) {
@@ -60,6 +56,85 @@ int lowpan_extern_match_context(struct in6_addr *addr, UNUSED uint8_t *ctx_id) {
 
 #endif
 
+/* CONTEXTS */
+
+void lowpan_context_init(struct lowpan_context_table *table) {
+  memset(table, 0, sizeof(*table));
+}
+
+int lowpan_context_set(struct lowpan_context_table *table, int id,
+                       struct in6_addr *prefix, int len) {
+  if (id < 0 || id >= LOWPAN_MAX_CONTEXTS || len <= 0 || len > 128)
+    return -1;
+  /* keep the prefix with the bits after len cleared, so that matching
+     only compares whole bytes and the last partial one */
+  memset(&table->prefix[id], 0, sizeof(struct in6_addr));
+  memcpy(&table->prefix[id], prefix, (len + 7) / 8);
+  if (len % 8)
+    table->prefix[id].s6_addr[len / 8] &= 0xff << (8 - len % 8);
+  table->len[id] = len;
+  table->valid |= 1 << id;
+  return 0;
+}
+
+int lowpan_context_match(const struct lowpan_context_table *table,
+                         struct in6_addr *addr, uint8_t *ctx_id) {
+  uint16_t valid = table->valid;
+  int i, j, best = 0;
+
+  for (i = 0; valid; i++, valid >>= 1) {
+    int len = table->len[i];
+    if (!(valid & 1) || len <= best)
+      continue;
+    for (j = 0; j < len / 8; j++)
+      if (addr->s6_addr[j] != table->prefix[i].s6_addr[j])
+        break;
+    if (j < len / 8)
+      continue;
+    if (len % 8 &&
+        ((addr->s6_addr[len / 8] ^ table->prefix[i].s6_addr[len / 8]) &
+         (0xff << (8 - len % 8))) != 0)
+      continue;
+    best = len;
+    *ctx_id = i;
+  }
+  return best;
+}
+
+int lowpan_context_read(const struct lowpan_context_table *table,
+                        struct in6_addr *addr, int ctx_id) {
+  int len;
+  if (!(table->valid & (1 << ctx_id)))
+    return -1;
+  len = table->len[ctx_id];
+  memcpy(addr, &table->prefix[ctx_id], (len + 7) / 8);
+  return len;
+}
+
+/* the context hooks of the application if there is no table */
+static int match_context(const struct lowpan_context_table *table,
+                         struct in6_addr *addr, uint8_t *ctx_id) {
+  *ctx_id = 0;
+  /* link-local addresses are compressed without a context */
+  if (addr->s6_addr16[0] == htons(0xfe80) && addr->s6_addr16[1] == 0 &&
+      addr->s6_addr16[2] == 0 && addr->s6_addr16[3] == 0)
+    return 0;
+  if (table)
+    return lowpan_context_match(table, addr, ctx_id);
+  else {
+    /* the id is not used, only context 0 is ever sent */
+    uint8_t unused;
+    return lowpan_extern_match_context(addr, &unused);
+  }
+}
+
+static int read_context(const struct lowpan_context_table *table,
+                        struct in6_addr *addr, int ctx_id) {
+  if (table)
+    return lowpan_context_read(table, addr, ctx_id);
+  return lowpan_extern_read_context(addr, ctx_id);
+}
+
 int iid_eui_cmp(uint8_t *iid, uint8_t *eui) {
   return (iid[0] == (eui[7] ^ 0x2) &&
           iid[1] == eui[6] &&
@@ -172,9 +247,7 @@ uint8_t *pack_address(uint8_t *buf, struct in6_addr *addr, int context_match_len
   if (IS_LINKLOCAL(addr)) {
     /* then we use stateless compression */
     /*     no bits to set, just pack the IID */
-    if (addr->s6_addr16[4] == 0 &&
-        addr->s6_addr16[5] == 0 &&
-        addr->s6_addr16[6] == 0) {
+    if ((addr->s6_addr16[4] | addr->s6_addr16[5] | addr->s6_addr16[6]) == 0) {
       // then we use 16-bit mode.  This isn't going to be popular...
       *flags |= LOWPAN_IPHC_AM_16;
       memcpy(buf, &addr->s6_addr[14], 2);
@@ -233,19 +306,22 @@ uint8_t *pack_address(uint8_t *buf, struct in6_addr *addr, int context_match_len
 /*  does not currently implement stateful multicast address compression */
 /*  also does not check to make sure it is a multicast address */
 uint8_t *pack_multicast(uint8_t *buf, struct in6_addr *addr, uint8_t *flags) {
+  /* the middle of the address, which must be zero for the short forms */
+  uint16_t mid = addr->s6_addr16[1] | addr->s6_addr16[2] |
+    addr->s6_addr16[3] | addr->s6_addr16[4];
   /* no need to set AC since it's zero */
   *flags = 0;
   if ((addr->s6_addr16[0] == htons(0xff02)) &&
-      (bit_range_zero_p(addr->s6_addr, 16, 120) == 0)) {
+      (mid | addr->s6_addr16[5] | addr->s6_addr16[6] | addr->s6_addr[14]) == 0) {
     *flags |= LOWPAN_IPHC_AM_M_8;
     *buf = addr->s6_addr[15];
     return buf + 1;
-  } else if (bit_range_zero_p(addr->s6_addr, 16, 104) == 0) {
+  } else if ((mid | addr->s6_addr[10] | addr->s6_addr[11] | addr->s6_addr[12]) == 0) {
     *flags |= LOWPAN_IPHC_AM_M_32;
     *buf = addr->s6_addr[1];
     memcpy(buf + 1, &addr->s6_addr[13], 3);
     return buf + 4;
-  } else if (bit_range_zero_p(addr->s6_addr, 16, 88) == 0) {
+  } else if ((mid | addr->s6_addr[10]) == 0) {
     *flags |= LOWPAN_IPHC_AM_M_48;
     *buf = addr->s6_addr[1];
     memcpy(buf + 1, &addr->s6_addr[11], 5);
@@ -410,10 +486,13 @@ int pack_nhc_chain(uint8_t **dest, size_t cnt, struct ip6_packet *packet) {
   return offset;
 }
 
-uint8_t * lowpan_pack_headers(struct ip6_packet *packet,
-                        struct ieee154_frame_addr *frame,
-                        uint8_t *buf, size_t cnt) {
-  uint8_t *dispatch, temp_dispatch, ctx_match_length;
+static uint8_t *pack_headers(struct ip6_packet *packet,
+                             struct ieee154_frame_addr *frame,
+                             uint8_t *buf, size_t cnt,
+                             const struct lowpan_context_table *contexts) {
+  uint8_t *dispatch, temp_dispatch, src_ctx, dst_ctx = 0;
+  int src_match, dst_match = 0;
+  int multicast = packet->ip6_hdr.ip6_dst.s6_addr[0] == 0xff;
 
   if ((packet->ip6_hdr.ip6_vfc & IPV6_VERSION_MASK) != IPV6_VERSION) {
     return NULL;
@@ -429,28 +508,35 @@ uint8_t * lowpan_pack_headers(struct ip6_packet *packet,
      support for stateful packing of multicast addresses.
      
      These things are only supported in decompression, for compatibility.
+     Contexts other than 0 are only used with a context table.
    */
   dispatch = buf;
   *dispatch = LOWPAN_DISPATCH_BYTE_VAL;
   *(dispatch+1) = 0;
   buf += 2;
 
+  /* match the contexts first, as their ids come before the inline fields */
+  src_match = match_context(contexts, &packet->ip6_hdr.ip6_src, &src_ctx);
+  if (!multicast)
+    dst_match = match_context(contexts, &packet->ip6_hdr.ip6_dst, &dst_ctx);
+  if ((src_match && src_ctx) || (dst_match && dst_ctx)) {
+    *(dispatch+1) |= LOWPAN_IPHC_CID_PRESENT;
+    *buf++ = (src_ctx << 4) | dst_ctx;
+  }
+
   buf = pack_tcfl(buf, &packet->ip6_hdr, dispatch);
   buf = pack_nh(buf, &packet->ip6_hdr, dispatch);
   buf = pack_hlim(buf, &packet->ip6_hdr, dispatch);
 
   /* back the source and destination addresses */
-  ctx_match_length = lowpan_extern_match_context(&packet->ip6_hdr.ip6_src, &temp_dispatch);
   temp_dispatch = 0;
-  buf = pack_address(buf, &packet->ip6_hdr.ip6_src, ctx_match_length,
+  buf = pack_address(buf, &packet->ip6_hdr.ip6_src, src_match,
                      &frame->ieee_src, frame->ieee_dstpan, &temp_dispatch);
   *(dispatch+1) |= temp_dispatch << LOWPAN_IPHC_SAM_SHIFT;
 
-  if (packet->ip6_hdr.ip6_dst.s6_addr[0] != 0xff) {
-    /* not multicast */
-    ctx_match_length = lowpan_extern_match_context(&packet->ip6_hdr.ip6_dst, &temp_dispatch);
+  if (!multicast) {
     temp_dispatch = 0;
-    buf = pack_address(buf, &packet->ip6_hdr.ip6_dst, ctx_match_length,
+    buf = pack_address(buf, &packet->ip6_hdr.ip6_dst, dst_match,
                        &frame->ieee_dst, frame->ieee_dstpan, &temp_dispatch);
     *(dispatch+1) |= temp_dispatch << LOWPAN_IPHC_DAM_SHIFT;
   } else {
@@ -462,6 +548,23 @@ uint8_t * lowpan_pack_headers(struct ip6_packet *packet,
   return buf;
 }
 
+uint8_t * lowpan_pack_headers(struct ip6_packet *packet,
+                        struct ieee154_frame_addr *frame,
+                        uint8_t *buf, size_t cnt) {
+  return pack_headers(packet, frame, buf, cnt, NULL);
+}
+
+int lowpan_pack_headers_batch(const struct lowpan_context_table *contexts,
+                              struct lowpan_batch *batch, int n) {
+  int i, packed = 0;
+  for (i = 0; i < n; i++) {
+    batch[i].end = pack_headers(batch[i].packet, batch[i].frame,
+                                batch[i].buf, batch[i].cnt, contexts);
+    packed += batch[i].end != NULL;
+  }
+  return packed;
+}
+
 uint8_t *unpack_tcfl(struct ip6_hdr *hdr, uint8_t dispatch, uint8_t *buf) {
   uint8_t  fl[3] = {0,0,0}; 
   uint8_t  tc = 0;
@@ -523,9 +626,10 @@ uint8_t *unpack_hlim(struct ip6_hdr *hdr, uint8_t dispatch, uint8_t *buf) {
   return buf;
 }
 
-uint8_t *unpack_address(struct in6_addr *addr, uint8_t dispatch, 
-                        int context, uint8_t *buf,
-                        ieee154_addr_t *frame, ieee154_panid_t pan) {
+static uint8_t *unpack_address_ctx(struct in6_addr *addr, uint8_t dispatch,
+                                   int context, uint8_t *buf,
+                                   ieee154_addr_t *frame, ieee154_panid_t pan,
+                                   const struct lowpan_context_table *contexts) {
   memset(addr, 0, 16);
   if(!((dispatch & LOWPAN_IPHC_AC_CONTEXT))) {
     /* stateless compression */
@@ -562,7 +666,7 @@ uint8_t *unpack_address(struct in6_addr *addr, uint8_t dispatch,
       // unspecified address ::
       return buf;
     } else {
-      int ctxlen = lowpan_extern_read_context(addr, context);
+      int ctxlen = read_context(contexts, addr, context);
       switch (dispatch & LOWPAN_IPHC_AM_MASK) {
       case LOWPAN_IPHC_AM_64:
         memcpy(&addr->s6_addr[8], buf, 8);
@@ -589,6 +693,12 @@ uint8_t *unpack_address(struct in6_addr *addr, uint8_t dispatch,
   return NULL;
 }
 
+uint8_t *unpack_address(struct in6_addr *addr, uint8_t dispatch, 
+                        int context, uint8_t *buf,
+                        ieee154_addr_t *frame, ieee154_panid_t pan) {
+  return unpack_address_ctx(addr, dispatch, context, buf, frame, pan, NULL);
+}
+
 uint8_t *unpack_multicast(struct in6_addr *addr, uint8_t dispatch, 
                           int context, uint8_t *buf) {
   memset(addr->s6_addr, 0, 16);
@@ -764,11 +874,12 @@ uint8_t *unpack_nhc_chain(struct lowpan_reconstruct *recon,
   return buf;
 }
 
-uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
+static uint8_t *unpack_headers(struct lowpan_reconstruct *recon,
                                struct ieee154_frame_addr *frame,
-                               uint8_t *buf, size_t cnt) {
+                               uint8_t *buf, size_t cnt,
+                               const struct lowpan_context_table *contexts) {
   uint8_t *dispatch, *unpack_start = buf, *unpack_end;
-  int contexts[2] = {0, 0};
+  int ctx_ids[2] = {0, 0};
   uint8_t *dest = recon->r_buf;
   size_t dst_cnt = recon->r_size;
   struct ip6_hdr *hdr = (struct ip6_hdr *)dest;
@@ -782,8 +893,8 @@ uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
 
   /* extend the dispatch block if the context extension is present */
   if ((*(dispatch + 1) & LOWPAN_IPHC_CID_MASK) == LOWPAN_IPHC_CID_PRESENT) {
-    contexts[0] = (*buf >> 4) & 0xf;
-    contexts[1] = (*buf) & 0xf;
+    ctx_ids[0] = (*buf >> 4) & 0xf;
+    ctx_ids[1] = (*buf) & 0xf;
     buf += 1;
   }
 
@@ -794,12 +905,13 @@ uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
   
   /* source address is always unicast compressed */
   // printf("unpack source: %p (%x)\n", buf, *buf);
-  buf = unpack_address(&hdr->ip6_src,
-                       ((*(dispatch + 1) >> LOWPAN_IPHC_SAM_SHIFT)), 
-                       contexts[0], 
-                       buf,
-                       &frame->ieee_src,
-                       frame->ieee_dstpan);
+  buf = unpack_address_ctx(&hdr->ip6_src,
+                           ((*(dispatch + 1) >> LOWPAN_IPHC_SAM_SHIFT)),
+                           ctx_ids[0],
+                           buf,
+                           &frame->ieee_src,
+                           frame->ieee_dstpan,
+                           contexts);
   if (!buf) {
     return NULL;
   }
@@ -809,16 +921,17 @@ uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
     // printf("unpack multicast: %p\n", buf);
     buf = unpack_multicast(&hdr->ip6_dst,
                            ((*(dispatch + 1) >> LOWPAN_IPHC_DAM_SHIFT)), 
-                           contexts[1],
+                           ctx_ids[1],
                            buf);
     // printf("unpack multicast: %p (%x)\n", buf, *buf);
   } else {
-    buf = unpack_address(&hdr->ip6_dst,
-                         ((*(dispatch + 1) >> LOWPAN_IPHC_DAM_SHIFT)), 
-                         contexts[1],
-                         buf,
-                         &frame->ieee_dst,
-                         frame->ieee_dstpan);
+    buf = unpack_address_ctx(&hdr->ip6_dst,
+                             ((*(dispatch + 1) >> LOWPAN_IPHC_DAM_SHIFT)),
+                             ctx_ids[1],
+                             buf,
+                             &frame->ieee_dst,
+                             frame->ieee_dstpan,
+                             contexts);
   }
   if (!buf) {
     return NULL;
@@ -846,3 +959,20 @@ uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
   /* return a pointer to the end of the unpacked data */
   return unpack_end + (cnt - (buf - unpack_start));
 }
+
+uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
+                               struct ieee154_frame_addr *frame,
+                               uint8_t *buf, size_t cnt) {
+  return unpack_headers(recon, frame, buf, cnt, NULL);
+}
+
+int lowpan_unpack_headers_batch(const struct lowpan_context_table *contexts,
+                                struct lowpan_batch *batch, int n) {
+  int i, unpacked = 0;
+  for (i = 0; i < n; i++) {
+    batch[i].end = unpack_headers(batch[i].recon, batch[i].frame,
+                                  batch[i].buf, batch[i].cnt, contexts);
+    unpacked += batch[i].end != NULL;
+  }
+  return unpacked;
+}
@@ -135,6 +135,30 @@ int lowpan_extern_match_context(struct in6_addr *addr, UNUSED uint8_t *ctx_id);
 int lowpan_extern_read_context(struct in6_addr *addr, int context);
 
 
+/*
+ * A table of the contexts of the network, which the batch functions
+ * below use instead of calling lowpan_extern_match_context and
+ * lowpan_extern_read_context for every address.  Prefixes are matched
+ * longest first.
+ */
+#define LOWPAN_MAX_CONTEXTS 16
+struct lowpan_context_table {
+  uint16_t valid;                               /* bit i: context i is set */
+  uint8_t  len[LOWPAN_MAX_CONTEXTS];            /* prefix lengths, in bits */
+  struct in6_addr prefix[LOWPAN_MAX_CONTEXTS];
+};
+
+void lowpan_context_init(struct lowpan_context_table *table);
+/* @return -1 if the id or the length are out of range */
+int lowpan_context_set(struct lowpan_context_table *table, int id,
+                       struct in6_addr *prefix, int len);
+/* @return the length of the longest matching prefix, its id in ctx_id */
+int lowpan_context_match(const struct lowpan_context_table *table,
+                         struct in6_addr *addr, uint8_t *ctx_id);
+/* @return the length of the prefix copied into addr, or -1 */
+int lowpan_context_read(const struct lowpan_context_table *table,
+                        struct in6_addr *addr, int ctx_id);
+
 int pack_nhc_chain(uint8_t **dest, size_t cnt, struct ip6_packet *packet);
 /*
  * Pack the header fields of msg into buffer 'buf'.
@@ -159,6 +183,29 @@ uint8_t *lowpan_unpack_headers(struct lowpan_reconstruct *recon,
                                struct ieee154_frame_addr *frame,
                                uint8_t *buf, size_t cnt);
 
+/*
+ * Pack or unpack the headers of n packets, as lowpan_pack_headers and
+ * lowpan_unpack_headers do for one, with the contexts of a table.
+ * Contexts other than 0 are sent with the context identifier
+ * extension.
+ *
+ * @return the number of packets which did not fail; end is set to the
+ * end of what was written for each, or NULL.
+ */
+struct lowpan_batch {
+  struct ip6_packet         *packet;  /* packing: the packet */
+  struct lowpan_reconstruct *recon;   /* unpacking: where it is unpacked */
+  struct ieee154_frame_addr *frame;
+  uint8_t *buf;                       /* the compressed headers */
+  size_t   cnt;
+  uint8_t *end;
+};
+
+int lowpan_pack_headers_batch(const struct lowpan_context_table *contexts,
+                              struct lowpan_batch *batch, int n);
+int lowpan_unpack_headers_batch(const struct lowpan_context_table *contexts,
+                                struct lowpan_batch *batch, int n);
+
 /*
  *  this function writes the next fragment which needs to be sent into
  *  the buffer passed in.  It updates the structures in process to
@@ -77,6 +77,7 @@ int lowpan_recon_add(struct lowpan_reconstruct *recon,
                      uint8_t *pkt, size_t len) {
   struct packed_lowmsg msg;
   uint8_t *buf;
+  uint8_t offset;
 
   msg.data = pkt;
   msg.len  = len;
@@ -89,11 +90,15 @@ int lowpan_recon_add(struct lowpan_reconstruct *recon,
 
   buf = getLowpanPayload(&msg);
   len -= (buf - pkt);
+  getFragDgramOffset(&msg, &offset);
 
-  if (recon->r_size < recon->r_bytes_rcvd + len) return -3;
+  if (recon->r_size < offset * 8 + len ||
+      recon->r_size < recon->r_bytes_rcvd + len) return -3;
 
-  /* just need to copy the new payload in and return */
-  memcpy(recon->r_buf + recon->r_bytes_rcvd, buf, len);
+  /* the fragments may arrive out of order: copy the payload to where
+     the header says it goes.  (gateways receiving fragments of many
+     datagrams, possibly twice, should use lowpan_reasm.h) */
+  memcpy(recon->r_buf + offset * 8, buf, len);
   recon->r_bytes_rcvd += len;
 
   return 0;
@@ -0,0 +1,235 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lowpan_reasm.h"
+
+/* reception is tracked in 8 byte units, the granularity of FRAGN offsets */
+#define UNITS(bytes) (((bytes) + 7) / 8)
+
+struct lowpan_reasm_entry {
+  struct lowpan_reasm_entry *hnext;       /* in its hash bucket */
+  struct lowpan_reasm_entry *prev, *next; /* oldest first */
+  struct lowpan_reasm_key key;
+  uint32_t hash;
+  uint32_t deadline;
+  uint16_t units_rcvd;
+  uint8_t  rcvd[(UNITS(LOWPAN_REASM_MAX_SIZE) + 7) / 8];
+  uint8_t  data[];
+};
+
+struct lowpan_reasm {
+  struct lowpan_reasm_config config;
+  struct lowpan_reasm_entry **buckets;
+  uint32_t mask;
+  /* the datagrams in order of their first fragment, which is the order
+     in which they time out */
+  struct lowpan_reasm_entry *oldest, *newest;
+  struct lowpan_reasm_stats stats;
+};
+
+static uint32_t key_hash(const struct lowpan_reasm_key *key) {
+  uint32_t h = 2166136261u;
+  int i;
+
+  for (i = 0; i < key->addr_len; i++)
+    h = (h ^ key->addr[i]) * 16777619u;
+  h = (h ^ key->tag) * 16777619u;
+  h = (h ^ key->size) * 16777619u;
+  return h ^ (h >> 15);
+}
+
+static int key_equal(const struct lowpan_reasm_key *a,
+                     const struct lowpan_reasm_key *b) {
+  return a->tag == b->tag && a->size == b->size &&
+    a->addr_len == b->addr_len && memcmp(a->addr, b->addr, a->addr_len) == 0;
+}
+
+struct lowpan_reasm *lowpan_reasm_new(const struct lowpan_reasm_config *config) {
+  struct lowpan_reasm *table = calloc(1, sizeof(struct lowpan_reasm));
+  uint32_t n = 16;
+
+  if (!table)
+    return NULL;
+  table->config = *config;
+  while (n < 2 * (uint32_t)config->max_datagrams)
+    n <<= 1;
+  table->buckets = calloc(n, sizeof(struct lowpan_reasm_entry *));
+  if (!table->buckets) {
+    free(table);
+    return NULL;
+  }
+  table->mask = n - 1;
+  return table;
+}
+
+/* removes entry from the hash table and the age list */
+static void unlink_entry(struct lowpan_reasm *table,
+                         struct lowpan_reasm_entry *entry) {
+  struct lowpan_reasm_entry **p = &table->buckets[entry->hash & table->mask];
+
+  while (*p != entry)
+    p = &(*p)->hnext;
+  *p = entry->hnext;
+
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    table->oldest = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    table->newest = entry->prev;
+  table->stats.datagrams--;
+}
+
+static void drop_entry(struct lowpan_reasm *table,
+                       struct lowpan_reasm_entry *entry) {
+  unlink_entry(table, entry);
+  lowpan_reasm_release(table, entry);
+}
+
+void lowpan_reasm_free(struct lowpan_reasm *table) {
+  while (table->oldest)
+    drop_entry(table, table->oldest);
+  free(table->buckets);
+  free(table);
+}
+
+static int expired(struct lowpan_reasm_entry *entry, uint32_t now) {
+  return (int32_t)(now - entry->deadline) >= 0;
+}
+
+int lowpan_reasm_expire(struct lowpan_reasm *table, uint32_t now,
+                        uint32_t *next) {
+  int count = 0;
+
+  while (table->oldest && expired(table->oldest, now)) {
+    drop_entry(table, table->oldest);
+    table->stats.timed_out++;
+    count++;
+  }
+  if (next)
+    *next = table->oldest ? table->oldest->deadline - now : table->config.timeout;
+  return count;
+}
+
+static struct lowpan_reasm_entry *new_entry(struct lowpan_reasm *table,
+                                            const struct lowpan_reasm_key *key,
+                                            uint32_t hash, uint32_t now) {
+  struct lowpan_reasm_entry *entry, **bucket;
+
+  /* make room by dropping the oldest datagrams */
+  while (table->oldest &&
+         (table->stats.datagrams >= table->config.max_datagrams ||
+          table->stats.bytes + key->size > table->config.max_bytes)) {
+    drop_entry(table, table->oldest);
+    table->stats.evicted++;
+  }
+  /* complete datagrams not yet released count too */
+  if (table->stats.datagrams >= table->config.max_datagrams ||
+      table->stats.bytes + key->size > table->config.max_bytes)
+    return NULL;
+
+  entry = malloc(sizeof(struct lowpan_reasm_entry) + key->size);
+  if (!entry)
+    return NULL;
+  entry->key = *key;
+  entry->hash = hash;
+  entry->deadline = now + table->config.timeout;
+  entry->units_rcvd = 0;
+  memset(entry->rcvd, 0, sizeof(entry->rcvd));
+
+  bucket = &table->buckets[hash & table->mask];
+  entry->hnext = *bucket;
+  *bucket = entry;
+
+  entry->next = NULL;
+  entry->prev = table->newest;
+  if (table->newest)
+    table->newest->next = entry;
+  else
+    table->oldest = entry;
+  table->newest = entry;
+
+  table->stats.datagrams++;
+  table->stats.bytes += key->size;
+  return entry;
+}
+
+int lowpan_reasm_add(struct lowpan_reasm *table,
+                     const struct lowpan_reasm_key *key,
+                     uint16_t offset, const uint8_t *data, uint16_t len,
+                     uint32_t now, struct lowpan_reasm_entry **done) {
+  struct lowpan_reasm_entry *entry;
+  uint32_t hash;
+  int unit, last, new_units = 0;
+
+  if (key->addr_len > LOWPAN_REASM_MAX_ADDR ||
+      key->size == 0 || key->size > LOWPAN_REASM_MAX_SIZE ||
+      offset % 8 != 0 || len == 0 || offset + len > key->size ||
+      /* the last unit may be partial only if it ends the datagram */
+      ((offset + len) % 8 != 0 && offset + len != key->size)) {
+    table->stats.invalid++;
+    return LOWPAN_REASM_INVALID;
+  }
+  lowpan_reasm_expire(table, now, NULL);
+  table->stats.fragments++;
+
+  hash = key_hash(key);
+  for (entry = table->buckets[hash & table->mask]; entry; entry = entry->hnext)
+    if (entry->hash == hash && key_equal(&entry->key, key))
+      break;
+  if (!entry) {
+    entry = new_entry(table, key, hash, now);
+    if (!entry) {
+      table->stats.no_memory++;
+      return LOWPAN_REASM_NO_MEMORY;
+    }
+  }
+
+  last = UNITS(offset + len);
+  for (unit = offset / 8; unit < last; unit++) {
+    if (!(entry->rcvd[unit / 8] & (1 << (unit % 8)))) {
+      entry->rcvd[unit / 8] |= 1 << (unit % 8);
+      new_units++;
+    }
+  }
+  if (new_units == 0) {
+    table->stats.duplicates++;
+    return LOWPAN_REASM_DUPLICATE;
+  }
+  memcpy(entry->data + offset, data, len);
+  entry->units_rcvd += new_units;
+
+  if (entry->units_rcvd < UNITS(entry->key.size))
+    return LOWPAN_REASM_INCOMPLETE;
+
+  unlink_entry(table, entry);
+  table->stats.completed++;
+  *done = entry;
+  return LOWPAN_REASM_COMPLETE;
+}
+
+const struct lowpan_reasm_key *lowpan_reasm_entry_key(struct lowpan_reasm_entry *entry) {
+  return &entry->key;
+}
+
+uint8_t *lowpan_reasm_data(struct lowpan_reasm_entry *entry) {
+  return entry->data;
+}
+
+uint16_t lowpan_reasm_size(struct lowpan_reasm_entry *entry) {
+  return entry->key.size;
+}
+
+void lowpan_reasm_release(struct lowpan_reasm *table,
+                          struct lowpan_reasm_entry *entry) {
+  table->stats.bytes -= entry->key.size;
+  free(entry);
+}
+
+void lowpan_reasm_get_stats(struct lowpan_reasm *table,
+                            struct lowpan_reasm_stats *stats) {
+  *stats = table->stats;
+}
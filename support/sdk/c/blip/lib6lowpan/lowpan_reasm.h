@@ -0,0 +1,102 @@
+#ifndef _LOWPAN_REASM_H_
+#define _LOWPAN_REASM_H_
+
+/*
+ * Reassembly table for 6lowpan fragments received by a gateway (RFC
+ * 4944, section 5.3).  Datagrams are keyed by the link-layer address of
+ * their sender (and whatever else the caller puts in the key, e.g., the
+ * destination), their tag and their size; they are found through a hash
+ * table in constant time.  Fragments may arrive in any order and more
+ * than once.  A datagram is dropped if it is not complete within the
+ * timeout after its first fragment, and the oldest datagrams are dropped
+ * to stay within a number of datagrams and bytes of buffer.
+ *
+ * It only depends on the C library, so that tools which do not use the
+ * rest of lib6lowpan (e.g., serial_tun) can use it too.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOWPAN_REASM_MAX_ADDR  18  /* two extended addresses and their modes */
+#define LOWPAN_REASM_MAX_SIZE  2047 /* datagram_size is 11 bits */
+
+struct lowpan_reasm_key {
+  uint8_t  addr[LOWPAN_REASM_MAX_ADDR];
+  uint8_t  addr_len;
+  uint16_t tag;
+  uint16_t size;
+};
+
+struct lowpan_reasm_config {
+  int      max_datagrams;       /* datagrams reassembled at once */
+  size_t   max_bytes;           /* bytes of buffer for them */
+  uint32_t timeout;             /* in the units of now, see lowpan_reasm_add */
+};
+
+struct lowpan_reasm_stats {
+  unsigned long fragments;      /* fragments added */
+  unsigned long duplicates;     /* fragments that held nothing new */
+  unsigned long invalid;        /* fragments outside their datagram */
+  unsigned long completed;      /* datagrams reassembled */
+  unsigned long timed_out;      /* datagrams dropped after the timeout */
+  unsigned long evicted;        /* datagrams dropped for a newer one */
+  unsigned long no_memory;      /* fragments dropped, out of memory */
+  int      datagrams;           /* currently being reassembled */
+  size_t   bytes;
+};
+
+enum {
+  LOWPAN_REASM_INCOMPLETE = 0,
+  LOWPAN_REASM_COMPLETE   = 1,
+  LOWPAN_REASM_DUPLICATE  = 2,
+  LOWPAN_REASM_INVALID    = -1,
+  LOWPAN_REASM_NO_MEMORY  = -2,
+};
+
+struct lowpan_reasm;
+struct lowpan_reasm_entry;
+
+/* returns NULL if out of memory */
+struct lowpan_reasm *lowpan_reasm_new(const struct lowpan_reasm_config *config);
+void lowpan_reasm_free(struct lowpan_reasm *table);
+
+/*
+ * Copies len bytes of the datagram identified by key, starting at
+ * offset (a multiple of 8, as FRAGN headers count offsets in 8 bytes),
+ * into its buffer, creating it if this is its first fragment.  now is
+ * the current time, in any unit (e.g., ms), as long as it is the unit of
+ * config->timeout; it may wrap around.
+ *
+ * Returns LOWPAN_REASM_COMPLETE if the datagram is complete: *done is
+ * then set to its entry, whose data must be released by the caller with
+ * lowpan_reasm_release.  Otherwise LOWPAN_REASM_INCOMPLETE, or
+ * LOWPAN_REASM_DUPLICATE if the fragment was received before, or a
+ * negative error.
+ */
+int lowpan_reasm_add(struct lowpan_reasm *table,
+                     const struct lowpan_reasm_key *key,
+                     uint16_t offset, const uint8_t *data, uint16_t len,
+                     uint32_t now, struct lowpan_reasm_entry **done);
+
+/* the key, the data and the size of a complete datagram */
+const struct lowpan_reasm_key *lowpan_reasm_entry_key(struct lowpan_reasm_entry *entry);
+uint8_t *lowpan_reasm_data(struct lowpan_reasm_entry *entry);
+uint16_t lowpan_reasm_size(struct lowpan_reasm_entry *entry);
+
+void lowpan_reasm_release(struct lowpan_reasm *table,
+                          struct lowpan_reasm_entry *entry);
+
+/*
+ * Drops the datagrams whose timeout expired at now.  Returns how many
+ * there were.  lowpan_reasm_add drops them too; call this from a timer
+ * if fragments may stop arriving.  Returns in *next (if not NULL) the
+ * time until the next one expires, or config->timeout if there is none.
+ */
+int lowpan_reasm_expire(struct lowpan_reasm *table, uint32_t now,
+                        uint32_t *next);
+
+void lowpan_reasm_get_stats(struct lowpan_reasm *table,
+                            struct lowpan_reasm_stats *stats);
+
+#endif
@@ -0,0 +1,83 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib6lowpan.h"
+#include "iovec.h"
+#include "in_cksum.h"
+
+/* the RFC 1071 example, and all-zero and all-one words */
+struct {
+  int len;
+  uint8_t data[8];
+  uint16_t cksum;
+} test_cases[] = {
+  {8, {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7}, 0x220d},
+  {4, {0, 0, 0, 0}, 0xffff},
+  {4, {0xff, 0xff, 0xff, 0xff}, 0},
+  {3, {0x12, 0x34, 0x56}, 0x97cb},
+};
+
+/* the sum of the 16-bit big-endian words, a byte at a time */
+uint16_t reference_cksum(const uint8_t *data, int len) {
+  uint32_t sum = 0;
+  int i;
+
+  for (i = 0; i < len; i++)
+    sum += (i & 1) ? data[i] : data[i] << 8;
+  while (sum > 0xffff)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum & 0xffff;
+}
+
+int main() {
+  int total = 0, successes = 0;
+  uint8_t data[4096 + 16];
+  struct ip_iovec v[16];
+  int i, j;
+
+  for (i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+    uint16_t rv;
+    v[0].iov_base = test_cases[i].data;
+    v[0].iov_len = test_cases[i].len;
+    v[0].iov_next = NULL;
+    total++;
+    rv = in_cksum(v);
+    if (rv == test_cases[i].cksum)
+      successes++;
+    else
+      printf("test %i: 0x%04x, expected 0x%04x\n", i, rv, test_cases[i].cksum);
+  }
+
+  /* random data at random alignments, split into random (odd, empty)
+     segments */
+  srand(1);
+  for (i = 0; i < 20000; i++) {
+    int align = rand() % 16, len = rand() % (i < 10000 ? 200 : 4096);
+    int nvec = 1 + rand() % 16, off = 0;
+    uint16_t rv, expected;
+
+    for (j = 0; j < len; j++)
+      data[align + j] = (i % 7 == 0) ? 0xff : rand();
+    for (j = 0; j < nvec; j++) {
+      int seg = (j == nvec - 1) ? len - off : rand() % (len - off + 1);
+      v[j].iov_base = data + align + off;
+      v[j].iov_len = seg;
+      v[j].iov_next = (j == nvec - 1) ? NULL : &v[j + 1];
+      off += seg;
+    }
+    total++;
+    rv = in_cksum(v);
+    expected = reference_cksum(data + align, len);
+    if (rv == expected)
+      successes++;
+    else
+      printf("fuzz %i: length %i in %i segments: 0x%04x, expected 0x%04x\n",
+             i, len, nvec, rv, expected);
+  }
+
+  printf("%s: %i/%i tests succeeded\n", __FILE__, successes, total);
+  return successes != total;
+}
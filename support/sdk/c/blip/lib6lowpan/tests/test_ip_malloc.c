@@ -0,0 +1,146 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ip_malloc.h"
+
+#define SLOTS 64
+#define ROUNDS 200000
+
+int total = 0, successes = 0;
+
+void check(int ok, const char *what) {
+  total++;
+  if (ok)
+    successes++;
+  else
+    printf("failed: %s\n", what);
+}
+
+struct slot {
+  uint8_t *p;
+  uint16_t len;
+  uint8_t fill;
+} slots[SLOTS];
+
+/* walks the heap from the start: the blocks must tile it, no two free
+   blocks may be next to each other, and the free bytes and blocks must
+   match the statistics */
+int heap_ok() {
+  struct ip_malloc_stats s;
+  uint16_t off = 0, free_bytes = 0, free_blocks = 0;
+  int prev_free = 0;
+
+  while (off < IP_MALLOC_HEAP_SIZE) {
+    bndrt_t hdr = *(bndrt_t *)(heap + off);
+    uint16_t len = hdr & IP_MALLOC_LEN;
+    int is_free = !(hdr & IP_MALLOC_INUSE);
+
+    if (len < IP_MALLOC_MIN_BLOCK || len % IP_MALLOC_ALIGN)
+      return 0;
+    if (!!(hdr & IP_MALLOC_PREV_FREE) != prev_free || (prev_free && is_free))
+      return 0;
+    if (is_free) {
+      if (*(bndrt_t *)(heap + off + len - sizeof(bndrt_t)) != len)
+        return 0;
+      free_bytes += len;
+      free_blocks++;
+    }
+    prev_free = is_free;
+    off += len;
+  }
+  ip_malloc_get_stats(&s);
+  return off == IP_MALLOC_HEAP_SIZE && free_bytes == s.free_bytes &&
+    free_blocks == s.free_blocks && free_bytes == ip_malloc_freespace();
+}
+
+int contents_ok() {
+  int i, j;
+  for (i = 0; i < SLOTS; i++)
+    for (j = 0; slots[i].p && j < slots[i].len; j++)
+      if (slots[i].p[j] != (uint8_t)(slots[i].fill + j))
+        return 0;
+  return 1;
+}
+
+int main() {
+  struct ip_malloc_stats s;
+  void *a, *b, *c;
+  int i, bad_heap = 0, bad_contents = 0, bad_range = 0;
+
+  ip_malloc_init();
+  check(ip_malloc_freespace() == IP_MALLOC_HEAP_SIZE, "all free after init");
+  check(ip_malloc(0) == NULL && ip_malloc(IP_MALLOC_HEAP_SIZE) == NULL, "impossible sizes");
+  check(heap_ok(), "heap after impossible sizes");
+
+  /* freeing in any order coalesces back to a single block */
+  a = ip_malloc(100);
+  b = ip_malloc(1);
+  c = ip_malloc(200);
+  check(a && b && c && ((uintptr_t)a | (uintptr_t)b | (uintptr_t)c) % IP_MALLOC_ALIGN == 0,
+        "small allocations");
+  check(heap_ok(), "heap after small allocations");
+  ip_free(b);
+  ip_free(b);
+  check(heap_ok(), "heap after double free");
+  ip_free(a);
+  ip_free(NULL);
+  check(heap_ok(), "heap after coalescing with the next block");
+  ip_free(c);
+  ip_malloc_get_stats(&s);
+  check(heap_ok() && s.free_blocks == 1 && s.largest_free == IP_MALLOC_HEAP_SIZE,
+        "single block after freeing all");
+
+  /* the whole heap in one allocation */
+  a = ip_malloc(IP_MALLOC_HEAP_SIZE - sizeof(bndrt_t));
+  check(a != NULL && ip_malloc_freespace() == 0 && ip_malloc(1) == NULL, "whole heap");
+  ip_free(a);
+
+  /* random sizes, random order, against the list of what is allocated */
+  srand(1);
+  for (i = 0; i < ROUNDS; i++) {
+    struct slot *sl = &slots[rand() % SLOTS];
+    if (sl->p) {
+      ip_free(sl->p);
+      sl->p = NULL;
+    } else {
+      /* mostly small allocations, sometimes a full packet */
+      sl->len = rand() % 8 ? 1 + rand() % 64 : 1 + rand() % 400;
+      sl->p = ip_malloc(sl->len);
+      if (sl->p) {
+        int j;
+        if (sl->p < heap || sl->p + sl->len > heap + IP_MALLOC_HEAP_SIZE)
+          bad_range++;
+        sl->fill = rand();
+        for (j = 0; j < sl->len; j++)
+          sl->p[j] = sl->fill + j;
+      }
+    }
+    if (i % 97 == 0) {
+      bad_heap += !heap_ok();
+      bad_contents += !contents_ok();
+    }
+  }
+  check(bad_range == 0, "random, inside the heap");
+  check(bad_heap == 0, "random, heap consistent");
+  check(bad_contents == 0 && contents_ok(), "random, contents intact");
+
+  ip_malloc_get_stats(&s);
+  check(s.allocs > ROUNDS / 4 && s.failures > 0, "random, some allocations failed");
+  check(s.max_steps <= SLOTS + 1, "random, bounded search");
+  printf("%lu allocs, %lu failures, %.2f steps per alloc (max %i), "
+         "fragmentation %i%%, peak used %i\n",
+         s.allocs, s.failures, (double)s.steps / s.allocs, s.max_steps,
+         s.free_bytes ? 100 - 100 * s.largest_free / s.free_bytes : 0, s.peak_used);
+
+  for (i = 0; i < SLOTS; i++)
+    ip_free(slots[i].p);
+  ip_malloc_get_stats(&s);
+  check(heap_ok() && s.free_blocks == 1 && s.free_bytes == IP_MALLOC_HEAP_SIZE,
+        "random, single block after freeing all");
+
+  printf("%s: %i/%i tests succeeded\n", __FILE__, successes, total);
+  return successes != total;
+}
@@ -0,0 +1,132 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Ieee154.h"
+#include "ip.h"
+#include "lib6lowpan.h"
+#include "nwbyte.h"
+#include "6lowpan.h"
+
+int total = 0, successes = 0;
+
+void check(int ok, const char *what) {
+  total++;
+  if (ok)
+    successes++;
+  else
+    printf("failed: %s\n", what);
+}
+
+struct {
+  char *src, *dst;
+  uint8_t src_ctx, dst_ctx;     /* with the table below */
+} test_cases[] = {
+  {"fe80::1", "fe80::2", 0, 0},
+  {"fe80::1:00ff:fe00:1", "ff02::1", 0, 0},
+  {"2001:db8::1", "2001:db8:1::2", 1, 3},
+  {"2001:db8:1::1:1", "2001:db8::5", 3, 1},
+  {"2001:db8:1fff::1", "ff05::1:3", 2, 0},
+  {"2002::1", "2001:db8:1:2:3:4:5:6", 0, 3},
+  {"::", "ff02::1:ff00:1", 0, 0},
+};
+#define N (sizeof(test_cases) / sizeof(test_cases[0]))
+
+int main() {
+  struct lowpan_context_table table, empty;
+  struct ieee154_frame_addr frame;
+  struct ip6_packet packets[N];
+  struct lowpan_reconstruct recons[N];
+  struct lowpan_batch batch[N];
+  uint8_t bufs[N][64], single[64], unpacked[N][64];
+  struct in6_addr addr, prefix;
+  uint8_t id;
+  int i;
+
+  lowpan_context_init(&empty);
+  lowpan_context_init(&table);
+  inet_pton6("2001:db8::", &prefix);
+  check(lowpan_context_set(&table, 1, &prefix, 32) == 0, "set context 1");
+  inet_pton6("2001:db8:1::", &prefix);
+  check(lowpan_context_set(&table, 3, &prefix, 48) == 0, "set context 3");
+  inet_pton6("2001:db8:1000::", &prefix);
+  check(lowpan_context_set(&table, 2, &prefix, 36) == 0, "set context 2");
+  check(lowpan_context_set(&table, 16, &prefix, 64) < 0 &&
+        lowpan_context_set(&table, 4, &prefix, 129) < 0, "out of range contexts");
+
+  /* longest match */
+  inet_pton6("2001:db8:1::5", &addr);
+  check(lowpan_context_match(&table, &addr, &id) == 48 && id == 3, "match 48 bits");
+  inet_pton6("2001:db8:2::5", &addr);
+  check(lowpan_context_match(&table, &addr, &id) == 32 && id == 1, "match 32 bits");
+  inet_pton6("2001:db8:1fff::5", &addr);
+  check(lowpan_context_match(&table, &addr, &id) == 36 && id == 2, "match 36 bits");
+  inet_pton6("2001:db9::1", &addr);
+  check(lowpan_context_match(&table, &addr, &id) == 0, "no match");
+  memset(&addr, 0, sizeof(addr));
+  check(lowpan_context_read(&table, &addr, 2) == 36 &&
+        addr.s6_addr[4] == 0x10 && addr.s6_addr[5] == 0, "read context 2");
+  check(lowpan_context_read(&table, &addr, 5) < 0, "read unset context");
+
+  memset(&frame, 0, sizeof(frame));
+  frame.ieee_src.ieee_mode = IEEE154_ADDR_SHORT;
+  frame.ieee_src.i_saddr = htole16(1);
+  frame.ieee_dst.ieee_mode = IEEE154_ADDR_SHORT;
+  frame.ieee_dst.i_saddr = htole16(0xffff);
+  frame.ieee_dstpan = htole16(0x22);
+
+  for (i = 0; i < N; i++) {
+    memset(&packets[i], 0, sizeof(packets[i]));
+    packets[i].ip6_hdr.ip6_vfc = IPV6_VERSION;
+    packets[i].ip6_hdr.ip6_flow |= htonl(i << 4);
+    packets[i].ip6_hdr.ip6_nxt = IANA_ICMP;
+    packets[i].ip6_hdr.ip6_hlim = i % 2 ? 64 : 17;
+    inet_pton6(test_cases[i].src, &packets[i].ip6_hdr.ip6_src);
+    inet_pton6(test_cases[i].dst, &packets[i].ip6_hdr.ip6_dst);
+
+    memset(&batch[i], 0, sizeof(batch[i]));
+    batch[i].packet = &packets[i];
+    batch[i].frame = &frame;
+    batch[i].buf = bufs[i];
+    batch[i].cnt = sizeof(bufs[i]);
+  }
+
+  /* without contexts, the same as one at a time */
+  check(lowpan_pack_headers_batch(&empty, batch, N) == N, "pack without contexts");
+  for (i = 0; i < N; i++) {
+    uint8_t *end = lowpan_pack_headers(&packets[i], &frame, single, sizeof(single));
+    check(end - single == batch[i].end - bufs[i] &&
+          memcmp(single, bufs[i], end - single) == 0, "same as lowpan_pack_headers");
+  }
+
+  /* with contexts, and back */
+  check(lowpan_pack_headers_batch(&table, batch, N) == N, "pack with contexts");
+  for (i = 0; i < N; i++) {
+    int cid = test_cases[i].src_ctx || test_cases[i].dst_ctx;
+    check(!!(bufs[i][1] & LOWPAN_IPHC_CID_PRESENT) == cid &&
+          (!cid || bufs[i][2] == (test_cases[i].src_ctx << 4 | test_cases[i].dst_ctx)),
+          "context identifier extension");
+
+    batch[i].cnt = batch[i].end - bufs[i];
+    memset(&recons[i], 0, sizeof(recons[i]));
+    memset(unpacked[i], 0, sizeof(unpacked[i]));
+    recons[i].r_buf = unpacked[i];
+    recons[i].r_size = sizeof(unpacked[i]);
+    batch[i].recon = &recons[i];
+  }
+  check(lowpan_unpack_headers_batch(&table, batch, N) == N, "unpack with contexts");
+  for (i = 0; i < N; i++) {
+    struct ip6_hdr *hdr = (struct ip6_hdr *)unpacked[i];
+    check(batch[i].end == unpacked[i] + sizeof(struct ip6_hdr) &&
+          hdr->ip6_flow == packets[i].ip6_hdr.ip6_flow &&
+          hdr->ip6_nxt == packets[i].ip6_hdr.ip6_nxt &&
+          hdr->ip6_hlim == packets[i].ip6_hdr.ip6_hlim &&
+          memcmp(&hdr->ip6_src, &packets[i].ip6_hdr.ip6_src, 16) == 0 &&
+          memcmp(&hdr->ip6_dst, &packets[i].ip6_hdr.ip6_dst, 16) == 0,
+          "unpacked headers");
+  }
+
+  printf("%s: %i/%i tests succeeded\n", __FILE__, successes, total);
+  return successes != total;
+}
@@ -0,0 +1,150 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lowpan_reasm.h"
+
+#define FRAG 48
+
+int total = 0, successes = 0;
+
+void check(int ok, const char *what) {
+  total++;
+  if (ok)
+    successes++;
+  else
+    printf("failed: %s\n", what);
+}
+
+void make_key(struct lowpan_reasm_key *key, int source, uint16_t tag, uint16_t size) {
+  memset(key, 0, sizeof(*key));
+  key->addr[0] = source >> 8;
+  key->addr[1] = source;
+  key->addr_len = 2;
+  key->tag = tag;
+  key->size = size;
+}
+
+/* adds fragment i of the datagram of key, whose bytes are data */
+int add(struct lowpan_reasm *t, struct lowpan_reasm_key *key, uint8_t *data,
+        int i, uint32_t now, struct lowpan_reasm_entry **done) {
+  int len = key->size - i * FRAG < FRAG ? key->size - i * FRAG : FRAG;
+  return lowpan_reasm_add(t, key, i * FRAG, data + i * FRAG, len, now, done);
+}
+
+int complete_ok(struct lowpan_reasm *t, struct lowpan_reasm_entry *e,
+                struct lowpan_reasm_key *key, uint8_t *data) {
+  int ok = lowpan_reasm_size(e) == key->size &&
+    memcmp(lowpan_reasm_data(e), data, key->size) == 0 &&
+    lowpan_reasm_entry_key(e)->tag == key->tag;
+  lowpan_reasm_release(t, e);
+  return ok;
+}
+
+int main() {
+  struct lowpan_reasm_config config = {8, 4096, 1000};
+  struct lowpan_reasm_stats stats;
+  struct lowpan_reasm *t = lowpan_reasm_new(&config);
+  struct lowpan_reasm_entry *e = NULL;
+  struct lowpan_reasm_key key, key2;
+  uint8_t data[1280], data2[1280];
+  int i, rv, n;
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = i * 7;
+    data2[i] = i * 13 + 1;
+  }
+
+  /* in order */
+  make_key(&key, 1, 5, 200);
+  for (i = 0; i < 4; i++)
+    check(add(t, &key, data, i, 0, &e) == LOWPAN_REASM_INCOMPLETE, "in order, incomplete");
+  check(add(t, &key, data, 4, 0, &e) == LOWPAN_REASM_COMPLETE &&
+        complete_ok(t, e, &key, data), "in order, complete");
+
+  /* backwards, with duplicates, interleaved with another source using
+     the same tag */
+  make_key(&key, 1, 6, 1280);
+  make_key(&key2, 2, 6, 1280);
+  n = (1280 + FRAG - 1) / FRAG;
+  for (i = n - 1; i > 0; i--) {
+    check(add(t, &key, data, i, 0, &e) == LOWPAN_REASM_INCOMPLETE, "backwards");
+    check(add(t, &key2, data2, i, 0, &e) == LOWPAN_REASM_INCOMPLETE, "other source");
+    check(add(t, &key, data, i, 0, &e) == LOWPAN_REASM_DUPLICATE, "duplicate");
+  }
+  check(add(t, &key, data, 0, 0, &e) == LOWPAN_REASM_COMPLETE &&
+        complete_ok(t, e, &key, data), "backwards, complete");
+  check(add(t, &key2, data2, 0, 0, &e) == LOWPAN_REASM_COMPLETE &&
+        complete_ok(t, e, &key2, data2), "other source, complete");
+
+  /* invalid fragments */
+  make_key(&key, 1, 7, 100);
+  check(lowpan_reasm_add(t, &key, 4, data, 8, 0, &e) == LOWPAN_REASM_INVALID, "unaligned offset");
+  check(lowpan_reasm_add(t, &key, 96, data, 8, 0, &e) == LOWPAN_REASM_INVALID, "past the end");
+  check(lowpan_reasm_add(t, &key, 0, data, 12, 0, &e) == LOWPAN_REASM_INVALID, "partial unit before the end");
+  check(lowpan_reasm_add(t, &key, 16, data + 16, 84, 0, &e) == LOWPAN_REASM_INCOMPLETE, "partial unit at the end");
+  check(lowpan_reasm_add(t, &key, 0, data, 16, 0, &e) == LOWPAN_REASM_COMPLETE &&
+        complete_ok(t, e, &key, data), "partial unit at the end, complete");
+
+  /* timeout, also across the wrap around of the time */
+  make_key(&key, 3, 8, 100);
+  check(add(t, &key, data, 0, 0xfffffe00u, &e) == LOWPAN_REASM_INCOMPLETE, "timeout start");
+  check(lowpan_reasm_expire(t, 0xfffffe00u + 999, NULL) == 0, "not timed out yet");
+  check(lowpan_reasm_expire(t, 0xfffffe00u + 1000, NULL) == 1, "timed out");
+  check(add(t, &key, data, 1, 0, &e) == LOWPAN_REASM_INCOMPLETE, "after timeout");
+  check(add(t, &key, data, 2, 0, &e) == LOWPAN_REASM_INCOMPLETE, "after timeout");
+  check(add(t, &key, data, 0, 0, &e) == LOWPAN_REASM_COMPLETE &&
+        complete_ok(t, e, &key, data), "after timeout, complete");
+
+  /* the oldest datagrams make room for new ones */
+  for (i = 0; i < 10; i++) {
+    make_key(&key, 10 + i, 1, 100);
+    check(add(t, &key, data, 0, i, &e) == LOWPAN_REASM_INCOMPLETE, "many datagrams");
+  }
+  lowpan_reasm_get_stats(t, &stats);
+  check(stats.datagrams == 8 && stats.evicted == 2, "datagrams limit");
+  make_key(&key, 100, 1, 1280);
+  check(add(t, &key, data, 0, 20, &e) == LOWPAN_REASM_INCOMPLETE, "big datagram");
+  lowpan_reasm_get_stats(t, &stats);
+  check(stats.bytes <= config.max_bytes && stats.evicted > 2, "bytes limit");
+  make_key(&key, 10, 1, 100);
+  check(add(t, &key, data, 1, 21, &e) == LOWPAN_REASM_INCOMPLETE, "evicted datagram restarts");
+  lowpan_reasm_free(t);
+
+  /* random order, random duplicates, many sources */
+  config.max_datagrams = 64;
+  config.max_bytes = 64 * 1280;
+  config.timeout = 100000;
+  t = lowpan_reasm_new(&config);
+  srand(1);
+  {
+    int order[64 * 27], count = 0, completed = 0, src, j;
+    for (src = 0; src < 64; src++)
+      for (j = 0; j < 27; j++)
+        order[count++] = src * 27 + j;
+    for (i = count - 1; i > 0; i--) {
+      int k = rand() % (i + 1), tmp = order[i];
+      order[i] = order[k];
+      order[k] = tmp;
+    }
+    for (i = 0; i < count; i++) {
+      src = order[i] / 27;
+      make_key(&key, src, src * 3, 1280);
+      rv = add(t, &key, src & 1 ? data : data2, order[i] % 27, i, &e);
+      if (rv == LOWPAN_REASM_COMPLETE)
+        completed += complete_ok(t, e, &key, src & 1 ? data : data2);
+      if (rand() % 4 == 0 && rv == LOWPAN_REASM_INCOMPLETE)
+        check(add(t, &key, src & 1 ? data : data2, order[i] % 27, i, &e) ==
+              LOWPAN_REASM_DUPLICATE, "random duplicate");
+    }
+    check(completed == 64, "random order, all complete");
+  }
+  lowpan_reasm_get_stats(t, &stats);
+  check(stats.datagrams == 0 && stats.bytes == 0, "nothing left");
+  lowpan_reasm_free(t);
+
+  printf("%s: %i/%i tests succeeded\n", __FILE__, successes, total);
+  return successes != total;
+}
@@ -0,0 +1,235 @@
+/*
+ * Header compression throughput: the IPv6 headers of the datagrams of
+ * a trace in the format read by compress (source and destination
+ * address lines, then one datagram per line in hex) are packed and
+ * unpacked one at a time, with the lowpan_extern_* context hooks, and
+ * in batches, with a context table, and the results compared.  The
+ * source addresses are varied across link-local, context and inline
+ * prefixes.  With -c, the trace holds compressed frames as read by
+ * decompress (e.g., packet.trace), whose headers are only unpacked.
+ *
+ *   batch [-n packets] [-b batch size] [-r rounds] [-c] < trace
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "../lib6lowpan-includes.h"
+#include "../ieee154_header.h"
+#include "../lib6lowpan.h"
+
+#define MAX_INPUT 64
+#define HDR_BUF   64
+
+uint8_t input[MAX_INPUT][1500];
+int input_len[MAX_INPUT], n_input;
+
+/* context 0 is aaaa::/64, as for compress and decompress */
+int lowpan_extern_read_context(struct in6_addr *addr, int context) {
+  if (context != 0)
+    return -1;
+  addr->s6_addr16[0] = htons(0xaaaa);
+  return 64;
+}
+
+int lowpan_extern_match_context(struct in6_addr *addr, UNUSED uint8_t *ctx_id) {
+  *ctx_id = 0;
+  if (addr->s6_addr16[0] == htons(0xaaaa) && addr->s6_addr16[1] == 0 &&
+      addr->s6_addr16[2] == 0 && addr->s6_addr16[3] == 0)
+    return 64;
+  return 0;
+}
+
+int read_line(FILE *f, uint8_t *buf, int len) {
+  char line[4096], *p = line;
+  int n = 0;
+
+  if (!fgets(line, sizeof(line), f))
+    return -1;
+  while (*p && n < len) {
+    unsigned v;
+    int k;
+    while (*p && !isxdigit(*p))
+      p++;
+    if (sscanf(p, "%2x%n", &v, &k) != 1)
+      break;
+    buf[n++] = v;
+    p += k;
+  }
+  return n;
+}
+
+double elapsed(struct timeval *start) {
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv) {
+  struct ieee154_frame_addr frame;
+  struct lowpan_context_table table;
+  struct ip6_packet *packets;
+  struct ieee154_frame_addr *frames;
+  struct lowpan_reconstruct *recons;
+  struct lowpan_batch *batch;
+  uint8_t (*packed)[HDR_BUF], (*unpacked)[HDR_BUF], *end;
+  struct in6_addr prefix;
+  struct timeval start;
+  int n = 4096, size = 64, rounds = 100, compressed = 0;
+  int opt, i, r, bad = 0, len;
+  double single_secs, batch_secs;
+  char line[256];
+
+  while ((opt = getopt(argc, argv, "n:b:r:c")) != -1) {
+    switch (opt) {
+    case 'n': n = atoi(optarg); break;
+    case 'b': size = atoi(optarg); break;
+    case 'r': rounds = atoi(optarg); break;
+    case 'c': compressed = 1; break;
+    default:
+      fprintf(stderr, "usage: %s [-n packets] [-b batch size] [-r rounds] [-c] < trace\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  memset(&frame, 0, sizeof(frame));
+  if (!compressed) {
+    /* the link-layer addresses */
+    if (!fgets(line, sizeof(line), stdin))
+      return 1;
+    line[strcspn(line, "\r\n")] = '\0';
+    ieee154_parse(line, &frame.ieee_src);
+    if (!fgets(line, sizeof(line), stdin))
+      return 1;
+    line[strcspn(line, "\r\n")] = '\0';
+    ieee154_parse(line, &frame.ieee_dst);
+    frame.ieee_dstpan = htole16(0x22);
+  }
+  while (n_input < MAX_INPUT &&
+         (len = read_line(stdin, input[n_input], sizeof(input[0]))) >= 0)
+    if (len >= (compressed ? 12 : sizeof(struct ip6_hdr)))
+      input_len[n_input++] = len;
+  if (n < 1 || size < 1 || n_input == 0) {
+    fprintf(stderr, "no packets\n");
+    return 1;
+  }
+
+  lowpan_context_init(&table);
+  memset(&prefix, 0, sizeof(prefix));
+  prefix.s6_addr16[0] = htons(0xaaaa);
+  lowpan_context_set(&table, 0, &prefix, 64);
+
+  packets = calloc(n, sizeof(struct ip6_packet));
+  frames = calloc(n, sizeof(struct ieee154_frame_addr));
+  recons = calloc(n, sizeof(struct lowpan_reconstruct));
+  batch = calloc(n, sizeof(struct lowpan_batch));
+  packed = calloc(n, HDR_BUF);
+  unpacked = calloc(n, HDR_BUF);
+  if (!packets || !frames || !recons || !batch || !packed || !unpacked)
+    return 1;
+
+  for (i = 0; i < n; i++) {
+    uint8_t *in = input[i % n_input];
+
+    if (compressed) {
+      /* the length byte comes before the frame */
+      uint8_t *hdrs = unpack_ieee154_hdr(in, &frames[i]);
+      batch[i].buf = packed[i];
+      batch[i].cnt = input_len[i % n_input] - (hdrs - in);
+      if (batch[i].cnt > HDR_BUF)
+        batch[i].cnt = HDR_BUF;
+      memcpy(packed[i], hdrs, batch[i].cnt);
+    } else {
+      struct ip6_hdr *hdr = &packets[i].ip6_hdr;
+      memcpy(hdr, in, sizeof(struct ip6_hdr));
+      /* the headers are unpacked without a next header chain */
+      if (hdr->ip6_nxt == IANA_UDP || hdr->ip6_nxt == IPV6_HOP ||
+          hdr->ip6_nxt == IPV6_ROUTING || hdr->ip6_nxt == IPV6_FRAG ||
+          hdr->ip6_nxt == IPV6_DEST || hdr->ip6_nxt == IPV6_MOBILITY ||
+          hdr->ip6_nxt == IPV6_IPV6)
+        hdr->ip6_nxt = IANA_ICMP;
+      /* a link-local, a context and an inline source prefix in turn */
+      switch (i % 3) {
+      case 1:
+        memcpy(&hdr->ip6_src, &prefix, 8);
+        break;
+      case 2:
+        hdr->ip6_src.s6_addr16[0] = htons(0x2001);
+        hdr->ip6_src.s6_addr16[1] = htons(0xdb8);
+        break;
+      }
+      hdr->ip6_src.s6_addr[15] ^= i;
+      frames[i] = frame;
+      batch[i].packet = &packets[i];
+      batch[i].buf = packed[i];
+      batch[i].cnt = HDR_BUF;
+    }
+    batch[i].frame = &frames[i];
+    recons[i].r_buf = unpacked[i];
+    recons[i].r_size = HDR_BUF;
+    batch[i].recon = &recons[i];
+  }
+
+  if (!compressed) {
+    uint8_t buf[HDR_BUF];
+
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++)
+      for (i = 0; i < n; i++)
+        end = lowpan_pack_headers(&packets[i], &frames[i], buf, sizeof(buf));
+    single_secs = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++)
+      for (i = 0; i < n; i += size)
+        lowpan_pack_headers_batch(&table, batch + i, n - i < size ? n - i : size);
+    batch_secs = elapsed(&start);
+
+    for (i = 0; i < n; i++) {
+      end = lowpan_pack_headers(&packets[i], &frames[i], buf, sizeof(buf));
+      if (!end || !batch[i].end || end - buf != batch[i].end - packed[i] ||
+          memcmp(buf, packed[i], end - buf))
+        bad++;
+      batch[i].cnt = batch[i].end - packed[i];
+    }
+    printf("pack:   %i packets x %i rounds: %.0f packets/s one at a time, "
+           "%.0f packets/s in batches of %i\n", n, rounds,
+           n * rounds / single_secs, n * rounds / batch_secs, size);
+  }
+
+  gettimeofday(&start, NULL);
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < n; i++)
+      lowpan_unpack_headers(&recons[i], &frames[i], packed[i], batch[i].cnt);
+  single_secs = elapsed(&start);
+
+  gettimeofday(&start, NULL);
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < n; i += size)
+      lowpan_unpack_headers_batch(&table, batch + i, n - i < size ? n - i : size);
+  batch_secs = elapsed(&start);
+
+  for (i = 0; i < n; i++) {
+    struct ip6_hdr *hdr = (struct ip6_hdr *)unpacked[i];
+    if (!batch[i].end)
+      bad++;
+    else if (!compressed &&
+             (memcmp(&hdr->ip6_src, &packets[i].ip6_hdr.ip6_src, 16) ||
+              memcmp(&hdr->ip6_dst, &packets[i].ip6_hdr.ip6_dst, 16) ||
+              hdr->ip6_flow != packets[i].ip6_hdr.ip6_flow ||
+              hdr->ip6_nxt != packets[i].ip6_hdr.ip6_nxt ||
+              hdr->ip6_hlim != packets[i].ip6_hdr.ip6_hlim))
+      bad++;
+  }
+  printf("unpack: %i packets x %i rounds: %.0f packets/s one at a time, "
+         "%.0f packets/s in batches of %i\n", n, rounds,
+         n * rounds / single_secs, n * rounds / batch_secs, size);
+  printf("%i packets differ\n", bad);
+  return bad != 0;
+}
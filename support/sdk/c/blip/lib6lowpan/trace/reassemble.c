@@ -0,0 +1,169 @@
+/*
+ * Reassembly throughput: the IPv6 datagrams of a trace in the format
+ * read by compress (source and destination address lines, then one
+ * datagram per line in hex) are sent as fragments by many motes at once,
+ * in a shuffled order and with some fragments received twice, through
+ * the reassembly table of lowpan_reasm.h.
+ *
+ *   reassemble [-m motes] [-f fragment bytes] [-r rounds] [-d duplicate %]
+ *              [-s datagram bytes] < uncompressed.trace
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "../lowpan_reasm.h"
+
+#define MAX_DATAGRAMS 64
+
+struct fragment {
+  uint16_t mote, datagram, offset, len;
+};
+
+uint8_t datagrams[MAX_DATAGRAMS][LOWPAN_REASM_MAX_SIZE];
+int sizes[MAX_DATAGRAMS], n_datagrams;
+
+int read_trace(FILE *f, int size) {
+  char line[8192];
+  int lineno = 0;
+
+  while (fgets(line, sizeof(line), f) && n_datagrams < MAX_DATAGRAMS) {
+    char *p = line;
+    int len = 0;
+
+    /* the source and destination addresses */
+    if (lineno++ < 2)
+      continue;
+    while (*p && len < LOWPAN_REASM_MAX_SIZE) {
+      unsigned v;
+      int n;
+      while (*p && !isxdigit(*p))
+        p++;
+      if (sscanf(p, "%2x%n", &v, &n) != 1)
+        break;
+      datagrams[n_datagrams][len++] = v;
+      p += n;
+    }
+    if (len == 0)
+      continue;
+    /* repeat the datagram to make it size bytes long */
+    if (size > len) {
+      int i;
+      for (i = len; i < size; i++)
+        datagrams[n_datagrams][i] = datagrams[n_datagrams][i % len];
+      len = size;
+    }
+    sizes[n_datagrams++] = len;
+  }
+  return n_datagrams;
+}
+
+int main(int argc, char **argv) {
+  int motes = 256, frag = 80, rounds = 200, dup = 5, size = 0;
+  struct lowpan_reasm_config config;
+  struct lowpan_reasm_stats stats;
+  struct lowpan_reasm *table;
+  struct fragment *frags;
+  struct timeval start, end;
+  unsigned long n_frags = 0, i, completed = 0, bad = 0;
+  double secs;
+  int opt, r, m, d;
+
+  while ((opt = getopt(argc, argv, "m:f:r:d:s:")) != -1) {
+    switch (opt) {
+    case 'm': motes = atoi(optarg); break;
+    case 'f': frag = atoi(optarg) & ~7; break;
+    case 'r': rounds = atoi(optarg); break;
+    case 'd': dup = atoi(optarg); break;
+    case 's': size = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-m motes] [-f fragment bytes] [-r rounds] "
+              "[-d duplicate %%] [-s datagram bytes] < trace\n", argv[0]);
+      return 2;
+    }
+  }
+  if (frag < 8 || size > LOWPAN_REASM_MAX_SIZE || read_trace(stdin, size) == 0) {
+    fprintf(stderr, "no datagrams\n");
+    return 1;
+  }
+
+  /* every mote sends every datagram of the trace, the fragments of all
+     motes are shuffled together */
+  for (d = 0; d < n_datagrams; d++)
+    n_frags += (sizes[d] + frag - 1) / frag;
+  n_frags *= motes;
+  frags = malloc(n_frags * sizeof(struct fragment));
+  if (!frags)
+    return 1;
+  i = 0;
+  for (m = 0; m < motes; m++)
+    for (d = 0; d < n_datagrams; d++) {
+      int off;
+      for (off = 0; off < sizes[d]; off += frag) {
+        frags[i].mote = m;
+        frags[i].datagram = d;
+        frags[i].offset = off;
+        frags[i].len = sizes[d] - off < frag ? sizes[d] - off : frag;
+        i++;
+      }
+    }
+  srand(1);
+  for (i = n_frags - 1; i > 0; i--) {
+    unsigned long k = rand() % (i + 1);
+    struct fragment tmp = frags[i];
+    frags[i] = frags[k];
+    frags[k] = tmp;
+  }
+
+  config.max_datagrams = motes * n_datagrams;
+  config.max_bytes = (size_t)motes * n_datagrams * LOWPAN_REASM_MAX_SIZE;
+  config.timeout = 60000;
+  table = lowpan_reasm_new(&config);
+  if (!table)
+    return 1;
+
+  gettimeofday(&start, NULL);
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < n_frags; i++) {
+      struct fragment *f = &frags[i];
+      struct lowpan_reasm_entry *e;
+      struct lowpan_reasm_key key;
+      int copies = (rand() % 100 < dup) ? 2 : 1;
+
+      key.addr[0] = f->mote >> 8;
+      key.addr[1] = f->mote;
+      key.addr_len = 2;
+      key.tag = r * n_datagrams + f->datagram;
+      key.size = sizes[f->datagram];
+      while (copies--) {
+        if (lowpan_reasm_add(table, &key, f->offset,
+                             datagrams[f->datagram] + f->offset, f->len,
+                             r, &e) == LOWPAN_REASM_COMPLETE) {
+          if (memcmp(lowpan_reasm_data(e), datagrams[f->datagram], key.size))
+            bad++;
+          completed++;
+          lowpan_reasm_release(table, e);
+        }
+      }
+    }
+  }
+  gettimeofday(&end, NULL);
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+  lowpan_reasm_get_stats(table, &stats);
+  printf("%i motes, %i datagrams of %i-%i bytes, %i byte fragments, %i%% duplicates\n",
+         motes, n_datagrams, sizes[0], sizes[n_datagrams - 1], frag, dup);
+  printf("%lu fragments (%lu duplicates) in %.3f s: %.0f fragments/s, %.0f datagrams/s\n",
+         stats.fragments, stats.duplicates, secs,
+         stats.fragments / secs, completed / secs);
+  printf("completed %lu, bad %lu, timed out %lu, evicted %lu, no memory %lu\n",
+         completed, bad, stats.timed_out, stats.evicted, stats.no_memory);
+  lowpan_reasm_free(table);
+  free(frags);
+  return bad != 0 || completed != (unsigned long)rounds * motes * n_datagrams;
+}
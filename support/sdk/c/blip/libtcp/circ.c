@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include "tcplib.h"
+#include "circ.h"
 
 struct circ_buf {
   uint8_t  *data_start;
@@ -55,6 +56,11 @@ void circ_set_seqno(void *buf, uint32_t seqno) {
   b->head_seqno = seqno;
 }
 
+int circ_get_window(void *buf) {
+  struct circ_buf *b = (struct circ_buf *)buf;
+  return b->data_len;
+}
+
 static void get_ptr_off_1(struct circ_buf *b, uint32_t sseqno, int len,
                           uint8_t **writeptr, int *w_len) {
   uint8_t *endptr =  b->data_start + b->data_len;
@@ -109,6 +115,27 @@ int circ_buf_read(void *buf, uint32_t sseqno,
   return rc;
 }
 
+int circ_buf_iov(void *buf, uint32_t sseqno, int len,
+                 struct ip_iovec *iov) {
+  struct circ_buf *b = (struct circ_buf *)buf;
+  uint8_t *readptr;
+  int r_len;
+
+  get_ptr_off_1(b, sseqno, len, &readptr, &r_len);
+  iov[0].iov_base = readptr;
+  iov[0].iov_len = r_len;
+  iov[0].iov_next = NULL;
+
+  if (r_len != len) {
+    iov[1].iov_base = b->data_start;
+    iov[1].iov_len = min(len - r_len, b->data_head - b->data_start);
+    iov[1].iov_next = NULL;
+    iov[0].iov_next = &iov[1];
+    r_len += iov[1].iov_len;
+  }
+  return r_len;
+}
+
 int circ_buf_write(char *buf, uint32_t sseqno,
                    uint8_t *data, int len) {
   struct circ_buf *b = (struct circ_buf *)buf;
@@ -134,6 +161,131 @@ int circ_buf_write(char *buf, uint32_t sseqno,
   return 0;
 }
 
+/*
+ * A reassembly buffer is a circular buffer whose head is the next
+ * byte expected, followed by the ranges of data stored past it.  The
+ * ranges never overlap or touch; an empty one has start == end, and
+ * they are kept in the order they were last extended in.
+ */
+struct circ_reasm {
+  struct circ_buf b;
+  struct {
+    uint32_t start, end;
+  } blocks[CIRC_REASM_BLOCKS];
+};
+
+#define BLOCK_EMPTY(R, I) ((R)->blocks[I].start == (R)->blocks[I].end)
+
+/* drop the empty ranges, keeping the order of the others */
+static int reasm_compact(struct circ_reasm *r) {
+  int i, n = 0;
+  for (i = 0; i < CIRC_REASM_BLOCKS; i++) {
+    if (BLOCK_EMPTY(r, i)) continue;
+    r->blocks[n++] = r->blocks[i];
+  }
+  for (i = n; i < CIRC_REASM_BLOCKS; i++)
+    r->blocks[i].start = r->blocks[i].end = 0;
+  return n;
+}
+
+int circ_reasm_init(void *buf, int len, uint32_t seqno) {
+  struct circ_reasm *r = (struct circ_reasm *)buf;
+
+  if (len <= sizeof(struct circ_reasm))
+    return -1;
+
+  memset(r, 0, sizeof(struct circ_reasm));
+  r->b.data_head = r->b.data_start = (uint8_t *)(r + 1);
+  r->b.data_len = len - sizeof(struct circ_reasm);
+  r->b.head_seqno = seqno;
+  return r->b.data_len;
+}
+
+int circ_reasm_add(void *buf, uint32_t sseqno, uint8_t *data, int len) {
+  struct circ_reasm *r = (struct circ_reasm *)buf;
+  uint32_t start = sseqno, end;
+  int32_t offset = sseqno - r->b.head_seqno;
+  uint8_t *writeptr;
+  int i, w_len, n;
+
+  if (offset <= 0 || offset >= r->b.data_len || len <= 0)
+    return -1;
+  if (offset + len > r->b.data_len)
+    len = r->b.data_len - offset;
+  end = sseqno + len;
+
+  /* merge with every range it overlaps or touches */
+  n = CIRC_REASM_BLOCKS;
+  for (i = 0; i < CIRC_REASM_BLOCKS; i++) {
+    if (BLOCK_EMPTY(r, i)) {
+      n--;
+    } else if (SEQ_LEQ(r->blocks[i].start, end) && SEQ_GEQ(r->blocks[i].end, start)) {
+      if (SEQ_LT(r->blocks[i].start, start)) start = r->blocks[i].start;
+      if (SEQ_GT(r->blocks[i].end, end)) end = r->blocks[i].end;
+      r->blocks[i].start = r->blocks[i].end;
+      n--;
+    }
+  }
+  if (n == CIRC_REASM_BLOCKS) {
+    /* a new range, and nowhere to keep it */
+    return -1;
+  }
+
+  get_ptr_off_1(&r->b, sseqno, len, &writeptr, &w_len);
+  memcpy(writeptr, data, w_len);
+  if (w_len != len)
+    memcpy(r->b.data_start, data + w_len, len - w_len);
+
+  n = reasm_compact(r);
+  for (i = n; i > 0; i--)
+    r->blocks[i] = r->blocks[i - 1];
+  r->blocks[0].start = start;
+  r->blocks[0].end = end;
+  return 0;
+}
+
+int circ_reasm_pull(void *buf, uint32_t seqno, uint8_t **data) {
+  struct circ_reasm *r = (struct circ_reasm *)buf;
+  int32_t offset = seqno - r->b.head_seqno;
+  uint8_t *endptr = r->b.data_start + r->b.data_len;
+  int i, len = 0;
+
+  if (offset > 0) {
+    offset = (r->b.data_head - r->b.data_start + offset) % r->b.data_len;
+    r->b.data_head = r->b.data_start + offset;
+    r->b.head_seqno = seqno;
+  }
+
+  for (i = 0; i < CIRC_REASM_BLOCKS; i++) {
+    if (BLOCK_EMPTY(r, i)) continue;
+    if (SEQ_LEQ(r->blocks[i].end, seqno)) {
+      /* all delivered */
+      r->blocks[i].start = r->blocks[i].end;
+    } else if (SEQ_LEQ(r->blocks[i].start, seqno)) {
+      len = r->blocks[i].end - seqno;
+    }
+  }
+  reasm_compact(r);
+
+  if (len == 0 || offset < 0)
+    return 0;
+  *data = r->b.data_head;
+  if (*data + len > endptr)
+    len = endptr - *data;
+  return len;
+}
+
+int circ_reasm_blocks(void *buf, uint32_t *blocks, int n) {
+  struct circ_reasm *r = (struct circ_reasm *)buf;
+  int i;
+
+  for (i = 0; i < n && i < CIRC_REASM_BLOCKS && !BLOCK_EMPTY(r, i); i++) {
+    *blocks++ = r->blocks[i].start;
+    *blocks++ = r->blocks[i].end;
+  }
+  return i;
+}
+
 #ifdef PC             
 void circ_buf_dump(void *buf) {
   struct circ_buf *b = (struct circ_buf *)buf;
@@ -24,6 +24,14 @@
 
 #include <stdint.h>
 
+struct ip_iovec;
+
+/* how many separate ranges of out-of-order data a reassembly buffer
+   can hold */
+#ifndef CIRC_REASM_BLOCKS
+#define CIRC_REASM_BLOCKS 3
+#endif
+
 int circ_buf_init(void *data, int len, uint32_t seqno);
 
 
@@ -35,6 +43,14 @@ int circ_buf_read(void *buf, uint32_t sseqno,
                   uint8_t *data, int len);
 
 
+/* point iov at len bytes of the buffer starting at sseqno, without
+ * copying them.  Since the data may wrap around the end of the buffer,
+ * iov must have room for two entries; they are chained together and
+ * the number of bytes covered is returned.
+ */
+int circ_buf_iov(void *buf, uint32_t sseqno, int len,
+                 struct ip_iovec *iov);
+
 int circ_shorten_head(void *buf, uint32_t seqno);
 
 /* read from the head of the buffer, moving the data pointer forward */
@@ -44,5 +60,28 @@ void circ_buf_dump(void *buf);
 
 uint32_t circ_get_seqno(void *buf);
 void circ_set_seqno(void *buf, uint32_t seqno);
+int circ_get_window(void *buf);
+
+/* Reassembly buffers hold segments which arrived ahead of seqno, the
+ * next byte expected, until the hole before them is filled.
+ *
+ * circ_reasm_init returns how many bytes past seqno can be held, or
+ * -1 if len is too short.
+ */
+int circ_reasm_init(void *buf, int len, uint32_t seqno);
+
+/* store data which starts after the next expected byte; returns -1 if
+   it is out of the window or there is no range left to record it. */
+int circ_reasm_add(void *buf, uint32_t sseqno, uint8_t *data, int len);
+
+/* move the next expected byte up to seqno, and point data at any
+ * stored bytes which start there.  Returns how many there are; the
+ * caller passes the seqno following them to get the rest.
+ */
+int circ_reasm_pull(void *buf, uint32_t seqno, uint8_t **data);
+
+/* copy the stored ranges, most recently extended first, as pairs of
+   start and end seqnos; returns the number of ranges. */
+int circ_reasm_blocks(void *buf, uint32_t *blocks, int n);
 
 #endif
@@ -29,8 +29,8 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
-#include "lib6lowpan/ip_malloc.h"
 #include "lib6lowpan/in_cksum.h"
 #include "lib6lowpan/6lowpan.h"
 #include "lib6lowpan/ip.h"
@@ -39,8 +39,36 @@
 #include "libtcp/circ.h"
 
 static struct tcplib_sock *conns = NULL;
+static struct tcplib_sock *conn_hash[TCPLIB_CONN_BUCKETS];
 
 #define ONE_SEGMENT(X)  ((X)->mss)
+#define NO_BUCKET       0xff
+
+enum {
+  TCP_OPT_EOL       = 0,
+  TCP_OPT_NOP       = 1,
+  TCP_OPT_SACK_PERM = 4,
+  TCP_OPT_SACK      = 5,
+};
+
+/* the most SACK blocks we report; four fill the option space */
+#define SACK_OPT_BLOCKS min(CIRC_REASM_BLOCKS, 4)
+
+/* an outgoing segment: the payload is not copied but referenced in
+   place in the tx buffer, through the last two iovecs */
+struct tcplib_seg {
+  struct ip6_packet pkt;
+  struct tcp_hdr tcph;
+  /* must follow the header, as the first iovec covers both */
+  uint8_t opts[4 + 8 * SACK_OPT_BLOCKS];
+  struct ip_iovec iov[3];
+};
+
+#if defined(PC) && defined(TCPLIB_DEBUG)
+#define tcplib_dbg(FMT, args ...) printf(FMT, ## args)
+#else
+#define tcplib_dbg(FMT, args ...)
+#endif
 
 #ifdef PC
 uint16_t alloc_local_port() {
@@ -52,6 +80,39 @@ uint16_t alloc_local_port() {
 }
 #endif
 
+/* sockets are hashed on the end of the remote address and both
+   ports; a listening socket has no remote endpoint, so its key is just
+   the local port. */
+#define CONN_KEY(RADDR, RPORT, LPORT) \
+  ((RADDR).s6_addr16[6] ^ (RADDR).s6_addr16[7] ^ (RPORT) ^ (LPORT))
+
+static uint8_t conn_bucket(uint16_t h) {
+  h ^= h >> 8;
+  h ^= h >> 4;
+  return h & (TCPLIB_CONN_BUCKETS - 1);
+}
+
+/* move the socket to the bucket of its current endpoints; this must
+   be called whenever they change. */
+static void conn_rehash(struct tcplib_sock *sock) {
+  struct tcplib_sock **prev;
+  uint8_t b = conn_bucket(CONN_KEY(sock->r_ep.sin6_addr, sock->r_ep.sin6_port,
+                                   sock->l_ep.sin6_port));
+  if (sock->hbucket == b) return;
+
+  if (sock->hbucket != NO_BUCKET) {
+    for (prev = &conn_hash[sock->hbucket]; *prev != NULL; prev = &(*prev)->hnext) {
+      if (*prev == sock) {
+        *prev = sock->hnext;
+        break;
+      }
+    }
+  }
+  sock->hnext = conn_hash[b];
+  conn_hash[b] = sock;
+  sock->hbucket = b;
+}
+
 static inline void conn_add_once(struct tcplib_sock *sock) {
   struct tcplib_sock *iter;
 
@@ -61,8 +122,10 @@ static inline void conn_add_once(struct tcplib_sock *sock) {
   if (iter == NULL) {
     sock->next = conns;
     conns = sock;
+    sock->hnext = NULL;
+    sock->hbucket = NO_BUCKET;
   }
-
+  conn_rehash(sock);
 }
 static int isInaddrAny(struct in6_addr *addr) {
   int i;
@@ -98,20 +161,32 @@ void print_headers(struct ip6_hdr *iph, struct tcp_hdr *tcph) {
 #define printf(FMT, args ...) ;
 #endif
 
+static inline int conn_local_match(struct ip6_hdr *iph, struct tcplib_sock *sock) {
+  return memcmp(iph->ip6_dst.s6_addr, sock->l_ep.sin6_addr.s6_addr, 16) == 0 ||
+    isInaddrAny(&sock->l_ep.sin6_addr);
+}
+
 static struct tcplib_sock *conn_lookup(struct ip6_hdr *iph, 
                                        struct tcp_hdr *tcph) {
   struct tcplib_sock *iter;
-  //printf("looking up conns: %p %p\n", iph, tcph);
   // print_headers(iph, tcph);
-  for (iter = conns; iter != NULL; iter = iter->next) {
-    // print_conn(iter);
-    printf("conn lport: %i\n", ntohs(iter->l_ep.sin6_port));
-    if (((memcmp(iph->ip6_dst.s6_addr, iter->l_ep.sin6_addr.s6_addr, 16) == 0) ||
-         isInaddrAny(&iter->l_ep.sin6_addr)) &&
-        tcph->dstport == iter->l_ep.sin6_port &&
-        (iter->r_ep.sin6_port == 0 ||
-         (memcmp(&iph->ip6_src, &iter->r_ep.sin6_addr, 16) == 0 &&
-          tcph->srcport == iter->r_ep.sin6_port)))
+
+  /* a connected socket takes precedence over a listening one */
+  iter = conn_hash[conn_bucket(CONN_KEY(iph->ip6_src, tcph->srcport, tcph->dstport))];
+  for (; iter != NULL; iter = iter->hnext) {
+    if (tcph->dstport == iter->l_ep.sin6_port &&
+        tcph->srcport == iter->r_ep.sin6_port &&
+        iter->r_ep.sin6_port != 0 &&
+        memcmp(&iph->ip6_src, &iter->r_ep.sin6_addr, 16) == 0 &&
+        conn_local_match(iph, iter))
+      return iter;
+  }
+
+  iter = conn_hash[conn_bucket(tcph->dstport)];
+  for (; iter != NULL; iter = iter->hnext) {
+    if (tcph->dstport == iter->l_ep.sin6_port &&
+        iter->r_ep.sin6_port == 0 &&
+        conn_local_match(iph, iter))
       return iter;
   }
   return NULL;
@@ -134,134 +209,282 @@ struct tcp_hdr *find_tcp_hdr(struct ip6_packet *msg) {
   return NULL;
 }
 
-static struct ip6_packet *get_ipmsg(int plen) {
-  int alen = sizeof(struct ip6_packet) + sizeof(struct tcp_hdr) + 
-    sizeof(struct ip_iovec) + plen;
-  char *buf = ip_malloc(alen);
-  struct ip6_packet *msg = (struct ip6_packet *)buf;
-  struct ip_iovec *iov = (struct ip_iovec *)(buf + alen - sizeof(struct ip_iovec));
+/* set up the headers of a segment carrying plen bytes of payload; the
+   caller chains the payload, if any, after the first iovec. */
+static struct tcp_hdr *init_seg(struct tcplib_seg *seg, int plen) {
+  memset(&seg->pkt, 0, sizeof(struct ip6_packet));
+  memset(&seg->tcph, 0, sizeof(struct tcp_hdr));
+  seg->pkt.ip6_hdr.ip6_nxt = IANA_TCP;
+  seg->pkt.ip6_hdr.ip6_plen = htons(sizeof(struct tcp_hdr) + plen);
 
-  if (buf == NULL) return NULL;
-  memset(msg, 0, sizeof(struct ip6_packet) + sizeof(struct tcp_hdr));
-  msg->ip6_hdr.ip6_nxt = IANA_TCP;
-  msg->ip6_hdr.ip6_plen = htons(sizeof(struct tcp_hdr) + plen);
+  seg->pkt.ip6_data = &seg->iov[0];
+  seg->iov[0].iov_next = NULL;
+  seg->iov[0].iov_len = sizeof(struct tcp_hdr);
+  seg->iov[0].iov_base = (void *)&seg->tcph;
+
+  return &seg->tcph;
+}
+
+static uint8_t *put_seqno(uint8_t *p, uint32_t seqno) {
+  *p++ = seqno >> 24;
+  *p++ = seqno >> 16;
+  *p++ = seqno >> 8;
+  *p++ = seqno;
+  return p;
+}
+
+static uint32_t get_seqno(uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
 
-  msg->ip6_data = iov;
-  iov->iov_next = NULL;
-  iov->iov_len = plen + sizeof(struct tcp_hdr);
-  iov->iov_base = (void *)(msg + 1);
+/* offer SACK in a SYN, accept it in a SYN-ACK, and afterwards report
+   the data we are holding past the ACK number */
+static void add_options(struct tcplib_sock *sock, struct tcplib_seg *seg) {
+  uint8_t *opt = seg->opts;
+  uint32_t blocks[2 * SACK_OPT_BLOCKS];
+  int i, n;
+
+  if (seg->tcph.flags & TCP_FLAG_SYN) {
+    if (!(seg->tcph.flags & TCP_FLAG_ACK) || (sock->ext_flags & TCP_SACK_OK)) {
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_SACK_PERM;
+      *opt++ = 2;
+    }
+  } else if ((sock->ext_flags & TCP_SACK_OK) && sock->rx_buf != NULL) {
+    n = circ_reasm_blocks(sock->rx_buf, blocks, SACK_OPT_BLOCKS);
+    if (n > 0) {
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_NOP;
+      *opt++ = TCP_OPT_SACK;
+      *opt++ = 2 + 8 * n;
+      for (i = 0; i < 2 * n; i++)
+        opt = put_seqno(opt, blocks[i]);
+    }
+  }
 
-  return msg;
+  n = opt - seg->opts;
+  seg->iov[0].iov_len += n;
+  seg->pkt.ip6_hdr.ip6_plen = htons(ntohs(seg->pkt.ip6_hdr.ip6_plen) + n);
 }
 
 static void __tcplib_send(struct tcplib_sock *sock,
-                          struct ip6_packet *msg) {
-  struct tcp_hdr *tcph = find_tcp_hdr(msg);
-  if (tcph == NULL) return;
-  memcpy(&msg->ip6_hdr.ip6_dst, &sock->r_ep.sin6_addr, 16);
+                          struct tcplib_seg *seg) {
+  struct tcp_hdr *tcph = &seg->tcph;
+  memcpy(&seg->pkt.ip6_hdr.ip6_dst, &sock->r_ep.sin6_addr, 16);
 
   sock->flags &= ~TCP_ACKPENDING;
   // sock->ackno = ntohl(tcph->ackno);
 
-  printf("srcprt: %hu dstprt: %hu\n", ntohs(sock->l_ep.sin6_port), 
-         ntohs(sock->r_ep.sin6_port));
+  tcplib_dbg("srcprt: %hu dstprt: %hu\n", ntohs(sock->l_ep.sin6_port), 
+             ntohs(sock->r_ep.sin6_port));
 
+  add_options(sock, seg);
   tcph->srcport = sock->l_ep.sin6_port;
   tcph->dstport = sock->r_ep.sin6_port;
-  tcph->offset = sizeof(struct tcp_hdr) * 4;
+  tcph->offset = seg->iov[0].iov_len * 4;
   tcph->window = htons(sock->my_wind);
   tcph->chksum = 0;
   tcph->urgent = 0;
 
-  tcplib_send_out(msg, tcph);
+  tcplib_send_out(&seg->pkt, tcph);
 }
 
 static void tcplib_send_ack(struct tcplib_sock *sock, int fin_seqno, uint8_t flags) {
-  struct ip6_packet *msg = get_ipmsg(0);
-  printf("sending ACK\n");
-      
-  if (msg != NULL) {
-    struct tcp_hdr *tcp_rep = (struct tcp_hdr *)(msg + 1);
-    tcp_rep->flags = flags;
+  struct tcplib_seg seg;
+  struct tcp_hdr *tcp_rep = init_seg(&seg, 0);
+
+  tcp_rep->flags = flags;
+  // a bare ACK goes after the data sent so far, not all that is queued
+  tcp_rep->seqno = htonl((flags & (TCP_FLAG_SYN | TCP_FLAG_FIN | TCP_FLAG_RST)) ?
+                         sock->seqno : sock->snd_nxt);
+  tcp_rep->ackno = htonl(sock->ackno +
+                         (fin_seqno ? 1 : 0));
+  tcplib_dbg("sending ACK seqno: %u ackno: %u\n", ntohl(tcp_rep->seqno), ntohl(tcp_rep->ackno));
+  __tcplib_send(sock, &seg);
+}
 
+static void tcplib_send_rst(struct ip6_hdr *iph, struct tcp_hdr *tcph) {
+  struct tcplib_seg seg;
+  struct tcp_hdr *tcp_rep = init_seg(&seg, 0);
 
-    tcp_rep->seqno = htonl(sock->seqno);
-    tcp_rep->ackno = htonl(sock->ackno +
-                           (fin_seqno ? 1 : 0));
-    printf("sending ACK seqno: %u ackno: %u\n", ntohl(tcp_rep->seqno), ntohl(tcp_rep->ackno));
-    __tcplib_send(sock, msg);
-    ip_free(msg);
-  } else {
-    printf("Could not send ack-- no memory!\n");
+  memcpy(&seg.pkt.ip6_hdr.ip6_dst, &iph->ip6_src, 16);
+
+  tcp_rep->flags = TCP_FLAG_RST | TCP_FLAG_ACK;
+
+  tcp_rep->ackno = htonl(ntohl(tcph->seqno) + 1);
+  tcp_rep->seqno = tcph->ackno;
+
+  tcp_rep->srcport = tcph->dstport;
+  tcp_rep->dstport = tcph->srcport;
+  tcp_rep->offset = sizeof(struct tcp_hdr) * 4;
+
+  tcplib_send_out(&seg.pkt, tcp_rep);
+}
+
+/* send one segment of the tx buffer, starting at sseqno */
+static void tcplib_send_seg(struct tcplib_sock *sock, uint32_t sseqno, int seg_size) {
+  struct tcplib_seg seg;
+  struct tcp_hdr *tcph = init_seg(&seg, seg_size);
+
+  tcph->flags = TCP_FLAG_ACK;
+  tcph->seqno = htonl(sseqno);
+  tcph->ackno = htonl(sock->ackno);
+
+  tcplib_dbg("tcplib_output: seqno: %u ackno: %u len: %i headno: %u\n",
+             ntohl(tcph->seqno), ntohl(tcph->ackno), seg_size,
+             circ_get_seqno(sock->tx_buf));
+
+  // send the data straight out of the tx buffer
+  if (seg_size != circ_buf_iov(sock->tx_buf, sseqno, seg_size, &seg.iov[1])) {
+    tcplib_dbg("WARN: circ could not read!\n");
   }
+  seg.iov[0].iov_next = &seg.iov[1];
+  __tcplib_send(sock, &seg);
 }
 
-static void tcplib_send_rst(struct ip6_hdr *iph, struct tcp_hdr *tcph) {
-  struct ip6_packet *msg = get_ipmsg(0);
-      
-  if (msg != NULL) {
-    struct tcp_hdr *tcp_rep = (struct tcp_hdr *)(msg + 1);
-
-    memcpy(&msg->ip6_hdr.ip6_dst, &iph->ip6_src, 16);
-
-    tcp_rep->flags = TCP_FLAG_RST | TCP_FLAG_ACK;
-
-    tcp_rep->ackno = htonl(ntohl(tcph->seqno) + 1);
-    tcp_rep->seqno = tcph->ackno;;
-
-    tcp_rep->srcport = tcph->dstport;
-    tcp_rep->dstport = tcph->srcport;
-    tcp_rep->offset = sizeof(struct tcp_hdr) * 4;
-    tcp_rep->window = 0;
-    tcp_rep->chksum = 0;
-    tcp_rep->urgent = 0;
-
-    tcplib_send_out(msg, tcp_rep);
-
-    ip_free(msg);
-    
-  }  
-}
-
-/* send all the data in the tx buffer, starting at sseqno */
-static int tcplib_output(struct tcplib_sock *sock, uint32_t sseqno) {
-  // the output size is the minimum of the advertised window and the
-  // conjestion window.  of course, if we have less data we send even
-  // less.
-  int seg_size = min(sock->seqno - sseqno, sock->r_wind);
-  printf("r_wind: %i\n", sock->r_wind);
-  seg_size = min(seg_size, sock->cwnd);
-  while (seg_size > 0 && sock->seqno > sseqno) {
-    // printf("sending seg_size: %i\n", seg_size);
-    struct ip6_packet *msg = get_ipmsg(seg_size);
-    struct tcp_hdr *tcph;
-    uint8_t *data;
-    if (msg == NULL) return -1;
-    tcph = (struct tcp_hdr *)(msg + 1);
-    data = (uint8_t *)(tcph + 1);
-
-    tcph->flags = TCP_FLAG_ACK;
-    tcph->seqno = htonl(sseqno);
-    tcph->ackno = htonl(sock->ackno);
-
-    printf("tcplib_output: seqno: %u ackno: %u len: %i headno: %u\n",
-           ntohl(tcph->seqno), ntohl(tcph->ackno), seg_size,
-           circ_get_seqno(sock->tx_buf));
-
-    if (seg_size != circ_buf_read(sock->tx_buf, sseqno, data, seg_size)) {
-      printf("WARN: circ could not read!\n");
+/* send the data in the tx buffer which has not been sent yet, as far
+ * as the minimum of the advertised window and the congestion window
+ * allow.  extra lets limited transmit go beyond the congestion window.
+ */
+static void tcplib_output(struct tcplib_sock *sock, uint16_t extra) {
+  uint32_t head = circ_get_seqno(sock->tx_buf);
+  uint32_t wind = min((uint32_t)sock->cwnd + extra, sock->r_wind);
+  uint32_t flight;
+  int seg_size;
+
+  tcplib_dbg("r_wind: %i\n", sock->r_wind);
+  while (SEQ_LT(sock->snd_nxt, sock->seqno)) {
+    flight = sock->snd_nxt - head;
+    if (flight >= wind) break;
+    seg_size = min(sock->seqno - sock->snd_nxt, sock->mss);
+    // don't chop the data into small segments to fill the window up
+    if (flight + seg_size > wind) {
+      if (flight > 0) break;
+      seg_size = wind;
     }
-    __tcplib_send(sock, msg);
-    ip_free(msg);
+    tcplib_send_seg(sock, sock->snd_nxt, seg_size);
+    sock->snd_nxt += seg_size;
+  }
+}
 
-    sseqno += seg_size;
-    seg_size = min(sock->seqno - sseqno, sock->mss);
+/* retransmit a segment from the first hole at or after sseqno in the
+ * data the other end has SACKed.  Unless forced, only holes below
+ * SACKed data are taken as lost.
+ */
+static int tcplib_retransmit(struct tcplib_sock *sock, uint32_t sseqno, int force) {
+  uint32_t end = sock->snd_nxt;
+  int i, seg_size;
+
+  if (SEQ_LT(sseqno, circ_get_seqno(sock->tx_buf)))
+    sseqno = circ_get_seqno(sock->tx_buf);
+
+  for (i = 0; i < TCPLIB_SACK_BLOCKS; i++) {
+    struct tcplib_sack *b = &sock->sacked[i];
+    if (b->start == b->end) break;
+    if (SEQ_GT(b->start, sseqno)) {
+      end = b->start;
+      force = 1;
+      break;
+    }
+    if (SEQ_GT(b->end, sseqno))
+      sseqno = b->end;
+  }
+  if (!force || SEQ_GEQ(sseqno, end))
+    return 0;
+
+  seg_size = min(end - sseqno, sock->mss);
+  tcplib_send_seg(sock, sseqno, seg_size);
+  sock->high_rxt = sseqno + seg_size;
+  return 1;
+}
+
+/* record a range the other end has SACKed, merging it with those we
+   know about; if there are too many the highest is forgotten. */
+static void sack_update(struct tcplib_sock *sock, uint32_t start, uint32_t end) {
+  struct tcplib_sack tmp[TCPLIB_SACK_BLOCKS + 1];
+  uint32_t head = circ_get_seqno(sock->tx_buf);
+  int i, n = 0;
+
+  if (!SEQ_LT(start, end) || !SEQ_GT(end, head) || SEQ_GT(end, sock->seqno))
+    return;
+  if (SEQ_LT(start, head))
+    start = head;
+
+  for (i = 0; i < TCPLIB_SACK_BLOCKS; i++) {
+    struct tcplib_sack *b = &sock->sacked[i];
+    if (b->start == b->end) break;
+    if (SEQ_LEQ(b->start, end) && SEQ_GEQ(b->end, start)) {
+      if (SEQ_LT(b->start, start)) start = b->start;
+      if (SEQ_GT(b->end, end)) end = b->end;
+    } else {
+      tmp[n++] = *b;
+    }
+  }
+  for (i = n; i > 0 && SEQ_GT(tmp[i - 1].start, start); i--)
+    tmp[i] = tmp[i - 1];
+  tmp[i].start = start;
+  tmp[i].end = end;
+  n++;
+
+  memset(sock->sacked, 0, sizeof(sock->sacked));
+  memcpy(sock->sacked, tmp, min(n, TCPLIB_SACK_BLOCKS) * sizeof(struct tcplib_sack));
+}
+
+/* forget the SACKed ranges which have now been ACKed */
+static void sack_trim(struct tcplib_sock *sock, uint32_t ackno) {
+  int i, n = 0;
+
+  for (i = 0; i < TCPLIB_SACK_BLOCKS; i++) {
+    struct tcplib_sack b = sock->sacked[i];
+    if (b.start == b.end) break;
+    if (SEQ_LEQ(b.end, ackno)) continue;
+    if (SEQ_LT(b.start, ackno)) b.start = ackno;
+    sock->sacked[n++] = b;
+  }
+  for (i = n; i < TCPLIB_SACK_BLOCKS; i++)
+    sock->sacked[i].start = sock->sacked[i].end = 0;
+}
+
+static void process_options(struct tcplib_sock *sock, struct tcp_hdr *tcph, int hdr_len) {
+  uint8_t *opt = (uint8_t *)(tcph + 1);
+  uint8_t *end = (uint8_t *)tcph + hdr_len;
+  int i;
+
+  while (opt < end && *opt != TCP_OPT_EOL) {
+    if (*opt == TCP_OPT_NOP) {
+      opt++;
+      continue;
+    }
+    if (opt + 2 > end || opt[1] < 2 || opt + opt[1] > end)
+      break;
+
+    if (opt[0] == TCP_OPT_SACK_PERM && (tcph->flags & TCP_FLAG_SYN)) {
+      sock->ext_flags |= TCP_SACK_OK;
+    } else if (opt[0] == TCP_OPT_SACK && (sock->ext_flags & TCP_SACK_OK)) {
+      for (i = 2; i + 8 <= opt[1]; i += 8)
+        sack_update(sock, get_seqno(opt + i), get_seqno(opt + i + 4));
+    }
+    opt += opt[1];
+  }
+}
+
+/* set up the reassembly buffer once we know the first seqno to expect,
+   and offer the other end as much window as it holds. */
+static void init_rx(struct tcplib_sock *sock) {
+  int wind;
+
+  if (sock->rx_buf == NULL) return;
+  wind = circ_reasm_init(sock->rx_buf, sock->rx_buf_len, sock->ackno);
+  if (wind < 0) {
+    sock->rx_buf = NULL;
+  } else if (wind > sock->my_wind) {
+    sock->my_wind = wind;
   }
-  return 0;
 }
 
 int tcplib_init_sock(struct tcplib_sock *sock) {
-  memset(sock, 0, sizeof(struct tcplib_sock) - sizeof(struct tcplib_sock *));
+  memset(sock, 0, offsetof(struct tcplib_sock, next));
   sock->mss = 200;
   sock->my_wind = 200;
   sock->cwnd = ONE_SEGMENT(sock);
@@ -272,29 +495,129 @@ int tcplib_init_sock(struct tcplib_sock *sock) {
 
 /* called when a new segment arrives. */
 /* deliver as much data to the app as possible, and update the ack
- * number of the socket to reflect how much was delivered 
+ * number of the socket to reflect how much was delivered.  The
+ * segment starts at the ack number, and may have filled the hole
+ * before data held in the reassembly buffer.
  */
-static int receive_data(struct tcplib_sock *sock, struct tcp_hdr *tcph, int len) {
-  uint8_t *ptr;
-  int payload_len;
-
-  ptr = ((uint8_t *)tcph) + (tcph->offset / 4);
-  payload_len = len - (tcph->offset / 4);
-  sock->ackno = ntohl(tcph->seqno) + payload_len;
+static int receive_data(struct tcplib_sock *sock, uint8_t *ptr, int payload_len) {
+  int len, rc = payload_len;
 
+  sock->ackno += payload_len;
   if (payload_len > 0) {
     tcplib_extern_recv(sock, ptr, payload_len);
+
+    while (sock->rx_buf != NULL &&
+           (len = circ_reasm_pull(sock->rx_buf, sock->ackno, &ptr)) > 0) {
+      sock->ackno += len;
+      rc += len;
+      tcplib_extern_recv(sock, ptr, len);
+    }
   }
-  return payload_len;
+  return rc;
 }
 
 static void reset_ssthresh(struct tcplib_sock *conn) {
-  uint16_t new_ssthresh = min(conn->cwnd, conn->r_wind) / 2;
+  // half of the data in flight
+  uint16_t new_ssthresh = (conn->snd_nxt - circ_get_seqno(conn->tx_buf)) / 2;
   if (new_ssthresh < 2 * ONE_SEGMENT(conn))
     new_ssthresh = 2 * ONE_SEGMENT(conn);
   conn->ssthresh = new_ssthresh;
 }
 
+static void cwnd_add(struct tcplib_sock *conn, uint16_t incr) {
+  if (conn->cwnd < 0xffff - incr)
+    conn->cwnd += incr;
+  else
+    conn->cwnd = 0xffff;
+}
+
+/* the ACK number has moved forward to ackno */
+static void ack_new_data(struct tcplib_sock *conn, uint32_t ackno) {
+  uint32_t acked = ackno - circ_get_seqno(conn->tx_buf);
+
+  // the connection is making progress
+  conn->retxcnt = 0;
+  // reset the duplicate ack counter
+  UNSET_ACK_COUNT(conn->flags);
+  // truncates the ack buffer 
+  circ_shorten_head(conn->tx_buf, ackno);
+  // the other end may have had data we sent before a timeout
+  if (SEQ_LT(conn->snd_nxt, ackno))
+    conn->snd_nxt = ackno;
+  sack_trim(conn, ackno);
+
+  if (conn->ext_flags & TCP_RECOVERY) {
+    if (SEQ_GEQ(ackno, conn->recover)) {
+      // everything sent before the loss was detected has arrived
+      conn->ext_flags &= ~TCP_RECOVERY;
+      conn->cwnd = conn->ssthresh;
+    } else {
+      // a partial ACK: the segment at ackno was lost as well.
+      // deflate the window by what has left the network.
+      conn->cwnd = (conn->cwnd > acked ? conn->cwnd - acked : 0) + ONE_SEGMENT(conn);
+      if (SEQ_GEQ(ackno, conn->high_rxt))
+        tcplib_retransmit(conn, ackno, 1);
+    }
+  } else if (conn->cwnd <= conn->ssthresh) {
+    // in slow start; increase the cwnd by one segment
+    cwnd_add(conn, ONE_SEGMENT(conn));
+  } else {
+    // in congestion avoidance
+    cwnd_add(conn, (ONE_SEGMENT(conn) * ONE_SEGMENT(conn)) / conn->cwnd);
+  }
+}
+
+/* a duplicate ACK: the segment at the ACK number may have been lost,
+ * while a later one has arrived.
+ *  - before there are enough of them, send new data to keep the ACKs
+ *    coming (limited transmit)
+ *  - then retransmit it and enter fast recovery.  Usually that takes
+ *    TCPLIB_DUPTHRESH of them, but with the small windows of a mote
+ *    that many segments may not be in flight, so when nothing new can
+ *    be sent one less than there are in flight will do (early
+ *    retransmit)
+ *  - during recovery, each one lets another segment go out: the next
+ *    hole in the SACKed data, or new data.
+ */
+static void ack_duplicate(struct tcplib_sock *conn) {
+  uint32_t head = circ_get_seqno(conn->tx_buf);
+  uint32_t snd_nxt = conn->snd_nxt;
+  int count, thresh;
+
+  if (GET_ACK_COUNT(conn->flags) < TCPLIB_DUPTHRESH)
+    INCR_ACK_COUNT(conn->flags);
+  count = GET_ACK_COUNT(conn->flags);
+
+  if (conn->ext_flags & TCP_RECOVERY) {
+    cwnd_add(conn, ONE_SEGMENT(conn));
+    tcplib_retransmit(conn, conn->high_rxt, 0);
+    tcplib_output(conn, 0);
+    return;
+  }
+
+  if (count < TCPLIB_DUPTHRESH)
+    tcplib_output(conn, count * ONE_SEGMENT(conn));
+
+  thresh = TCPLIB_DUPTHRESH;
+  if (conn->snd_nxt == snd_nxt) {
+    int segs = (conn->snd_nxt - head + ONE_SEGMENT(conn) - 1) / ONE_SEGMENT(conn);
+    if (segs - 1 < thresh)
+      thresh = segs > 1 ? segs - 1 : 1;
+  }
+
+  if (count >= thresh) {
+    tcplib_dbg("detected multiple duplicate ACKs-- doing fast retransmit [%u, %u]\n",
+               head, conn->snd_nxt);
+    reset_ssthresh(conn);
+    conn->recover = conn->snd_nxt;
+    conn->ext_flags |= TCP_RECOVERY;
+    tcplib_retransmit(conn, head, 1);
+    conn->cwnd = conn->ssthresh + count * ONE_SEGMENT(conn);
+    if (conn->state == TCP_ESTABLISHED)
+      conn->timer.retx = TCPLIB_RTO;
+  }
+}
+
 int tcplib_process(struct ip6_hdr *iph, void *payload) {
   int rc = 0;
   struct tcp_hdr *tcph;
@@ -302,11 +625,13 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
   //   uint8_t *ptr;
   int len = ntohs(iph->ip6_plen) + sizeof(struct ip6_hdr);
   int payload_len;
+  uint8_t *data;
   uint32_t hdr_seqno, hdr_ackno;
   int connect_done = 0;
 
   tcph = (struct tcp_hdr *)payload;
   payload_len = len - sizeof(struct ip6_hdr) - (tcph->offset / 4);
+  data = (uint8_t *)tcph + (tcph->offset / 4);
 
   /* if there's no local */
   this_conn = conn_lookup(iph, tcph);
@@ -318,7 +643,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
     if (tcph->flags & TCP_FLAG_RST) {
       /* Really hose this connection if we get a RST packet.
        * still TODO: RST generation for unbound ports */
-      printf("connection reset by peer\n");
+      tcplib_dbg("connection reset by peer\n");
           
       tcplib_extern_closedone(this_conn);
       // tcplib_init_sock(this_conn);
@@ -328,7 +653,12 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
     // TODO : this should be after we detect out-of-sequence ACK
     // numbers!
     this_conn->r_wind = ntohs(tcph->window);
-    printf("State: %i\n", this_conn->state);
+    // a listening socket has no buffers yet; the accepted one gets
+    // the options of the SYN below.
+    if (this_conn->state != TCP_LISTEN && this_conn->state != TCP_CLOSED &&
+        payload_len >= 0 && tcph->offset / 4 > sizeof(struct tcp_hdr))
+      process_options(this_conn, tcph, tcph->offset / 4);
+    tcplib_dbg("State: %i\n", this_conn->state);
 
     switch (this_conn->state) {
     case TCP_LAST_ACK:
@@ -340,7 +670,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
         break;
       }
     case TCP_FIN_WAIT_1:
-      printf("IN FIN_WAIT_1, %i\n", (tcph->flags & TCP_FLAG_FIN));
+      tcplib_dbg("IN FIN_WAIT_1, %i\n", (tcph->flags & TCP_FLAG_FIN));
       if (tcph->flags & TCP_FLAG_ACK && 
           hdr_ackno == this_conn->seqno + 1) {
         if (tcph->flags & TCP_FLAG_FIN) {
@@ -373,6 +703,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
         // send the ACK this_conn
         this_conn->state = TCP_ESTABLISHED;
         this_conn->ackno = hdr_seqno + 1;
+        init_rx(this_conn);
         connect_done = 1;
         // skip the LISTEN processing
         // this will also generate an ACK
@@ -382,7 +713,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
         this_conn->state = TCP_SYN_RCVD;
         connect_done = 1;
       } else {
-        printf("sending RST on bad data in state SYN_SENT\n");
+        tcplib_dbg("sending RST on bad data in state SYN_SENT\n");
         // we'll just let the timeout eventually close the socket, though
         tcplib_send_rst(iph, tcph);
         break;
@@ -412,10 +743,16 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
           }
           memcpy(&new_sock->l_ep.sin6_addr, &iph->ip6_dst, 16);
           new_sock->l_ep.sin6_port = tcph->dstport;
+          conn_rehash(new_sock);
 
           new_sock->ackno = hdr_seqno + 1;
+          // our SYN will be 0xcafebabe + 1
           circ_buf_init(new_sock->tx_buf, new_sock->tx_buf_len,
-                        0xcafebabe + 1);
+                        0xcafebabe + 2);
+          init_rx(new_sock);
+          new_sock->ext_flags = 0;
+          if (payload_len >= 0 && tcph->offset / 4 > sizeof(struct tcp_hdr))
+            process_options(new_sock, tcph, tcph->offset / 4);
         } else {
           /* recieved a SYN retransmission. */
           new_sock = this_conn;
@@ -426,6 +763,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
           new_sock->state = TCP_SYN_RCVD;
           tcplib_send_ack(new_sock, 0, TCP_FLAG_ACK | TCP_FLAG_SYN);
           new_sock->seqno++;
+          new_sock->snd_nxt = new_sock->seqno;
         } else {
           memset(&this_conn->r_ep, 0, sizeof(struct sockaddr_in6));
         }
@@ -455,72 +793,61 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
 
 
         // receive side sequence check and add data
-        printf("seqno: %u ackno: %u\n", hdr_seqno, hdr_ackno);
-        printf("conn seqno: %u ackno: %u\n", this_conn->seqno, this_conn->ackno);
+        tcplib_dbg("seqno: %u ackno: %u\n", hdr_seqno, hdr_ackno);
+        tcplib_dbg("conn seqno: %u ackno: %u\n", this_conn->seqno, this_conn->ackno);
 
 
         // send side recieve sequence check and congestion window updates.
-        if (hdr_ackno > circ_get_seqno(this_conn->tx_buf)) {
+        if (SEQ_GT(hdr_ackno, circ_get_seqno(this_conn->tx_buf)) &&
+            SEQ_LEQ(hdr_ackno, this_conn->seqno + 1)) {
           // new data is being ACKed
           // or we haven't sent anything new
-          if (this_conn->cwnd <= this_conn->ssthresh) {
-            // in slow start; increase the cwnd by one segment
-            this_conn->cwnd += ONE_SEGMENT(this_conn);
-            // printf("in slow start\n");
-          } else {
-            // in congestion avoidance
-            this_conn->cwnd += (ONE_SEGMENT(this_conn) * ONE_SEGMENT(this_conn)) / this_conn->cwnd;
-            // printf("in congestion avoidence\n");
-          }
-          // printf("ACK new data: cwnd: %i ssthresh: %i\n", this_conn->cwnd, this_conn->ssthresh);
-          // reset the duplicate ack counter
-          UNSET_ACK_COUNT(this_conn->flags);
-          // truncates the ack buffer 
-          circ_shorten_head(this_conn->tx_buf, hdr_ackno);
-          // printf("ack_count: %i\n", GET_ACK_COUNT(this_conn->flags));
+          ack_new_data(this_conn, hdr_ackno);
 
           if (this_conn->seqno == hdr_ackno) {
             tcplib_extern_acked(this_conn);
           }
-        } else if (this_conn->seqno > circ_get_seqno(this_conn->tx_buf)) {
+          // the window has moved; send what the app has queued since
+          if (this_conn->state == TCP_ESTABLISHED ||
+              this_conn->state == TCP_FIN_WAIT_1)
+            tcplib_output(this_conn, 0);
+          if (this_conn->state == TCP_ESTABLISHED)
+            this_conn->timer.retx = TCPLIB_RTO;
+        } else if (hdr_ackno == circ_get_seqno(this_conn->tx_buf) &&
+                   SEQ_GT(this_conn->snd_nxt, hdr_ackno) &&
+                   payload_len == 0 &&
+                   !(tcph->flags & (TCP_FLAG_SYN | TCP_FLAG_FIN))) {
           // this is a duplicate ACK
-          //  - increase the counter of the number of duplicate ACKs
-          //  - if we get to three duplicate ACK's, start resending at
-          //    the ACK number because this probably means we lost a segment
-
-          INCR_ACK_COUNT(this_conn->flags);
-          // printf("ack_count: %i\n", GET_ACK_COUNT(this_conn->flags));
-          // printf("dup ack count: %i\n", GET_ACK_COUNT(this_conn->flags));
-          // a "dup ack count" of 2 is really 3 total acks because we start with zero
-          if (GET_ACK_COUNT(this_conn->flags) == 2) {
-            UNSET_ACK_COUNT(this_conn->flags);
-            printf("detected multiple duplicate ACKs-- doing fast retransmit [%u, %u]\n",
-                   circ_get_seqno(this_conn->tx_buf),
-                   this_conn->seqno);
-
-            // this is our detection of a "duplicate ack" event.
-            // we are going to reset ssthresh and retransmit the data.
-            reset_ssthresh(this_conn);
-            tcplib_output(this_conn, circ_get_seqno(this_conn->tx_buf));
-            this_conn->timer.retx = 6;
-            
-          }
+          ack_duplicate(this_conn);
+        }
+
+        // a retransmission may overlap data we already have
+        if (SEQ_LT(hdr_seqno, this_conn->ackno) &&
+            SEQ_GT(hdr_seqno + payload_len, this_conn->ackno)) {
+          data += this_conn->ackno - hdr_seqno;
+          payload_len -= this_conn->ackno - hdr_seqno;
+          hdr_seqno = this_conn->ackno;
         }
 
         if (hdr_seqno != this_conn->ackno) {
-          printf("==> received forward segment\n");
-          if ((hdr_seqno > this_conn->ackno + this_conn->my_wind) ||
-              (hdr_seqno < this_conn->ackno - this_conn->my_wind)) {
+          tcplib_dbg("==> received forward segment\n");
+          if (SEQ_GT(hdr_seqno, this_conn->ackno + this_conn->my_wind) ||
+              SEQ_LT(hdr_seqno, this_conn->ackno - this_conn->my_wind)) {
             // send a RST on really wild data 
             tcplib_send_rst(iph, tcph);
-          } else {
+          } else if (payload_len > 0 || (tcph->flags & TCP_FLAG_FIN)) {
+            // hold on to data past a hole, and tell the other end
+            // about it with a duplicate ACK
+            if (payload_len > 0 && SEQ_GT(hdr_seqno, this_conn->ackno) &&
+                this_conn->rx_buf != NULL)
+              circ_reasm_add(this_conn->rx_buf, hdr_seqno, data, payload_len);
             tcplib_send_ack(this_conn, 0, TCP_FLAG_ACK);
             this_conn->flags |= TCP_ACKSENT;
           }
         } else { // (hdr_seqno == this_conn->ackno) {
-          printf("receive data [%li]\n", len - sizeof(struct ip6_hdr));
+          tcplib_dbg("receive data [%i]\n", payload_len);
 
-          if (receive_data(this_conn, tcph, len - sizeof(struct ip6_hdr)) > 0 &&
+          if (receive_data(this_conn, data, payload_len) > 0 &&
               this_conn->flags & TCP_ACKSENT) {
             this_conn->flags &= ~TCP_ACKSENT;
             tcplib_send_ack(this_conn, 0, TCP_FLAG_ACK);
@@ -529,7 +856,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
 
         // reset the retransmission timer
         if (this_conn->timer.retx == 0)
-          this_conn->timer.retx = 6;
+          this_conn->timer.retx = TCPLIB_RTO;
       }
 
       if (connect_done && !(this_conn->flags & TCP_CONNECTDONE)) {
@@ -559,7 +886,7 @@ int tcplib_process(struct ip6_hdr *iph, void *payload) {
   } else {
     /* this_conn was NULL */
     /* interestingly, TCP sends a RST on this condition, not an ICMP error.  go figure. */
-    printf("sending rst on missing connection\n");
+    tcplib_dbg("sending rst on missing connection\n");
     tcplib_send_rst(iph, tcph);
 
   }
@@ -576,6 +903,7 @@ int tcplib_bind(struct tcplib_sock *sock,
     return -1;
   
   memcpy(&sock->l_ep, addr, sizeof(struct sockaddr_in6));
+  conn_rehash(sock);
   /* passive open */
   sock->state = TCP_LISTEN;
   return 0;
@@ -604,11 +932,14 @@ int tcplib_connect(struct tcplib_sock *sock,
 
   sock->ackno = 0;
   sock->seqno = 0xcafebabe;
+  sock->ext_flags = 0;
   memcpy(&sock->r_ep, serv_addr, sizeof(struct sockaddr_in6));
+  conn_rehash(sock);
   tcplib_send_ack(sock, 0, TCP_FLAG_SYN);
   sock->state = TCP_SYN_SENT;
   sock->seqno++;
-  sock->timer.retx = 6;
+  sock->snd_nxt = sock->seqno;
+  sock->timer.retx = TCPLIB_RTO;
 
   return 0;
 }
@@ -618,22 +949,18 @@ int tcplib_send(struct tcplib_sock *sock, void *data, int len) {
   /* have enough tx buffer left? */
   if (sock->state != TCP_ESTABLISHED)
     return -1;
-  if (sock->seqno - circ_get_seqno(sock->tx_buf) + len > sock->tx_buf_len) // circ_get_window(sock->tx_buf))
+  if (sock->seqno - circ_get_seqno(sock->tx_buf) + len > circ_get_window(sock->tx_buf))
     return -1;
   if (circ_buf_write(sock->tx_buf, sock->seqno, data, len) < 0)
     return -1;
 
   sock->seqno += len;
-  // printf("tcplib_output from send\n");
-  // tcplib_output(sock, sock->seqno - len);
 
   // this will let multiple calls to send() get combined into a single packet
-  // the data will be sent out next time the timer fires
-  sock->timer.retx = 1;
-  
-  // 3 seconds
-  //if (sock->timer.retx == 0)
-  //sock->timer.retx = 6;
+  // the data will be sent out next time the timer fires.  If data is
+  // already in flight, the ACKs for it will clock this out instead.
+  if (sock->snd_nxt == circ_get_seqno(sock->tx_buf))
+    sock->timer.retx = 1;
 
   return 0;
 }
@@ -643,22 +970,33 @@ void tcplib_retx_expire(struct tcplib_sock *sock) {
   sock->retxcnt++;
   switch (sock->state) {
   case TCP_ESTABLISHED:
-    if (circ_get_seqno(sock->tx_buf) != sock->seqno) {
-      printf("retransmitting [%u, %u]\n", circ_get_seqno(sock->tx_buf),
-             sock->seqno);
+    if (circ_get_seqno(sock->tx_buf) != sock->snd_nxt) {
+      tcplib_dbg("retransmitting [%u, %u]\n", circ_get_seqno(sock->tx_buf),
+                 sock->snd_nxt);
       reset_ssthresh(sock);
-      // restart slow start
+      // restart slow start from the ACK number, and forget what the
+      // other end told us it has: it may have dropped it.
       sock->cwnd = ONE_SEGMENT(sock);
-      // printf("tcplib_output from timer\n");
-      tcplib_output(sock, circ_get_seqno(sock->tx_buf));
-      sock->timer.retx = 6;
+      sock->snd_nxt = circ_get_seqno(sock->tx_buf);
+      sock->ext_flags &= ~TCP_RECOVERY;
+      UNSET_ACK_COUNT(sock->flags);
+      memset(sock->sacked, 0, sizeof(sock->sacked));
+      tcplib_output(sock, 0);
+      sock->timer.retx = TCPLIB_RTO;
     } else {
+      // nothing in flight; send what has been queued
       sock->retxcnt--;
+      tcplib_output(sock, 0);
+      if (sock->snd_nxt != circ_get_seqno(sock->tx_buf))
+        sock->timer.retx = TCPLIB_RTO;
     }
     break;
   case TCP_SYN_SENT:
+    // the SYN is the byte before the first one of data
+    sock->seqno--;
     tcplib_send_ack(sock, 0, TCP_FLAG_SYN);
-    sock->timer.retx = 6;
+    sock->seqno++;
+    sock->timer.retx = TCPLIB_RTO;
     break;
   case TCP_LAST_ACK:
   case TCP_FIN_WAIT_1:
@@ -700,6 +1038,7 @@ int tcplib_abort(struct tcplib_sock *sock) {
     tcplib_send_ack(sock, 0, TCP_FLAG_RST);
     memset(&sock->l_ep, 0, sizeof(struct sockaddr_in6));
     memset(&sock->r_ep, 0, sizeof(struct sockaddr_in6));
+    conn_rehash(sock);
     sock->state = TCP_CLOSED;
   }
   return 0;
@@ -712,7 +1051,7 @@ int tcplib_close(struct tcplib_sock *sock) {
     /* passive close */
   case TCP_CLOSE_WAIT:
     tcplib_send_ack(sock, 1, TCP_FLAG_ACK | TCP_FLAG_FIN);
-    sock->timer.retx = 6;
+    sock->timer.retx = TCPLIB_RTO;
     sock->state = TCP_LAST_ACK;
     break;
     /* active close */
@@ -33,6 +33,13 @@
 #include <lib6lowpan/ip.h>
 
 #define min(X,Y) (((X) > (Y)) ? (Y) : (X))
+
+/* comparisons of sequence numbers which survive wrapping around */
+#define SEQ_LT(X,Y)  ((int32_t)((X) - (Y)) < 0)
+#define SEQ_LEQ(X,Y) ((int32_t)((X) - (Y)) <= 0)
+#define SEQ_GT(X,Y)  ((int32_t)((X) - (Y)) > 0)
+#define SEQ_GEQ(X,Y) ((int32_t)((X) - (Y)) >= 0)
+
 #ifndef PC
 #define printf(X, args ...) dbg("stdout", X, ## args)
 #define fprintf(X, Y, args ...) dbg("fprintf", Y, ## args)
@@ -60,20 +67,57 @@ enum {
   TCP_ACKSENT     = 0x80,
 };
 
+/* ext_flags */
+enum {
+  /* the other end takes SACK options */
+  TCP_SACK_OK     = 0x1,
+  /* recovering from a loss detected by duplicate ACKs */
+  TCP_RECOVERY    = 0x2,
+};
+
 enum {
   /* how many timer tics to stay in TIME_WAIT */
   TCPLIB_TIMEWAIT_LEN = 1,
   TCPLIB_2MSL = 4,
   /* how many un-acked retransmissions before we give up the connection */
   TCPLIB_GIVEUP = 6,
+  /* how many timer tics before retransmitting un-acked data */
+  TCPLIB_RTO = 6,
+  /* how many duplicate ACKs signal a lost segment */
+  TCPLIB_DUPTHRESH = 3,
 };
 
+/* how many ranges of SACKed data the sender remembers */
+#ifndef TCPLIB_SACK_BLOCKS
+#ifdef PC
+#define TCPLIB_SACK_BLOCKS 4
+#else
+#define TCPLIB_SACK_BLOCKS 2
+#endif
+#endif
+
+/* connections are found by hashing their four-tuple into one of this
+   many buckets; it must be a power of two. */
+#ifndef TCPLIB_CONN_BUCKETS
+#ifdef PC
+#define TCPLIB_CONN_BUCKETS 64
+#else
+#define TCPLIB_CONN_BUCKETS 8
+#endif
+#endif
+
 #define GET_ACK_COUNT(X)    (((X) & TCP_DUPACKS) >> TCP_DUPACKS_OFF)
 #define UNSET_ACK_COUNT(X)  ((X) &= ~TCP_DUPACKS)
 #define INCR_ACK_COUNT(X)   ((X) += 1 << TCP_DUPACKS_OFF)
 
+struct tcplib_sack {
+  uint32_t start;
+  uint32_t end;
+};
+
 struct tcplib_sock {
   uint8_t flags;
+  uint8_t ext_flags;
   
   /* local and remote endpoints */
   struct sockaddr_in6 l_ep;
@@ -85,6 +129,11 @@ struct tcplib_sock {
   void    *tx_buf;
   int tx_buf_len;
 
+  /* optional buffer for segments received out of order.  Without
+     one they are dropped and have to be retransmitted. */
+  void    *rx_buf;
+  int rx_buf_len;
+
   /* max segment size, or default if
      we didn't bother to pull it out
      of the options field */
@@ -101,6 +150,16 @@ struct tcplib_sock {
   uint32_t seqno;
   // and the index of the last byte we've ACKed
   uint32_t ackno;
+  // the next byte of the tx buffer which has not been sent yet
+  uint32_t snd_nxt;
+
+  // fast recovery ends once everything sent before it started is ACKed
+  uint32_t recover;
+  // the end of the last hole retransmitted during recovery
+  uint32_t high_rxt;
+  // ranges above the ACK number which the other end has reported
+  // receiving, sorted by seqno
+  struct tcplib_sack sacked[TCPLIB_SACK_BLOCKS];
 
   struct {
     int8_t retx;
@@ -109,11 +168,14 @@ struct tcplib_sock {
   /* retransmission counter */
   uint16_t retxcnt;
 
-  /* this needs to be at the end so
+  /* these need to be at the end so
      we can call init() on a socket
      without blowing away the linked
-     list */
+     lists */
   struct tcplib_sock *next;
+  /* chain of the hash bucket the socket is in */
+  struct tcplib_sock *hnext;
+  uint8_t hbucket;
 };
 
 /* EVENTS 
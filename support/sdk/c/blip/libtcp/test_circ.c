@@ -107,6 +107,35 @@ int main(int argc, char **argv) {
 
   // do_read(buf, 50);
 
+  printf("\n\nREASSEMBLY\n\n");
+
+  {
+    uint32_t blocks[6], seqno = 0;
+    uint8_t *ptr;
+    int cap = circ_reasm_init(buf, 120, 0), n;
+    printf("reasm capacity: %i\n", cap);
+
+    /* the text arrives in 20-byte pieces, each behind the next, and
+       is read back as the holes are filled in */
+    for (i = 0; i < 10; i++) {
+      uint32_t piece = (i % 2 == 0) ? (i + 1) * 20 : (i - 1) * 20;
+      if (piece != seqno) {
+        if (circ_reasm_add(buf, piece, (uint8_t *)data, 20) < 0)
+          printf("circ_reasm_add: error\n");
+        n = circ_reasm_blocks(buf, blocks, 3);
+        printf("holding %i ranges, first [%u, %u)\n", n, blocks[0], blocks[1]);
+        continue;
+      }
+      seqno += 20;
+      while ((data_len = circ_reasm_pull(buf, seqno, &ptr)) > 0) {
+        printf("pulled %i at %u: ", data_len, seqno);
+        fwrite(ptr, 1, data_len, stdout);
+        putc('\n', stdout);
+        seqno += data_len;
+      }
+    }
+  }
+
 /*   do_head_read(buf); */
 /*   circ_buf_dump(buf); */
 
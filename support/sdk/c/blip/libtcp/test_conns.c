@@ -0,0 +1,197 @@
+/*
+ * "Copyright (c) 2008, 2009 The Regents of the University  of California.
+ * All rights reserved."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice, the following
+ * two paragraphs and the author appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF CALIFORNIA BE LIABLE TO ANY PARTY FOR
+ * DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF
+ * CALIFORNIA HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE UNIVERSITY OF CALIFORNIA SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS
+ * ON AN "AS IS" BASIS, AND THE UNIVERSITY OF CALIFORNIA HAS NO OBLIGATION TO
+ * PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ */
+
+/*
+ * Many-connection benchmark: the echo server of test_server, but with
+ * the clients simulated in-process instead of behind a tun device, so
+ * that only tcplib itself is measured.
+ *
+ * usage: test_conns [connections] [rounds] [iterations]
+ *
+ * Each iteration opens all the connections, has every client send
+ * `rounds' data segments which the server echoes back, and aborts them
+ * again.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lib6lowpan/ip.h"
+#include "lib6lowpan/in_cksum.h"
+#include "tcplib.h"
+
+/* small enough for the echoes to wrap around the tx buffers */
+#define BUFSZ    256
+#define SEGSZ    64
+#define SRV_PORT 7
+
+struct client {
+  uint16_t port;
+  uint32_t seqno;
+  /* everything the server has sent so far */
+  uint32_t ackno;
+};
+
+static struct client *clients;
+static struct tcplib_sock *socks, srv_sock;
+static char *bufs;
+static int n_conns, n_accepted;
+static unsigned long segs_in, segs_out, bytes_sent, bytes_echoed, corrupt;
+
+static struct {
+  struct ip6_hdr iph;
+  struct tcp_hdr tcph;
+  uint8_t data[SEGSZ];
+} seg;
+
+void tcplib_extern_recv(struct tcplib_sock *sock, void *data, int len) {
+  if (tcplib_send(sock, data, len) < 0)
+    printf("tcplib_send: fail\n");
+}
+
+void tcplib_extern_connectdone(struct tcplib_sock *sock, int error) {}
+void tcplib_extern_closed(struct tcplib_sock *sock) {
+  tcplib_close(sock);
+}
+void tcplib_extern_closedone(struct tcplib_sock *sock) {
+  tcplib_init_sock(sock);
+}
+void tcplib_extern_acked(struct tcplib_sock *sock) {}
+
+struct tcplib_sock *tcplib_accept(struct tcplib_sock *conn,
+                                  struct sockaddr_in6 *from) {
+  struct tcplib_sock *sock;
+  if (n_accepted == n_conns) return NULL;
+
+  sock = &socks[n_accepted];
+  tcplib_init_sock(sock);
+  sock->tx_buf = bufs + n_accepted * BUFSZ;
+  sock->tx_buf_len = BUFSZ;
+  n_accepted++;
+  return sock;
+}
+
+void tcplib_send_out(struct ip6_packet *pkt, struct tcp_hdr *tcph) {
+  int i = ntohs(pkt->ip6_hdr.ip6_dst.s6_addr16[7]);
+  struct client *c = &clients[i];
+  int len = ntohs(pkt->ip6_hdr.ip6_plen) - sizeof(struct tcp_hdr);
+  struct ip_iovec *v;
+  size_t j;
+
+  /* the payload follows the header, and must be what the client sent */
+  for (v = pkt->ip6_data->iov_next; v != NULL; v = v->iov_next)
+    for (j = 0; j < v->iov_len; j++)
+      if (v->iov_base[j] != (uint8_t)i)
+        corrupt++;
+
+  tcph->chksum = htons(msg_cksum(&pkt->ip6_hdr, pkt->ip6_data, IANA_TCP));
+  segs_out++;
+  bytes_echoed += len;
+  c->ackno = ntohl(tcph->seqno) + len;
+  if (tcph->flags & TCP_FLAG_SYN)
+    c->ackno++;
+}
+
+static void client_send(int i, uint8_t flags, int len) {
+  struct client *c = &clients[i];
+
+  seg.iph.ip6_src.s6_addr16[7] = htons(i);
+  seg.iph.ip6_plen = htons(sizeof(struct tcp_hdr) + len);
+  seg.tcph.srcport = htons(c->port);
+  seg.tcph.seqno = htonl(c->seqno);
+  seg.tcph.ackno = htonl(c->ackno);
+  seg.tcph.flags = flags;
+  memset(seg.data, i, len);
+
+  if (tcplib_process(&seg.iph, &seg.tcph))
+    printf("TCPLIB_PROCESS: ERROR!\n");
+  segs_in++;
+  bytes_sent += len;
+  c->seqno += len;
+  if (flags & TCP_FLAG_SYN)
+    c->seqno++;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_in6 laddr;
+  struct timespec start, end;
+  int rounds = 4, iterations = 20;
+  int i, r, it;
+  double secs;
+
+  n_conns = argc > 1 ? atoi(argv[1]) : 1000;
+  if (argc > 2) rounds = atoi(argv[2]);
+  if (argc > 3) iterations = atoi(argv[3]);
+
+  clients = calloc(n_conns, sizeof(struct client));
+  socks = calloc(n_conns, sizeof(struct tcplib_sock));
+  bufs = malloc(n_conns * BUFSZ);
+  if (!clients || !socks || !bufs)
+    return 1;
+
+  tcplib_init_sock(&srv_sock);
+  memset(&laddr, 0, sizeof(laddr));
+  laddr.sin6_port = htons(SRV_PORT);
+  tcplib_bind(&srv_sock, &laddr);
+
+  /* every client talks from its own address to the same server */
+  memset(&seg, 0, sizeof(seg));
+  seg.iph.ip6_nxt = IANA_TCP;
+  seg.iph.ip6_src.s6_addr16[0] = htons(0x2001);
+  seg.iph.ip6_dst.s6_addr16[0] = htons(0x2001);
+  seg.iph.ip6_dst.s6_addr16[7] = htons(0xffff);
+  seg.tcph.dstport = htons(SRV_PORT);
+  seg.tcph.offset = sizeof(struct tcp_hdr) * 4;
+  seg.tcph.window = htons(BUFSZ);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (it = 0; it < iterations; it++) {
+    n_accepted = 0;
+    for (i = 0; i < n_conns; i++) {
+      clients[i].port = 0x8000 | (rand() & 0x7fff);
+      clients[i].seqno = rand();
+      client_send(i, TCP_FLAG_SYN, 0);
+    }
+    for (i = 0; i < n_conns; i++)
+      client_send(i, TCP_FLAG_ACK, 0);
+
+    for (r = 0; r < rounds; r++) {
+      for (i = 0; i < n_conns; i++)
+        client_send(i, TCP_FLAG_ACK | TCP_FLAG_PSH, SEGSZ);
+      /* the echoes go out on the next tick */
+      tcplib_timer_process();
+    }
+
+    for (i = 0; i < n_conns; i++)
+      tcplib_abort(&socks[i]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%i connections, %i rounds, %i iterations: %lu segments in, %lu out "
+         "in %.3fs (%.0f segments/s)\n", n_conns, rounds, iterations,
+         segs_in, segs_out, secs, (segs_in + segs_out) / secs);
+  printf("echoed %lu of %lu bytes, %lu corrupt\n", bytes_echoed, bytes_sent, corrupt);
+  return bytes_echoed == bytes_sent && corrupt == 0 ? 0 : 1;
+}
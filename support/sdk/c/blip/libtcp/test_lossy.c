@@ -0,0 +1,259 @@
+/*
+ * "Copyright (c) 2008, 2009 The Regents of the University  of California.
+ * All rights reserved."
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for any purpose, without fee, and without written agreement is
+ * hereby granted, provided that the above copyright notice, the following
+ * two paragraphs and the author appear in all copies of this software.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF CALIFORNIA BE LIABLE TO ANY PARTY FOR
+ * DIRECT, INDIRECT, SPECIAL, INCIDENTAL, OR CONSEQUENTIAL DAMAGES ARISING OUT
+ * OF THE USE OF THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF
+ * CALIFORNIA HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THE UNIVERSITY OF CALIFORNIA SPECIFICALLY DISCLAIMS ANY WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS FOR A PARTICULAR PURPOSE.  THE SOFTWARE PROVIDED HEREUNDER IS
+ * ON AN "AS IS" BASIS, AND THE UNIVERSITY OF CALIFORNIA HAS NO OBLIGATION TO
+ * PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
+ *
+ */
+
+/*
+ * Lossy-path benchmark: a bulk transfer between two sockets of the
+ * same tcplib, over a simulated multihop path which drops segments at
+ * random.  Time is simulated, with the timer ticking every 512ms as in
+ * TcpP, so the goodput reported is what a mote with the same buffers
+ * would see over such a path.
+ *
+ * usage: test_lossy [bytes] [seeds] [reasm buffer length]
+ *
+ * A reassembly buffer length of zero makes the receiver drop segments
+ * which arrive out of order, as it did before it had one.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib6lowpan/ip.h"
+#include "lib6lowpan/in_cksum.h"
+#include "tcplib.h"
+
+#define TX_BUFSZ   800
+#define SRV_PORT   7
+
+/* the path: its bottleneck rate, the delay of a segment on top of
+   that, and how many segments may be queued at the bottleneck */
+#define PATH_BPS    20000
+#define PATH_DELAY  60000
+#define PATH_QUEUE  8
+
+#define TICK        512000
+#define TIME_LIMIT  (1800 * 1000000ULL)
+#define MAX_PKTS    64
+#define MAX_PKTLEN  512
+
+struct pkt {
+  unsigned long long at;
+  int dir, len;
+  uint8_t data[MAX_PKTLEN];
+};
+
+static struct pkt pkts[MAX_PKTS];
+static int n_pkts;
+/* when each direction of the path is next free */
+static unsigned long long busy[2], now;
+static double loss;
+static unsigned long drops, segs;
+
+static struct tcplib_sock srv_sock, cli_sock, *acc_sock;
+static char cli_tx[TX_BUFSZ], srv_tx[TX_BUFSZ];
+static uint32_t rx_buf[1024];
+static int rx_buf_len;
+static int total, sent, received, corrupt;
+
+static struct in6_addr cli_addr, srv_addr;
+
+static uint8_t pattern(int off) {
+  return (off * 7) ^ (off >> 8);
+}
+
+void tcplib_extern_recv(struct tcplib_sock *sock, void *data, int len) {
+  uint8_t *d = data;
+  int i;
+  if (sock != acc_sock) return;
+  for (i = 0; i < len; i++)
+    if (d[i] != pattern(received + i))
+      corrupt++;
+  received += len;
+}
+
+void tcplib_extern_connectdone(struct tcplib_sock *sock, int error) {}
+void tcplib_extern_closed(struct tcplib_sock *sock) {}
+void tcplib_extern_closedone(struct tcplib_sock *sock) {}
+void tcplib_extern_acked(struct tcplib_sock *sock) {}
+
+struct tcplib_sock *tcplib_accept(struct tcplib_sock *conn,
+                                  struct sockaddr_in6 *from) {
+  if (acc_sock != NULL) return NULL;
+  acc_sock = conn;
+  conn->tx_buf = srv_tx;
+  conn->tx_buf_len = TX_BUFSZ;
+  if (rx_buf_len > 0) {
+    conn->rx_buf = rx_buf;
+    conn->rx_buf_len = rx_buf_len;
+  }
+  return conn;
+}
+
+/* queue the segment at the end of the path, unless it is dropped */
+void tcplib_send_out(struct ip6_packet *msg, struct tcp_hdr *tcph) {
+  int dir = tcph->srcport == htons(SRV_PORT);
+  struct pkt *p;
+  struct ip_iovec *v;
+  int i, off, queued = 0;
+
+  memcpy(&msg->ip6_hdr.ip6_src, dir ? &srv_addr : &cli_addr, 16);
+  tcph->chksum = htons(msg_cksum(&msg->ip6_hdr, msg->ip6_data, IANA_TCP));
+  segs++;
+
+  /* those still waiting for the bottleneck */
+  for (i = 0; i < n_pkts; i++)
+    if (pkts[i].dir == dir && pkts[i].at - PATH_DELAY > now)
+      queued++;
+  if (n_pkts == MAX_PKTS || queued >= PATH_QUEUE ||
+      rand() < loss * RAND_MAX) {
+    drops++;
+    return;
+  }
+
+  p = &pkts[n_pkts++];
+  memcpy(p->data, &msg->ip6_hdr, sizeof(struct ip6_hdr));
+  off = sizeof(struct ip6_hdr);
+  for (v = msg->ip6_data; v != NULL; v = v->iov_next) {
+    memcpy(p->data + off, v->iov_base, v->iov_len);
+    off += v->iov_len;
+  }
+  p->len = off;
+  p->dir = dir;
+
+  if (busy[dir] < now)
+    busy[dir] = now;
+  busy[dir] += p->len * 8 * 1000000ULL / PATH_BPS;
+  p->at = busy[dir] + PATH_DELAY;
+}
+
+/* keep the sender's tx buffer full */
+static void fill(void) {
+  uint8_t chunk[100];
+  int i, len;
+
+  while (cli_sock.state == TCP_ESTABLISHED && sent < total) {
+    len = total - sent < sizeof(chunk) ? total - sent : sizeof(chunk);
+    for (i = 0; i < len; i++)
+      chunk[i] = pattern(sent + i);
+    if (tcplib_send(&cli_sock, chunk, len) < 0)
+      break;
+    sent += len;
+  }
+}
+
+static int next_pkt(void) {
+  int i, n = -1;
+  for (i = 0; i < n_pkts; i++)
+    if (n < 0 || pkts[i].at < pkts[n].at)
+      n = i;
+  return n;
+}
+
+/* move one transfer of total bytes, returning how long it took, or 0
+   if it did not finish */
+static unsigned long long transfer(void) {
+  struct sockaddr_in6 addr;
+  unsigned long long next_tick = TICK;
+  struct pkt p;
+  int n;
+
+  now = n_pkts = sent = received = 0;
+  busy[0] = busy[1] = 0;
+  acc_sock = NULL;
+
+  tcplib_init_sock(&srv_sock);
+  tcplib_init_sock(&cli_sock);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_port = htons(SRV_PORT);
+  tcplib_bind(&srv_sock, &addr);
+
+  cli_sock.tx_buf = cli_tx;
+  cli_sock.tx_buf_len = TX_BUFSZ;
+  memcpy(&addr.sin6_addr, &srv_addr, 16);
+  tcplib_connect(&cli_sock, &addr);
+
+  while (received < total && now < TIME_LIMIT) {
+    n = next_pkt();
+    if (n >= 0 && pkts[n].at < next_tick) {
+      p = pkts[n];
+      pkts[n] = pkts[--n_pkts];
+      now = p.at;
+      tcplib_process((struct ip6_hdr *)p.data, p.data + sizeof(struct ip6_hdr));
+    } else {
+      now = next_tick;
+      next_tick += TICK;
+      tcplib_timer_process();
+    }
+    fill();
+  }
+
+  now = received == total ? now : 0;
+  if (acc_sock != NULL) {
+    tcplib_abort(acc_sock);
+    tcplib_init_sock(acc_sock);
+  }
+  tcplib_abort(&cli_sock);
+  tcplib_init_sock(&cli_sock);
+  return now;
+}
+
+int main(int argc, char **argv) {
+  double rates[] = {0, 0.05, 0.10, 0.20};
+  int seeds = 10, failed = 0;
+  int r, s;
+
+  total = argc > 1 ? atoi(argv[1]) : 20000;
+  if (argc > 2) seeds = atoi(argv[2]);
+  rx_buf_len = argc > 3 ? atoi(argv[3]) : 640;
+  if (rx_buf_len > sizeof(rx_buf))
+    rx_buf_len = sizeof(rx_buf);
+
+  memset(&cli_addr, 0, 16);
+  cli_addr.s6_addr16[0] = htons(0x2001);
+  cli_addr.s6_addr16[7] = htons(1);
+  memcpy(&srv_addr, &cli_addr, 16);
+  srv_addr.s6_addr16[7] = htons(2);
+
+  printf("%i bytes over %i bps, reassembly buffer %i bytes\n",
+         total, PATH_BPS, rx_buf_len);
+  for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    double secs = 0;
+    int done = 0;
+    loss = rates[r];
+    drops = segs = 0;
+    for (s = 0; s < seeds; s++) {
+      unsigned long long t;
+      srand(s + 1);
+      if ((t = transfer()) > 0) {
+        secs += t / 1e6;
+        done++;
+      }
+    }
+    failed += seeds - done;
+    printf("loss %2.0f%%: %i/%i done, goodput %6.0f bps, %lu segments, %lu dropped\n",
+           loss * 100, done, seeds, done ? total * 8 * done / secs : 0,
+           segs, drops);
+  }
+  if (corrupt)
+    printf("%i bytes corrupt\n", corrupt);
+  return failed || corrupt ? 1 : 0;
+}
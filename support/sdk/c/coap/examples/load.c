@@ -0,0 +1,223 @@
+/* load -- many outstanding confirmable messages
+ *
+ * Copyright (C) 2010 Olaf Bergmann <bergmann@tzi.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Load benchmark for the sendqueue: a client context sends CONs to a
+ * server context in the same process over loopback until all of them
+ * are outstanding at once. The server then ACKs some of them in random
+ * order, and the client expires the rest in the order of their
+ * retransmission time.
+ *
+ * usage: coap-load [CONs] [percent ACKed] [seed]
+ *
+ * The messages, the ACKed subset and its order depend on the seed only,
+ * so two runs with the same arguments do the same work. The datagrams
+ * go in chunks small enough for the socket buffers, so none are lost.
+ * The contexts use ports 61616 and 61617, which must be free.
+ * Build the library with -DNDEBUG, or its debug output is measured too.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../coap.h"
+
+/* datagrams in flight before the receiver drains its socket */
+#define CHUNK 64
+
+static coap_tid_t *received;
+static int received_count;
+static struct sockaddr_in6 client_addr;
+
+static double
+now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* server side: remembers each CON to ACK it later */
+void
+message_handler( coap_context_t *ctx, coap_queue_t *node, void *data ) {
+  if ( node->pdu->hdr->type != COAP_MESSAGE_CON )
+    return;
+  received[received_count++] = node->pdu->hdr->id;
+  memcpy( &client_addr, &node->remote, sizeof(struct sockaddr_in6) );
+}
+
+/* reads and dispatches until done() holds, or fails after a second
+ * without a datagram */
+static int
+drain( coap_context_t *ctx, int (*done)( coap_context_t * ) ) {
+  fd_set readfds;
+  struct timeval tv;
+
+  while ( !done( ctx ) ) {
+    FD_ZERO( &readfds );
+    FD_SET( ctx->sockfd, &readfds );
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    if ( select( ctx->sockfd + 1, &readfds, 0, 0, &tv ) <= 0 )
+      return -1;
+    coap_read( ctx );
+    coap_dispatch( ctx );
+  }
+  return 0;
+}
+
+static int expected;
+
+static int
+all_received( coap_context_t *ctx ) {
+  return received_count == expected;
+}
+
+static int
+all_acked( coap_context_t *ctx ) {
+  return ctx->sendqueue_count == expected;
+}
+
+int
+main(int argc, char **argv) {
+  coap_context_t *client, *server;
+  struct sockaddr_in6 server_addr;
+  socklen_t addrlen = sizeof(server_addr);
+  coap_pdu_t *pdu;
+  coap_queue_t *node;
+  int count, percent, acked = 0, expired = 0, i, j, result = 0;
+  unsigned int seed;
+  time_t last = 0;
+  coap_tid_t id;
+  double start, t_send, t_ack, t_expire;
+
+  count = argc > 1 ? atoi(argv[1]) : 10000;
+  percent = argc > 2 ? atoi(argv[2]) : 50;
+  seed = argc > 3 ? atoi(argv[3]) : 1;
+  if ( count <= 0 || count > 65535 || percent < 0 || percent > 100 ) {
+    fprintf(stderr, "usage: %s [CONs (1-65535)] [percent ACKed] [seed]\n", argv[0]);
+    return 1;
+  }
+
+  /* the sockets allow reuse, so the ports must be given */
+  client = coap_new_context( COAP_DEFAULT_PORT );
+  server = coap_new_context( COAP_DEFAULT_PORT + 1 );
+  if ( !client || !server )
+    return 1;
+  coap_register_message_handler( server, message_handler );
+
+  if ( getsockname( server->sockfd, (struct sockaddr *)&server_addr, &addrlen ) < 0 ) {
+    perror("getsockname");
+    return 1;
+  }
+  memcpy( &server_addr.sin6_addr, &in6addr_loopback, sizeof(struct in6_addr) );
+
+  /* coap_new_context() seeds rand() from the time */
+  srand( seed );
+
+  received = coap_malloc( count * sizeof(coap_tid_t) );
+  if ( !received )
+    return 1;
+
+  /* send all CONs, with transaction ids that are all different */
+  start = now();
+  for (i = 0; i < count; i++) {
+    if ( !(pdu = coap_new_pdu()) )
+      return 1;
+    pdu->hdr->type = COAP_MESSAGE_CON;
+    pdu->hdr->code = COAP_REQUEST_GET;
+    pdu->hdr->id = htons( (i * 40503u + seed) & 0xffff );
+    coap_add_option( pdu, COAP_OPTION_URI_PATH, 4, (unsigned char *)"load" );
+
+    if ( coap_send_confirmed( client, &server_addr, pdu ) == COAP_INVALID_TID ) {
+      coap_delete_pdu( pdu );
+      return 1;
+    }
+
+    if ( (i + 1) % CHUNK == 0 || i + 1 == count ) {
+      expected = i + 1;
+      if ( drain( server, all_received ) < 0 ) {
+	fprintf(stderr, "lost CONs: %d of %d received\n", received_count, expected);
+	return 1;
+      }
+    }
+  }
+  t_send = now() - start;
+
+  /* pick the ACKed ones and shuffle them */
+  for (i = 0; i < count; i++)
+    if ( rand() % 100 < percent )
+      received[acked++] = received[i];
+  for (i = acked - 1; i > 0; i--) {
+    j = rand() % (i + 1);
+    id = received[i];
+    received[i] = received[j];
+    received[j] = id;
+  }
+
+  start = now();
+  for (i = 0; i < acked; i++) {
+    if ( !(pdu = coap_new_pdu()) )
+      return 1;
+    pdu->hdr->type = COAP_MESSAGE_ACK;
+    pdu->hdr->id = received[i];
+
+    if ( coap_send( server, &client_addr, pdu ) == COAP_INVALID_TID ) {
+      coap_delete_pdu( pdu );
+      return 1;
+    }
+
+    if ( (i + 1) % CHUNK == 0 || i + 1 == acked ) {
+      expected = count - (i + 1);
+      if ( drain( client, all_acked ) < 0 ) {
+	fprintf(stderr, "lost ACKs: %d of %d outstanding\n", client->sendqueue_count, count);
+	return 1;
+      }
+    }
+  }
+  t_ack = now() - start;
+
+  /* the rest are given up on, as after their last retransmission */
+  start = now();
+  while ( (node = coap_pop_next( client )) ) {
+    if ( node->t < last )
+      result = 1;
+    last = node->t;
+    coap_delete_node( node );
+    expired++;
+  }
+  t_expire = now() - start;
+
+  if ( expired != count - acked || !coap_can_exit( client ) )
+    result = 1;
+
+  printf("%d CONs, %d ACKed, %d expired: send %.3fs, ack %.3fs, expire %.3fs%s\n",
+	 count, acked, expired, t_send, t_ack, t_expire, result ? ", FAILED" : "");
+
+  coap_free( received );
+  coap_free_context( client );
+  coap_free_context( server );
+  return result;
+}
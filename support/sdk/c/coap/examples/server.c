@@ -338,7 +338,10 @@ handle_get(coap_context_t  *ctx, coap_queue_t *node, void *data) {
 	    }
 	    /* FIXME: else error? */
 	  }
-	  coap_add_subscription(ctx, subscription);
+	  if (coap_add_subscription(ctx, subscription) == COAP_INVALID_HASHKEY) {
+	    coap_free(subscription->token.s);
+	    coap_free(subscription);
+	  }
 	}
       }
     }
@@ -762,7 +765,8 @@ resource_wellknown(coap_context_t *ctx,
   assert(ctx); assert(resource);
 
   /* first, update the link-set */
-  for (node = ctx->resources; node; node = node->next) {
+  for (node = coap_first_resource(ctx); node;
+       node = coap_next_resource(ctx, node)) {
     n = print_link(COAP_RESOURCE(node), resources + maxlen,
 		   RESOURCE_BUFLEN - maxlen);
     if (n <= 0) { 			/* error */
@@ -17,6 +17,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#ifndef IDENT_APPNAME
+#define _GNU_SOURCE		/* for recvmmsg() */
+#endif
+
 #include <ctype.h>
 #include <stdio.h>
 #ifndef IDENT_APPNAME
@@ -42,15 +46,6 @@
 
 #define options_start(p) ((coap_opt_t *) ( (unsigned char *)p->hdr + sizeof ( coap_hdr_t ) ))
 
-#define options_end(p, opt) {			\
-  unsigned char opt_code = 0, cnt;		\
-  *opt = options_start( node->pdu );            \
-  for ( cnt = (p)->hdr->optcnt; cnt; --cnt ) {  \
-    opt_code += COAP_OPT_DELTA(**opt);			\
-    *opt = (coap_opt_t *)( (unsigned char *)(*opt) + COAP_OPT_SIZE(**opt)); \
-  } \
-}
-
 /************************************************************************
  ** some functions for debugging
  ************************************************************************/
@@ -173,12 +168,26 @@ coap_insert_node(coap_queue_t **queue, coap_queue_t *node,
   return 1;
 }
 
+#ifndef IDENT_APPNAME
+/* deleted nodes, linked through next */
+static coap_queue_t *node_pool;
+static unsigned int node_pool_count;
+#endif
+
 int 
 coap_delete_node(coap_queue_t *node) {
   if ( !node ) 
     return 0;
 
-  coap_free( node->pdu );
+  coap_delete_pdu( node->pdu );
+#ifndef IDENT_APPNAME
+  if ( node_pool_count < COAP_NODE_POOL_SIZE ) {
+    node->next = node_pool;
+    node_pool = node;
+    node_pool_count++;
+    return 1;
+  }
+#endif
   coap_free( node );  
 
   return 1;
@@ -186,17 +195,27 @@ coap_delete_node(coap_queue_t *node) {
 
 void
 coap_delete_all(coap_queue_t *queue) {
-  if ( !queue ) 
-    return;
+  coap_queue_t *next;
 
-  coap_delete_all( queue->next );
-  coap_delete_node( queue );
+  for (; queue; queue = next) {
+    next = queue->next;
+    coap_delete_node( queue );
+  }
 }
 
 
 coap_queue_t *
 coap_new_node() {
-  coap_queue_t *node = coap_malloc ( sizeof *node );
+  coap_queue_t *node;
+
+#ifndef IDENT_APPNAME
+  if ( node_pool ) {
+    node = node_pool;
+    node_pool = node->next;
+    node_pool_count--;
+  } else
+#endif
+    node = coap_malloc ( sizeof *node );
   if ( ! node ) {
 #ifndef IDENT_APPNAME
     perror ("coap_new_node: malloc");
@@ -208,28 +227,209 @@ coap_new_node() {
   return node;
 }
 
+#ifndef IDENT_APPNAME
+/* The sendqueue is a binary min-heap on t, in which every node knows
+ * its position so that acknowledged transactions can be removed from
+ * the middle. The nodes are also chained into the transactions table
+ * by their id, which has as many buckets as the heap has slots. */
+
+static unsigned int
+transaction_bucket(coap_context_t *ctx, coap_tid_t id) {
+  unsigned long h = id * 0x9e3779b1UL;
+  return (h ^ (h >> 16)) & (ctx->sendqueue_size - 1);
+}
+
+static void
+sendqueue_set(coap_context_t *ctx, unsigned int i, coap_queue_t *node) {
+  ctx->sendqueue[i] = node;
+  node->heap_index = i;
+}
+
+static void
+sendqueue_up(coap_context_t *ctx, unsigned int i) {
+  coap_queue_t *node = ctx->sendqueue[i];
+
+  while (i && ctx->sendqueue[(i - 1) / 2]->t > node->t) {
+    sendqueue_set(ctx, i, ctx->sendqueue[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  sendqueue_set(ctx, i, node);
+}
+
+static void
+sendqueue_down(coap_context_t *ctx, unsigned int i) {
+  coap_queue_t *node = ctx->sendqueue[i];
+  unsigned int child;
+
+  while ((child = 2 * i + 1) < ctx->sendqueue_count) {
+    if (child + 1 < ctx->sendqueue_count &&
+	ctx->sendqueue[child + 1]->t < ctx->sendqueue[child]->t)
+      child++;
+    if (ctx->sendqueue[child]->t >= node->t)
+      break;
+    sendqueue_set(ctx, i, ctx->sendqueue[child]);
+    i = child;
+  }
+  sendqueue_set(ctx, i, node);
+}
+
+/* Doubles heap and transactions table, returns 0 if out of memory. */
+static int
+sendqueue_grow(coap_context_t *ctx) {
+  unsigned int i, size = ctx->sendqueue_size ? 2 * ctx->sendqueue_size : 16;
+  coap_queue_t **heap, **table, *node;
+
+  heap = coap_malloc(size * sizeof(coap_queue_t *));
+  table = coap_malloc(size * sizeof(coap_queue_t *));
+  if ( !heap || !table ) {
+    coap_free(heap);
+    coap_free(table);
+    return 0;
+  }
+
+  if ( ctx->sendqueue_count )
+    memcpy(heap, ctx->sendqueue, ctx->sendqueue_count * sizeof(coap_queue_t *));
+  coap_free(ctx->sendqueue);
+  coap_free(ctx->transactions);
+  ctx->sendqueue = heap;
+  ctx->transactions = table;
+  ctx->sendqueue_size = size;
+
+  memset(table, 0, size * sizeof(coap_queue_t *));
+  for (i = 0; i < ctx->sendqueue_count; i++) {
+    node = heap[i];
+    node->next = table[transaction_bucket(ctx, node->pdu->hdr->id)];
+    table[transaction_bucket(ctx, node->pdu->hdr->id)] = node;
+  }
+  return 1;
+}
+
+static int
+sendqueue_push(coap_context_t *ctx, coap_queue_t *node) {
+  coap_queue_t **bucket;
+
+  if ( ctx->sendqueue_count == ctx->sendqueue_size && !sendqueue_grow(ctx) )
+    return 0;
+
+  sendqueue_set(ctx, ctx->sendqueue_count++, node);
+  sendqueue_up(ctx, node->heap_index);
+
+  bucket = &ctx->transactions[transaction_bucket(ctx, node->pdu->hdr->id)];
+  node->next = *bucket;
+  *bucket = node;
+  return 1;
+}
+
+static void
+sendqueue_remove(coap_context_t *ctx, coap_queue_t *node) {
+  coap_queue_t **p;
+  unsigned int i = node->heap_index;
+
+  for (p = &ctx->transactions[transaction_bucket(ctx, node->pdu->hdr->id)];
+       *p; p = &(*p)->next) {
+    if (*p == node) {
+      *p = node->next;
+      break;
+    }
+  }
+  node->next = NULL;
+
+  if (--ctx->sendqueue_count == i)
+    return;
+
+  sendqueue_set(ctx, i, ctx->sendqueue[ctx->sendqueue_count]);
+  sendqueue_up(ctx, i);
+  sendqueue_down(ctx, ctx->sendqueue[i]->heap_index);
+}
+
 coap_queue_t *
 coap_peek_next( coap_context_t *context ) {
-  if ( !context || !context->sendqueue )
+  if ( !context || !context->sendqueue_count )
     return NULL;
 
-  return context->sendqueue;
+  return context->sendqueue[0];
 }
 
 coap_queue_t *
 coap_pop_next( coap_context_t *context ) {
   coap_queue_t *next; 
 
-  if ( !context || !context->sendqueue )
+  if ( !context || !context->sendqueue_count )
     return NULL;
 
-  next = context->sendqueue;
-  context->sendqueue = context->sendqueue->next;
-  next->next = NULL;
+  next = context->sendqueue[0];
+  sendqueue_remove(context, next);
   return next;
 }
 
+coap_queue_t *
+coap_find_sent( coap_context_t *context, coap_tid_t id ) {
+  coap_queue_t *node;
+
+  if ( !context || !context->sendqueue_count )
+    return NULL;
+
+  for (node = context->transactions[transaction_bucket(context, id)];
+       node; node = node->next) {
+    if (node->pdu->hdr->id == id)
+      return node;
+  }
+  return NULL;
+}
+
+int
+coap_remove_sent( coap_context_t *context, coap_tid_t id ) {
+  coap_queue_t *node = coap_find_sent(context, id);
+
+  if ( !node )
+    return 0;
+
+  sendqueue_remove(context, node);
+  coap_delete_node( node );
+#ifndef NDEBUG
+  debug("*** removed transaction %u\n", ntohs(id));
+#endif
+  return 1;
+}
+#else
+/* there are no confirmable messages from TinyOS, see coap_send_confirmed() */
+coap_queue_t *
+coap_peek_next( coap_context_t *context ) {
+  return NULL;
+}
+
+coap_queue_t *
+coap_pop_next( coap_context_t *context ) {
+  return NULL;
+}
+
+coap_queue_t *
+coap_find_sent( coap_context_t *context, coap_tid_t id ) {
+  return NULL;
+}
+
+int
+coap_remove_sent( coap_context_t *context, coap_tid_t id ) {
+  return 0;
+}
+#endif
+
 #ifndef IDENT_APPNAME
+#ifndef HAVE_RECVMMSG
+#undef COAP_READ_BATCH
+#define COAP_READ_BATCH 1
+#endif
+
+/* The nodes coap_read() receives into. They are kept ready between
+ * calls, only those that went to the receive queue are replaced. */
+struct coap_recvset_t {
+  coap_queue_t *node[COAP_READ_BATCH];
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr msg[COAP_READ_BATCH];
+  struct iovec iov[COAP_READ_BATCH];
+#endif
+};
+
 coap_context_t *
 coap_new_context(in_port_t port) {
   coap_context_t *c = coap_malloc( sizeof( coap_context_t ) );
@@ -246,6 +446,14 @@ coap_new_context(in_port_t port) {
 
   memset(c, 0, sizeof( coap_context_t ) );
 
+  c->recvset = coap_malloc( sizeof( struct coap_recvset_t ) );
+  if ( !c->recvset ) {
+    perror("coap_init: malloc:");
+    coap_free( c );
+    return NULL;
+  }
+  memset(c->recvset, 0, sizeof( struct coap_recvset_t ) );
+
   c->sockfd = socket(AF_INET6, SOCK_DGRAM, 0);
   if ( c->sockfd < 0 ) {
     perror("coap_new_context: socket");
@@ -281,19 +489,27 @@ coap_new_context(in_port_t port) {
  onerror:
   if ( c->sockfd >= 0 ) 
     close ( c->sockfd );
+  coap_free( c->recvset );
   coap_free( c );
   return NULL;
 }
 
 void
 coap_free_context( coap_context_t *context ) {
+  int i;
+
   if ( !context )
     return;
 
   coap_delete_all(context->recvqueue);
-  coap_delete_all(context->sendqueue);
-  coap_delete_list(context->resources);
-  coap_delete_list(context->subscriptions);
+  for (i = 0; i < COAP_READ_BATCH; i++)
+    coap_delete_node( context->recvset->node[i] );
+  coap_free( context->recvset );
+  while ( context->sendqueue_count )
+    coap_delete_node( context->sendqueue[--context->sendqueue_count] );
+  coap_free( context->sendqueue );
+  coap_free( context->transactions );
+  coap_delete_all_resources(context);
   close( context->sockfd );
   coap_free( context );
 }
@@ -305,6 +521,7 @@ coap_tid_t
 coap_send_impl( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pdu_t *pdu,
 		int free_pdu ) {
   ssize_t bytes_written;
+  coap_tid_t id;
 #ifndef NDEBUG
   char addr[INET6_ADDRSTRLEN];/* buffer space for textual represenation of destination address  */
 #endif
@@ -324,15 +541,16 @@ coap_send_impl( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pd
   bytes_written = sendto( context->sockfd, pdu->hdr, pdu->length, 0, 
 			  (const struct sockaddr *)dst, sizeof( *dst ));
   
-  if ( free_pdu )
-    coap_delete_pdu( pdu );
-
   if ( bytes_written < 0 ) {
     perror("coap_send: sendto");
-    return COAP_INVALID_TID;
+    return COAP_INVALID_TID;	/* the caller still owns pdu */
   }
 
-  return ntohs(pdu->hdr->id);
+  id = ntohs(pdu->hdr->id);
+  if ( free_pdu )
+    coap_delete_pdu( pdu );
+
+  return id;
 }
 #else
 // this is defined in LibCoapAdapterP.nc for TinyOS
@@ -347,11 +565,6 @@ coap_send( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pdu_t *
 }
 
 #ifndef IDENT_APPNAME
-int
-_order_timestamp( coap_queue_t *lhs, coap_queue_t *rhs ) {
-  return lhs && rhs && ( lhs->t < rhs->t ) ? -1 : 1;
-}
-  
 coap_tid_t
 coap_send_confirmed( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pdu_t *pdu ) {
   coap_queue_t *node;
@@ -359,22 +572,32 @@ coap_send_confirmed( coap_context_t *context, const struct sockaddr_in6 *dst, co
   /* send once, and enter into message queue for retransmission unless
    * retransmission counter is reached */
 
-  node = coap_new_node();
+  if ( !context || !dst || !pdu || !(node = coap_new_node()) )
+    return COAP_INVALID_TID;
+
   time(&node->t);
   node->t += 1;		      /* 1 == 1 << 0 == 1 << retransmit_cnt */
 
   memcpy( &node->remote, dst, sizeof( struct sockaddr_in6 ) );
   node->pdu = pdu;
 
-  if ( !coap_insert_node( &context->sendqueue, node, _order_timestamp ) ) {
+  if ( !sendqueue_push( context, node ) ) {
 #ifndef NDEBUG
     fprintf(stderr, "coap_send_confirmed: cannot insert node:into sendqueue\n");
 #endif
+    node->pdu = NULL;		/* the caller still owns pdu */
+    coap_delete_node ( node );
+    return COAP_INVALID_TID;
+  }
+
+  if ( coap_send_impl( context, dst, pdu, 0 ) == COAP_INVALID_TID ) {
+    sendqueue_remove( context, node );
+    node->pdu = NULL;
     coap_delete_node ( node );
     return COAP_INVALID_TID;
   }
 
-  return coap_send_impl( context, dst, pdu, 0 );
+  return ntohs(pdu->hdr->id);
 }
 
 coap_tid_t
@@ -386,7 +609,10 @@ coap_retransmit( coap_context_t *context, coap_queue_t *node ) {
   if ( node->retransmit_cnt < COAP_DEFAULT_MAX_RETRANSMIT ) {
     node->retransmit_cnt++;
     node->t += ( 1 << node->retransmit_cnt );
-    coap_insert_node( &context->sendqueue, node, _order_timestamp );
+    if ( !sendqueue_push( context, node ) ) {
+      coap_delete_node( node );
+      return COAP_INVALID_TID;
+    }
 
     debug("** retransmission #%d of transaction %d\n",
 	  node->retransmit_cnt, ntohs(node->pdu->hdr->id));
@@ -412,27 +638,15 @@ order_transaction_id( coap_queue_t *lhs, coap_queue_t *rhs ) {
 }  
 
 #ifndef IDENT_APPNAME
-int
-coap_read( coap_context_t *ctx ) {
-  static char buf[COAP_MAX_PDU_SIZE];
-  ssize_t bytes_read;
-  static struct sockaddr_in6 src;
-  socklen_t addrsize = sizeof src;
-  coap_queue_t *node;
-  coap_opt_t *opt;
-
+/* Adds node to the receive queue after bytes_read bytes have been
+ * received into its PDU. Returns -1 if they are no valid PDU, the
+ * node is left to the caller then. */
+static int
+coap_enqueue_read( coap_context_t *ctx, coap_queue_t *node, ssize_t bytes_read ) {
 #ifndef NDEBUG
   static char addr[INET6_ADDRSTRLEN];
 #endif
 
-  bytes_read = recvfrom( ctx->sockfd, buf, COAP_MAX_PDU_SIZE, 0,
-			 (struct sockaddr *)&src, &addrsize );
-
-  if ( bytes_read < 0 ) {
-    perror("coap_read: recvfrom");
-    return -1;
-  }
-
   if ( bytes_read < sizeof(coap_hdr_t)) {
 #ifndef NDEBUG
     fprintf(stderr, "coap_read: discarded invalid frame (too small)\n" );
@@ -440,52 +654,114 @@ coap_read( coap_context_t *ctx ) {
     return -1;
   }
 
-  if (((coap_hdr_t *)buf)->version != COAP_DEFAULT_VERSION ) {
+  if ( node->pdu->hdr->version != COAP_DEFAULT_VERSION ) {
 #ifndef NDEBUG
-    fprintf(stderr, "coap_read: discarded invalid frame (wrong version 0x%x)\n", ((coap_hdr_t *)buf)->version );
+    fprintf(stderr, "coap_read: discarded invalid frame (wrong version 0x%x)\n", node->pdu->hdr->version );
 #endif
     return -1;
   }
 
-  node = coap_new_node();
-  if ( !node ) 
-    return -1;
-
-  node->pdu = coap_new_pdu();
-  if ( !node->pdu ) {
-    coap_delete_node( node );
+  /* parse options in place and find the beginning of the data block */
+  node->pdu->length = bytes_read;
+  if ( !coap_pdu_parse( node->pdu ) ) 
     return -1;
-  }
 
   time( &node->t );
-  memcpy( &node->remote, &src, sizeof( src ) );
-
-  /* "parse" received PDU by filling pdu structure */
-  memcpy( node->pdu->hdr, buf, bytes_read );
-  node->pdu->length = bytes_read;
-  
-  /* finally calculate beginning of data block */
-  options_end( node->pdu, &opt );
-
-  if ( (unsigned char *)node->pdu->hdr + node->pdu->length < (unsigned char *)opt )
-    node->pdu->data = (unsigned char *)node->pdu->hdr + node->pdu->length;
-  else
-    node->pdu->data = (unsigned char *)opt;
 
   /* and add new node to receive queue */
   coap_insert_node( &ctx->recvqueue, node, order_transaction_id );
   
 #ifndef NDEBUG
-  if ( inet_ntop(src.sin6_family, &src.sin6_addr, addr, INET6_ADDRSTRLEN) == 0 ) {
+  if ( inet_ntop(node->remote.sin6_family, &node->remote.sin6_addr, addr, INET6_ADDRSTRLEN) == 0 ) {
     perror("coap_read: inet_ntop");
   } else {
-    debug("** received from [%s]:%d:\n  ",addr,ntohs(src.sin6_port));
+    debug("** received from [%s]:%d:\n  ",addr,ntohs(node->remote.sin6_port));
   }
   coap_show_pdu( node->pdu );
 #endif
 
   return 0;
 }
+
+/* sets up slot i of the receive set for the next datagram, with a new
+ * node unless it still has one */
+static int
+coap_arm_read( struct coap_recvset_t *set, int i ) {
+  coap_queue_t *node = set->node[i];
+
+  if ( !node ) {
+    if ( !(node = coap_new_node()) )
+      return -1;
+    if ( !(node->pdu = coap_new_pdu()) ) {
+      coap_delete_node( node );
+      return -1;
+    }
+    set->node[i] = node;
+#ifdef HAVE_RECVMMSG
+    set->iov[i].iov_base = node->pdu->hdr;
+    set->iov[i].iov_len = COAP_MAX_PDU_SIZE;
+    memset(&set->msg[i], 0, sizeof(struct mmsghdr));
+    set->msg[i].msg_hdr.msg_name = &node->remote;
+    set->msg[i].msg_hdr.msg_iov = &set->iov[i];
+    set->msg[i].msg_hdr.msg_iovlen = 1;
+#endif
+  }
+
+#ifdef HAVE_RECVMMSG
+  /* the kernel returns the actual address length here */
+  set->msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+#endif
+  return 0;
+}
+
+int
+coap_read( coap_context_t *ctx ) {
+  struct coap_recvset_t *set = ctx->recvset;
+#ifndef HAVE_RECVMMSG
+  socklen_t addrsize = sizeof(struct sockaddr_in6);
+#endif
+  ssize_t bytes_read;
+  int i, n, received, result = -1;
+
+  /* slots left empty by a failed allocation are retried here, the
+   * datagrams are received into the ready ones up to the first gap */
+  for (n = 0; n < COAP_READ_BATCH && set->node[n]; n++)
+    ;
+  for (; n < COAP_READ_BATCH && coap_arm_read( set, n ) == 0; n++)
+    ;
+
+  if ( !n )
+    return -1;
+
+#ifdef HAVE_RECVMMSG
+  /* waits for the first datagram only */
+  received = recvmmsg( ctx->sockfd, set->msg, n, MSG_WAITFORONE, NULL );
+  if ( received < 0 )
+    perror("coap_read: recvmmsg");
+#else
+  bytes_read = recvfrom( ctx->sockfd, set->node[0]->pdu->hdr, COAP_MAX_PDU_SIZE, 0,
+			 (struct sockaddr *)&set->node[0]->remote, &addrsize );
+  received = 1;
+  if ( bytes_read < 0 ) {
+    perror("coap_read: recvfrom");
+    received = -1;
+  }
+#endif
+
+  /* the nodes of discarded datagrams receive the next ones */
+  for (i = 0; i < received; i++) {
+#ifdef HAVE_RECVMMSG
+    bytes_read = set->msg[i].msg_len;
+#endif
+    if ( coap_enqueue_read( ctx, set->node[i], bytes_read ) == 0 ) {
+      set->node[i] = NULL;
+      result = 0;
+    }
+    coap_arm_read( set, i );
+  }
+
+  return result;
+}
 #endif
 
 int
@@ -567,7 +843,7 @@ coap_dispatch( coap_context_t *context ) {
     switch ( node->pdu->hdr->type ) {
     case COAP_MESSAGE_ACK :
       /* find transaction in sendqueue to stop retransmission */
-      coap_remove_transaction( &context->sendqueue, node->pdu->hdr->id );
+      coap_remove_sent( context, node->pdu->hdr->id );
       break;
     case COAP_MESSAGE_RST :
       /* We have sent something the receiver disliked, so we remove
@@ -577,7 +853,7 @@ coap_dispatch( coap_context_t *context ) {
 #ifndef NDEBUG
       fprintf(stderr, "* got RST for transaction %u\n", ntohs(node->pdu->hdr->id) );
 #endif
-      sent = coap_find_transaction(context->sendqueue, node->pdu->hdr->id);
+      sent = coap_find_sent(context, node->pdu->hdr->id);
       if (sent && coap_get_request_uri(sent->pdu, &uri)) { 
 	/* The easy way: we still have the transaction that has caused
 	* the trouble.*/
@@ -590,7 +866,7 @@ coap_dispatch( coap_context_t *context ) {
       }
 
       /* find transaction in sendqueue to stop retransmission */
-      coap_remove_transaction( &context->sendqueue, node->pdu->hdr->id );
+      coap_remove_sent( context, node->pdu->hdr->id );
       break;
     case COAP_MESSAGE_NON :	/* check for unknown critical options */
       if ( coap_check_critical(node->pdu, &opt) != 0 ) 
@@ -643,6 +919,6 @@ coap_register_message_handler( coap_context_t *context, coap_message_handler_t h
 
 int 
 coap_can_exit( coap_context_t *context ) {
-  return !context || (context->recvqueue == NULL && context->sendqueue == NULL);
+  return !context || (context->recvqueue == NULL && coap_peek_next(context) == NULL);
 }
 
@@ -36,12 +36,16 @@ typedef uint16_t in_port_t;
 #include "pdu.h"
 
 struct coap_listnode {
-  struct coap_listnode *next;
+  struct coap_listnode *next;	/* next in queue, or in the transaction hash
+				 * chain while in the context's sendqueue */
 
 #ifndef IDENT_APPNAME
   time_t t;			/* when to send PDU for the next time */
 #endif
   unsigned char retransmit_cnt;	/* retransmission counter, will be removed when zero */
+#ifndef IDENT_APPNAME
+  unsigned int heap_index;	/* position in the context's sendqueue */
+#endif
   
   struct sockaddr_in6 remote;	/* remote address */
 
@@ -63,12 +67,32 @@ void coap_delete_all(coap_queue_t *queue);
 /* creates a new node suitable for adding to the CoAP sendqueue */
 coap_queue_t *coap_new_node();
 
+/* number of deleted nodes that are kept for reuse by coap_new_node() */
+#ifndef COAP_NODE_POOL_SIZE
+#define COAP_NODE_POOL_SIZE 64
+#endif
+
 /* The CoAP stack's global state is stored in a coap_context_t object */
 typedef struct {
-  coap_list_t *resources, *subscriptions; /* FIXME: make these hash tables */
-  coap_queue_t *sendqueue, *recvqueue; /* FIXME make these coap_list_t */
+  coap_list_t **resources;	/* hash table of resources, see subscribe.h */
+  unsigned int resource_buckets, resource_count;
+#ifndef IDENT_APPNAME
+  struct coap_subscription_t **subscriptions; /* min-heap by deadline */
+  unsigned int subscription_count, subscription_size;
+#endif
+#ifndef IDENT_APPNAME
+  /* confirmable messages awaiting acknowledgement, a min-heap ordered by
+   * retransmission time, and the same nodes hashed by transaction id
+   * into sendqueue_size buckets */
+  coap_queue_t **sendqueue, **transactions;
+  unsigned int sendqueue_count, sendqueue_size;
+#else
+  coap_queue_t *sendqueue;
+#endif
+  coap_queue_t *recvqueue;	/* FIXME make this coap_list_t */
 #ifndef IDENT_APPNAME
   int sockfd;			/* send/receive socket */
+  struct coap_recvset_t *recvset; /* nodes ready for coap_read() */
 #else
   int tinyos_port;
 #endif
@@ -107,13 +131,14 @@ void coap_free_context( coap_context_t *context );
 /**
  * Sends a confirmed CoAP message to given destination. The memory that is allocated by pdu will
  * be released by coap_send_confirmed(). The caller must not make any assumption on the lifetime
- * of pdu.
+ * of pdu, unless COAP_INVALID_TID is returned, in which case pdu must be released by the caller.
  */
 coap_tid_t coap_send_confirmed( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pdu_t *pdu );
 
 /**
  * Sends a non-confirmed CoAP message to given destination. The memory that is allocated by pdu will
- * be released by coap_send(). The caller must not make any assumption on the lifetime of pdu.
+ * be released by coap_send(). The caller must not make any assumption on the lifetime of pdu,
+ * unless COAP_INVALID_TID is returned, in which case pdu must be released by the caller.
  */
 #ifndef IDENT_APPNAME
 coap_tid_t coap_send( coap_context_t *context, const struct sockaddr_in6 *dst, coap_pdu_t *pdu );
@@ -123,10 +148,17 @@ coap_tid_t coap_send( coap_context_t *context, const struct sockaddr_in6 *dst, c
 coap_tid_t coap_retransmit( coap_context_t *context, coap_queue_t *node );
 
 #ifndef IDENT_APPNAME
+/* maximum number of datagrams that coap_read() takes from the socket at once */
+#ifndef COAP_READ_BATCH
+#define COAP_READ_BATCH 16
+#endif
+
 /**
  * Reads data from the network and tries to parse as CoAP PDU. On success, 0 is returned
  * and a new node with the parsed PDU is added to the receive queue in the specified context
- * object.
+ * object. Where recvmmsg() is available, up to COAP_READ_BATCH datagrams that are pending
+ * are read, each directly into the PDU of its node. Only the first one is waited for.
+ * The nodes are kept ready in the context, only the ones that were queued are replaced.
  */
 int coap_read( coap_context_t *context );
 #endif
@@ -134,6 +166,19 @@ int coap_read( coap_context_t *context );
 /** Removes transaction with specified id from given queue. Returns 0 if not found, 1 otherwise. */
 int coap_remove_transaction( coap_queue_t **queue, coap_tid_t id );
 
+/**
+ * Removes the confirmable message with given transaction id from the
+ * sendqueue of context, which stops its retransmission. Returns 0 if
+ * not found, 1 otherwise.
+ */
+int coap_remove_sent( coap_context_t *context, coap_tid_t id );
+
+/**
+ * Retrieves the confirmable message with given transaction id from the
+ * sendqueue of context, or NULL if there is none.
+ */
+coap_queue_t *coap_find_sent( coap_context_t *context, coap_tid_t id );
+
 /**
  * Retrieves transaction from queue.
  * @queue The transaction queue to be searched
@@ -30,10 +30,24 @@
 #include "mem.h"
 #include "pdu.h"
 
+#ifndef IDENT_APPNAME
+/* deleted PDUs, linked through their first word */
+static void *pdu_pool;
+static unsigned int pdu_pool_count;
+#endif
 
 coap_pdu_t *
 coap_new_pdu() {
-  coap_pdu_t *pdu = coap_malloc( sizeof(coap_pdu_t) + COAP_MAX_PDU_SIZE );
+  coap_pdu_t *pdu;
+
+#ifndef IDENT_APPNAME
+  if ( pdu_pool ) {
+    pdu = pdu_pool;
+    pdu_pool = *(void **)pdu_pool;
+    pdu_pool_count--;
+  } else
+#endif
+    pdu = coap_malloc( sizeof(coap_pdu_t) + COAP_MAX_PDU_SIZE );
   if (!pdu) {
 #ifndef IDENT_APPNAME
     perror("new_pdu: malloc");
@@ -41,8 +55,9 @@ coap_new_pdu() {
     return NULL;
   }
   
-  /* initialize PDU */
-  memset(pdu, 0, sizeof(coap_pdu_t) + COAP_MAX_PDU_SIZE );
+  /* initialize PDU; options and data are written before they are read,
+     so the rest of the buffer is left as it is */
+  memset(pdu, 0, sizeof(coap_pdu_t) + sizeof(coap_hdr_t) );
   pdu->hdr = (coap_hdr_t *) ( (unsigned char *)pdu + sizeof(coap_pdu_t) );
   pdu->hdr->version = COAP_DEFAULT_VERSION;
   pdu->hdr->id = ntohs( COAP_INVALID_TID );
@@ -51,33 +66,82 @@ coap_new_pdu() {
      pointer is moved to the back */
   pdu->length = sizeof(coap_hdr_t);
   pdu->data = (unsigned char *)pdu->hdr + pdu->length;
+  pdu->opt_end = pdu->length;
 
   return pdu;
 }
 
 void 
 coap_delete_pdu(coap_pdu_t *pdu) {
+#ifndef IDENT_APPNAME
+  if ( pdu && pdu_pool_count < COAP_PDU_POOL_SIZE ) {
+    *(void **)pdu = pdu_pool;
+    pdu_pool = pdu;
+    pdu_pool_count++;
+    return;
+  }
+#endif
   coap_free( pdu );
 }
 
 #define options_start(p) ((coap_opt_t *) ( (unsigned char *)p->hdr + sizeof ( coap_hdr_t ) ))
 
+/* the index is rebuilt when hdr has been changed behind our back */
+#define options_indexed(p) \
+  ((p)->opt_parsed == (p)->hdr->optcnt || coap_pdu_parse(p))
+
+int
+coap_pdu_parse(coap_pdu_t *pdu) {
+  unsigned char cnt, opt_code = 0;
+  unsigned int offset = sizeof(coap_hdr_t);
+  coap_opt_t *opt;
+
+  if (!pdu || pdu->length < sizeof(coap_hdr_t))
+    return 0;
+
+  memset(pdu->opt_offset, 0, sizeof(pdu->opt_offset));
+
+  for ( cnt = 0; cnt < pdu->hdr->optcnt; ++cnt ) {
+    opt = (coap_opt_t *)( (unsigned char *)pdu->hdr + offset );
+    if ( offset >= pdu->length 
+	 || (COAP_OPT_ISEXTENDED(*opt) && offset + 1 >= pdu->length) )
+      goto error;
+
+    opt_code += COAP_OPT_DELTA(*opt);
+    if ( opt_code < COAP_OPTION_INDEX_SIZE && !pdu->opt_offset[opt_code] )
+      pdu->opt_offset[opt_code] = offset;
+
+    offset += COAP_OPT_SIZE(*opt);
+  }
+
+  if ( offset > pdu->length )
+    goto error;
+
+  pdu->opt_end = offset;
+  pdu->opt_type = opt_code;
+  pdu->opt_parsed = cnt;
+  pdu->data = (unsigned char *)pdu->hdr + offset;
+  return 1;
+
+ error:
+#ifndef NDEBUG
+  fprintf(stderr, "coap_pdu_parse: options exceed PDU\n");
+#endif
+  pdu->opt_parsed = 0;
+  return 0;
+}
+
 int 
 coap_add_option(coap_pdu_t *pdu, unsigned char type, unsigned int len, const unsigned char *data) {
-  unsigned char cnt;
+  unsigned char cnt, fenceposts;
   coap_opt_t *opt;
-  unsigned char opt_code = 0;
+  unsigned char opt_code;
 
-  if (!pdu) 
+  if (!pdu || !options_indexed(pdu)) 
     return -1;
 
-  /* get last option from pdu to calculate the delta */
-  
-  opt = options_start( pdu );
-  for ( cnt = pdu->hdr->optcnt; cnt; --cnt ) {
-    opt_code += COAP_OPT_DELTA(*opt);
-    opt = (coap_opt_t *)( (unsigned char *)opt + COAP_OPT_SIZE(*opt) ); 
-  }
+  /* options are appended, the last one gives the delta */
+  opt_code = pdu->opt_type;
 
   if ( type < opt_code ) {
 #ifndef NDEBUG
@@ -86,6 +150,20 @@ coap_add_option(coap_pdu_t *pdu, unsigned char type, unsigned int len, const uns
     return -1;
   }
 
+  for ( fenceposts = 0; type - opt_code > 15; ++fenceposts )
+    opt_code = COAP_OPTION_NOOP * (opt_code / COAP_OPTION_NOOP + 1);
+  opt_code = pdu->opt_type;
+
+  if ( len > 270 || pdu->hdr->optcnt + fenceposts >= 15 ||
+       pdu->opt_end + fenceposts + (len < 15 ? 1 : 2) + len > COAP_MAX_PDU_SIZE ) {
+#ifndef NDEBUG
+    fprintf(stderr, "coap_add_option: cannot add: option too large for PDU\n");
+#endif
+    return -1;
+  }
+
+  opt = (coap_opt_t *)( (unsigned char *)pdu->hdr + pdu->opt_end );
+
   /* Create new option after last existing option: First check if we
    * need fence posts between type and last opt_code (i.e. delta >
    * 15), and then add actual option.
@@ -100,6 +178,8 @@ coap_add_option(coap_pdu_t *pdu, unsigned char type, unsigned int len, const uns
     COAP_OPT_SETDELTA( *opt, (COAP_OPTION_NOOP * (cnt+1)) - opt_code );
 
     opt_code += COAP_OPT_DELTA(*opt);
+    if ( opt_code < COAP_OPTION_INDEX_SIZE && !pdu->opt_offset[opt_code] )
+      pdu->opt_offset[opt_code] = (unsigned char *)opt - (unsigned char *)pdu->hdr;
     opt = (coap_opt_t *)( (unsigned char *)opt + COAP_OPT_SIZE(*opt) ); 
   }
 
@@ -111,7 +191,13 @@ coap_add_option(coap_pdu_t *pdu, unsigned char type, unsigned int len, const uns
   memcpy(COAP_OPT_VALUE(*opt), data, len);
   pdu->data = (unsigned char *)COAP_OPT_VALUE(*opt) + len ;
 
+  if ( type < COAP_OPTION_INDEX_SIZE && !pdu->opt_offset[type] )
+    pdu->opt_offset[type] = (unsigned char *)opt - (unsigned char *)pdu->hdr;
+
   pdu->length = pdu->data - (unsigned char *)pdu->hdr;
+  pdu->opt_end = pdu->length;
+  pdu->opt_type = type;
+  pdu->opt_parsed = pdu->hdr->optcnt;
   return len;
 }
 
@@ -121,10 +207,15 @@ coap_check_option(coap_pdu_t *pdu, unsigned char type) {
   coap_opt_t *opt;
   unsigned char opt_code = 0;
 
-  if (!pdu) 
+  if (!pdu || !options_indexed(pdu)) 
     return NULL;
 
-  /* get last option from pdu to calculate the delta */
+  if ( type < COAP_OPTION_INDEX_SIZE )
+    return pdu->opt_offset[type] 
+      ? (coap_opt_t *)( (unsigned char *)pdu->hdr + pdu->opt_offset[type] )
+      : NULL;
+
+  /* the types above are reached through fence posts only */
   
   opt = options_start( pdu );
   for ( cnt = pdu->hdr->optcnt; cnt && opt_code < type; --cnt ) {
@@ -225,6 +225,9 @@ typedef struct {
 #endif
 #define COAP_OPTION_DATA(option) ((unsigned char *)&(option) + sizeof(coap_option))
 
+/** Option types below this are indexed in coap_pdu_t, see coap_check_option() */
+#define COAP_OPTION_INDEX_SIZE 16
+
 /** Header structure for CoAP PDUs */
 
 typedef struct {
@@ -232,6 +235,13 @@ typedef struct {
   unsigned short length;	/* PDU length (including header, options, data)  */
   coap_list_t *options;		/* parsed options */
   unsigned char *data;		/* payload */
+
+  /* option index, kept by coap_add_option() and coap_pdu_parse(), with
+   * offsets relative to hdr */
+  unsigned short opt_offset[COAP_OPTION_INDEX_SIZE]; /* first option of type, 0 if none */
+  unsigned short opt_end;	/* end of the last option */
+  unsigned char opt_type;	/* type of the last option */
+  unsigned char opt_parsed;	/* number of options indexed */
 } coap_pdu_t;
 
 /** Options in coap_pdu_t are accessed with the macro COAP_OPTION. */
@@ -245,16 +255,35 @@ typedef struct {
 coap_pdu_t *coap_new_pdu();
 void coap_delete_pdu(coap_pdu_t *);
 
+/* number of deleted PDUs that are kept for reuse by coap_new_pdu() */
+#ifndef COAP_PDU_POOL_SIZE
+#define COAP_PDU_POOL_SIZE 32
+#endif
+
 #if 0
 int coap_encode_pdu(coap_pdu_t *);
 #endif
 
+/**
+ * Builds the option index and sets the data pointer of a PDU whose
+ * length bytes have been written directly to pdu->hdr, e.g. when
+ * received from the network. The options are parsed in place. Returns
+ * 1 on success, 0 if the options do not fit into length bytes.
+ */
+int coap_pdu_parse(coap_pdu_t *pdu);
+
 /** 
- * Adds option of given type to pdu that is passed as first parameter. coap_add_option() 
- * destroys the PDU's data, so coap_add_data must be called after all options have been
- * added.
+ * Appends option of given type to pdu that is passed as first parameter. Options must be
+ * added in ascending order of their type. coap_add_option() destroys the PDU's data, so
+ * coap_add_data must be called after all options have been added. Returns the length of
+ * the option's value, or -1 if it is out of order or does not fit into the PDU.
  */
 int coap_add_option(coap_pdu_t *pdu, unsigned char type, unsigned int len, const unsigned char *data);
+
+/**
+ * Returns the first option of given type in pdu, or NULL if there is none. This is a
+ * lookup in the option index for types below COAP_OPTION_INDEX_SIZE.
+ */
 coap_opt_t *coap_check_option(coap_pdu_t *pdu, unsigned char type);
 
 /** 
@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <limits.h>
 #ifndef IDENT_APPNAME
@@ -103,29 +104,166 @@ notify(coap_context_t *context, coap_resource_t *res,
 
 #endif
 
+/* The low bits of coap_uri_hash() are little more than the sum of the
+ * characters, so mix the key before using it as a bucket index. */
+static unsigned int
+resource_bucket(coap_context_t *ctx, coap_key_t key) {
+  key ^= key >> 16;
+  key *= 0x45d9f3bUL;
+  key ^= key >> 16;
+  return key & (ctx->resource_buckets - 1);
+}
+
+/* Rehashes the resources into a table of the given number of buckets,
+ * returns 0 if out of memory. */
+static int
+resize_resources(coap_context_t *ctx, unsigned int buckets) {
+  coap_list_t **table, *node, *next;
+  unsigned int i, old = ctx->resource_buckets;
+
+  if ( !(table = coap_malloc(buckets * sizeof(coap_list_t *))) )
+    return 0;
+  memset(table, 0, buckets * sizeof(coap_list_t *));
+
+  ctx->resource_buckets = buckets;
+  for (i = 0; i < old; i++) {
+    /* appends to keep newer resources with the same key in front */
+    for (node = ctx->resources[i]; node; node = next) {
+      coap_list_t **last;
+
+      next = node->next;
+      node->next = NULL;
+      last = &table[resource_bucket(ctx, COAP_RESOURCE(node)->key)];
+      while (*last)
+	last = &(*last)->next;
+      *last = node;
+    }
+  }
+
+  coap_free(ctx->resources);
+  ctx->resources = table;
+  return 1;
+}
+
 #ifndef IDENT_APPNAME
+/* Subscriptions are kept in a binary min-heap ordered by deadline, each
+ * knowing its own position so that it can be removed from the middle. */
+
+static void
+heap_set(coap_context_t *ctx, unsigned int i, coap_subscription_t *sub) {
+  ctx->subscriptions[i] = sub;
+  sub->heap_index = i;
+}
+
+static void
+heap_up(coap_context_t *ctx, unsigned int i) {
+  coap_subscription_t *sub = ctx->subscriptions[i];
+
+  while (i && ctx->subscriptions[(i - 1) / 2]->deadline > sub->deadline) {
+    heap_set(ctx, i, ctx->subscriptions[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  heap_set(ctx, i, sub);
+}
+
+static void
+heap_down(coap_context_t *ctx, unsigned int i) {
+  coap_subscription_t *sub = ctx->subscriptions[i];
+  unsigned int child;
+
+  while ((child = 2 * i + 1) < ctx->subscription_count) {
+    if (child + 1 < ctx->subscription_count &&
+	ctx->subscriptions[child + 1]->deadline < ctx->subscriptions[child]->deadline)
+      child++;
+    if (ctx->subscriptions[child]->deadline >= sub->deadline)
+      break;
+    heap_set(ctx, i, ctx->subscriptions[child]);
+    i = child;
+  }
+  heap_set(ctx, i, sub);
+}
+
+static int
+heap_push(coap_context_t *ctx, coap_subscription_t *sub) {
+  coap_subscription_t **heap;
+  unsigned int size;
+
+  if (ctx->subscription_count == ctx->subscription_size) {
+    size = ctx->subscription_size ? 2 * ctx->subscription_size : 16;
+    if ( !(heap = coap_malloc(size * sizeof(coap_subscription_t *))) )
+      return 0;
+    if (ctx->subscriptions) {
+      memcpy(heap, ctx->subscriptions,
+	     ctx->subscription_count * sizeof(coap_subscription_t *));
+      coap_free(ctx->subscriptions);
+    }
+    ctx->subscriptions = heap;
+    ctx->subscription_size = size;
+  }
+
+  sub->deadline = sub->expires;
+  heap_set(ctx, ctx->subscription_count++, sub);
+  heap_up(ctx, sub->heap_index);
+  return 1;
+}
+
+static void
+heap_remove(coap_context_t *ctx, coap_subscription_t *sub) {
+  unsigned int i = sub->heap_index;
+
+  if (--ctx->subscription_count == i)
+    return;
+
+  heap_set(ctx, i, ctx->subscriptions[ctx->subscription_count]);
+  heap_up(ctx, i);
+  heap_down(ctx, ctx->subscriptions[i]->heap_index);
+}
+
+static void
+coap_free_subscription(void *sub) {
+  if ( sub )
+    coap_free(((coap_subscription_t *)sub)->token.s);
+}
+
+/* Unlinks sub from the subscribers of its resource and the heap and
+ * frees it. The resource is the one sub was added to: other resources
+ * may share its key. */
+static void
+remove_subscription(coap_context_t *ctx, coap_subscription_t *sub) {
+  coap_list_t **node, *found;
+
+  for (node = &sub->owner->subscribers; *node; node = &(*node)->next)
+    if (COAP_SUBSCRIPTION(*node) == sub)
+      break;
+
+  /* a subscription in the heap is always on its resource's list */
+  assert(*node);
+  if ( !*node )
+    return;
+
+  heap_remove(ctx, sub);
+  found = *node;
+  *node = found->next;
+  coap_delete(found);
+}
+
 void 
 coap_check_resource_list(coap_context_t *context) {
   coap_list_t *res, *sub;
-  coap_key_t key;
   time_t now;
 
-  if ( !context || !context->resources /* || !context->subscribers */) 
+  if ( !context || !context->subscription_count )
     return;
 
   time(&now);
-  for (res = context->resources; res; res = res->next) {
+  for (res = coap_first_resource(context); res; 
+       res = coap_next_resource(context, res)) {
     if ( COAP_RESOURCE(res)->dirty && COAP_RESOURCE(res)->uri ) {
-      key = coap_uri_hash( COAP_RESOURCE(res)->uri ) ;
-
-      /* is subscribed? */
-      for (sub = context->subscriptions; sub; sub = sub->next) {
-	if ( COAP_SUBSCRIPTION(sub)->resource == key ) {
-	  /* notify subscriber */
-	  notify(context, COAP_RESOURCE(res), COAP_SUBSCRIPTION(sub), 
-		 COAP_SUBSCRIPTION(sub)->expires - now, COAP_RESPONSE_200);
-	}
 
+      /* notify subscribers */
+      for (sub = COAP_RESOURCE(res)->subscribers; sub; sub = sub->next) {
+	notify(context, COAP_RESOURCE(res), COAP_SUBSCRIPTION(sub), 
+	       COAP_SUBSCRIPTION(sub)->expires - now, COAP_RESPONSE_200);
       }
 
       COAP_RESOURCE(res)->dirty = 0;
@@ -138,10 +276,10 @@ coap_resource_t *
 coap_get_resource_from_key(coap_context_t *ctx, coap_key_t key) {
   coap_list_t *node;
 
-  if (ctx) {
-    /* TODO: use hash table for resources with key to access */
-    for (node = ctx->resources; node; node = node->next) {
-      if ( key == coap_uri_hash(COAP_RESOURCE(node)->uri) )
+  if (ctx && ctx->resources) {
+    for (node = ctx->resources[resource_bucket(ctx, key)]; node; 
+	 node = node->next) {
+      if ( key == COAP_RESOURCE(node)->key )
 	return COAP_RESOURCE(node);
     }
   }
@@ -154,11 +292,43 @@ coap_get_resource(coap_context_t *ctx, coap_uri_t *uri) {
   return uri ? coap_get_resource_from_key(ctx, coap_uri_hash(uri)) : NULL;
 }
 
+coap_list_t *
+coap_first_resource(coap_context_t *context) {
+  unsigned int i;
+
+  if ( !context || !context->resources )
+    return NULL;
+
+  for (i = 0; i < context->resource_buckets; i++)
+    if (context->resources[i])
+      return context->resources[i];
+
+  return NULL;
+}
+
+coap_list_t *
+coap_next_resource(coap_context_t *context, coap_list_t *node) {
+  unsigned int i;
+
+  if ( !context || !node )
+    return NULL;
+
+  if ( node->next )
+    return node->next;
+
+  for (i = resource_bucket(context, COAP_RESOURCE(node)->key) + 1; 
+       i < context->resource_buckets; i++)
+    if (context->resources[i])
+      return context->resources[i];
+
+  return NULL;
+}
+
 #ifndef IDENT_APPNAME
 void 
 coap_check_subscriptions(coap_context_t *context) {
   time_t now;
-  coap_list_t *node;
+  coap_subscription_t *sub;
 #ifndef NDEBUG
   char addr[INET6_ADDRSTRLEN];
 #endif
@@ -168,23 +338,27 @@ coap_check_subscriptions(coap_context_t *context) {
 
   time(&now);
 
-  node = context->subscriptions;
-  while ( node && COAP_SUBSCRIPTION(node)->expires < now ) {
+  while ( context->subscription_count
+	  && context->subscriptions[0]->deadline < now ) {
+    sub = context->subscriptions[0];
+
+    if ( sub->expires >= now ) {
+      /* refreshed since it was queued, reorder by the new expiry */
+      sub->deadline = sub->expires;
+      heap_down(context, 0);
+      continue;
+    }
+
 #ifndef NDEBUG
-    if ( inet_ntop(AF_INET6, &(COAP_SUBSCRIPTION(node)->subscriber.sin6_addr), addr, INET6_ADDRSTRLEN) ) {
+    if ( inet_ntop(AF_INET6, &(sub->subscriber.sin6_addr), addr, INET6_ADDRSTRLEN) ) {
       
-      debug("** removed expired subscription from [%s]:%d\n", addr, ntohs(COAP_SUBSCRIPTION(node)->subscriber.sin6_port));
+      debug("** removed expired subscription from [%s]:%d\n", addr, ntohs(sub->subscriber.sin6_port));
     }
 #endif
 #if 0
-    notify(context, 
-	   coap_get_resource_from_key(context, COAP_SUBSCRIPTION(node)->resource), 
-	   COAP_SUBSCRIPTION(node), 
-	   0, COAP_RESPONSE_400);
+    notify(context, sub->owner, sub, 0, COAP_RESPONSE_400);
 #endif
-    context->subscriptions = node->next;
-    coap_delete(node);
-    node = context->subscriptions;
+    remove_subscription(context, sub);
   }
 }
 #endif
@@ -192,6 +366,7 @@ coap_check_subscriptions(coap_context_t *context) {
 void
 coap_free_resource(void *res) {
   if ( res ) {
+    coap_delete_list(((coap_resource_t *)res)->subscribers);
     coap_free(((coap_resource_t *)res)->uri);
     coap_delete_string(((coap_resource_t *)res)->name);
   }
@@ -228,23 +403,33 @@ coap_key_t coap_uri_hash(const coap_uri_t *uri) {
 
 coap_key_t 
 coap_add_resource(coap_context_t *context, coap_resource_t *resource) {
-  coap_list_t *node;
+  coap_list_t *node, **bucket;
 
   if ( !context || !resource )
     return COAP_INVALID_HASHKEY;
 
+  if ( !context->resources 
+       && !resize_resources(context, COAP_RESOURCE_BUCKETS) )
+    return COAP_INVALID_HASHKEY;
+
+  /* keep the chains short, but a full table is still correct */
+  if ( context->resource_count >= 2 * context->resource_buckets )
+    resize_resources(context, 2 * context->resource_buckets);
+
   node = coap_new_listnode(resource, coap_free_resource);
   if ( !node )
     return COAP_INVALID_HASHKEY;
 
-  if ( !context->resources ) {
-    context->resources = node;
-  } else {
-    node->next = context->resources;
-    context->resources = node;
-  }
+  resource->key = coap_uri_hash( resource->uri );
+  resource->subscribers = NULL;
+
+  /* push front, so that lookups find the newest resource for a key */
+  bucket = &context->resources[resource_bucket(context, resource->key)];
+  node->next = *bucket;
+  *bucket = node;
+  context->resource_count++;
 
-  return coap_uri_hash( resource->uri );
+  return resource->key;
 }
  
 
@@ -255,20 +440,32 @@ coap_add_resource(coap_context_t *context, coap_resource_t *resource) {
 int
 coap_delete_resource(coap_context_t *context, coap_key_t key) {
   coap_list_t *prev, *node;
+  unsigned int bucket;
 
-  if (!context || key == COAP_INVALID_HASHKEY)
+  if (!context || !context->resources || key == COAP_INVALID_HASHKEY)
     return 0;
 
-  for (prev = NULL, node = context->resources; node; 
+  bucket = resource_bucket(context, key);
+  for (prev = NULL, node = context->resources[bucket]; node; 
        prev = node, node = node->next) {
-    if (coap_uri_hash(COAP_RESOURCE(node)->uri) == key) {
+    if (COAP_RESOURCE(node)->key == key) {
 #ifndef NDEBUG
       debug("removed key %lu (%s)\n",key,COAP_RESOURCE(node)->uri->path.s);
 #endif
       if (!prev)
-	context->resources = node->next;
+	context->resources[bucket] = node->next;
       else
 	prev->next = node->next;
+      context->resource_count--;
+
+#ifndef IDENT_APPNAME
+      /* the subscription objects are freed along with the resource */
+      {
+	coap_list_t *sub;
+	for (sub = COAP_RESOURCE(node)->subscribers; sub; sub = sub->next)
+	  heap_remove(context, COAP_SUBSCRIPTION(sub));
+      }
+#endif
 
       coap_delete(node);
       return 1;
@@ -277,6 +474,28 @@ coap_delete_resource(coap_context_t *context, coap_key_t key) {
   return 0;  
 }
 
+void
+coap_delete_all_resources(coap_context_t *context) {
+  unsigned int i;
+
+  if ( !context )
+    return;
+
+  if ( context->resources ) {
+    for (i = 0; i < context->resource_buckets; i++)
+      coap_delete_list(context->resources[i]);
+    coap_free(context->resources);
+  }
+  context->resources = NULL;
+  context->resource_buckets = context->resource_count = 0;
+
+#ifndef IDENT_APPNAME
+  coap_free(context->subscriptions);
+  context->subscriptions = NULL;
+  context->subscription_count = context->subscription_size = 0;
+#endif
+}
+
 #ifndef IDENT_APPNAME
 coap_subscription_t *
 coap_new_subscription(coap_context_t *context, const coap_uri_t *resource,
@@ -314,14 +533,6 @@ coap_list_push_first(coap_list_t **list, void *data, void (*delete)(void *) ) {
   return node;
 } 
 
-int
-_order_subscription(void *a, void *b) {
-  if ( !a || !b ) 
-    return a < b ? -1 : 1;
-  
-  return ((coap_subscription_t *)a)->expires < ((coap_subscription_t *)b)->expires ? -1 : 1;
-}
-
 coap_key_t 
 coap_subscription_hash(coap_subscription_t *subscription) {
   if ( !subscription )
@@ -334,47 +545,59 @@ coap_subscription_hash(coap_subscription_t *subscription) {
 coap_key_t 
 coap_add_subscription(coap_context_t *context,
 		      coap_subscription_t *subscription) {
+  coap_resource_t *res;
   coap_list_t *node;
+
   if ( !context || !subscription )
     return COAP_INVALID_HASHKEY;
   
-  if ( !(node = coap_new_listnode(subscription, NULL)) ) 
+  if ( !(res = coap_get_resource_from_key(context, subscription->resource)) )
+    return COAP_INVALID_HASHKEY;
+
+  if ( !(node = coap_new_listnode(subscription, coap_free_subscription)) ) 
     return COAP_INVALID_HASHKEY;
 
-  if ( !coap_insert(&context->subscriptions, node, _order_subscription ) ) {
+  if ( !heap_push(context, subscription) ) {
     coap_free( node );	/* do not call coap_delete(), so subscription object will survive */
     return COAP_INVALID_HASHKEY;
   }
 
+  subscription->owner = res;
+  node->next = res->subscribers;
+  res->subscribers = node;
+
   return coap_subscription_hash(subscription); 
 }
 
+static int
+match_subscriber(coap_subscription_t *sub, struct sockaddr_in6 *subscriber) {
+  return subscriber->sin6_port == sub->subscriber.sin6_port
+    && memcmp(&subscriber->sin6_addr, &sub->subscriber.sin6_addr,
+	      sizeof(struct in6_addr)) == 0;
+}
+
 coap_subscription_t *
 coap_find_subscription(coap_context_t *context, 
 		       coap_key_t hashkey,
 		       struct sockaddr_in6 *subscriber,
 		       str *token) {
+  coap_resource_t *res;
   coap_list_t *node;
 
-  if (!context || !subscriber || hashkey == COAP_INVALID_HASHKEY)
+  if (!context || !subscriber || hashkey == COAP_INVALID_HASHKEY
+      || !(res = coap_get_resource_from_key(context, hashkey)))
     return NULL;
 
-  for (node = context->subscriptions; node; node = node->next) {
-    if (COAP_SUBSCRIPTION(node)->resource == hashkey) {
-
-      if (token) {	   /* do not proceed if tokens do not match */
-	if (token->length != COAP_SUBSCRIPTION(node)->token.length ||
-	    memcmp(token->s, COAP_SUBSCRIPTION(node)->token.s, 
-		   token->length) != 0)
-	  continue;
-      }
-
-      if (subscriber->sin6_port == COAP_SUBSCRIPTION(node)->subscriber.sin6_port
-	  && memcmp(&subscriber->sin6_addr, 
-		    &COAP_SUBSCRIPTION(node)->subscriber.sin6_addr,
-		    sizeof(struct in6_addr)) == 0)
-	return COAP_SUBSCRIPTION(node);
+  for (node = res->subscribers; node; node = node->next) {
+    if (token) {	   /* do not proceed if tokens do not match */
+      if (token->length != COAP_SUBSCRIPTION(node)->token.length ||
+	  memcmp(token->s, COAP_SUBSCRIPTION(node)->token.s, 
+		 token->length) != 0)
+	continue;
     }
+
+    if (match_subscriber(COAP_SUBSCRIPTION(node), subscriber))
+      return COAP_SUBSCRIPTION(node);
   }
   return NULL;  
 }
@@ -383,30 +606,17 @@ int
 coap_delete_subscription(coap_context_t *context,
 			 coap_key_t key, 
 			 struct sockaddr_in6 *subscriber) {
-  coap_list_t *prev, *node;
+  coap_resource_t *res;
+  coap_list_t *node;
 
-  if (!context || !subscriber || key == COAP_INVALID_HASHKEY)
+  if (!context || !subscriber || key == COAP_INVALID_HASHKEY
+      || !(res = coap_get_resource_from_key(context, key)))
     return 0;
 
-  for (prev = NULL, node = context->subscriptions; node; 
-       prev = node, node = node->next) {
-    if (COAP_SUBSCRIPTION(node)->resource == key) {
-      if (subscriber->sin6_port == COAP_SUBSCRIPTION(node)->subscriber.sin6_port
-	  && memcmp(&subscriber->sin6_addr, 
-		    &COAP_SUBSCRIPTION(node)->subscriber.sin6_addr,
-		    sizeof(struct in6_addr)) == 0) {
-
-	if (!prev) {
-	  context->subscriptions = node->next;
-	  coap_free(COAP_SUBSCRIPTION(node)->token.s);
-	  coap_delete(node);
-	} else {
-	  prev->next = node->next;
-	  coap_free(COAP_SUBSCRIPTION(node)->token.s);
-	  coap_delete(node);
-	}
-	return 1;
-      }
+  for (node = res->subscribers; node; node = node->next) {
+    if (match_subscriber(COAP_SUBSCRIPTION(node), subscriber)) {
+      remove_subscription(context, COAP_SUBSCRIPTION(node));
+      return 1;
     }
   }
   return 0;  
@@ -64,25 +64,40 @@ typedef struct {
    * this function.
    */
   int (*data)(coap_uri_t *uri, unsigned short *tid, unsigned char *mediatype, unsigned int offset, unsigned char *buf, unsigned int *buflen, int *finished, unsigned int method);
+
+  /* set by coap_add_resource() */
+  coap_key_t key;		/* coap_uri_hash(uri), the key in the resource table */
+  coap_list_t *subscribers;	/* subscriptions for this resource */
 } coap_resource_t;
 
-typedef struct {
+typedef struct coap_subscription_t {
   coap_key_t resource;		/* hash key for subscribed resource */
 #ifndef IDENT_APPNAME
-  time_t expires;		/* expiry time of subscription */
-
+  time_t expires;		/* expiry time of subscription, may be extended */
+  time_t deadline;		/* expiry the subscription heap is ordered by */
+  unsigned int heap_index;	/* position in the subscription heap */
+  coap_resource_t *owner;	/* the resource it was added to */
 #endif
   struct sockaddr_in6 subscriber; /* subscriber's address */
   str token;			  /* subscription token */
 } coap_subscription_t;
 
+/** Initial number of buckets of the resource table, a power of two. */
+#define COAP_RESOURCE_BUCKETS 16
+
 #define COAP_RESOURCE(node) ((coap_resource_t *)(node)->data)
 #define COAP_SUBSCRIPTION(node) ((coap_subscription_t *)(node)->data)
 
 /** Checks subscribed resources for updates and notifies subscribers of changes. */
 void coap_check_resource_list(coap_context_t *context);
 
-/** Removes expired subscriptions. */
+/**
+ * Removes expired subscriptions. The subscriptions are kept in a
+ * min-heap ordered by their deadline, so this only looks at the ones
+ * that are due. A subscription whose expires field has been extended
+ * since it was added is kept and moved down the heap. Note that
+ * shortening expires takes effect at the old expiry time only.
+ */
 void coap_check_subscriptions(coap_context_t *context);
 
 /**
@@ -93,11 +108,30 @@ void coap_check_subscriptions(coap_context_t *context);
 coap_key_t coap_add_resource(coap_context_t *context, coap_resource_t *);
 
 /**
- * Deletes the resource that is identified by key. Returns 1 if the resource was
- * removed, 0 on error (e.g. if no such resource exists). 
+ * Deletes the resource that is identified by key and all subscriptions
+ * for it. Returns 1 if the resource was removed, 0 on error (e.g. if no
+ * such resource exists).
  */
 int coap_delete_resource(coap_context_t *context, coap_key_t key);
 
+/** Deletes all resources and subscriptions stored in context. */
+void coap_delete_all_resources(coap_context_t *context);
+
+/**
+ * Returns the first node of the resource table of context, or NULL if
+ * there are no resources. Together with coap_next_resource(), this
+ * iterates over all resources in no particular order:
+ * @code
+ * for (node = coap_first_resource(ctx); node;
+ *      node = coap_next_resource(ctx, node))
+ *   print_link(COAP_RESOURCE(node), ...);
+ * @endcode
+ */
+coap_list_t *coap_first_resource(coap_context_t *context);
+
+/** Returns the node following node in the resource table, or NULL. */
+coap_list_t *coap_next_resource(coap_context_t *context, coap_list_t *node);
+
 /**
  * Creates a new subscription object filled with the given data. The storage
  * allocated for this object must be released using coap_free(). */
@@ -109,10 +143,11 @@ coap_subscription_t *coap_new_subscription(coap_context_t *context,
 #endif
 
 /**
- * Adds the given subsription object to the observer list. 
+ * Adds the given subsription object to the observer list of its resource.
  * @param context The CoAP context
  * @param subscription A new subscription oobject created with coap_new_subscription()
- * @return A unique hash key for this resource or COAP_INVALID_HASHKEY on error.
+ * @return A unique hash key for this resource or COAP_INVALID_HASHKEY on error
+ * (e.g. if the resource does not exist).
  * The storage allocated for the subscription object is released when it is
  * removed from the subscription list, unless the function has returned 
  * COAP_INVALID_HASHKEY. In this case, the storage must be released by the 
@@ -0,0 +1,420 @@
+/* Capture files of serial forwarder traffic, see capture.h */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+#define CAPTURE_MAGIC "TOSSFCAP"
+
+enum {
+  CAPTURE_VERSION = 1,
+  /* bytes of the file mapped at a time */
+  CAPTURE_WINDOW = 16 << 20,
+  /* the writer grows the file by this much at a time */
+  CAPTURE_GROWTH = 64 << 20
+};
+
+struct capture_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t index_interval;
+  uint64_t realtime;		/* CLOCK_REALTIME (ns) when the capture began */
+  uint64_t first_time;		/* time of the first packet record */
+  uint64_t last_time;		/* time of the last packet record */
+  uint64_t end;			/* offset after the last complete record */
+  uint64_t last_index;		/* offset of the last index record, 0 if none */
+  uint64_t records;		/* number of packet records */
+};
+
+struct record_header {
+  uint32_t length;
+  uint16_t type;
+  uint16_t reserved;
+  uint64_t time;
+};
+
+/* an index record holds the offset of the previous index record and the
+   number of entries (both uint64_t), followed by the entries */
+struct index_entry {
+  uint64_t offset, time;
+};
+
+/* the part of the file that is mapped */
+struct window {
+  uint8_t *map;
+  uint64_t offset, size;
+};
+
+struct capture_writer_t {
+  int fd;
+  struct capture_header *header;
+  struct window window;
+  uint64_t pos, file_size;
+  struct index_entry index[CAPTURE_INDEX_INTERVAL];
+  int indexed;
+};
+
+struct capture_reader_t {
+  int fd;
+  /* mapped, so records appended to a live capture are seen */
+  const struct capture_header *header;
+  struct window window;
+  uint64_t pos;
+};
+
+uint64_t capture_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Returns: a pointer to the length bytes at offset of the file, moving
+     the window if they are not mapped, NULL for failure */
+static uint8_t *map_window(int fd, struct window *w, uint64_t offset,
+			   size_t length, int prot)
+{
+  if (!w->map || offset < w->offset || offset + length > w->offset + w->size)
+    {
+      uint64_t page = sysconf(_SC_PAGESIZE);
+      void *map;
+
+      if (w->map)
+	munmap(w->map, w->size);
+      w->map = NULL;
+      w->offset = offset - offset % page;
+      w->size = CAPTURE_WINDOW;
+      if (offset + length > w->offset + w->size)
+	w->size = offset + length - w->offset;
+      map = mmap(NULL, w->size, prot, MAP_SHARED, fd, w->offset);
+      if (map == MAP_FAILED)
+	return NULL;
+      w->map = map;
+#ifdef MADV_SEQUENTIAL
+      madvise(map, w->size, MADV_SEQUENTIAL);
+#endif
+    }
+  return w->map + (offset - w->offset);
+}
+
+static int grow(capture_writer w, uint64_t size)
+{
+  size = (size + CAPTURE_GROWTH - 1) / CAPTURE_GROWTH * CAPTURE_GROWTH;
+#ifdef __linux__
+  {
+    /* allocate the blocks now: running out of disk space while writing
+       through the mapping would raise SIGBUS */
+    int err = posix_fallocate(w->fd, w->file_size, size - w->file_size);
+
+    if (err)
+      {
+	errno = err;
+	return -1;
+      }
+  }
+#else
+  if (ftruncate(w->fd, size) < 0)
+    return -1;
+#endif
+  w->file_size = size;
+  return 0;
+}
+
+/* appends a record with the head_length bytes at head and the length
+   bytes at data */
+static int append(capture_writer w, int type, uint64_t time,
+		  const void *head, size_t head_length,
+		  const void *data, size_t length)
+{
+  size_t total = head_length + length;
+  uint64_t size = sizeof(struct record_header) + ((total + 7) & ~(size_t)7);
+  struct record_header *r;
+  uint8_t *p;
+
+  if (total > UINT32_MAX)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (w->pos + size > w->file_size && grow(w, w->pos + size) < 0)
+    return -1;
+  p = map_window(w->fd, &w->window, w->pos, size, PROT_READ | PROT_WRITE);
+  if (!p)
+    return -1;
+
+  r = (struct record_header *)p;
+  r->length = total;
+  r->type = type;
+  r->reserved = 0;
+  r->time = time;
+  p += sizeof *r;
+  memcpy(p, head, head_length);
+  memcpy(p + head_length, data, length);
+  memset(p + total, 0, size - sizeof *r - total);
+
+  w->pos += size;
+  /* a reader of the live capture must not see end before the record */
+  __sync_synchronize();
+  w->header->end = w->pos;
+  return 0;
+}
+
+static int write_index(capture_writer w)
+{
+  uint64_t head[2], offset = w->pos;
+
+  head[0] = w->header->last_index;
+  head[1] = w->indexed;
+  if (append(w, CAPTURE_INDEX, w->index[w->indexed - 1].time,
+	     head, sizeof head, w->index, w->indexed * sizeof *w->index) < 0)
+    return -1;
+  w->header->last_index = offset;
+  w->indexed = 0;
+  return 0;
+}
+
+capture_writer open_capture_writer(const char *path)
+{
+  capture_writer w = calloc(1, sizeof *w);
+  struct timespec ts;
+  void *map;
+  int err;
+
+  if (!w)
+    return NULL;
+  w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (w->fd < 0 || grow(w, sizeof *w->header) < 0)
+    goto fail;
+  map = mmap(NULL, sizeof *w->header, PROT_READ | PROT_WRITE, MAP_SHARED,
+	     w->fd, 0);
+  if (map == MAP_FAILED)
+    goto fail;
+
+  w->header = map;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  w->header->version = CAPTURE_VERSION;
+  w->header->index_interval = CAPTURE_INDEX_INTERVAL;
+  w->header->realtime = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  w->header->end = w->pos = sizeof *w->header;
+  memcpy(w->header->magic, CAPTURE_MAGIC, sizeof w->header->magic);
+  return w;
+
+ fail:
+  err = errno;
+  if (w->fd >= 0)
+    close(w->fd);
+  free(w);
+  errno = err;
+  return NULL;
+}
+
+int capture_write(capture_writer w, int type, uint64_t time,
+		  const void *data, size_t length)
+{
+  uint64_t offset = w->pos;
+
+  if (type != CAPTURE_FROM_NODE && type != CAPTURE_TO_NODE)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (append(w, type, time, NULL, 0, data, length) < 0)
+    return -1;
+
+  if (!w->header->records)
+    w->header->first_time = time;
+  w->header->last_time = time;
+  w->header->records++;
+  w->index[w->indexed].offset = offset;
+  w->index[w->indexed].time = time;
+  if (++w->indexed == CAPTURE_INDEX_INTERVAL)
+    return write_index(w);
+  return 0;
+}
+
+int close_capture_writer(capture_writer w)
+{
+  int ok = 0;
+
+  if (w->indexed && write_index(w) < 0)
+    ok = -1;
+  if (w->window.map)
+    munmap(w->window.map, w->window.size);
+  if (msync(w->header, sizeof *w->header, MS_SYNC) < 0)
+    ok = -1;
+  munmap(w->header, sizeof *w->header);
+  /* drop the space allocated ahead */
+  if (ftruncate(w->fd, w->pos) < 0)
+    ok = -1;
+  if (close(w->fd) < 0)
+    ok = -1;
+  free(w);
+  return ok;
+}
+
+capture_reader open_capture_reader(const char *path)
+{
+  capture_reader r = calloc(1, sizeof *r);
+  struct stat st;
+  void *map;
+  int err;
+
+  if (!r)
+    return NULL;
+  r->fd = open(path, O_RDONLY);
+  if (r->fd < 0 || fstat(r->fd, &st) < 0)
+    goto fail;
+  if (st.st_size < (off_t)sizeof *r->header)
+    {
+      errno = EINVAL;
+      goto fail;
+    }
+  map = mmap(NULL, sizeof *r->header, PROT_READ, MAP_SHARED, r->fd, 0);
+  if (map == MAP_FAILED)
+    goto fail;
+  r->header = map;
+  if (memcmp(r->header->magic, CAPTURE_MAGIC, sizeof r->header->magic) ||
+      r->header->version != CAPTURE_VERSION)
+    {
+      munmap(map, sizeof *r->header);
+      errno = EINVAL;
+      goto fail;
+    }
+  r->pos = sizeof *r->header;
+  return r;
+
+ fail:
+  err = errno;
+  if (r->fd >= 0)
+    close(r->fd);
+  free(r);
+  errno = err;
+  return NULL;
+}
+
+/* Effects: reads the header and data of the record at pos, *next is the
+     offset of the following record
+   Returns: 1 if successful, 0 if pos is at the end, -1 for a damaged
+     capture
+*/
+static int read_record(capture_reader r, uint64_t pos,
+		       struct record_header *rh, const uint8_t **data,
+		       uint64_t *next)
+{
+  uint64_t end = r->header->end, size;
+  const uint8_t *p;
+
+  /* see append */
+  __sync_synchronize();
+  if (pos >= end)
+    return 0;
+  if (pos + sizeof *rh > end ||
+      !(p = map_window(r->fd, &r->window, pos, sizeof *rh, PROT_READ)))
+    return -1;
+  memcpy(rh, p, sizeof *rh);
+  size = sizeof *rh + (((uint64_t)rh->length + 7) & ~(uint64_t)7);
+  if (pos + size > end ||
+      !(p = map_window(r->fd, &r->window, pos, size, PROT_READ)))
+    return -1;
+  *data = p + sizeof *rh;
+  *next = pos + size;
+  return 1;
+}
+
+int capture_next(capture_reader r, capture_record *record)
+{
+  for (;;)
+    {
+      struct record_header rh;
+      const uint8_t *data;
+      uint64_t next;
+      int ok = read_record(r, r->pos, &rh, &data, &next);
+
+      if (ok <= 0)
+	return ok;
+      r->pos = next;
+      if (rh.type != CAPTURE_INDEX)
+	{
+	  record->type = rh.type;
+	  record->time = rh.time;
+	  record->data = data;
+	  record->length = rh.length;
+	  return 1;
+	}
+    }
+}
+
+uint64_t capture_first_time(capture_reader r)
+{
+  return r->header->records ? r->header->first_time : 0;
+}
+
+int capture_seek(capture_reader r, uint64_t time)
+{
+  uint64_t index = r->header->last_index, pos = sizeof *r->header;
+
+  /* walk back to the last index that starts at or before time */
+  while (index)
+    {
+      struct record_header rh;
+      const uint8_t *data;
+      const struct index_entry *entries;
+      uint64_t head[2], next, i;
+
+      if (read_record(r, index, &rh, &data, &next) <= 0 ||
+	  rh.type != CAPTURE_INDEX || rh.length < sizeof head)
+	return -1;
+      memcpy(head, data, sizeof head);
+      if (head[1] == 0 ||
+	  rh.length != sizeof head + head[1] * sizeof *entries ||
+	  head[0] >= index)
+	return -1;
+      entries = (const struct index_entry *)(data + sizeof head);
+      if (entries[0].time <= time)
+	{
+	  for (i = 0; i < head[1] && entries[i].time < time; i++)
+	    ;
+	  pos = i < head[1] ? entries[i].offset : next;
+	  break;
+	}
+      index = head[0];
+    }
+
+  /* the rest is not indexed (yet) */
+  for (;;)
+    {
+      struct record_header rh;
+      const uint8_t *data;
+      uint64_t next;
+      int ok = read_record(r, pos, &rh, &data, &next);
+
+      if (ok < 0)
+	return -1;
+      if (ok == 0 || (rh.type != CAPTURE_INDEX && rh.time >= time))
+	break;
+      pos = next;
+    }
+  r->pos = pos;
+  return 0;
+}
+
+int close_capture_reader(capture_reader r)
+{
+  int ok = 0;
+
+  if (r->window.map)
+    munmap(r->window.map, r->window.size);
+  munmap((void *)r->header, sizeof *r->header);
+  if (close(r->fd) < 0)
+    ok = -1;
+  free(r);
+  return ok;
+}
@@ -0,0 +1,98 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/* Capture files of serial forwarder traffic, written by the C and C++
+   serial forwarders and replayed by them to TCP clients.
+
+   A capture is a 64 byte header followed by records, all in host byte
+   order and 8 byte aligned:
+     uint32_t length, uint16_t type, uint16_t reserved, uint64_t time,
+     length bytes of data, padding to a multiple of 8
+   time is CLOCK_MONOTONIC in nanoseconds. Every CAPTURE_INDEX_INTERVAL
+   packet records are followed by a CAPTURE_INDEX record holding the
+   offset of the previous index record, the number of entries and an
+   (offset, time) pair for each of these packets, so a reader can find a
+   point in time without reading the whole capture.
+
+   Both sides map a window of the file at a time rather than the whole
+   file, so captures may be larger than the address space, and the
+   header is kept up to date after every record, so a capture is readable
+   while it is being written or after sf was killed. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct capture_writer_t *capture_writer;
+typedef struct capture_reader_t *capture_reader;
+
+enum {
+  CAPTURE_FROM_NODE = 1,	/* packet read from the serial port */
+  CAPTURE_TO_NODE = 2,		/* packet written to the serial port */
+  CAPTURE_INDEX = 3,		/* index of the preceding packets */
+
+  CAPTURE_INDEX_INTERVAL = 1024
+};
+
+typedef struct {
+  int type;			/* CAPTURE_FROM_NODE or CAPTURE_TO_NODE */
+  uint64_t time;		/* monotonic time in ns */
+  const void *data;
+  size_t length;
+} capture_record;
+
+uint64_t capture_now(void);
+/* Returns: the current CLOCK_MONOTONIC time in ns */
+
+capture_writer open_capture_writer(const char *path);
+/* Effects: creates (or truncates) the capture file path
+   Returns: the writer, or NULL for failure (see errno)
+*/
+
+int capture_write(capture_writer w, int type, uint64_t time,
+		  const void *data, size_t length);
+/* Effects: appends a record of type (CAPTURE_FROM_NODE or
+     CAPTURE_TO_NODE) with the length bytes at data to w. Not thread safe.
+   Returns: 0 if successful, -1 for failure (see errno)
+*/
+
+int close_capture_writer(capture_writer w);
+/* Effects: writes the index of the last packets and closes w
+   Returns: 0 if successful, -1 if some problem occured (but w is
+     considered closed anyway)
+*/
+
+capture_reader open_capture_reader(const char *path);
+/* Returns: a reader positioned at the first record of capture path, or
+     NULL for failure (see errno, EINVAL if path is not a capture)
+*/
+
+int capture_next(capture_reader r, capture_record *record);
+/* Effects: reads the next packet record into *record. record->data
+     stays valid until the next call.
+   Returns: 1 if a record was read, 0 at the end of the capture (more may
+     follow if it is still being written), -1 for a damaged capture
+*/
+
+uint64_t capture_first_time(capture_reader r);
+/* Returns: the time of the first packet record of r, 0 if there is none */
+
+int capture_seek(capture_reader r, uint64_t time);
+/* Effects: positions r at the first packet record at or after time,
+     using the index records to skip the ones before
+   Returns: 0 if successful, -1 for a damaged capture
+*/
+
+int close_capture_reader(capture_reader r);
+/* Effects: closes r
+   Returns: 0 if successful, -1 if some problem occured
+*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
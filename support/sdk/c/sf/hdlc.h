@@ -0,0 +1,90 @@
+#ifndef HDLC_H
+#define HDLC_H
+
+/* HDLC-like framing of the TinyOS serial protocol (see
+   tos/lib/serial/SerialP.nc), shared by the C and C++ serial
+   forwarders. A frame is
+     SYNC, escaped(bytes, crc low byte, crc high byte), SYNC
+   where SYNC and ESCAPE bytes are sent as ESCAPE, byte ^ 0x20 and crc is
+   the CRC-CCITT (polynomial 0x1021, initial value 0) of the bytes.
+
+   The CRC is computed 8 bytes at a time (slice-by-8) and runs of bytes
+   that need no escaping are found a word (or SSE2 vector) at a time and
+   copied in bulk. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  HDLC_SYNC_BYTE = 0x7e,
+  HDLC_ESCAPE_BYTE = 0x7d
+};
+
+uint16_t hdlc_crc_byte(uint16_t crc, uint8_t b);
+/* Returns: crc updated with byte b (the byte-wise reference code) */
+
+uint16_t hdlc_crc(uint16_t crc, const void *data, size_t len);
+/* Returns: crc updated with len bytes at data */
+
+size_t hdlc_scan(const void *data, size_t len);
+/* Returns: the offset of the first SYNC or ESCAPE byte in the len bytes at
+     data, len if there is none */
+
+size_t hdlc_encode(void *frame, const void *data, size_t len);
+/* Effects: frames the len bytes at data (the crc is added) into frame,
+     which must hold at least HDLC_MAX_ENCODED(len) bytes
+   Returns: the number of bytes written to frame
+*/
+#define HDLC_MAX_ENCODED(len) (2 * ((len) + 2) + 2)
+
+int hdlc_check(const void *frame, size_t len);
+/* Returns: true if the len bytes at frame (as returned by hdlc_decode)
+     end with the correct crc
+*/
+
+typedef enum {
+  hdlc_more,			/* all bytes consumed, no frame complete */
+  hdlc_sync,			/* sync achieved */
+  hdlc_frame,			/* frame complete, see hdlc_decoder.length */
+  hdlc_too_long,		/* frame longer than the buffer, sync lost */
+  hdlc_bad_sync			/* sync byte after an escape, frame dropped */
+} hdlc_event;
+
+typedef struct {
+  uint8_t *buffer;		/* frame being received */
+  size_t size;			/* bytes in buffer */
+  size_t count;			/* bytes received for the current frame */
+  size_t length;		/* length of the last complete frame */
+  int in_sync, escaped;
+} hdlc_decoder;
+
+void hdlc_decoder_init(hdlc_decoder *d, void *buffer, size_t size);
+/* Effects: initialises d to decode frames of less than size bytes
+     (including the crc) into buffer. d waits for a sync byte.
+*/
+
+void hdlc_decoder_move(hdlc_decoder *d, void *buffer, size_t size);
+/* Effects: makes d decode into the size bytes at buffer from now on,
+     copying the bytes of the frame received so far (which must fit).
+     Lets a caller decode frames straight into its own memory.
+*/
+
+size_t hdlc_decode(hdlc_decoder *d, const void *bytes, size_t len,
+		   hdlc_event *event);
+/* Effects: decodes the len bytes at bytes, stopping after the first
+     event. If *event is hdlc_frame, the frame (unescaped, including the
+     crc, which is not checked) is in the first d->length bytes of
+     d->buffer until the next call. Empty frames (e.g., the sync bytes
+     between two frames) are not reported.
+   Returns: the number of bytes consumed
+*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
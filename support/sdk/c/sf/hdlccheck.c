@@ -0,0 +1,296 @@
+/* Checks the framing code in hdlc.c against the byte-at-a-time code the
+   serial forwarders used before, and times both, separately on plain
+   packets and on packets where half the bytes need escaping. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "hdlc.h"
+
+enum {
+  MTU = 256,
+  PACKETS = 20000,
+  ROUNDS = 5			/* timings are the best of this many */
+};
+
+enum { MIXED, PLAIN, HEAVY };
+
+static int failures;
+
+static void check(int ok, const char *what, int n)
+{
+  if (!ok)
+    {
+      fprintf(stderr, "FAIL: %s (packet %d)\n", what, n);
+      failures++;
+    }
+}
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* the byte-wise code */
+
+static uint16_t ref_crc(const uint8_t *data, int len)
+{
+  uint16_t crc = 0;
+  int i;
+
+  for (i = 0; i < len; i++)
+    crc = hdlc_crc_byte(crc, data[i]);
+  return crc;
+}
+
+static void ref_escape(uint8_t *out, int *n, uint8_t b)
+{
+  if (b == HDLC_SYNC_BYTE || b == HDLC_ESCAPE_BYTE)
+    {
+      out[(*n)++] = HDLC_ESCAPE_BYTE;
+      out[(*n)++] = b ^ 0x20;
+    }
+  else
+    out[(*n)++] = b;
+}
+
+static int ref_encode(uint8_t *out, const uint8_t *data, int len)
+{
+  uint16_t crc = ref_crc(data, len);
+  int i, n = 0;
+
+  out[n++] = HDLC_SYNC_BYTE;
+  for (i = 0; i < len; i++)
+    ref_escape(out, &n, data[i]);
+  ref_escape(out, &n, crc & 0xff);
+  ref_escape(out, &n, crc >> 8);
+  out[n++] = HDLC_SYNC_BYTE;
+  return n;
+}
+
+static size_t ref_scan(const uint8_t *data, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++)
+    if (data[i] == HDLC_SYNC_BYTE || data[i] == HDLC_ESCAPE_BYTE)
+      break;
+  return i;
+}
+
+/* returns the number of frames in the len bytes at in */
+static int ref_decode(const uint8_t *in, size_t len, uint8_t *buffer)
+{
+  int in_sync = 0, escaped = 0, count = 0, frames = 0;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      uint8_t b = in[i];
+
+      if (!in_sync)
+	{
+	  if (b == HDLC_SYNC_BYTE)
+	    in_sync = 1, escaped = 0, count = 0;
+	  continue;
+	}
+      if (escaped)
+	{
+	  escaped = 0;
+	  if (b == HDLC_SYNC_BYTE)
+	    {
+	      count = 0;
+	      continue;
+	    }
+	  b ^= 0x20;
+	}
+      else if (b == HDLC_ESCAPE_BYTE)
+	{
+	  escaped = 1;
+	  continue;
+	}
+      else if (b == HDLC_SYNC_BYTE)
+	{
+	  if (count > 0 && hdlc_crc(0, buffer, count - 2) ==
+	      (buffer[count - 2] | buffer[count - 1] << 8))
+	    frames++;
+	  count = 0;
+	  continue;
+	}
+      if (count >= MTU + 2)
+	{
+	  in_sync = 0;
+	  continue;
+	}
+      buffer[count++] = b;
+    }
+  return frames;
+}
+
+/* random packets, heavy in bytes that need escaping or not, or a third
+   of them heavy if mixed */
+static int random_packet(uint8_t *packet, int kind)
+{
+  int len = 1 + rand() % (MTU - 10), i;
+  int special = kind == MIXED ? rand() % 3 == 0 : kind == HEAVY;
+
+  for (i = 0; i < len; i++)
+    packet[i] = special && rand() % 2 ? HDLC_SYNC_BYTE - rand() % 2 : rand();
+  return len;
+}
+
+static uint8_t stream[PACKETS * HDLC_MAX_ENCODED(MTU)];
+static uint8_t packets[PACKETS][MTU];
+static int lengths[PACKETS];
+
+static void report(const char *what, double ref_rate, double rate)
+{
+  printf("  %s: byte-wise %.1f MB/s, hdlc.c %.1f MB/s (%.1fx)\n",
+	 what, ref_rate, rate, rate / ref_rate);
+}
+
+/* times crc, encode and decode on PACKETS packets of the given kind */
+static void bench(const char *name, int kind)
+{
+  uint8_t frame[HDLC_MAX_ENCODED(MTU)], buffer[MTU + 2];
+  double t, best[6] = { 0 };
+  size_t streamlen = 0, pos;
+  int i, r, decoded, total = 0;
+  volatile uint16_t sink = 0;
+  hdlc_decoder d;
+
+  for (i = 0; i < PACKETS; i++)
+    {
+      total += lengths[i] = random_packet(packets[i], kind);
+      streamlen += hdlc_encode(stream + streamlen, packets[i], lengths[i]);
+    }
+
+#define TIME(k, bytes, code)				\
+  t = now();						\
+  code;							\
+  t = (bytes) / (now() - t) / 1e6;			\
+  if (t > best[k])					\
+    best[k] = t
+
+  for (r = 0; r < ROUNDS; r++)
+    {
+      TIME(0, total, for (i = 0; i < PACKETS; i++)
+	     sink ^= ref_crc(packets[i], lengths[i]));
+      TIME(1, total, for (i = 0; i < PACKETS; i++)
+	     sink ^= hdlc_crc(0, packets[i], lengths[i]));
+      TIME(2, total, for (i = 0; i < PACKETS; i++)
+	     sink ^= ref_encode(frame, packets[i], lengths[i]));
+      TIME(3, total, for (i = 0; i < PACKETS; i++)
+	     sink ^= hdlc_encode(frame, packets[i], lengths[i]));
+      TIME(4, streamlen,
+	   check(ref_decode(stream, streamlen, buffer) == PACKETS,
+		 "byte-wise decode", 0));
+      TIME(5, streamlen,
+	   hdlc_decoder_init(&d, buffer, sizeof buffer);
+	   for (pos = 0, decoded = 0; pos < streamlen; )
+	     {
+	       hdlc_event event;
+
+	       pos += hdlc_decode(&d, stream + pos, streamlen - pos, &event);
+	       if (event == hdlc_frame && hdlc_check(buffer, d.length))
+		 decoded++;
+	     }
+	   check(decoded == PACKETS, "hdlc_decode", decoded));
+    }
+#undef TIME
+
+  printf("%s packets (%.1f bytes sent per byte):\n", name,
+	 (double)streamlen / total);
+  report("crc", best[0], best[1]);
+  report("encode", best[2], best[3]);
+  report("decode", best[4], best[5]);
+}
+
+int main(int argc, char **argv)
+{
+  uint8_t frame[HDLC_MAX_ENCODED(MTU)], ref[HDLC_MAX_ENCODED(MTU)];
+  uint8_t buffer[MTU + 2];
+  hdlc_decoder d;
+  size_t streamlen = 0, pos;
+  int i, n, decoded;
+
+  srand(argc > 1 ? atoi(argv[1]) : 1);
+
+  for (i = 0; i < PACKETS; i++)
+    {
+      int len = lengths[i] = random_packet(packets[i], MIXED);
+
+      check(hdlc_crc(0, packets[i], len) == ref_crc(packets[i], len), "crc", i);
+      n = hdlc_encode(frame, packets[i], len);
+      check(n == ref_encode(ref, packets[i], len) && !memcmp(frame, ref, n),
+	    "encode", i);
+      check(hdlc_scan(packets[i], len) == ref_scan(packets[i], len), "scan", i);
+      memcpy(stream + streamlen, frame, n);
+      streamlen += n;
+    }
+
+  /* decode the stream in random pieces, with garbage in front */
+  hdlc_decoder_init(&d, buffer, sizeof buffer);
+  memmove(stream + 3, stream, streamlen);
+  stream[0] = 0x11; stream[1] = HDLC_ESCAPE_BYTE; stream[2] = 0x22;
+  streamlen += 3;
+  for (pos = 0, decoded = 0; pos < streamlen; )
+    {
+      size_t piece = 1 + rand() % 300, end = pos + piece;
+
+      if (end > streamlen)
+	end = streamlen;
+      while (pos < end)
+	{
+	  hdlc_event event;
+
+	  pos += hdlc_decode(&d, stream + pos, end - pos, &event);
+	  if (event == hdlc_frame)
+	    {
+	      check(decoded < PACKETS && d.length == lengths[decoded] + 2 &&
+		    hdlc_check(buffer, d.length) &&
+		    !memcmp(buffer, packets[decoded], lengths[decoded]),
+		    "decode", decoded);
+	      decoded++;
+	    }
+	  else
+	    check(event == hdlc_more || event == hdlc_sync, "decode event", decoded);
+	}
+    }
+  check(decoded == PACKETS, "decoded all packets", decoded);
+
+  /* a frame that does not fit is dropped, the next one is decoded */
+  {
+    uint8_t big[2 * MTU], out[HDLC_MAX_ENCODED(2 * MTU) + HDLC_MAX_ENCODED(8)];
+    hdlc_event event;
+
+    memset(big, 1, sizeof big);
+    n = hdlc_encode(out, big, sizeof big);
+    n += hdlc_encode(out + n, big, 8);
+    hdlc_decoder_init(&d, buffer, sizeof buffer);
+    pos = hdlc_decode(&d, out, n, &event);
+    check(event == hdlc_sync, "sync", 0);
+    pos += hdlc_decode(&d, out + pos, n - pos, &event);
+    check(event == hdlc_too_long, "too long", 0);
+    while (pos < n && event != hdlc_frame)
+      pos += hdlc_decode(&d, out + pos, n - pos, &event);
+    check(event == hdlc_frame && d.length == 10 && hdlc_check(buffer, 10),
+	  "frame after too long", 0);
+  }
+
+  bench("plain", PLAIN);
+  bench("escape-heavy", HEAVY);
+
+  if (failures)
+    {
+      fprintf(stderr, "%d failures\n", failures);
+      exit(1);
+    }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,444 @@
+/* Pseudo-terminal emulator of a mote's serial stack, see moteemu.h */
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "moteemu.h"
+#include "hdlc.h"
+#include "serialprotocol.h"
+
+enum {
+  MAX_FRAME = 300,
+  MAX_WINDOW = 16,
+  /* generated packets are not queued behind more than this */
+  MAX_BACKLOG = 64 * 1024,
+  /* longest wait in mote_emulator_run (ns) */
+  MAX_WAIT = 10000000
+};
+
+struct mote_emulator_t {
+  mote_emulator_config config;
+  mote_emulator_stats stats;
+  int fd;			/* master side */
+  int slave_fd;			/* kept open so the forwarder may come and go */
+  char device[64];
+
+  hdlc_decoder decoder;
+  uint8_t frame[MAX_FRAME];
+
+  /* selective repeat receive window, like SerialP's: the oldest seqno
+     not delivered yet and a bitmap of the seqnos after it that were */
+  uint8_t window_base, last_seqno;
+  uint16_t window_mask;
+  int window, delivered;
+
+  /* encoded frames waiting for the line */
+  uint8_t *tx;
+  size_t tx_start, tx_end, tx_size;
+
+  /* bytes the line may carry now in each direction (baud pacing) */
+  double tx_allowance, rx_allowance;
+  uint64_t paced;
+
+  uint64_t next_burst, seqno;
+  unsigned random;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void mote_emulator_defaults(mote_emulator_config *config)
+{
+  memset(config, 0, sizeof *config);
+  config->baud_rate = 115200;
+  config->rate = 100;
+  config->burst = 1;
+  config->payload = 28;
+  config->window = 4;
+  config->seed = 1;
+}
+
+mote_emulator open_mote_emulator(const mote_emulator_config *config)
+{
+  mote_emulator emu = calloc(1, sizeof *emu);
+  struct termios tio;
+  const char *name;
+  int err;
+
+  if (!emu)
+    return NULL;
+  emu->config = *config;
+  if (emu->config.burst < 1)
+    emu->config.burst = 1;
+  if (emu->config.payload < MOTE_EMULATOR_MIN_PAYLOAD)
+    emu->config.payload = MOTE_EMULATOR_MIN_PAYLOAD;
+  if (emu->config.payload > MAX_FRAME - MOTE_EMULATOR_HEADER - 3)
+    emu->config.payload = MAX_FRAME - MOTE_EMULATOR_HEADER - 3;
+  if (emu->config.window > MAX_WINDOW)
+    emu->config.window = MAX_WINDOW;
+  emu->random = config->seed;
+  emu->window = 1;
+  emu->slave_fd = -1;
+  hdlc_decoder_init(&emu->decoder, emu->frame, sizeof emu->frame);
+
+  emu->fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (emu->fd < 0)
+    goto fail;
+  if (grantpt(emu->fd) < 0 || unlockpt(emu->fd) < 0 ||
+      !(name = ptsname(emu->fd)) || strlen(name) >= sizeof emu->device)
+    goto fail;
+  strcpy(emu->device, name);
+  emu->slave_fd = open(emu->device, O_RDWR | O_NOCTTY);
+  if (emu->slave_fd < 0)
+    goto fail;
+  /* no echo of our frames before the forwarder sets the line up */
+  if (tcgetattr(emu->slave_fd, &tio) < 0)
+    goto fail;
+  cfmakeraw(&tio);
+  if (tcsetattr(emu->slave_fd, TCSANOW, &tio) < 0 ||
+      fcntl(emu->fd, F_SETFL, O_NONBLOCK) < 0)
+    goto fail;
+  return emu;
+
+ fail:
+  err = errno;
+  close_mote_emulator(emu);
+  errno = err;
+  return NULL;
+}
+
+const char *mote_emulator_device(mote_emulator emu)
+{
+  return emu->device;
+}
+
+static int lose(mote_emulator emu)
+{
+  if (emu->config.loss > 0 &&
+      rand_r(&emu->random) < emu->config.loss * ((double)RAND_MAX + 1))
+    {
+      emu->stats.lost++;
+      return 1;
+    }
+  return 0;
+}
+
+static size_t backlog(mote_emulator emu)
+{
+  return emu->tx_end - emu->tx_start;
+}
+
+/* queues the len bytes at data as a frame, unless it is lost */
+static int queue_frame(mote_emulator emu, const void *data, size_t len)
+{
+  if (lose(emu))
+    return 0;
+  if (emu->tx_end + HDLC_MAX_ENCODED(len) > emu->tx_size)
+    {
+      size_t used = backlog(emu);
+
+      memmove(emu->tx, emu->tx + emu->tx_start, used);
+      emu->tx_start = 0;
+      emu->tx_end = used;
+      if (used + HDLC_MAX_ENCODED(len) > emu->tx_size)
+	{
+	  size_t size = 2 * (used + HDLC_MAX_ENCODED(len));
+	  uint8_t *tx = realloc(emu->tx, size);
+
+	  if (!tx)
+	    return -1;
+	  emu->tx = tx;
+	  emu->tx_size = size;
+	}
+    }
+  emu->tx_end += hdlc_encode(emu->tx + emu->tx_end, data, len);
+  return 0;
+}
+
+static int send_packets(mote_emulator emu, uint64_t now)
+{
+  uint8_t packet[MAX_FRAME];
+  size_t len = 1 + MOTE_EMULATOR_HEADER + emu->config.payload;
+  int i;
+
+  memset(packet, 0, len);
+  packet[0] = SERIAL_SERIAL_PROTO_PACKET_NOACK;
+  /* AM packet (dispatch 0) to the broadcast address from node 1 */
+  packet[2] = packet[3] = 0xff;
+  packet[5] = 1;
+  packet[6] = emu->config.payload;
+  packet[8] = MOTE_EMULATOR_AM_TYPE;
+  for (i = 0; i < emu->config.burst; i++)
+    {
+      if (backlog(emu) > MAX_BACKLOG)
+	{
+	  emu->stats.overruns++;
+	  continue;
+	}
+      memcpy(packet + 1 + MOTE_EMULATOR_HEADER, &now, sizeof now);
+      memcpy(packet + 1 + MOTE_EMULATOR_HEADER + 8, &emu->seqno, sizeof emu->seqno);
+      emu->seqno++;
+      emu->stats.sent++;
+      if (queue_frame(emu, packet, len) < 0)
+	return -1;
+    }
+  return 0;
+}
+
+static void deliver(mote_emulator emu, const uint8_t *packet, size_t len)
+{
+  emu->stats.received++;
+  if (len >= MOTE_EMULATOR_HEADER + 8 && packet[0] == 0 &&
+      packet[MOTE_EMULATOR_HEADER - 1] == MOTE_EMULATOR_AM_TYPE)
+    {
+      uint64_t sent, now = now_ns();
+
+      memcpy(&sent, packet + MOTE_EMULATOR_HEADER, sizeof sent);
+      if (sent && sent <= now)
+	{
+	  emu->stats.timed++;
+	  emu->stats.latency_sum += now - sent;
+	  if (now - sent > emu->stats.latency_max)
+	    emu->stats.latency_max = now - sent;
+	}
+    }
+}
+
+static void window_slide(mote_emulator emu)
+{
+  while (emu->window_mask & 1)
+    {
+      emu->window_mask >>= 1;
+      emu->window_base++;
+    }
+}
+
+static int delivered_before(mote_emulator emu, uint8_t seqno)
+{
+  uint8_t offset = seqno - emu->window_base;
+
+  if (offset < emu->window)
+    return (emu->window_mask >> offset) & 1;
+  /* the host has at most window seqnos outstanding, so those just
+     below the window were delivered before */
+  return offset >= 256 - emu->window;
+}
+
+static void window_deliver(mote_emulator emu, uint8_t seqno)
+{
+  uint8_t offset = seqno - emu->window_base;
+
+  if (offset >= emu->window)
+    {
+      /* the host gave up on the packets at the bottom of the window */
+      offset -= emu->window - 1;
+      emu->window_base += offset;
+      emu->window_mask = offset < 16 ? emu->window_mask >> offset : 0;
+      offset = emu->window - 1;
+    }
+  emu->window_mask |= 1u << offset;
+  emu->last_seqno = seqno;
+  emu->delivered = 1;
+  window_slide(emu);
+}
+
+static int receive_frame(mote_emulator emu, const uint8_t *frame, size_t len)
+{
+  uint8_t reply[2];
+
+  if (len < 4 || !hdlc_check(frame, len))
+    {
+      emu->stats.bad++;
+      return 0;
+    }
+  len -= 2;
+  if (lose(emu))
+    return 0;
+
+  switch (frame[0])
+    {
+    case SERIAL_SERIAL_PROTO_PACKET_ACK:
+      if (len < 2)
+	break;
+      /* with a window, the ack of a delivered packet may have been lost */
+      if (emu->window > 1 && delivered_before(emu, frame[1]))
+	emu->stats.duplicates++;
+      else
+	{
+	  deliver(emu, frame + 2, len - 2);
+	  window_deliver(emu, frame[1]);
+	}
+      reply[0] = SERIAL_SERIAL_PROTO_ACK;
+      reply[1] = frame[1];
+      emu->stats.acks++;
+      return queue_frame(emu, reply, 2);
+
+    case SERIAL_SERIAL_PROTO_PACKET_NOACK:
+      deliver(emu, frame + 1, len - 1);
+      return 0;
+
+    case SERIAL_SERIAL_PROTO_WINDOW:
+      emu->stats.window_requests++;
+      if (len < 3 || !emu->config.window)
+	return 0;
+      emu->window = frame[2] < 1 ? 1 :
+	frame[2] > emu->config.window ? emu->config.window : frame[2];
+      /* the request carries the host's last seqno */
+      emu->window_base = frame[1];
+      emu->window_mask = emu->delivered && emu->last_seqno == frame[1];
+      window_slide(emu);
+      reply[0] = SERIAL_SERIAL_PROTO_WINDOW;
+      reply[1] = emu->window;
+      return queue_frame(emu, reply, 2);
+    }
+  emu->stats.bad++;
+  return 0;
+}
+
+static int receive(mote_emulator emu)
+{
+  uint8_t bytes[4096];
+  size_t count = sizeof bytes, pos = 0;
+  ssize_t n;
+
+  if (emu->config.baud_rate && count > emu->rx_allowance)
+    count = emu->rx_allowance;
+  n = read(emu->fd, bytes, count);
+  if (n < 0)
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+  if (emu->config.baud_rate)
+    emu->rx_allowance -= n;
+
+  while (pos < (size_t)n)
+    {
+      hdlc_event event;
+
+      pos += hdlc_decode(&emu->decoder, bytes + pos, n - pos, &event);
+      if (event == hdlc_frame &&
+	  receive_frame(emu, emu->frame, emu->decoder.length) < 0)
+	return -1;
+      if (event == hdlc_too_long || event == hdlc_bad_sync)
+	emu->stats.bad++;
+    }
+  return 0;
+}
+
+static int transmit(mote_emulator emu)
+{
+  size_t count = backlog(emu);
+  ssize_t n;
+
+  if (emu->config.baud_rate && count > emu->tx_allowance)
+    count = emu->tx_allowance;
+  if (!count)
+    return 0;
+  n = write(emu->fd, emu->tx + emu->tx_start, count);
+  if (n < 0)
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+  emu->tx_start += n;
+  if (emu->config.baud_rate)
+    emu->tx_allowance -= n;
+  return 0;
+}
+
+/* lets the line carry the bytes of the time since the last call */
+static void pace(mote_emulator emu, uint64_t now)
+{
+  double bytes_per_ns = emu->config.baud_rate / 10 / 1e9;
+  /* at most 10ms worth, a line does not save up */
+  double limit = bytes_per_ns * MAX_WAIT + HDLC_MAX_ENCODED(MAX_FRAME);
+
+  if (!emu->config.baud_rate)
+    return;
+  if (emu->paced)
+    {
+      emu->tx_allowance += (now - emu->paced) * bytes_per_ns;
+      emu->rx_allowance += (now - emu->paced) * bytes_per_ns;
+    }
+  if (emu->tx_allowance > limit)
+    emu->tx_allowance = limit;
+  if (emu->rx_allowance > limit)
+    emu->rx_allowance = limit;
+  emu->paced = now;
+}
+
+int mote_emulator_run(mote_emulator emu, volatile int *stop)
+{
+  uint64_t interval = emu->config.rate > 0 ?
+    emu->config.burst * 1e9 / emu->config.rate : 0;
+
+  emu->next_burst = now_ns();
+  while (!*stop)
+    {
+      struct pollfd pfd;
+      uint64_t now = now_ns(), wait = MAX_WAIT;
+      int pacing = emu->config.baud_rate != 0;
+
+      pace(emu, now);
+      while (interval && now >= emu->next_burst)
+	{
+	  if (send_packets(emu, now) < 0)
+	    return -1;
+	  emu->next_burst += interval;
+	}
+      if (interval && emu->next_burst - now < wait)
+	wait = emu->next_burst - now;
+      if (transmit(emu) < 0)
+	return -1;
+
+      pfd.fd = emu->fd;
+      pfd.events = 0;
+      if (!pacing || emu->rx_allowance >= 1)
+	pfd.events |= POLLIN;
+      if (backlog(emu))
+	{
+	  if (!pacing || emu->tx_allowance >= 1)
+	    pfd.events |= POLLOUT;
+	}
+      /* the line is busy, wait for a few bytes to go through */
+      if (pacing && ((backlog(emu) && emu->tx_allowance < 1) || emu->rx_allowance < 1))
+	{
+	  uint64_t byte = 10 * 1000000000ULL / emu->config.baud_rate;
+
+	  if (byte < wait)
+	    wait = byte;
+	}
+      if (poll(&pfd, 1, (wait + 999999) / 1000000) < 0 && errno != EINTR)
+	return -1;
+      if ((pfd.revents & POLLIN) && receive(emu) < 0)
+	return -1;
+    }
+  return 0;
+}
+
+void mote_emulator_get_stats(mote_emulator emu, mote_emulator_stats *stats)
+{
+  *stats = emu->stats;
+}
+
+int close_mote_emulator(mote_emulator emu)
+{
+  int ok = 0;
+
+  if (emu->slave_fd >= 0 && close(emu->slave_fd) < 0)
+    ok = -1;
+  if (emu->fd >= 0 && close(emu->fd) < 0)
+    ok = -1;
+  free(emu->tx);
+  free(emu);
+  return ok;
+}
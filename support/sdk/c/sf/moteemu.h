@@ -0,0 +1,98 @@
+#ifndef MOTEEMU_H
+#define MOTEEMU_H
+
+/* Emulates the serial stack of a TinyOS mote (tos/lib/serial/SerialP.nc)
+   on the master side of a pseudo-terminal, so the serial forwarders can
+   be run and benchmarked without hardware: point them at the slave
+   device (mote_emulator_device).
+
+   The emulator acks packets sent with SERIAL_PROTO_PACKET_ACK (dropping
+   retransmissions of packets it delivered, like SerialP with a window),
+   answers window requests, and sends packets of its own in bursts at a
+   given rate. Frames are lost with a given probability in each
+   direction, and the bytes are paced at the baud rate of a real serial
+   line if one is set.
+
+   Packets sent by the emulator carry a serial active message header
+   followed by the CLOCK_MONOTONIC time (ns) they were generated and a
+   sequence number, both uint64_t in host byte order:
+     00 ffff 0001 <length> 00 <am type> <time> <seqno> <zeros>
+   Packets sent to it that carry a time at the same offset are counted in
+   the delivery latency. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mote_emulator_t *mote_emulator;
+
+enum {
+  MOTE_EMULATOR_HEADER = 8,	/* serial AM header, including the packet type */
+  MOTE_EMULATOR_MIN_PAYLOAD = 16, /* time and seqno */
+  MOTE_EMULATOR_AM_TYPE = 0x42
+};
+
+typedef struct {
+  int baud_rate;		/* bytes are paced at baud_rate / 10 per
+				   second, 0 for no pacing */
+  double rate;			/* packets per second sent by the mote */
+  int burst;			/* sent back to back every burst / rate s */
+  int payload;			/* payload bytes per packet (at least
+				   MOTE_EMULATOR_MIN_PAYLOAD) */
+  double loss;			/* probability a frame is lost, each way */
+  int window;			/* largest window granted, 0 to ignore
+				   window requests like old motes */
+  unsigned seed;		/* for the loss pattern */
+} mote_emulator_config;
+
+typedef struct {
+  unsigned long sent;		/* packets sent by the mote */
+  unsigned long received;	/* packets delivered to the mote */
+  unsigned long duplicates;	/* retransmissions not delivered again */
+  unsigned long acks;		/* acks sent */
+  unsigned long lost;		/* frames lost on purpose, both ways */
+  unsigned long overruns;	/* packets not sent, the line was busy */
+  unsigned long bad;		/* frames with a bad crc or type */
+  unsigned long window_requests;
+  unsigned long timed;		/* received packets carrying a time */
+  uint64_t latency_sum;		/* their total latency (ns) */
+  uint64_t latency_max;
+} mote_emulator_stats;
+
+void mote_emulator_defaults(mote_emulator_config *config);
+/* Effects: sets config to a 115200 baud mote sending 100 packets/s one at
+     a time with 28 byte payloads, no loss, granting windows up to 4 */
+
+mote_emulator open_mote_emulator(const mote_emulator_config *config);
+/* Returns: an emulator on a new pseudo-terminal, or NULL for failure
+     (see errno)
+*/
+
+const char *mote_emulator_device(mote_emulator emu);
+/* Returns: the name of the slave device the forwarder should open */
+
+int mote_emulator_run(mote_emulator emu, volatile int *stop);
+/* Effects: runs the emulator until *stop is set (checked at least every
+     10ms) or the pseudo-terminal fails
+   Returns: 0 if stopped, -1 for failure (see errno)
+*/
+
+void mote_emulator_get_stats(mote_emulator emu, mote_emulator_stats *stats);
+/* Effects: copies the counters of emu to stats (they are updated by
+     mote_emulator_run without locking, read them after it returned or
+     accept a slightly stale copy)
+*/
+
+int close_mote_emulator(mote_emulator emu);
+/* Effects: closes the pseudo-terminal and frees emu
+   Returns: 0 if successful, -1 if some problem occured
+*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
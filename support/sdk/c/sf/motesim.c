@@ -0,0 +1,74 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "moteemu.h"
+
+static volatile int stop;
+
+static void interrupt(int sig)
+{
+  stop = 1;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-B <baud>] [-r <packets/s>] [-b <burst>] [-s <payload>]\n"
+	  "         [-l <loss>] [-w <window>] - emulate a mote on a pseudo-terminal\n",
+	  name);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  mote_emulator_config config;
+  mote_emulator_stats stats;
+  mote_emulator emu;
+  struct sigaction sa;
+  int opt, ok;
+
+  mote_emulator_defaults(&config);
+  while ((opt = getopt(argc, argv, "B:r:b:s:l:w:")) != -1)
+    switch (opt)
+      {
+      case 'B': config.baud_rate = atoi(optarg); break;
+      case 'r': config.rate = atof(optarg); break;
+      case 'b': config.burst = atoi(optarg); break;
+      case 's': config.payload = atoi(optarg); break;
+      case 'l': config.loss = atof(optarg); break;
+      case 'w': config.window = atoi(optarg); break;
+      default: usage(argv[0]);
+      }
+  if (optind != argc)
+    usage(argv[0]);
+
+  emu = open_mote_emulator(&config);
+  if (!emu)
+    {
+      perror("Couldn't open pseudo-terminal");
+      exit(1);
+    }
+  printf("%s\n", mote_emulator_device(emu));
+  fflush(stdout);
+
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = interrupt;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  ok = mote_emulator_run(emu, &stop);
+  if (ok < 0)
+    perror("Pseudo-terminal failed");
+
+  mote_emulator_get_stats(emu, &stats);
+  printf("sent %lu, received %lu (%lu duplicates), acks %lu, lost %lu, "
+	 "overruns %lu, bad %lu, window requests %lu\n",
+	 stats.sent, stats.received, stats.duplicates, stats.acks, stats.lost,
+	 stats.overruns, stats.bad, stats.window_requests);
+  if (stats.timed)
+    printf("latency to mote: mean %.3f ms, max %.3f ms\n",
+	   stats.latency_sum / 1e6 / stats.timed, stats.latency_max / 1e6);
+  close_mote_emulator(emu);
+  return ok < 0;
+}
@@ -0,0 +1,12 @@
+#include "packetbatch.h"
+
+void packet_batch_init(packet_batch *batch, void *arena, size_t size,
+		       packet_desc *packets, int max_packets)
+{
+  batch->arena = arena;
+  batch->size = size;
+  batch->packets = packets;
+  batch->max_packets = max_packets;
+  batch->count = 0;
+  batch->kept = batch->kept_len = 0;
+}
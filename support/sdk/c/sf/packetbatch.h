@@ -0,0 +1,52 @@
+#ifndef PACKETBATCH_H
+#define PACKETBATCH_H
+
+/* Batches of packets read by read_serial_packets and read_sf_packets.
+   The packets are read into memory provided by the caller (the arena)
+   instead of one malloc'ed buffer per packet, and are described by
+   (offset, length) descriptors. They stay valid until the batch is read
+   into again. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  PACKET_BATCH_MIN_SIZE = 256	/* smallest arena, fits the largest packet */
+};
+
+typedef struct {
+  size_t offset;		/* of the packet in the arena */
+  int len;
+} packet_desc;
+
+typedef struct {
+  uint8_t *arena;
+  size_t size;
+  packet_desc *packets;
+  int max_packets;
+  int count;			/* packets read by the last call */
+
+  /* bytes after the packets that belong to the next packet (sf sources) */
+  size_t kept, kept_len;
+} packet_batch;
+
+void packet_batch_init(packet_batch *batch, void *arena, size_t size,
+		       packet_desc *packets, int max_packets);
+/* Effects: initialises batch to read up to max_packets packets at a time
+     into the size bytes (at least PACKET_BATCH_MIN_SIZE) at arena,
+     describing them in packets.
+*/
+
+#define PACKET_BATCH_DATA(batch, i) \
+  ((batch)->arena + (batch)->packets[i].offset)
+/* Returns: the i-th packet of batch */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
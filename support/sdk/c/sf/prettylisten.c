@@ -5,6 +5,9 @@
 #include "serialpacket.h"
 #include "serialprotocol.h"
 
+/* packets read at a time */
+#define BATCH 64
+
 void hexprint(uint8_t *packet, int len)
 {
   int i;
@@ -16,6 +19,9 @@ void hexprint(uint8_t *packet, int len)
 int main(int argc, char **argv)
 {
   int fd;
+  static uint8_t arena[BATCH * PACKET_BATCH_MIN_SIZE];
+  packet_desc packets[BATCH];
+  packet_batch batch;
 
   if (argc != 3)
     {
@@ -29,40 +35,45 @@ int main(int argc, char **argv)
 	      argv[1], argv[2]);
       exit(1);
     }
+  packet_batch_init(&batch, arena, sizeof arena, packets, BATCH);
   for (;;)
     {
-      int len, i;
-      uint8_t *packet = read_sf_packet(fd, &len);
+      int i;
 
-      if (!packet)
+      if (read_sf_packets(fd, &batch, 0) < 0)
 	exit(0);
 
-      if (len >= 1 + SPACKET_SIZE &&
-	  packet[0] == SERIAL_TOS_SERIAL_ACTIVE_MESSAGE_ID)
+      for (i = 0; i < batch.count; i++)
 	{
-	  tmsg_t *msg = new_tmsg(packet + 1, len - 1);
+	  uint8_t *packet = PACKET_BATCH_DATA(&batch, i);
+	  int len = batch.packets[i].len;
 
-	  if (!msg)
-	    exit(0);
+	  if (len >= 1 + SPACKET_SIZE &&
+	      packet[0] == SERIAL_TOS_SERIAL_ACTIVE_MESSAGE_ID)
+	    {
+	      tmsg_t *msg = new_tmsg(packet + 1, len - 1);
 
-	  printf("dest %u, src %u, length %u, group %u, type %u\n  ",
-		 spacket_header_dest_get(msg),
-		 spacket_header_src_get(msg),
-		 spacket_header_length_get(msg),
-		 spacket_header_group_get(msg),
-		 spacket_header_type_get(msg));
-	  hexprint((uint8_t *)tmsg_data(msg) + spacket_data_offset(0),
-		   tmsg_length(msg) - spacket_data_offset(0));
+	      if (!msg)
+		exit(0);
 
-	  free(msg);
-	}
-      else
-	{
-	  printf("non-AM packet: ");
-	  hexprint(packet, len);
+	      printf("dest %u, src %u, length %u, group %u, type %u\n  ",
+		     spacket_header_dest_get(msg),
+		     spacket_header_src_get(msg),
+		     spacket_header_length_get(msg),
+		     spacket_header_group_get(msg),
+		     spacket_header_type_get(msg));
+	      hexprint((uint8_t *)tmsg_data(msg) + spacket_data_offset(0),
+		       tmsg_length(msg) - spacket_data_offset(0));
+
+	      free(msg);
+	    }
+	  else
+	    {
+	      printf("non-AM packet: ");
+	      hexprint(packet, len);
+	    }
+	  putchar('\n');
 	}
-      putchar('\n');
       fflush(stdout);
-      free((void *)packet);
     }
 }
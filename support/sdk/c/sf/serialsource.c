@@ -35,6 +35,7 @@
 
 #include "serialsource.h"
 #include "serialprotocol.h"
+#include "hdlc.h"
 
 typedef int bool;
 
@@ -48,12 +49,12 @@ enum {
   BUFSIZE = 256,
   MTU = 256,
   ACK_TIMEOUT = 100000, /* in us */
-  SYNC_BYTE = SERIAL_HDLC_FLAG_BYTE,
-  ESCAPE_BYTE = SERIAL_HDLC_CTLESC_BYTE,
+  SEND_RETRIES = 5, /* retransmissions of a send_serial_packet packet */
 
   P_ACK = SERIAL_SERIAL_PROTO_ACK,
   P_PACKET_ACK = SERIAL_SERIAL_PROTO_PACKET_ACK,
   P_PACKET_NO_ACK = SERIAL_SERIAL_PROTO_PACKET_NOACK,
+  P_WINDOW = SERIAL_SERIAL_PROTO_WINDOW,
   P_UNKNOWN = SERIAL_SERIAL_PROTO_PACKET_UNKNOWN
 };
 
@@ -78,15 +79,24 @@ struct serial_source_t {
     uint8_t buffer[BUFSIZE];
     int bufpos, bufused;
     uint8_t packet[MTU];
-    bool in_sync, escaped;
-    int count;
+    hdlc_decoder decoder;
     struct packet_list *queue[256]; // indexed by protocol
   } recv;
   struct {
     uint8_t seqno;
-    uint8_t *escaped;
-    int escapeptr;
-    uint16_t crc;
+
+    /* send_serial_packet state */
+    int window, requested; /* unacked packets the mote accepts / we asked for */
+    bool granted;
+    int unacked;
+    struct {
+      bool used;
+      uint8_t seqno;
+      int retries;
+      struct timeval deadline;
+      int len;
+      uint8_t packet[MTU];
+    } slots[SERIAL_MAX_WINDOW];
   } send;
 };
 
@@ -327,6 +337,8 @@ serial_source open_serial_source(const char *device, int baud_rate,
 	  src->non_blocking = non_blocking;
 	  src->message = message;
 	  src->send.seqno = 37;
+	  src->send.window = 1;
+	  hdlc_decoder_init(&src->recv.decoder, src->recv.packet, MTU);
 
 	  return src;
 	}
@@ -371,6 +383,8 @@ serial_source open_serial_source(const char *device, int baud_rate,
 	  src->non_blocking = non_blocking;
 	  src->message = message;
 	  src->send.seqno = 37;
+	  src->send.window = 1;
+	  hdlc_decoder_init(&src->recv.decoder, src->recv.packet, MTU);
 
 	}
 
@@ -581,35 +595,10 @@ int serial_source_empty(serial_source src)
     !packet_available(src, P_PACKET_NO_ACK);
 }
 
-/* Slow implementation of crc function */
-static uint16_t crc_byte(uint16_t crc, uint8_t b)
-{
-  uint8_t i;
-  
-  crc = crc ^ b << 8;
-  i = 8;
-  do
-    if (crc & 0x8000)
-      crc = crc << 1 ^ 0x1021;
-    else
-      crc = crc << 1;
-  while (--i);
-
-  return crc;
-}
-
-static uint16_t crc_packet(uint8_t *data, int len)
-{
-  uint16_t crc = 0;
-
-  while (len-- > 0)
-    crc = crc_byte(crc, *data++);
-
-  return crc;
-}
-
-static int read_byte(serial_source src, int non_blocking)
-/* Returns: next byte (>= 0), or -1 if no data available and non-blocking is true.
+static int fill_buffer(serial_source src, int non_blocking)
+/* Effects: reads more bytes into the receive buffer if it is empty
+   Returns: 0 if the buffer holds some bytes, or -1 if no data available
+     and non-blocking is true.
 */
 {
   if (src->recv.bufpos >= src->recv.bufused)
@@ -640,8 +629,7 @@ static int read_byte(serial_source src, int non_blocking)
 #endif
     }
     }
-  //printf("in %02x\n", src->recv.buffer[src->recv.bufpos]);
-  return src->recv.buffer[src->recv.bufpos++];
+  return 0;
 }
 
 static void process_packet(serial_source src, uint8_t *packet, int len);
@@ -657,94 +645,97 @@ static void read_and_process(serial_source src, int non_blocking)
 
   for (;;)
     {
-      int byte = read_byte(src, non_blocking);
+      hdlc_event event;
+      uint8_t *received;
+      int count;
 
-      if (byte < 0)
+      if (fill_buffer(src, non_blocking) < 0)
 	return;
 
-      if (!src->recv.in_sync)
+      src->recv.bufpos += hdlc_decode(&src->recv.decoder,
+				      src->recv.buffer + src->recv.bufpos,
+				      src->recv.bufused - src->recv.bufpos,
+				      &event);
+      switch (event)
 	{
-	  if (byte == SYNC_BYTE)
-	    {
-	      src->recv.in_sync = TRUE;
-	      message(src, msg_sync);
-	      src->recv.count = 0;
-	      src->recv.escaped = FALSE;
-	    }
+	case hdlc_sync:
+	  message(src, msg_sync);
 	  continue;
-	}
-      if (src->recv.count >= MTU)
-	{
+	case hdlc_too_long:
 	  message(src, msg_too_long);
-	  src->recv.in_sync = FALSE;
+	  continue;
+	case hdlc_bad_sync:
+	  message(src, msg_bad_sync);
+	  continue;
+	case hdlc_frame:
+	  break;
+	default:
 	  continue;
 	}
-      if (src->recv.escaped)
+
+      count = src->recv.decoder.length;
+      if (count < 4)
+	/* frames that are too small are ignored */
+	continue;
+
+#ifdef DEBUG
+      dump("received", packet, count);
+#endif
+      if (!hdlc_check(packet, count))
 	{
-	  if (byte == SYNC_BYTE)
-	    {
-	      /* sync byte following escape is an error, resync */
-	      message(src, msg_bad_sync);
-	      src->recv.in_sync = FALSE;
-	      continue;
-	    }
-	  byte ^= 0x20;
-	  src->recv.escaped = FALSE;
+	  message(src, msg_bad_crc);
+	  /* We don't lose sync here. If we did, garbage on the line
+	     at startup will cause loss of the first packet. */
+	  continue;
 	}
-      else if (byte == ESCAPE_BYTE)
+
+      received = malloc(count - 2);
+      if (!received)
 	{
-	  src->recv.escaped = TRUE;
+	  message(src, msg_no_memory);
 	  continue;
 	}
-      else if (byte == SYNC_BYTE)
-	{
-	  int count = src->recv.count;
-	  uint8_t *received;
-	  uint16_t read_crc, computed_crc;
-
-	  src->recv.count = 0; /* ready for next packet */
-
-	  if (count < 4)
-	    /* frames that are too small are ignored */
-	    continue;
+      memcpy(received, packet, count - 2);
+      process_packet(src, received, count - 2);
+      return; /* give rest of world chance to do something */
+    }
+}
 
-	  received = malloc(count - 2);
-	  if (!received)
-	    {
-	      message(src, msg_no_memory);
-	      continue;
-	    }
-	  memcpy(received, packet, count - 2);
+static void ack_unacked(serial_source src, uint8_t seqno);
 
-	  read_crc = packet[count - 2] | packet[count - 1] << 8;
-	  computed_crc = crc_packet(received, count - 2);
+static bool process_control_packet(serial_source src, const uint8_t *packet)
+/* Effects: handles packet if it is a window or an ack for
+     send_serial_packet
+   Returns: true if it was
+*/
+{
+  if (packet[0] == P_WINDOW)
+    {
+      /* answer to serial_source_set_window. The mote has no seqno */
+      int granted = packet[1];
 
-#ifdef DEBUG
-	  dump("received", packet, count);
-	  printf("  crc %x comp %x\n", read_crc, computed_crc);
-#endif
-	  if (read_crc == computed_crc) 
-	    {
-	      process_packet(src, received, count - 2);
-	      return; /* give rest of world chance to do something */
-	    }
-	  else
-	    {
-	      message(src, msg_bad_crc);
-	      free(received);
-	      /* We don't lose sync here. If we did, garbage on the line
-		 at startup will cause loss of the first packet. */
-	      continue;
-	    }
-	}
-      packet[src->recv.count++] = byte;
+      src->send.window = granted < 1 ? 1 :
+	granted > src->send.requested ? src->send.requested : granted;
+      src->send.granted = TRUE;
+      return TRUE;
+    }
+  if (packet[0] == P_ACK && src->send.unacked > 0)
+    {
+      ack_unacked(src, packet[1]);
+      return TRUE;
     }
+  return FALSE;
 }
 
 static void process_packet(serial_source src, uint8_t *packet, int len)
 {
   int packet_type = packet[0], offset = 1;
 
+  if (process_control_packet(src, packet))
+    {
+      free(packet);
+      return;
+    }
   if (packet_type == P_PACKET_ACK)
     {
       /* send ack */
@@ -789,49 +780,114 @@ void *read_serial_packet(serial_source src, int *len)
     }
 }
 
-/* The escaper does the sync bytes+escape-like encoding+crc of packets */
-
-static void escape_add(serial_source src, uint8_t b)
+int read_serial_packets(serial_source src, packet_batch *batch, int drain)
+/* Effects: Read the serial source src into batch: as many packets as are
+     available, without blocking once there is one. If drain is false and
+     src is in blocking mode, wait until there is one.
+   Returns: the number of packets read (also in batch->count)
+*/
 {
-  src->send.escaped[src->send.escapeptr++] = b;
-}
+  hdlc_decoder *decoder = &src->recv.decoder;
+  bool wait = !drain && !src->non_blocking;
+  size_t used = 0;
 
-static int init_escaper(serial_source src, int count)
-{
-  src->send.escaped = malloc(count * 2 + 2);
-  if (!src->send.escaped)
+  batch->count = 0;
+
+  /* packets queued by read_serial_packet's helpers come first */
+  while (batch->count < batch->max_packets &&
+	 packet_available(src, P_PACKET_NO_ACK) &&
+	 src->recv.queue[P_PACKET_NO_ACK]->len <= batch->size - used)
     {
-      message(src, msg_no_memory);
-      return -1;
+      struct packet_list *entry = pop_protocol_packet(src, P_PACKET_NO_ACK);
+
+      memcpy(batch->arena + used, entry->packet, entry->len);
+      batch->packets[batch->count].offset = used;
+      batch->packets[batch->count++].len = entry->len;
+      used += entry->len;
+      free(entry->packet);
+      free(entry);
     }
-  src->send.escapeptr = 0;
-  src->send.crc = 0;
-
-  escape_add(src, SYNC_BYTE);
 
-  return 0;
-}
+  /* frames are decoded straight into the arena, the packets aren't
+     copied again */
+  while (batch->count < batch->max_packets && batch->size - used >= MTU)
+    {
+      uint8_t *frame = batch->arena + used;
+      hdlc_event event;
+      int count, offset;
+
+      if (fill_buffer(src, !wait || batch->count > 0) < 0)
+	break;
+
+      hdlc_decoder_move(decoder, frame, MTU);
+      src->recv.bufpos += hdlc_decode(decoder,
+				      src->recv.buffer + src->recv.bufpos,
+				      src->recv.bufused - src->recv.bufpos,
+				      &event);
+      switch (event)
+	{
+	case hdlc_sync:
+	  message(src, msg_sync);
+	  continue;
+	case hdlc_too_long:
+	  message(src, msg_too_long);
+	  continue;
+	case hdlc_bad_sync:
+	  message(src, msg_bad_sync);
+	  continue;
+	case hdlc_frame:
+	  break;
+	default:
+	  continue;
+	}
 
-static void terminate_escaper(serial_source src)
-{
-  escape_add(src, SYNC_BYTE);
-}
+      count = decoder->length;
+      if (count < 4)
+	continue;
+#ifdef DEBUG
+      dump("received", frame, count);
+#endif
+      if (!hdlc_check(frame, count))
+	{
+	  message(src, msg_bad_crc);
+	  continue;
+	}
+      count -= 2;
 
-static void escape_byte(serial_source src, uint8_t b)
-{
-  src->send.crc = crc_byte(src->send.crc, b);
-  if (b == SYNC_BYTE || b == ESCAPE_BYTE)
-    {
-      escape_add(src, ESCAPE_BYTE);
-      escape_add(src, b ^ 0x20);
+      if (frame[0] == P_PACKET_NO_ACK)
+	offset = 1;
+      else if (frame[0] == P_PACKET_ACK)
+	{
+	  write_framed_packet(src, P_ACK, frame[1], NULL, 0);
+	  offset = 2;
+	}
+      else
+	{
+	  /* the frame's space in the arena is reused */
+	  if (!process_control_packet(src, frame))
+	    {
+	      /* queued, as read_serial_packet does */
+	      uint8_t *received = malloc(count);
+
+	      if (!received)
+		message(src, msg_no_memory);
+	      else
+		{
+		  memcpy(received, frame, count);
+		  process_packet(src, received, count);
+		}
+	    }
+	  continue;
+	}
+      batch->packets[batch->count].offset = used + offset;
+      batch->packets[batch->count++].len = count - offset;
+      used += count;
     }
-  else
-    escape_add(src, b);
-}
 
-static void free_escaper(serial_source src)
-{
-  free(src->send.escaped);
+  /* the frame being received must not stay in the caller's arena */
+  hdlc_decoder_move(decoder, src->recv.packet, MTU);
+
+  return batch->count;
 }
 
 // Write a packet of type 'packetType', first byte 'firstByte'
@@ -840,37 +896,38 @@ static int write_framed_packet(serial_source src,
 			       uint8_t packet_type, uint8_t first_byte,
 			       const uint8_t *packet, int count)
 {
-  int i, crc;
+  uint8_t *raw, *frame;
+  int len;
 
 #ifdef DEBUG
   printf("writing %02x %02x", packet_type, first_byte);
   dump("", packet, count);
 #endif
 
-  if (init_escaper(src, count + 4) < 0)
-    return -1;
-	
-  escape_byte(src, packet_type);
-  escape_byte(src, first_byte);
-  for (i = 0; i < count; i++)
-    escape_byte(src, packet[i]);
+  raw = malloc(count + 2 + HDLC_MAX_ENCODED(count + 2));
+  if (!raw)
+    {
+      message(src, msg_no_memory);
+      return -1;
+    }
+  frame = raw + count + 2;
 
-  crc = src->send.crc;
-  escape_byte(src, crc & 0xff);
-  escape_byte(src, crc >> 8);
-  
-  terminate_escaper(src);
+  raw[0] = packet_type;
+  raw[1] = first_byte;
+  if (count > 0)
+    memcpy(raw + 2, packet, count);
+  len = hdlc_encode(frame, raw, count + 2);
 
 #ifdef DEBUG
-  dump("encoded", src->send.escaped, src->send.escapeptr);
+  dump("encoded", frame, len);
 #endif
 
-  if (source_write(src, src->send.escaped, src->send.escapeptr) < 0)
+  if (source_write(src, frame, len) < 0)
     {
-      free_escaper(src);
+      free(raw);
       return -1;
     }
-  free_escaper(src);
+  free(raw);
   return 0;
 }
 
@@ -925,6 +982,196 @@ int write_serial_packet(serial_source src, const void *packet, int len)
     }
 }
 
+int serial_source_set_window(serial_source src, int window)
+/* Effects: asks the mote to accept up to window packets written by
+     send_serial_packet before they are acknowledged. Motes with an older
+     serial stack do not answer, the window then stays at 1.
+   Returns: the window the mote accepted, -1 if the request could not
+     be written
+*/
+{
+  uint8_t request;
+  int attempt;
+
+  if (window < 1)
+    window = 1;
+  if (window > SERIAL_MAX_WINDOW)
+    window = SERIAL_MAX_WINDOW;
+  src->send.window = 1;
+  src->send.requested = window;
+  src->send.granted = FALSE;
+  if (window == 1)
+    return 1;
+
+  /* source_wait ignores the deadline on Windows, where we would wait
+     forever for old motes: stay with stop-and-wait there */
+#ifndef LOSE32
+  request = window;
+  for (attempt = 0; attempt < 2 && !src->send.granted; attempt++)
+    {
+      struct timeval deadline;
+
+      if (write_framed_packet(src, P_WINDOW, src->send.seqno, &request, 1) < 0)
+	return -1;
+
+      gettimeofday(&deadline, NULL);
+      add_timeval(&deadline, ACK_TIMEOUT);
+      do
+	read_and_process(src, TRUE);
+      while (!src->send.granted && source_wait(src, &deadline) == 0);
+    }
+#endif
+
+  return src->send.window;
+}
+
+static void ack_unacked(serial_source src, uint8_t seqno)
+{
+  int i;
+
+  for (i = 0; i < SERIAL_MAX_WINDOW; i++)
+    if (src->send.slots[i].used && src->send.slots[i].seqno == seqno)
+      {
+	src->send.slots[i].used = FALSE;
+	src->send.unacked--;
+	return;
+      }
+}
+
+static bool window_open(serial_source src)
+{
+  int i;
+
+  if (src->send.unacked >= src->send.window)
+    return FALSE;
+  /* The mote's receive window starts at the oldest seqno it has not
+     delivered, which is at least our oldest unacked one: the next
+     seqno must stay within window of that */
+  for (i = 0; i < SERIAL_MAX_WINDOW; i++)
+    if (src->send.slots[i].used &&
+	(uint8_t)(src->send.seqno + 1 - src->send.slots[i].seqno) >= src->send.window)
+      return FALSE;
+  return TRUE;
+}
+
+int serial_source_window_open(serial_source src)
+/* Returns: true if send_serial_packet would write a packet to serial
+     source src without waiting for acknowledgements
+*/
+{
+  return window_open(src);
+}
+
+static bool timeval_before(struct timeval *a, struct timeval *b)
+{
+  return a->tv_sec < b->tv_sec ||
+    (a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec);
+}
+
+int serial_source_service(serial_source src, struct timeval *timeout)
+/* Effects: processes acknowledgements received on serial source src and
+     retransmits packets written by send_serial_packet that were not
+     acknowledged in time. Packets are dropped (signalling
+     msg_ack_timeout) after SEND_RETRIES retransmissions.
+   Returns: the number of unacknowledged packets, -1 if a retransmission
+     could not be written. If that number is not 0, *timeout is set to
+     the time until the next retransmission.
+*/
+{
+  struct timeval now, *next = NULL;
+  int i;
+
+  read_and_process(src, TRUE);
+  gettimeofday(&now, NULL);
+  for (i = 0; i < SERIAL_MAX_WINDOW; i++)
+    {
+      struct timeval *deadline = &src->send.slots[i].deadline;
+
+      if (!src->send.slots[i].used)
+	continue;
+      if (!timeval_before(&now, deadline))
+	{
+	  if (src->send.slots[i].retries++ == SEND_RETRIES)
+	    {
+	      message(src, msg_ack_timeout);
+	      src->send.slots[i].used = FALSE;
+	      src->send.unacked--;
+	      continue;
+	    }
+	  if (write_framed_packet(src, P_PACKET_ACK, src->send.slots[i].seqno,
+				  src->send.slots[i].packet,
+				  src->send.slots[i].len) < 0)
+	    return -1;
+	  *deadline = now;
+	  add_timeval(deadline, ACK_TIMEOUT);
+	}
+      if (!next || timeval_before(deadline, next))
+	next = deadline;
+    }
+
+  if (next)
+    {
+      timeout->tv_sec = next->tv_sec - now.tv_sec;
+      timeout->tv_usec = next->tv_usec - now.tv_usec;
+      if (timeout->tv_usec < 0)
+	{
+	  timeout->tv_usec += 1000000;
+	  timeout->tv_sec--;
+	}
+    }
+
+  return src->send.unacked;
+}
+
+int send_serial_packet(serial_source src, const void *packet, int len)
+/* Effects: writes len byte packet to serial source src without waiting
+     for its acknowledgement. Waits (processing acknowledgements and
+     retransmitting, see serial_source_service) while the window accepted
+     by the mote is full. With a window of 1 this is stop-and-wait with
+     retransmissions.
+   Returns: 0 if packet successfully written, -1 otherwise
+*/
+{
+  int i;
+
+  if (len > MTU)
+    return -1;
+
+  while (!window_open(src))
+    {
+      struct timeval timeout, deadline;
+
+      if (serial_source_service(src, &timeout) < 0)
+	return -1;
+      if (window_open(src))
+	break;
+#ifndef LOSE32
+      gettimeofday(&deadline, NULL);
+      add_timeval(&deadline, timeout.tv_sec * 1000000 + timeout.tv_usec);
+      source_wait(src, &deadline);
+#endif
+    }
+
+  for (i = 0; src->send.slots[i].used; i++)
+    ;
+  src->send.seqno++;
+  if (write_framed_packet(src, P_PACKET_ACK, src->send.seqno, packet, len) < 0)
+    return -1;
+
+  src->send.slots[i].used = TRUE;
+  src->send.slots[i].seqno = src->send.seqno;
+  src->send.slots[i].retries = 0;
+  src->send.slots[i].len = len;
+  memcpy(src->send.slots[i].packet, packet, len);
+#ifndef LOSE32
+  gettimeofday(&src->send.slots[i].deadline, NULL);
+  add_timeval(&src->send.slots[i].deadline, ACK_TIMEOUT);
+#endif
+  src->send.unacked++;
+
+  return 0;
+}
+
 /* This somewhat convoluted code allows us to use a common baudrate table
    with the Java code. This could be improved if we generated the Java
    code from a common table.
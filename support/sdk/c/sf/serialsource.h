@@ -3,8 +3,12 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <sys/time.h>
 #endif
 
+#include "packetbatch.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,6 +28,10 @@ typedef enum {
   msg_unix_error		/* check errno for details */
 } serial_source_msg;
 
+enum {
+  SERIAL_MAX_WINDOW = 16	/* largest window of send_serial_packet */
+};
+
 serial_source open_serial_source(const char *device, int baud_rate,
 				 int non_blocking,
 				 void (*message)(serial_source_msg problem));
@@ -75,12 +83,61 @@ void *read_serial_packet(serial_source src, int *len);
      the serial source is in non-blocking mode
 */
 
+int read_serial_packets(serial_source src, packet_batch *batch, int drain);
+/* Effects: Read the serial source src into batch: as many packets as are
+     available (and fit), without allocating memory. Frames are decoded
+     straight into the batch's arena. Once there is a packet, or if drain
+     is true or the serial source is in non-blocking mode, the source is
+     only read while data is available, so a caller can select on
+     serial_source_fd and drain the source when it is readable (or when
+     serial_source_empty is false). Otherwise waits for a packet.
+   Returns: the number of packets read (also in batch->count), which are
+     valid until the next read into batch
+*/
+
 int write_serial_packet(serial_source src, const void *packet, int len);
 /* Effects: writes len byte packet to serial source src
    Returns: 0 if packet successfully written, 1 if successfully written
      but not acknowledged, -1 otherwise
 */
 
+int serial_source_set_window(serial_source src, int window);
+/* Effects: asks the mote to accept up to window (at most
+     SERIAL_MAX_WINDOW) packets written by send_serial_packet before they
+     are acknowledged. Motes with an older serial stack do not answer,
+     the window then stays at 1.
+   Returns: the window the mote accepted, -1 if the request could not
+     be written
+*/
+
+int send_serial_packet(serial_source src, const void *packet, int len);
+/* Effects: writes len byte packet to serial source src without waiting
+     for its acknowledgement. Waits (processing acknowledgements and
+     retransmitting, see serial_source_service) while the window accepted
+     by the mote is full. With a window of 1 this is stop-and-wait with
+     retransmissions.
+     Packets following a lost packet may reach the mote before its
+     retransmission.
+   Returns: 0 if packet successfully written, -1 otherwise
+*/
+
+int serial_source_window_open(serial_source src);
+/* Returns: true if send_serial_packet would write a packet to serial
+     source src without waiting for acknowledgements, so that event-driven
+     callers can queue packets until it is (and call serial_source_service
+     when the source is readable or its timeout expires)
+*/
+
+int serial_source_service(serial_source src, struct timeval *timeout);
+/* Effects: processes acknowledgements received on serial source src and
+     retransmits packets written by send_serial_packet that were not
+     acknowledged in time. Packets are dropped (signalling
+     msg_ack_timeout) after a few retransmissions.
+   Returns: the number of unacknowledged packets, -1 if a retransmission
+     could not be written. If that number is not 0, *timeout is set to
+     the time until the next retransmission.
+*/
+
 int platform_baud_rate(char *platform_name);
 /* Returns: The baud rate of the specified platform, or -1 for unknown
      platforms. If platform_name starts with a digit, just return 
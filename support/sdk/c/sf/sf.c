@@ -13,10 +13,24 @@
 
 #include "sfsource.h"
 #include "serialsource.h"
+#include "capture.h"
 
 serial_source src;
+int window = 1; /* unacked packets the mote accepts */
 int server_socket;
 int packets_read, packets_written, num_clients;
+capture_writer capture;
+volatile sig_atomic_t stop;
+
+#define DEFAULT_WINDOW 8
+/* packets replayed at a time at max speed, between looking for clients */
+#define REPLAY_BATCH 64
+/* packets read from the mote at a time */
+#define SERIAL_BATCH 32
+
+packet_batch serial_batch;
+uint8_t serial_arena[SERIAL_BATCH * PACKET_BATCH_MIN_SIZE];
+packet_desc serial_packets[SERIAL_BATCH];
 
 struct client_list
 {
@@ -217,22 +231,45 @@ void open_serial(const char *dev, int baud)
     }
 }
 
+void capture_packet(int type, const void *packet, int len)
+{
+  if (capture && capture_write(capture, type, capture_now(), packet, len) < 0)
+    {
+      perror("capture");
+      close_capture_writer(capture);
+      capture = NULL;
+    }
+}
+
 void check_serial(void)
 {
-  int len;
-  const unsigned char *packet = read_serial_packet(src, &len);
+  int i;
 
-  if (packet)
+  read_serial_packets(src, &serial_batch, 1);
+  for (i = 0; i < serial_batch.count; i++)
     {
+      const uint8_t *packet = PACKET_BATCH_DATA(&serial_batch, i);
+      int len = serial_batch.packets[i].len;
+
       packets_read++;
+      capture_packet(CAPTURE_FROM_NODE, packet, len);
       dispatch_packet(packet, len);
-      free((void *)packet);
     }
 }
 
 void forward_packet(const void *packet, int len)
 {
-  int ok = write_serial_packet(src, packet, len);
+  int ok;
+
+  if (!src)
+    return; /* replaying, there is no mote */
+
+  capture_packet(CAPTURE_TO_NODE, packet, len);
+  if (window > 1)
+    /* not acknowledged packets are noted by serial_source_service */
+    ok = send_serial_packet(src, packet, len);
+  else
+    ok = write_serial_packet(src, packet, len);
 
   packets_written++;
   if (ok < 0)
@@ -241,35 +278,162 @@ void forward_packet(const void *packet, int len)
     fprintf(stderr, "Note: write failed\n");
 }
 
+void stop_signal(int sig)
+{
+  stop = 1;
+}
+
+/* serves the packets read from the mote in capture path to the clients,
+   speed times faster than they were captured (all at once if speed is 0),
+   starting start seconds into the capture when the first client is there */
+void replay(const char *path, double speed, double start)
+{
+  capture_reader r = open_capture_reader(path);
+  capture_record record;
+  uint64_t first_time, wall = 0, delay = 0;
+  int pending = 0, done = 0;
+
+  if (!r)
+    {
+      perror(path);
+      exit(1);
+    }
+  first_time = capture_first_time(r) + (uint64_t)(start * 1e9);
+  unix_check("capture", capture_seek(r, first_time));
+
+  while (!done && !stop)
+    {
+      fd_set rfds;
+      int maxfd = -1, sent;
+      struct timeval timeout;
+
+      FD_ZERO(&rfds);
+      fd_wait(&rfds, &maxfd, server_socket);
+      wait_clients(&rfds, &maxfd);
+      timeout.tv_sec = delay / 1000000000;
+      timeout.tv_usec = delay % 1000000000 / 1000;
+      /* nothing happens before the first client is there */
+      if (select(maxfd + 1, &rfds, NULL, NULL, wall ? &timeout : NULL) >= 0)
+	{
+	  if (FD_ISSET(server_socket, &rfds))
+	    check_new_client();
+	  /* packets from the clients are dropped */
+	  check_clients(&rfds);
+	}
+      if (!wall)
+	{
+	  if (num_clients)
+	    wall = capture_now();
+	  continue;
+	}
+
+      for (sent = 0, delay = 0; sent < REPLAY_BATCH; sent++)
+	{
+	  if (!pending)
+	    {
+	      int ok = capture_next(r, &record);
+
+	      if (ok <= 0)
+		{
+		  unix_check("capture", ok);
+		  done = 1;
+		  break;
+		}
+	      if (record.type != CAPTURE_FROM_NODE)
+		continue;
+	      pending = 1;
+	    }
+	  if (speed > 0 && record.time > first_time)
+	    {
+	      uint64_t due = wall + (uint64_t)((record.time - first_time) / speed);
+	      uint64_t now = capture_now();
+
+	      if (due > now)
+		{
+		  delay = due - now;
+		  break;
+		}
+	    }
+	  pending = 0;
+	  packets_read++;
+	  dispatch_packet(record.data, record.length);
+	}
+    }
+  pstatus();
+  close_capture_reader(r);
+}
+
 int main(int argc, char **argv)
 {
   int serfd;
 
-  if (argc != 4)
+  if (argc >= 4 && !strcmp(argv[2], "replay") && argc <= 6)
+    {
+      double speed = 1;
+
+      if (argc >= 5)
+	speed = strcmp(argv[4], "max") ? atof(argv[4]) : 0;
+      if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+	fprintf(stderr, "Warning: failed to ignore SIGPIPE.\n");
+      signal(SIGINT, stop_signal);
+      signal(SIGTERM, stop_signal);
+      open_server_socket(atoi(argv[1]));
+      replay(argv[3], speed, argc == 6 ? atof(argv[5]) : 0);
+      exit(0);
+    }
+
+  /* capture=<file> may follow the other arguments */
+  if (argc >= 5 && !strncmp(argv[argc - 1], "capture=", 8))
+    {
+      capture = open_capture_writer(argv[argc - 1] + 8);
+      if (!capture)
+	{
+	  perror(argv[argc - 1] + 8);
+	  exit(1);
+	}
+      argc--;
+    }
+
+  if (argc != 4 && argc != 5)
     {
       fprintf(stderr,
-	      "Usage: %s <port> <device> <rate> - act as a serial forwarder on <port>\n"
-	      "(listens to serial port <device> at baud rate <rate>)\n" ,
-	      argv[0]);
+	      "Usage: %s <port> <device> <rate> [<window>] [capture=<file>] - act as a serial forwarder on <port>\n"
+	      "(listens to serial port <device> at baud rate <rate>, sends up to\n"
+	      "<window> packets before waiting for acks if the mote accepts it, default %d,\n"
+	      "and records the packets in both directions in capture <file>)\n"
+	      "   or: %s <port> replay <file> [<speed>|max [<start>]] - serve the packets\n"
+	      "read from the mote in capture <file> to the clients on <port>, <speed> times\n"
+	      "as fast as they were captured (default 1), from <start> seconds into it\n",
+	      argv[0], DEFAULT_WINDOW, argv[0]);
       exit(2);
     }
 
   if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
     fprintf(stderr, "Warning: failed to ignore SIGPIPE.\n");
+  /* let the capture be closed properly */
+  signal(SIGINT, stop_signal);
+  signal(SIGTERM, stop_signal);
 
   open_serial(argv[2], platform_baud_rate(argv[3]));
   serfd = serial_source_fd(src);
+  packet_batch_init(&serial_batch, serial_arena, sizeof serial_arena,
+		    serial_packets, SERIAL_BATCH);
+  window = unix_check("window", serial_source_set_window(src, argc == 5 ? atoi(argv[4]) : DEFAULT_WINDOW));
+  if (window > 1)
+    printf("window %d\n", window);
   open_server_socket(atoi(argv[1]));
 
-  for (;;)
+  while (!stop)
     {
       fd_set rfds;
       int maxfd = -1;
-      struct timeval zero;
-      int serial_empty;
+      struct timeval zero, retransmit;
+      int serial_empty, unacked = 0;
       int ret;
 
       zero.tv_sec = zero.tv_usec = 0;
+      if (window > 1)
+	unacked = unix_check("serial", serial_source_service(src, &retransmit));
 
       FD_ZERO(&rfds);
       fd_wait(&rfds, &maxfd, serfd);
@@ -278,7 +442,7 @@ int main(int argc, char **argv)
 
       serial_empty = serial_source_empty(src);
       if (serial_empty)
-	ret = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+	ret = select(maxfd + 1, &rfds, NULL, NULL, unacked ? &retransmit : NULL);
       else
 	{
 	  ret = select(maxfd + 1, &rfds, NULL, NULL, &zero);
@@ -295,4 +459,7 @@ int main(int argc, char **argv)
 	  check_clients(&rfds);
 	}
     }
+  if (capture)
+    unix_check("capture", close_capture_writer(capture));
+  return 0;
 }
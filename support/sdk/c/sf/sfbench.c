@@ -0,0 +1,413 @@
+/* Measures a serial forwarder (this directory's sf or the C++ one) with
+   an emulated mote (see moteemu.h) and a number of TCP clients: the
+   packets/s delivered to each client, the latency from the mote to the
+   clients and the CPU time the forwarder spends per packet. One JSON
+   object is printed with the results.
+
+   The forwarder command follows the options, with @DEV@ and @PORT@
+   replaced by the pseudo-terminal and the TCP port, e.g.
+     sfbench -c 4 -r 2000 ./sf @PORT@ @DEV@ 115200
+     sfbench -e "start @PORT@ @DEV@ 115200" ../../cpp/sf/sf
+   (-e sends the text to the standard input of the forwarder, the C++
+   forwarder reads its commands there). */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "moteemu.h"
+#include "sfsource.h"
+
+struct sample {
+  uint64_t seqno, latency;
+};
+
+/* A client records every packet from the mote once measuring starts.
+   Only those the mote sent during the measurement count, so packets
+   sent before it are not counted and those still in flight at its end
+   are waited for. */
+struct client {
+  pthread_t thread;
+  int fd;
+  struct sample *samples;
+  size_t count, size;
+};
+
+static volatile int stop, measuring;
+static mote_emulator emu;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-c <clients>] [-t <seconds>] [-p <port>] [-T <packets/s to mote>]\n"
+	  "         [-B <baud>] [-r <packets/s>] [-b <burst>] [-s <payload>]\n"
+	  "         [-l <loss>] [-w <window>] [-e <stdin text>] <forwarder command>\n",
+	  name);
+  exit(2);
+}
+
+static void *run_emulator(void *arg)
+{
+  (void)arg;
+  if (mote_emulator_run(emu, &stop) < 0)
+    perror("Pseudo-terminal failed");
+  return NULL;
+}
+
+static void *run_client(void *arg)
+{
+  struct client *c = arg;
+
+  for (;;)
+    {
+      int len;
+      unsigned char *packet = read_sf_packet(c->fd, &len);
+      uint64_t sent;
+
+      if (!packet)
+	return NULL;
+      if (measuring && len >= MOTE_EMULATOR_HEADER + MOTE_EMULATOR_MIN_PAYLOAD &&
+	  packet[MOTE_EMULATOR_HEADER - 1] == MOTE_EMULATOR_AM_TYPE)
+	{
+	  struct sample *sample;
+
+	  memcpy(&sent, packet + MOTE_EMULATOR_HEADER, sizeof sent);
+	  if (c->count == c->size)
+	    {
+	      size_t size = c->size ? 2 * c->size : 4096;
+	      struct sample *l = realloc(c->samples, size * sizeof *l);
+
+	      if (!l)
+		{
+		  free(packet);
+		  return NULL;
+		}
+	      c->samples = l;
+	      c->size = size;
+	    }
+	  sample = &c->samples[c->count++];
+	  memcpy(&sample->seqno, packet + MOTE_EMULATOR_HEADER + 8, sizeof sample->seqno);
+	  sample->latency = now_ns() - sent;
+	}
+      free(packet);
+    }
+}
+
+/* Returns: the CPU time (s) used so far by process pid, -1 if unknown */
+static double cpu_time(pid_t pid)
+{
+  char path[64], stat[1024], *p;
+  unsigned long utime, stime;
+  size_t n;
+  FILE *f;
+
+  snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+  f = fopen(path, "r");
+  if (!f)
+    return -1;
+  n = fread(stat, 1, sizeof stat - 1, f);
+  fclose(f);
+  stat[n] = '\0';
+  /* the command name may contain spaces, skip past it */
+  p = strrchr(stat, ')');
+  if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+		   &utime, &stime) != 2)
+    return -1;
+  return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/* Returns: command with @DEV@ and @PORT@ substituted, in new memory */
+static char *substitute(const char *command, const char *device, int port)
+{
+  size_t size = strlen(command) + 1;
+  const char *p;
+  char *result, *q;
+
+  for (p = command; (p = strchr(p, '@')); p++)
+    size += strlen(device) + 16;
+  result = q = malloc(size);
+  if (!result)
+    return NULL;
+  while (*command)
+    if (!strncmp(command, "@DEV@", 5))
+      {
+	q += sprintf(q, "%s", device);
+	command += 5;
+      }
+    else if (!strncmp(command, "@PORT@", 6))
+      {
+	q += sprintf(q, "%d", port);
+	command += 6;
+      }
+    else
+      *q++ = *command++;
+  *q = '\0';
+  return result;
+}
+
+static int compare(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *sorted, size_t count, double p)
+{
+  if (!count)
+    return 0;
+  return sorted[(size_t)(p * (count - 1))] / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+  mote_emulator_config config;
+  mote_emulator_stats before, after, drained;
+  struct client *clients;
+  int nclients = 1, port = 9002, opt, i, status, stdin_pipe[2];
+  double seconds = 5, warmup = 1, to_mote = 0, cpu_before, cpu_after, elapsed;
+  const char *input = NULL;
+  uint64_t start, *latencies;
+  unsigned long received = 0, sent_to_mote = 0;
+  size_t count = 0, j;
+  pthread_t emulator;
+  pid_t pid;
+  char **command;
+
+  mote_emulator_defaults(&config);
+  config.rate = 1000;
+  config.baud_rate = 0;
+  while ((opt = getopt(argc, argv, "+c:t:p:T:B:r:b:s:l:w:e:")) != -1)
+    switch (opt)
+      {
+      case 'c': nclients = atoi(optarg); break;
+      case 't': seconds = atof(optarg); break;
+      case 'p': port = atoi(optarg); break;
+      case 'T': to_mote = atof(optarg); break;
+      case 'B': config.baud_rate = atoi(optarg); break;
+      case 'r': config.rate = atof(optarg); break;
+      case 'b': config.burst = atoi(optarg); break;
+      case 's': config.payload = atoi(optarg); break;
+      case 'l': config.loss = atof(optarg); break;
+      case 'w': config.window = atoi(optarg); break;
+      case 'e': input = optarg; break;
+      default: usage(argv[0]);
+      }
+  if (optind == argc || nclients < 1 || seconds <= 0)
+    usage(argv[0]);
+
+  emu = open_mote_emulator(&config);
+  if (!emu)
+    {
+      perror("Couldn't open pseudo-terminal");
+      exit(1);
+    }
+  signal(SIGPIPE, SIG_IGN);
+
+  command = calloc(argc - optind + 1, sizeof *command);
+  for (i = optind; i < argc; i++)
+    command[i - optind] = substitute(argv[i], mote_emulator_device(emu), port);
+  if (pipe(stdin_pipe) < 0)
+    {
+      perror("pipe");
+      exit(1);
+    }
+  pid = fork();
+  if (pid < 0)
+    {
+      perror("fork");
+      exit(1);
+    }
+  if (pid == 0)
+    {
+      dup2(stdin_pipe[0], 0);
+      close(stdin_pipe[0]);
+      close(stdin_pipe[1]);
+      /* the forwarder's reports would get in the way of the results */
+      dup2(2, 1);
+      execvp(command[0], command);
+      perror(command[0]);
+      _exit(127);
+    }
+  close(stdin_pipe[0]);
+  if (input)
+    {
+      char *text = substitute(input, mote_emulator_device(emu), port);
+
+      if (write(stdin_pipe[1], text, strlen(text)) < 0 ||
+	  write(stdin_pipe[1], "\n", 1) < 0)
+	perror("Couldn't write to the forwarder");
+      free(text);
+    }
+
+  if (pthread_create(&emulator, NULL, run_emulator, NULL))
+    {
+      fprintf(stderr, "Couldn't start the emulator\n");
+      exit(1);
+    }
+
+  clients = calloc(nclients, sizeof *clients);
+  for (i = 0; i < nclients; i++)
+    {
+      int tries;
+
+      /* give the forwarder time to start listening */
+      for (tries = 0; (clients[i].fd = open_sf_source("localhost", port)) < 0 &&
+	     tries < 100; tries++)
+	usleep(50000);
+      if (clients[i].fd < 0)
+	{
+	  fprintf(stderr, "Couldn't connect to the forwarder on port %d\n", port);
+	  kill(pid, SIGTERM);
+	  exit(1);
+	}
+      pthread_create(&clients[i].thread, NULL, run_client, &clients[i]);
+    }
+
+  usleep(warmup * 1e6);
+  measuring = 1;
+  mote_emulator_get_stats(emu, &before);
+  cpu_before = cpu_time(pid);
+  start = now_ns();
+  if (to_mote > 0)
+    {
+      /* timed packets to the mote, from each client in turn */
+      unsigned char packet[MOTE_EMULATOR_HEADER + 16];
+      uint64_t next = start, interval = 1e9 / to_mote, seqno = 0;
+
+      memset(packet, 0, sizeof packet);
+      packet[1] = packet[2] = 0xff;
+      packet[6] = 16;
+      packet[7] = MOTE_EMULATOR_AM_TYPE;
+      while (now_ns() - start < seconds * 1e9)
+	{
+	  uint64_t now = now_ns();
+
+	  if (now < next)
+	    {
+	      usleep((next - now) / 1000);
+	      continue;
+	    }
+	  memcpy(packet + MOTE_EMULATOR_HEADER, &now, sizeof now);
+	  memcpy(packet + MOTE_EMULATOR_HEADER + 8, &seqno, sizeof seqno);
+	  if (write_sf_packet(clients[seqno % nclients].fd, packet, sizeof packet) == 0)
+	    sent_to_mote++;
+	  seqno++;
+	  next += interval;
+	}
+    }
+  else
+    usleep(seconds * 1e6);
+  elapsed = (now_ns() - start) / 1e9;
+  cpu_after = cpu_time(pid);
+  mote_emulator_get_stats(emu, &after);
+
+  /* packets may still be on their way, or being retransmitted to the
+     mote: wait at least 0.2s, and up to 5s until those to the mote have
+     all been delivered */
+  drained = after;
+  for (i = 0; i < 50 && (i < 2 || drained.received - before.received < sent_to_mote); i++)
+    {
+      usleep(100000);
+      mote_emulator_get_stats(emu, &drained);
+    }
+
+  /* stop the forwarder, then the clients see their connections close */
+  if (input)
+    {
+      if (write(stdin_pipe[1], "exit\n", 5) < 0)
+	kill(pid, SIGTERM);
+    }
+  else
+    kill(pid, SIGTERM);
+  close(stdin_pipe[1]);
+  for (i = 0; i < 50 && waitpid(pid, &status, WNOHANG) == 0; i++)
+    usleep(100000);
+  if (i == 50)
+    {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+    }
+  if (cpu_before < 0 || cpu_after < 0)
+    {
+      /* no /proc: use the whole run */
+      struct rusage usage;
+
+      getrusage(RUSAGE_CHILDREN, &usage);
+      cpu_before = 0;
+      cpu_after = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+  stop = 1;
+  pthread_join(emulator, NULL);
+  for (i = 0; i < nclients; i++)
+    {
+      shutdown(clients[i].fd, SHUT_RDWR);
+      pthread_join(clients[i].thread, NULL);
+      count += clients[i].count;
+    }
+
+  /* the packets the mote sent while measuring have the seqnos from
+     before.sent on, up to after.sent */
+  latencies = malloc((count ? count : 1) * sizeof *latencies);
+  count = 0;
+  for (i = 0; i < nclients; i++)
+    {
+      for (j = 0; j < clients[i].count; j++)
+	if (clients[i].samples[j].seqno >= before.sent &&
+	    clients[i].samples[j].seqno < after.sent)
+	  latencies[count++] = clients[i].samples[j].latency;
+      free(clients[i].samples);
+      close(clients[i].fd);
+    }
+  received = count;
+  qsort(latencies, count, sizeof *latencies, compare);
+
+  {
+    unsigned long sent = after.sent - before.sent;
+    unsigned long to_mote_received = drained.received - before.received;
+    unsigned long handled = received + to_mote_received;
+    double cpu = cpu_after - cpu_before;
+
+    printf("{\"clients\": %d, \"seconds\": %.3f, \"mote_rate\": %g, \"burst\": %d, "
+	   "\"payload\": %d, \"baud_rate\": %d, \"loss\": %g, "
+	   "\"mote_sent\": %lu, \"client_received\": %lu, "
+	   "\"packets_per_second\": %.1f, \"delivery\": %.4f, "
+	   "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+	   "\"to_mote_sent\": %lu, \"to_mote_received\": %lu, "
+	   "\"to_mote_latency_ms\": %.3f, "
+	   "\"cpu_seconds\": %.3f, \"cpu_us_per_packet\": %.2f, "
+	   "\"overruns\": %lu, \"exit_status\": %d}\n",
+	   nclients, elapsed, config.rate, config.burst, config.payload,
+	   config.baud_rate, config.loss, sent, received,
+	   received / elapsed / nclients,
+	   sent ? (double)received / sent / nclients : 0.0,
+	   percentile(latencies, count, 0.5), percentile(latencies, count, 0.9),
+	   percentile(latencies, count, 0.99),
+	   count ? latencies[count - 1] / 1e6 : 0.0,
+	   sent_to_mote, to_mote_received,
+	   drained.timed > before.timed ?
+	   (drained.latency_sum - before.latency_sum) / 1e6 / (drained.timed - before.timed) : 0.0,
+	   cpu, handled ? cpu * 1e6 / handled : 0.0,
+	   after.overruns - before.overruns,
+	   WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+  }
+  free(latencies);
+  close_mote_emulator(emu);
+  return 0;
+}
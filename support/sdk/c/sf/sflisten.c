@@ -3,9 +3,15 @@
 
 #include "sfsource.h"
 
+/* packets read at a time */
+#define BATCH 64
+
 int main(int argc, char **argv)
 {
   int fd;
+  static unsigned char arena[BATCH * PACKET_BATCH_MIN_SIZE];
+  packet_desc packets[BATCH];
+  packet_batch batch;
 
   if (argc != 3)
     {
@@ -19,17 +25,21 @@ int main(int argc, char **argv)
 	      argv[1], argv[2]);
       exit(1);
     }
+  packet_batch_init(&batch, arena, sizeof arena, packets, BATCH);
   for (;;)
     {
-      int len, i;
-      const unsigned char *packet = read_sf_packet(fd, &len);
+      int i, j;
 
-      if (!packet)
+      if (read_sf_packets(fd, &batch, 0) < 0)
 	exit(0);
-      for (i = 0; i < len; i++)
-	printf("%02x ", packet[i]);
-      putchar('\n');
+      for (j = 0; j < batch.count; j++)
+	{
+	  const unsigned char *packet = PACKET_BATCH_DATA(&batch, j);
+
+	  for (i = 0; i < batch.packets[j].len; i++)
+	    printf("%02x ", packet[i]);
+	  putchar('\n');
+	}
       fflush(stdout);
-      free((void *)packet);
     }
 }
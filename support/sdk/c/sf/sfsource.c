@@ -2,6 +2,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -145,6 +146,65 @@ void *read_sf_packet(int fd, int *len)
   return packet;
 }
 
+static int readable(int fd)
+{
+  struct pollfd p;
+
+  p.fd = fd;
+  p.events = POLLIN;
+  return poll(&p, 1, 0) > 0;
+}
+
+int read_sf_packets(int fd, packet_batch *batch, int drain)
+/* Effects: reads as many packets as are available (and fit) from serial
+     forwarder on file descriptor fd into batch. Waits for a packet unless
+     drain is true
+   Returns: the number of packets read (also in batch->count), or -1 if
+     fd was closed or failed before any packet was read
+*/
+{
+  size_t used, parsed = 0;
+  int closed = 0;
+
+  /* the start of a packet read by the last call */
+  memmove(batch->arena, batch->arena + batch->kept, batch->kept_len);
+  used = batch->kept_len;
+  batch->count = 0;
+
+  for (;;)
+    {
+      int n;
+
+      /* packets are used where they were read, each is preceded by its
+	 length */
+      while (batch->count < batch->max_packets && parsed < used &&
+	     parsed + 1 + batch->arena[parsed] <= used)
+	{
+	  batch->packets[batch->count].offset = parsed + 1;
+	  batch->packets[batch->count++].len = batch->arena[parsed];
+	  parsed += 1 + batch->arena[parsed];
+	}
+      if (closed || batch->count == batch->max_packets || used == batch->size)
+	break;
+      if ((drain || batch->count > 0) && !readable(fd))
+	break;
+
+      n = read(fd, batch->arena + used, batch->size - used);
+      if (n == -1 && errno == EINTR)
+	continue;
+      if (n == -1 && errno == EAGAIN)
+	break;
+      if (n <= 0)
+	closed = 1;
+      else
+	used += n;
+    }
+  batch->kept = parsed;
+  batch->kept_len = used - parsed;
+
+  return closed && batch->count == 0 ? -1 : batch->count;
+}
+
 int write_sf_packet(int fd, const void *packet, int len)
 /* Effects: writes len byte packet to serial forwarder on file descriptor
      fd
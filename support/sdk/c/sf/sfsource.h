@@ -1,6 +1,8 @@
 #ifndef SFSOURCE_H
 #define SFSOURCE_H
 
+#include "packetbatch.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,6 +25,20 @@ void *read_sf_packet(int fd, int *len);
      set to the packet length
 */
 
+int read_sf_packets(int fd, packet_batch *batch, int drain);
+/* Effects: reads as many packets as are available (and fit) from serial
+     forwarder on file descriptor fd into batch, without allocating
+     memory: bytes are read straight into the batch's arena and the
+     packets are left where they are. Waits for a packet unless drain is
+     true (or fd is non-blocking), in which case fd is only read while
+     data is available, e.g., after select says fd is readable.
+     The start of an incomplete packet is kept in the arena for the next
+     call, so don't mix this with read_sf_packet on the same fd.
+   Returns: the number of packets read (also in batch->count), which are
+     valid until the next read into batch, or -1 if fd was closed or
+     failed before any packet was read
+*/
+
 int write_sf_packet(int fd, const void *packet, int len);
 /* Effects: writes len byte packet to serial forwarder on file descriptor
      fd
@@ -32,6 +32,7 @@
 
 
 #include <errno.h>
+#include <unistd.h>
 #include <iostream>
 
 #include "basecomm.h"
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Histogram of per-packet latencies in microseconds.
+ */
+
+#include "histogram.h"
+
+#include <cstring>
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void LatencyHistogram::record(long long usec)
+{
+    if (usec < 0)
+        usec = 0;
+    int i = 0;
+    while ((i < bucketCount - 1) && (usec >= (1LL << (i + firstBucketShift))))
+        ++i;
+    ++buckets[i];
+    ++count;
+    sum += usec;
+    if (usec > max)
+        max = usec;
+}
+
+long long LatencyHistogram::percentile(int percent)
+{
+    unsigned long wanted = (count * percent + 99) / 100;
+    unsigned long seen = 0;
+    for (int i = 0; i < bucketCount - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= wanted)
+            return 1LL << (i + firstBucketShift);
+    }
+    return max;
+}
+
+void LatencyHistogram::print(ostream& os)
+{
+    if (count == 0)
+    {
+        os << "no packets";
+        return;
+    }
+    os << "packets = " << count
+       << " , mean = " << sum / (long long)count << " us"
+       << " , max = " << max << " us"
+       << " , p50 < " << percentile(50) << " us"
+       << " , p99 < " << percentile(99) << " us"
+       << " , buckets :";
+    for (int i = 0; i < bucketCount; i++)
+    {
+        if (buckets[i] == 0)
+            continue;
+        if (i < bucketCount - 1)
+            os << " <" << (1LL << (i + firstBucketShift)) << ":" << buckets[i];
+        else
+            os << " >=" << (1LL << (i - 1 + firstBucketShift)) << ":" << buckets[i];
+    }
+}
+
+void LatencyHistogram::printMetric(ostream& os, const string& name, const string& labels)
+{
+    string separator = labels.empty() ? "" : ",";
+    unsigned long total = 0;
+    for (int i = 0; i < bucketCount; i++)
+    {
+        total += buckets[i];
+        os << name << "_bucket{" << labels << separator << "le=\"";
+        if (i < bucketCount - 1)
+            os << (double)(1LL << (i + firstBucketShift)) / 1e6;
+        else
+            os << "+Inf";
+        os << "\"} " << total << "\n";
+    }
+    os << name << "_sum{" << labels << "} " << (double)sum / 1e6 << "\n"
+       << name << "_count{" << labels << "} " << total << "\n";
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Histogram of per-packet latencies in microseconds, bucketed by powers
+ * of two. One thread records, reportStatus() reads without locking; the
+ * numbers may be off by the packet currently being recorded.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iostream>
+#include <string>
+
+class LatencyHistogram
+{
+protected:
+    /* bucket i counts latencies below 2^(i + firstBucketShift) usec,
+       the last bucket everything above */
+    static const int firstBucketShift = 6;
+    static const int bucketCount = 16;
+
+    unsigned long buckets[bucketCount];
+
+    unsigned long count;
+
+    long long sum;
+
+    long long max;
+
+public:
+    LatencyHistogram();
+
+    /* adds one latency in usec */
+    void record(long long usec);
+
+    /* prints count, mean, max, percentiles and the non-empty buckets */
+    void print(std::ostream& os);
+
+    /* prints the buckets (cumulative, bounds in seconds), sum and count
+       as the samples of a Prometheus histogram */
+    void printMetric(std::ostream& os, const std::string& name, const std::string& labels);
+
+protected:
+    /* upper bound (usec) of the bucket containing the given percentile */
+    long long percentile(int percent);
+};
+
+#endif
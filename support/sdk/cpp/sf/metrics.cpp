@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Prometheus text exposition of the sf-server statistics.
+ */
+
+#include "metrics.h"
+
+#include <sstream>
+
+using namespace std;
+
+Metrics::family_t& Metrics::family(const string& name, const char* help, const char* type)
+{
+    map<string, family_t>::iterator it = families.find(name);
+    if (it != families.end())
+        return it->second;
+    names.push_back(name);
+    family_t& f = families[name];
+    f.help = help;
+    f.type = type;
+    return f;
+}
+
+void Metrics::counter(const string& name, const char* help, const string& labels, double value)
+{
+    ostringstream sample;
+    sample.precision(15);
+    sample << name << "{" << labels << "} " << value << "\n";
+    family(name, help, "counter").samples += sample.str();
+}
+
+void Metrics::gauge(const string& name, const char* help, const string& labels, double value)
+{
+    ostringstream sample;
+    sample.precision(15);
+    sample << name << "{" << labels << "} " << value << "\n";
+    family(name, help, "gauge").samples += sample.str();
+}
+
+void Metrics::histogram(const string& name, const char* help, const string& labels, LatencyHistogram& histogram)
+{
+    ostringstream samples;
+    histogram.printMetric(samples, name, labels);
+    family(name, help, "histogram").samples += samples.str();
+}
+
+void Metrics::print(ostream& os)
+{
+    for (vector<string>::iterator it = names.begin(); it != names.end(); ++it)
+    {
+        family_t& f = families[*it];
+        os << "# HELP " << *it << " " << f.help << "\n"
+           << "# TYPE " << *it << " " << f.type << "\n"
+           << f.samples;
+    }
+}
+
+string Metrics::label(const char* name, const string& value)
+{
+    string result(name);
+    result += "=\"";
+    for (string::const_iterator it = value.begin(); it != value.end(); ++it)
+    {
+        if ((*it == '\\') || (*it == '"'))
+            result += '\\';
+        if (*it == '\n')
+            result += "\\n";
+        else
+            result += *it;
+    }
+    result += '"';
+    return result;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Counters, gauges and latency histograms of the sf-servers in the
+ * Prometheus text exposition format. The servers add their samples with
+ * reportMetrics(), which reads their counters without taking the locks
+ * of the packet path, so a scrape never holds up a packet; a value may
+ * be off by the packet currently being handled.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "histogram.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+
+class Metrics
+{
+protected:
+    typedef struct
+    {
+        std::string help;
+        std::string type;
+        /* sample lines of all servers */
+        std::string samples;
+    } family_t;
+
+    /* names in the order they were first added */
+    std::vector<std::string> names;
+
+    std::map<std::string, family_t> families;
+
+    /* the family name, created on first use */
+    family_t& family(const std::string& name, const char* help, const char* type);
+
+public:
+    /* adds a sample of a monotonically increasing count */
+    void counter(const std::string& name, const char* help, const std::string& labels, double value);
+
+    /* adds a sample of a value that goes up and down */
+    void gauge(const std::string& name, const char* help, const std::string& labels, double value);
+
+    /* adds the buckets, sum and count of a latency histogram, in seconds */
+    void histogram(const std::string& name, const char* help, const std::string& labels, LatencyHistogram& histogram);
+
+    /* prints all families, samples of one family together */
+    void print(std::ostream& os);
+
+    /* name="value" with value escaped */
+    static std::string label(const char* name, const std::string& value);
+};
+
+#endif
@@ -33,135 +33,254 @@
 #include "packetbuffer.h"
 
 #include "pthread.h"
-#include <algorithm>
 
-PacketBuffer::PacketBuffer()
+/* the Makefile does not ask for C++11, so use the GCC/clang builtins */
+#define LOAD(x, order) __atomic_load_n(&(x), order)
+#define STORE(x, v, order) __atomic_store_n(&(x), v, order)
+#define CAS(x, expected, v) __atomic_compare_exchange_n(&(x), &(expected), v, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+
+PacketBuffer::PacketBuffer(unsigned pCapacity) : droppedCount(0)
 {
-    pthread_mutex_init(&buffer.lock, NULL);
-    pthread_cond_init(&buffer.notempty, NULL);
-    pthread_cond_init(&buffer.notfull, NULL);
+    initRing(ring, (pCapacity > 0) ? pCapacity : 1);
+    initRing(frontRing, cFrontBufferSize);
+    pthread_mutex_init(&waiters.lock, NULL);
+    pthread_cond_init(&waiters.notempty, NULL);
+    pthread_cond_init(&waiters.notfull, NULL);
+    waiters.emptyWaiters = 0;
+    waiters.fullWaiters = 0;
 }
 
 
 PacketBuffer::~PacketBuffer()
 {
-  pthread_cond_destroy(&buffer.notempty);
-  pthread_cond_destroy(&buffer.notfull);
-  pthread_mutex_destroy(&buffer.lock);
+  delete[] ring.slots;
+  delete[] frontRing.slots;
+  pthread_cond_destroy(&waiters.notempty);
+  pthread_cond_destroy(&waiters.notfull);
+  pthread_mutex_destroy(&waiters.lock);
+}
+
+void PacketBuffer::initRing(ring_t &pRing, unsigned long pCapacity)
+{
+    pRing.slots = new slot_t[pCapacity];
+    pRing.capacity = pCapacity;
+    pRing.head = 0;
+    pRing.tail = 0;
+    for (unsigned long i = 0; i < pCapacity; i++)
+    {
+        pRing.slots[i].sequence = i;
+    }
+}
+
+/* claims the slot at the enqueue (tail) or dequeue (head) position.
+   A slot can be enqueued at pos when its sequence is pos, and dequeued
+   when it is pos + 1 */
+PacketBuffer::slot_t* PacketBuffer::claimSlot(ring_t &pRing, unsigned long &pPos, bool enqueue)
+{
+    unsigned long &counter = enqueue ? pRing.tail : pRing.head;
+    unsigned long ready = enqueue ? 0 : 1;
+    unsigned long pos = LOAD(counter, __ATOMIC_RELAXED);
+    slot_t* slot;
+    while (true)
+    {
+        slot = &pRing.slots[pos % pRing.capacity];
+        long diff = (long)(LOAD(slot->sequence, __ATOMIC_ACQUIRE) - (pos + ready));
+        if (diff == 0)
+        {
+            if (CAS(counter, pos, pos + 1))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // enqueue: slot still holds the packet of one round before,
+            // dequeue: not enqueued yet
+            return NULL;
+        }
+        else
+        {
+            pos = LOAD(counter, __ATOMIC_RELAXED);
+        }
+    }
+    pPos = pos;
+    return slot;
+}
+
+/* copies the packet into the slot at tail and hands it to the consumers */
+bool PacketBuffer::tryEnqueue(ring_t &pRing, SFPacket &pPacket)
+{
+    unsigned long pos;
+    slot_t* slot = claimSlot(pRing, pos, true);
+    if (!slot)
+        return false;
+    slot->packet = pPacket;
+    STORE(slot->sequence, pos + 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+/* copies the packet out of the slot at head and hands it back to the producers */
+bool PacketBuffer::tryDequeue(ring_t &pRing, SFPacket &pPacket)
+{
+    unsigned long pos;
+    slot_t* slot = claimSlot(pRing, pos, false);
+    if (!slot)
+        return false;
+    pPacket = slot->packet;
+    STORE(slot->sequence, pos + pRing.capacity, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+unsigned long PacketBuffer::size(ring_t &pRing)
+{
+    unsigned long head = LOAD(pRing.head, __ATOMIC_SEQ_CST);
+    unsigned long tail = LOAD(pRing.tail, __ATOMIC_SEQ_CST);
+    return (tail > head) ? tail - head : 0;
+}
+
+/* the sequence stores above and the waiter count here are both
+   sequentially consistent: either the sleeping thread sees the change
+   when it checks again under the lock, or we see that it sleeps */
+void PacketBuffer::wakeup(pthread_cond_t &cond, int &waiting)
+{
+    if (LOAD(waiting, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&waiters.lock);
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&waiters.lock);
+    }
+}
+
+static void waitCleanup(void* waiting)
+{
+    __atomic_sub_fetch((int*) waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+void PacketBuffer::waitOn(pthread_cond_t &cond, int &waiting, bool front, bool enqueue)
+{
+    ring_t &target = front ? frontRing : ring;
+    pthread_testcancel();
+    pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &waiters.lock);
+    pthread_mutex_lock(&waiters.lock);
+    __atomic_add_fetch(&waiting, 1, __ATOMIC_SEQ_CST);
+    pthread_cleanup_push(waitCleanup, (void *) &waiting);
+    if (enqueue ? (size(target) >= target.capacity) : ((size(frontRing) == 0) && (size(ring) == 0)))
+    {
+        DEBUG("PacketBuffer::waitOn : waiting until buffer is " << (enqueue ? "<notfull>" : "<notempty>"))
+        pthread_cond_wait(&cond, &waiters.lock);
+    }
+    pthread_cleanup_pop(1);
+    pthread_cleanup_pop(1);
 }
 
 // clears the buffer
 void PacketBuffer::clear() {
-    pthread_testcancel();
-    pthread_mutex_lock(&buffer.lock);
-    // clear
-    buffer.container.clear();
+    claim_t claim;
+    while (claimDequeue(claim))
+        release(claim);
     DEBUG("PacketBuffer::clear : cleared buffer and signal <notfull>")
-    pthread_cond_signal(&buffer.notfull);
-    pthread_mutex_unlock(&buffer.lock);
+    wakeup(waiters.notfull, waiters.fullWaiters);
 }
 
-// gets a packet from the buffer (NULL = buffer empty)
-SFPacket PacketBuffer::dequeue()
+// gets a packet without waiting (false = buffer empty)
+bool PacketBuffer::tryDequeue(SFPacket &pPacket)
 {
-    SFPacket packet;
-    pthread_testcancel();
-    pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &buffer.lock);
-    pthread_mutex_lock(&buffer.lock);
-    // wait until buffer is _not_ empty
-    while(buffer.container.size() == 0)
+    if (!tryDequeue(frontRing, pPacket) && !tryDequeue(ring, pPacket))
+        return false;
+    DEBUG("PacketBuffer::tryDequeue : get from buffer and signal <notfull>")
+    wakeup(waiters.notfull, waiters.fullWaiters);
+    return true;
+}
+
+// gets a packet from the buffer, waits while it is empty
+void PacketBuffer::dequeue(SFPacket &pPacket)
+{
+    while (!tryDequeue(pPacket))
+    {
+        waitOn(waiters.notempty, waiters.emptyWaiters, false, false);
+    }
+}
+
+// gets a packet without copying it out of its slot (NULL = buffer empty)
+SFPacket* PacketBuffer::claimDequeue(claim_t &pClaim)
+{
+    pClaim.ring = &frontRing;
+    pClaim.slot = claimSlot(frontRing, pClaim.pos, false);
+    if (!pClaim.slot)
     {
-        DEBUG("PacketBuffer::dequeue : waiting until buffer is <notempty>")
-        pthread_cond_wait(&buffer.notempty, &buffer.lock);
+        pClaim.ring = &ring;
+        pClaim.slot = claimSlot(ring, pClaim.pos, false);
     }
-    // dequeue
-    packet = buffer.container.front();
-    buffer.container.pop_front();
-    DEBUG("PacketBuffer::dequeue : get from buffer and signal <notfull>")
-    pthread_cond_signal(&buffer.notfull);
-    pthread_cleanup_pop(1); 
-    return packet;
+    return pClaim.slot ? &pClaim.slot->packet : NULL;
+}
+
+void PacketBuffer::release(claim_t &pClaim)
+{
+    STORE(pClaim.slot->sequence, pClaim.pos + pClaim.ring->capacity, __ATOMIC_SEQ_CST);
+    DEBUG("PacketBuffer::release : released slot and signal <notfull>")
+    wakeup(waiters.notfull, waiters.fullWaiters);
 }
 
 // puts a packet into buffer... (SUCCESS = true)
 bool PacketBuffer::enqueueFront(SFPacket &pPacket)
 {
-    pthread_testcancel();
-    pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &buffer.lock);
-    pthread_mutex_lock(&buffer.lock);
-    // wait until buffer is _not_ full
-    while(buffer.container.size() >= cMaxBufferSize)
+    while (!tryEnqueue(frontRing, pPacket))
     {
-        DEBUG("PacketBuffer::enqueueFront : waiting until buffer is <notfull>")
-        pthread_cond_wait(&buffer.notfull, &buffer.lock);
+        waitOn(waiters.notfull, waiters.fullWaiters, true, true);
     }
-    // enqueue
-    buffer.container.push_front(pPacket);
     DEBUG("PacketBuffer::enqueueFront : put in buffer and signal <notempty>")
-    // signal that buffer is now not empty
-    pthread_cond_signal(&buffer.notempty);
-    pthread_cleanup_pop(1); 
+    wakeup(waiters.notempty, waiters.emptyWaiters);
     return true;
 }
 
 // puts a packet into buffer... (SUCCESS = true)
 bool PacketBuffer::enqueueBack(SFPacket &pPacket)
 {
-    pthread_testcancel();
-    pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &buffer.lock);
-    pthread_mutex_lock(&buffer.lock);
-    // wait until buffer is _not_ full
-    while(buffer.container.size() >= cMaxBufferSize)
+    while (!tryEnqueue(ring, pPacket))
     {
-        DEBUG("PacketBuffer::enqueueBack : waiting until buffer is <notfull>")
-        pthread_cond_wait(&buffer.notfull, &buffer.lock);
+        waitOn(waiters.notfull, waiters.fullWaiters, false, true);
     }
-    // enqueue
-    buffer.container.push_back(pPacket);
     DEBUG("PacketBuffer::enqueueBack : put in buffer and signal <notempty>")
-    // signal that buffer is now not empty
-    pthread_cond_signal(&buffer.notempty);
-    pthread_cleanup_pop(1); 
+    wakeup(waiters.notempty, waiters.emptyWaiters);
     return true;
 }
 
+// puts a packet into buffer, dropping the oldest ones if it is full
+unsigned PacketBuffer::enqueueBackDropOldest(SFPacket &pPacket)
+{
+    unsigned dropped = 0;
+    unsigned long pos;
+    slot_t* old;
+    while (!tryEnqueue(ring, pPacket))
+    {
+        // below capacity the slot at tail is still being read in place
+        if ((size(ring) >= ring.capacity) && (old = claimSlot(ring, pos, false)))
+        {
+            STORE(old->sequence, pos + ring.capacity, __ATOMIC_SEQ_CST);
+            ++dropped;
+        }
+    }
+    if (dropped > 0)
+    {
+        __atomic_add_fetch(&droppedCount, dropped, __ATOMIC_RELAXED);
+        DEBUG("PacketBuffer::enqueueBackDropOldest : dropped " << dropped)
+    }
+    wakeup(waiters.notempty, waiters.emptyWaiters);
+    return dropped;
+}
+
 /* checks if packet buffer is full */
 bool PacketBuffer::isFull() {
-  bool isFull = true;
-  pthread_testcancel();
-  pthread_mutex_lock(&buffer.lock);
-  if (buffer.container.size() < cMaxBufferSize) {
-      isFull = false;
-  }
-  pthread_mutex_unlock(&buffer.lock);
-  return isFull;
+  return size(ring) >= ring.capacity;
 }
 
 /* checks if packet buffer is empty */
 bool PacketBuffer::isEmpty() {
-  bool isEmpty = true;
-  pthread_testcancel();
-  pthread_mutex_lock(&buffer.lock);
-  if (buffer.container.size() > 0) {
-      isEmpty = false;
-  }
-  pthread_mutex_unlock(&buffer.lock);
-  return isEmpty;
+  return (size(frontRing) == 0) && (size(ring) == 0);
 }
 
-/* checks if pPacket is in queue */
-bool PacketBuffer::isInQueue(SFPacket &pPacket)
-{
-    bool result = false;
-    DEBUG("PacketBuffer::isInQueue : lock")
-    pthread_testcancel();
-    pthread_mutex_lock(&buffer.lock);
-    container_t::const_iterator it = find(buffer.container.begin(), buffer.container.end(), pPacket);
-    if( it != buffer.container.end() )
-    {
-        result = true;
-    }
-    pthread_mutex_unlock(&buffer.lock);
-    DEBUG("PacketBuffer::isInQueue : unlock")
-    return result;
+unsigned PacketBuffer::getSize() {
+  return size(frontRing) + size(ring);
+}
+
+unsigned long PacketBuffer::getDroppedCount() {
+  return LOAD(droppedCount, __ATOMIC_RELAXED);
 }
@@ -34,7 +34,6 @@
 #define PACKETBUFFER_H
 
 #include <pthread.h>
-#include <list>
 #include "sfpacket.h"
 
 // #define DEBUG_PACKETBUFFER
@@ -47,15 +46,56 @@
 #define DEBUG(message) 
 #endif
 
+/*
+ * Bounded queue of preallocated packet slots. Enqueueing and dequeueing
+ * claim a slot with a compare-and-swap on a position counter and hand it
+ * over with a per-slot sequence number, so neither side takes a lock or
+ * allocates memory. The mutex and condition variables are only used to
+ * put a thread to sleep on an empty (dequeue) or full (enqueue) buffer.
+ *
+ * Packets enqueued at the front (ACKs for the mote) go into a small
+ * separate ring that dequeue() empties first.
+ *
+ * Enqueueing copies the packet into its slot. Consumers that only read
+ * the packet can claim it in place with claimDequeue() and release() the
+ * slot afterwards instead of copying it out.
+ */
 class PacketBuffer
 {
+public:
+  /* default number of packets per buffer */
+  static const unsigned cDefaultBufferSize = 25;
+
 protected:
 
-  static const unsigned cMaxBufferSize = 25;
+  /* number of packets that can be enqueued at the front */
+  static const unsigned cFrontBufferSize = 8;
 
-  typedef std::list<SFPacket> container_t;
+  typedef struct
+  {
+    // position this slot can be enqueued (== pos) or dequeued (== pos + 1) at
+    unsigned long sequence;
+    SFPacket packet;
+  } slot_t;
 
-  // thread safe buffer
+  // lock-free ring of slots
+  typedef struct
+  {
+    slot_t* slots;
+    unsigned long capacity;
+    // enqueue and dequeue positions on separate cache lines
+    char pad0[64];
+    unsigned long tail;
+    char pad1[64];
+    unsigned long head;
+    char pad2[64];
+  } ring_t;
+
+  ring_t ring;
+
+  ring_t frontRing;
+
+  // sleeping threads
   typedef struct
   {
     // mutex lock for any of this vars
@@ -64,31 +104,84 @@ protected:
     pthread_cond_t notempty;
     // not full cond
     pthread_cond_t notfull;
-    // actual buffer 
-    container_t container;
-  } sharedBuffer_t;
+    // number of threads waiting on notempty / notfull
+    int emptyWaiters;
+    int fullWaiters;
+  } waiters_t;
+
+  waiters_t waiters;
+
+  /* packets dropped by enqueueBackDropOldest */
+  unsigned long droppedCount;
 
-  sharedBuffer_t buffer;
+  void initRing(ring_t &pRing, unsigned long pCapacity);
+
+  /* claims the slot at tail (enqueue) or head, NULL if full / empty */
+  slot_t* claimSlot(ring_t &pRing, unsigned long &pPos, bool enqueue);
+
+  bool tryEnqueue(ring_t &pRing, SFPacket &pPacket);
+
+  bool tryDequeue(ring_t &pRing, SFPacket &pPacket);
+
+  /* number of packets in pRing (approximate while others modify it) */
+  unsigned long size(ring_t &pRing);
+
+  /* wakes threads sleeping on cond, waiting is the matching waiter count */
+  void wakeup(pthread_cond_t &cond, int &waiting);
+
+  /* sleeps until enqueue (front = false) or dequeue becomes possible */
+  void waitOn(pthread_cond_t &cond, int &waiting, bool front, bool enqueue);
 
 public:
-  PacketBuffer();
+  /* a packet dequeued in place, see claimDequeue() */
+  typedef struct
+  {
+    ring_t* ring;
+    slot_t* slot;
+    unsigned long pos;
+  } claim_t;
+
+  PacketBuffer(unsigned pCapacity = cDefaultBufferSize);
 
   ~PacketBuffer();
 
   void clear();
 
-  SFPacket dequeue();
+  /* blocks until a packet is available */
+  void dequeue(SFPacket &pPacket);
+
+  /* non-blocking, false if the buffer is empty */
+  bool tryDequeue(SFPacket &pPacket);
+
+  /* non-blocking, the next packet left in its slot, NULL if the buffer
+     is empty. Producers cannot reuse the slot until release(), so do not
+     block while holding it */
+  SFPacket* claimDequeue(claim_t &pClaim);
+
+  /* hands a claimed slot back to the producers */
+  void release(claim_t &pClaim);
 
+  /* blocks while the buffer is full */
   bool enqueueFront(SFPacket &pPacket);
 
+  /* blocks while the buffer is full */
   bool enqueueBack(SFPacket &pPacket);
 
+  /* never blocks, drops the oldest packets instead. Returns the number
+     of packets dropped */
+  unsigned enqueueBackDropOldest(SFPacket &pPacket);
+
   bool isFull();
 
   bool isEmpty();
 
-  bool isInQueue(SFPacket &pPacket);
-  
+  unsigned getCapacity() const { return ring.capacity; }
+
+  /* number of packets in the buffer */
+  unsigned getSize();
+
+  /* packets dropped by enqueueBackDropOldest */
+  unsigned long getDroppedCount();
 };
 
 #endif
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Event loop for running many sf-servers on few threads.
+ */
+
+#include "reactor.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+using namespace std;
+
+/* forward declarations of pthrad helper functions*/
+void* reactorThread(void*);
+
+Reactor::Reactor() : pollFD(-1), servers(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    // handlers register and unregister fds while they are being called
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    int pipeFDPair[2];
+    reportError("Reactor::Reactor : pipe(pipeFDPair)", pipe(pipeFDPair));
+    pipeWriteFD = pipeFDPair[1];
+    pipeReadFD = pipeFDPair[0];
+    reportError("Reactor::Reactor : fcntl(pipeReadFD, F_SETFL, O_NONBLOCK)",
+                fcntl(pipeReadFD, F_SETFL, O_NONBLOCK));
+    reportError("Reactor::Reactor : fcntl(pipeWriteFD, F_SETFL, O_NONBLOCK)",
+                fcntl(pipeWriteFD, F_SETFL, O_NONBLOCK));
+
+#ifdef __linux__
+    pollFD = reportError("Reactor::Reactor : epoll_create(maxEvents)", epoll_create(maxEvents));
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = pipeReadFD;
+    reportError("Reactor::Reactor : epoll_ctl(pollFD, EPOLL_CTL_ADD, pipeReadFD, &ev)",
+                epoll_ctl(pollFD, EPOLL_CTL_ADD, pipeReadFD, &ev));
+#endif
+
+    reportError("Reactor::Reactor : pthread_create( &thread, NULL, reactorThread, this)",
+                pthread_create( &thread, NULL, reactorThread, this));
+}
+
+Reactor::~Reactor()
+{
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+    if (pollFD >= 0) close(pollFD);
+    close(pipeWriteFD);
+    close(pipeReadFD);
+    pthread_mutex_destroy(&lock);
+}
+
+long long Reactor::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void Reactor::acquire()
+{
+    pthread_mutex_lock(&lock);
+}
+
+void Reactor::release()
+{
+    pthread_mutex_unlock(&lock);
+}
+
+void Reactor::add(int fd, Handler* handler, int events)
+{
+    acquire();
+    registration_t reg;
+    reg.handler = handler;
+    reg.events = events;
+    handlers[fd] = reg;
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((events & READABLE) ? EPOLLIN : 0) | ((events & WRITABLE) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    epoll_ctl(pollFD, EPOLL_CTL_ADD, fd, &ev);
+#endif
+    release();
+    stuffPipe();
+}
+
+void Reactor::modify(int fd, int events)
+{
+    acquire();
+    map<int, registration_t>::iterator it = handlers.find(fd);
+    if ((it != handlers.end()) && (it->second.events != events))
+    {
+        it->second.events = events;
+#ifdef __linux__
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((events & READABLE) ? EPOLLIN : 0) | ((events & WRITABLE) ? EPOLLOUT : 0);
+        ev.data.fd = fd;
+        epoll_ctl(pollFD, EPOLL_CTL_MOD, fd, &ev);
+#endif
+    }
+    release();
+    stuffPipe();
+}
+
+void Reactor::remove(int fd)
+{
+    acquire();
+    if (handlers.erase(fd) > 0)
+    {
+#ifdef __linux__
+        struct epoll_event ev;
+        epoll_ctl(pollFD, EPOLL_CTL_DEL, fd, &ev);
+#endif
+    }
+    release();
+}
+
+void Reactor::setTimer(Handler* handler, long long expiry)
+{
+    acquire();
+    if (expiry > 0)
+        timers[handler] = expiry;
+    else
+        timers.erase(handler);
+    release();
+    stuffPipe();
+}
+
+void Reactor::notify(Handler* handler)
+{
+    acquire();
+    notified.insert(handler);
+    release();
+    stuffPipe();
+}
+
+void Reactor::forget(Handler* handler)
+{
+    acquire();
+    timers.erase(handler);
+    notified.erase(handler);
+    release();
+}
+
+void Reactor::deliverNotifications()
+{
+    while (!notified.empty())
+    {
+        Handler* handler = *notified.begin();
+        notified.erase(notified.begin());
+        handler->bufferChanged();
+    }
+}
+
+int Reactor::nextTimeout()
+{
+    if (!notified.empty())
+        return 0;
+    if (timers.empty())
+        return -1;
+    long long next = timers.begin()->second;
+    for (map<Handler*, long long>::iterator it = timers.begin(); it != timers.end(); ++it)
+    {
+        if (it->second < next)
+            next = it->second;
+    }
+    long long diff = next - now();
+    // round up, waking early would only mean another wait
+    return (diff <= 0) ? 0 : (int)((diff + 999) / 1000);
+}
+
+void Reactor::expireTimers()
+{
+    long long current = now();
+    vector<Handler*> expired;
+    for (map<Handler*, long long>::iterator it = timers.begin(); it != timers.end(); ++it)
+    {
+        if (it->second <= current)
+            expired.push_back(it->first);
+    }
+    for (vector<Handler*>::iterator it = expired.begin(); it != expired.end(); ++it)
+    {
+        // an earlier handler may have removed or re-armed this one
+        map<Handler*, long long>::iterator timer = timers.find(*it);
+        if ((timer != timers.end()) && (timer->second <= current))
+        {
+            timers.erase(timer);
+            (*it)->handleTimer();
+        }
+    }
+}
+
+int Reactor::wait(int* fds, int* events, int timeout)
+{
+#ifdef __linux__
+    struct epoll_event ev[maxEvents];
+    int n = epoll_wait(pollFD, ev, maxEvents, timeout);
+    for (int i = 0; i < n; i++)
+    {
+        fds[i] = ev[i].data.fd;
+        events[i] = ((ev[i].events & EPOLLIN) ? READABLE : 0)
+            | ((ev[i].events & EPOLLOUT) ? WRITABLE : 0)
+            | ((ev[i].events & (EPOLLERR | EPOLLHUP)) ? FAILED : 0);
+    }
+    return n;
+#else
+    vector<struct pollfd> pfds;
+    struct pollfd pfd;
+    pfd.fd = pipeReadFD;
+    pfd.events = POLLIN;
+    pfds.push_back(pfd);
+    acquire();
+    for (map<int, registration_t>::iterator it = handlers.begin(); it != handlers.end(); ++it)
+    {
+        pfd.fd = it->first;
+        pfd.events = ((it->second.events & READABLE) ? POLLIN : 0)
+            | ((it->second.events & WRITABLE) ? POLLOUT : 0);
+        pfds.push_back(pfd);
+    }
+    release();
+    int n = poll(&pfds[0], pfds.size(), timeout);
+    int count = 0;
+    for (unsigned i = 0; (n > 0) && (i < pfds.size()) && (count < maxEvents); i++)
+    {
+        if (pfds[i].revents)
+        {
+            fds[count] = pfds[i].fd;
+            events[count] = ((pfds[i].revents & POLLIN) ? READABLE : 0)
+                | ((pfds[i].revents & POLLOUT) ? WRITABLE : 0)
+                | ((pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) ? FAILED : 0);
+            count++;
+        }
+    }
+    return (n < 0) ? n : count;
+#endif
+}
+
+/* helper function to start reactor pthread */
+void* reactorThread(void* ob)
+{
+    static_cast<Reactor*>(ob)->run();
+    return NULL;
+}
+
+void Reactor::run()
+{
+    int fds[maxEvents];
+    int events[maxEvents];
+    int oldState;
+
+    while (true)
+    {
+        acquire();
+        int timeout = nextTimeout();
+        release();
+
+        // cancellation point, the lock is not held here
+        int n = wait(fds, events, timeout);
+        if ((n < 0) && (errno != EINTR))
+        {
+            reportError("Reactor::run : wait(fds, events, timeout)", n);
+        }
+
+        // handlers do I/O, which must not be cancelled half way
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldState);
+        acquire();
+        for (int i = 0; i < n; i++)
+        {
+            if (fds[i] == pipeReadFD)
+            {
+                clearPipe();
+                continue;
+            }
+            // the handler may have been removed by an earlier one
+            map<int, registration_t>::iterator it = handlers.find(fds[i]);
+            if (it != handlers.end())
+            {
+                it->second.handler->handleEvent(fds[i], events[i]);
+            }
+        }
+        deliverNotifications();
+        expireTimers();
+        deliverNotifications();
+        release();
+        pthread_setcancelstate(oldState, NULL);
+        pthread_testcancel();
+    }
+}
+
+void Reactor::stuffPipe()
+{
+    if (pthread_equal(pthread_self(), thread))
+        return;
+    char info = 'n';
+    if(write(pipeWriteFD, &info, 1) != 1) DEBUG("Reactor::stuffPipe : lokal pipe is broken");
+}
+
+void Reactor::clearPipe()
+{
+    char buf[64];
+    while(read(pipeReadFD, buf, sizeof(buf)) > 0) {
+        ;
+    }
+}
+
+/* reports error */
+int Reactor::reportError(const char *msg, int result)
+{
+    if (result < 0)
+    {
+        cerr << "error : Reactor : "
+        << msg << " ( result = " << result << " )" << endl
+        << "error-description : " << strerror(errno) << endl;
+    }
+    return result;
+}
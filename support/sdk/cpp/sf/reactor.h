@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Event loop for running many sf-servers on few threads.
+ *
+ * A reactor owns one thread that waits on the serial devices, TCP
+ * listeners and client sockets of the sf-servers assigned to it (with
+ * epoll, or poll where epoll is not available) and calls their handlers
+ * when a descriptor is ready or a timer expired. Handlers are called
+ * with the reactor lock held; everything that touches a handler's state
+ * from another thread (starting, stopping, status reports) has to take
+ * the lock as well.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <map>
+#include <set>
+
+// #define DEBUG_REACTOR
+
+#undef DEBUG
+#ifdef DEBUG_REACTOR
+#include <iostream>
+#define DEBUG(message) std::cout << message << std::endl;
+#else
+#define DEBUG(message) 
+#endif
+
+class Reactor
+{
+public:
+    /* event flags */
+    enum {
+        READABLE = 1,
+        WRITABLE = 2,
+        FAILED = 4
+    };
+
+    class Handler
+    {
+    public:
+        virtual ~Handler() {}
+
+        /* fd is readable, writable or failed */
+        virtual void handleEvent(int fd, int events) = 0;
+
+        /* the timer set with setTimer expired */
+        virtual void handleTimer() {}
+
+        /* the other side of the sf-server put packets into or took
+           packets out of a buffer shared with this handler */
+        virtual void bufferChanged() {}
+    };
+
+protected:
+    /* max. number of events handled per wakeup */
+    static const int maxEvents = 64;
+
+    typedef struct
+    {
+        Handler* handler;
+        int events;
+    } registration_t;
+
+    pthread_t thread;
+
+    /* protects the maps and all registered handlers */
+    pthread_mutex_t lock;
+
+    int pollFD;
+
+    /* pipe fd pair to wake up the reactor thread */
+    int pipeWriteFD;
+    int pipeReadFD;
+
+    std::map<int, registration_t> handlers;
+
+    /* absolute expiry times in usec, see now() */
+    std::map<Handler*, long long> timers;
+
+    /* handlers waiting for a bufferChanged() call */
+    std::set<Handler*> notified;
+
+    /* number of sf-servers using this reactor */
+    int servers;
+
+    friend void* reactorThread(void* ob);
+
+    /* event loop */
+    void run();
+
+    /* calls handlers of expired timers */
+    void expireTimers();
+
+    /* calls bufferChanged() of notified handlers */
+    void deliverNotifications();
+
+    /* milliseconds until the next timer expires, -1 if none */
+    int nextTimeout();
+
+    /* waits for events, returns number of entries in fds/events */
+    int wait(int* fds, int* events, int timeout);
+
+    /* write something into pipe to wake up the reactor thread */
+    void stuffPipe();
+
+    /* remove data written into pipe */
+    void clearPipe();
+
+    /* reports error to stderr */
+    int reportError(const char *msg, int result);
+
+public:
+    Reactor();
+
+    ~Reactor();
+
+    /* registers fd, events is a combination of READABLE and WRITABLE */
+    void add(int fd, Handler* handler, int events);
+
+    /* changes the events fd is watched for */
+    void modify(int fd, int events);
+
+    /* unregisters fd, must be called before it is closed */
+    void remove(int fd);
+
+    /* calls handler->handleTimer() at the absolute time expiry (usec,
+       see now()), replacing an earlier timer. 0 cancels the timer */
+    void setTimer(Handler* handler, long long expiry);
+
+    /* calls handler->bufferChanged() once the current event has been
+       handled, so handlers never call into each other directly */
+    void notify(Handler* handler);
+
+    /* drops the timer and pending notification of handler */
+    void forget(Handler* handler);
+
+    /* serializes calls into handlers with the reactor thread */
+    void acquire();
+    void release();
+
+    /* bookkeeping for choosing the least used reactor */
+    void attach() { ++servers; }
+    void detach() { --servers; }
+    int getServerCount() const { return servers; }
+
+    /* current monotonic time in usec */
+    static long long now();
+};
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Replays a capture to the clients of an sf-server.
+ */
+
+#include "replaycomm.h"
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+/* forward declarations of pthrad helper functions*/
+void* replayCaptureThread(void*);
+void* drainClientsThread(void*);
+
+ReplayComm::ReplayComm(const char* pFile, double pSpeed, double pStart, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, TCPComm &pServer, sharedControlInfo_t& pControl, Reactor* pReactor) : replayThreadRunning(false), drainThreadRunning(false), file(pFile), reader(NULL), speed(pSpeed), pending(false), firstTime(0), wallStart(0), finished(false), readBuffer(pReadBuffer), writeBuffer(pWriteBuffer), server(pServer), replayedPacketCount(0), discardedPacketCount(0), errorReported(false), errorMsg(""), control(pControl), reactor(pReactor), peer(NULL), reactorCanceled(false)
+{
+    reader = open_capture_reader(pFile);
+    if (!reader)
+    {
+        reportError("ReplayComm::ReplayComm : open_capture_reader(pFile)", -1);
+        return;
+    }
+    firstTime = capture_first_time(reader) + (uint64_t)(pStart * 1e9);
+    if (capture_seek(reader, firstTime) < 0)
+    {
+        errno = EINVAL;
+        reportError("ReplayComm::ReplayComm : capture_seek(reader, firstTime)", -1);
+        return;
+    }
+
+    if (reactor)
+    {
+        reactor->setTimer(this, Reactor::now());
+    }
+    else
+    {
+        reportError("ReplayComm::ReplayComm : pthread_create( &replayThread, NULL, replayCaptureThread, this)",
+                    pthread_create( &replayThread, NULL, replayCaptureThread, this));
+        replayThreadRunning = true;
+        reportError("ReplayComm::ReplayComm : pthread_create( &drainThread, NULL, drainClientsThread, this)",
+                    pthread_create( &drainThread, NULL, drainClientsThread, this));
+        drainThreadRunning = true;
+    }
+}
+
+ReplayComm::~ReplayComm()
+{
+    cancel();
+    if (reader)
+        close_capture_reader(reader);
+}
+
+/* puts the packets that are due into readBuffer */
+long long ReplayComm::replayPackets()
+{
+    if (finished)
+        return -1;
+    if (!wallStart)
+    {
+        // nothing is replayed before a client is there
+        if (server.getClientCount() == 0)
+            return pollDelay;
+        wallStart = capture_now();
+    }
+    for (int sent = 0; sent < maxBatch; )
+    {
+        if (!pending)
+        {
+            int ok = capture_next(reader, &record);
+            if (ok <= 0)
+            {
+                if (ok < 0)
+                {
+                    errno = EINVAL;
+                    reportError("ReplayComm::replayPackets : capture_next(reader, &record)", -1);
+                }
+                DEBUG("ReplayComm::replayPackets : finished")
+                finished = true;
+                return -1;
+            }
+            if ((record.type != CAPTURE_FROM_NODE) || (record.length == 0) || (record.length >= (size_t)SFPacket::cMaxPacketLength))
+                continue;
+            pending = true;
+        }
+        if ((speed > 0) && (record.time > firstTime))
+        {
+            uint64_t due = wallStart + (uint64_t)((record.time - firstTime) / speed);
+            uint64_t now = capture_now();
+            if (due > now)
+                return (due - now + 999) / 1000;
+        }
+        // packets are delayed rather than dropped when the clients are
+        // slow, the threads block in enqueueBack
+        if (reactor && readBuffer.isFull())
+            return pollDelay / 10;
+        SFPacket packet(SF_PACKET_NO_ACK);
+        packet.setPayload((const char*)record.data, record.length);
+        packet.setTimestamp(Reactor::now());
+        pending = false;
+        ++replayedPacketCount;
+        ++sent;
+        readBuffer.enqueueBack(packet);
+        if (peer)
+            reactor->notify(peer);
+    }
+    return 0;
+}
+
+/* helper function to start replay pthread */
+void* replayCaptureThread(void* ob)
+{
+    static_cast<ReplayComm*>(ob)->replayCapture();
+    return NULL;
+}
+
+/* replays the capture */
+void ReplayComm::replayCapture()
+{
+    long long delay;
+    while ((delay = replayPackets()) >= 0)
+    {
+        if (delay > 0)
+            usleep(delay);
+        pthread_testcancel();
+    }
+}
+
+/* helper function to start drain pthread */
+void* drainClientsThread(void* ob)
+{
+    static_cast<ReplayComm*>(ob)->drainClients();
+    return NULL;
+}
+
+/* drops packets from the clients */
+void ReplayComm::drainClients()
+{
+    SFPacket packet;
+    while (true)
+    {
+        writeBuffer.dequeue(packet);
+        ++discardedPacketCount;
+    }
+}
+
+/* reactor mode: the next packet is due */
+void ReplayComm::handleTimer()
+{
+    long long delay = replayPackets();
+    if ((delay >= 0) && !reactorCanceled)
+        reactor->setTimer(this, Reactor::now() + delay);
+}
+
+/* reactor mode: the tcp side queued packets */
+void ReplayComm::bufferChanged()
+{
+    PacketBuffer::claim_t claim;
+    bool dequeued = false;
+    while (writeBuffer.claimDequeue(claim))
+    {
+        writeBuffer.release(claim);
+        dequeued = true;
+        ++discardedPacketCount;
+    }
+    // the clients are read again
+    if (dequeued && peer)
+        reactor->notify(peer);
+}
+
+/* cancels all running threads */
+void ReplayComm::cancel()
+{
+    if (reactor)
+    {
+        if (!reactorCanceled)
+        {
+            reactorCanceled = true;
+            reactor->forget(this);
+            pthread_cond_signal(&control.cancel);
+        }
+        return;
+    }
+    pthread_t callingThread = pthread_self();
+    if (replayThreadRunning && pthread_equal(callingThread, replayThread))
+    {
+        DEBUG("ReplayComm::cancel : by replayThread")
+        pthread_detach(replayThread);
+        if (drainThreadRunning)
+        {
+            pthread_cancel(drainThread);
+            pthread_join(drainThread, NULL);
+            drainThreadRunning = false;
+        }
+        replayThreadRunning = false;
+        pthread_cond_signal(&control.cancel);
+        pthread_exit(NULL);
+    }
+    else
+    {
+        DEBUG("ReplayComm::cancel : by other thread")
+        if (replayThreadRunning)
+        {
+            pthread_cancel(replayThread);
+            pthread_join(replayThread, NULL);
+            replayThreadRunning = false;
+        }
+        if (drainThreadRunning)
+        {
+            pthread_cancel(drainThread);
+            pthread_join(drainThread, NULL);
+            drainThreadRunning = false;
+        }
+        pthread_cond_signal(&control.cancel);
+    }
+}
+
+string ReplayComm::getDevice() const
+{
+    return "replay:" + file;
+}
+
+/* reports error */
+int ReplayComm::reportError(const char *msg, int result)
+{
+    if ((result < 0) && (!errorReported))
+    {
+        errorMsg << "error : SF-Server ( ReplayComm of capture = " << file << " ) : "
+                 << msg << " ( result = " << result << " )" << endl
+                 << "error-description : " << strerror(errno) << endl;
+
+        cerr << errorMsg.str();
+        errorReported = true;
+        cancel();
+    }
+    return result;
+}
+
+/* prints out status */
+void ReplayComm::reportStatus(ostream& os)
+{
+    os << "SF-Server ( ReplayComm of capture " << file << " ) : "
+       << "speed = ";
+    if (speed > 0)
+        os << speed;
+    else
+        os << "max";
+    os << " , packets replayed = " << replayedPacketCount
+       << " , packets from clients discarded = " << discardedPacketCount
+       << " , " << (finished ? "finished" : (wallStart ? "replaying" : "waiting for a client")) << endl;
+}
+
+void ReplayComm::reportMetrics(Metrics& metrics, const string& labels)
+{
+    metrics.counter("sf_replay_packets_total", "Packets replayed from the capture.", labels, replayedPacketCount);
+    metrics.counter("sf_replay_discarded_total", "Packets from the clients discarded while replaying.", labels, discardedPacketCount);
+    metrics.gauge("sf_replay_finished", "1 once the end of the capture was replayed.", labels, finished ? 1 : 0);
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2007, Technische Universitaet Berlin
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright 
+ *   notice, this list of conditions and the following disclaimer in the 
+ *   documentation and/or other materials provided with the distribution.
+ * - Neither the name of the Technische Universitaet Berlin nor the names 
+ *   of its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT 
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED 
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, 
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+ * USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * Serves a capture recorded by SerialComm (see capture.h) to the TCP
+ * clients of an sf-server in place of a serial device. The packets the
+ * node sent are put into the read buffer with their original spacing,
+ * scaled by a speed factor, or as fast as the clients take them, and are
+ * delayed rather than dropped while the clients fall behind; packets from
+ * the clients are dropped. Replaying starts when the first client
+ * connects. The capture is read through a window mapped into memory, so
+ * it may be larger than the available memory.
+ */
+
+#ifndef REPLAYCOMM_H
+#define REPLAYCOMM_H
+
+#include "sfpacket.h"
+#include "packetbuffer.h"
+#include "sharedinfo.h"
+#include "reactor.h"
+#include "tcpcomm.h"
+#include "capture.h"
+
+#include <pthread.h>
+#include <string>
+#include <sstream>
+
+// #define DEBUG_REPLAYCOMM
+
+#undef DEBUG
+#ifdef DEBUG_REPLAYCOMM
+#include <iostream>
+#define DEBUG(message) std::cout << message << std::endl;
+#else
+#define DEBUG(message)
+#endif
+
+class ReplayComm : public Reactor::Handler
+{
+    /** Constants **/
+protected:
+    // max. packets put into the read buffer at a time
+    static const int maxBatch = 64;
+    // how often the replay checks for a first client or room in a full buffer (usec)
+    static const int pollDelay = 10000;
+
+    /** Member vars */
+protected:
+    /* pthread replaying the capture */
+    pthread_t replayThread;
+
+    bool replayThreadRunning;
+
+    /* pthread dropping packets from the clients */
+    pthread_t drainThread;
+
+    bool drainThreadRunning;
+
+    /* capture file being replayed */
+    std::string file;
+
+    capture_reader reader;
+
+    /* speed factor, 0 to replay as fast as possible */
+    double speed;
+
+    /* next packet, read but not yet due */
+    capture_record record;
+    bool pending;
+
+    /* capture time (ns) replayed at wallStart (ns), 0 until a client connected */
+    uint64_t firstTime;
+    uint64_t wallStart;
+
+    /* the whole capture was replayed */
+    bool finished;
+
+    /* reference to read packet buffer */
+    PacketBuffer &readBuffer;
+
+    /* reference to write packet buffer */
+    PacketBuffer &writeBuffer;
+
+    /* the server replayed to */
+    TCPComm &server;
+
+    /* number of replayed and discarded (from the clients) packets */
+    unsigned long replayedPacketCount;
+    unsigned long discardedPacketCount;
+
+    /* indicates that an error occured */
+    bool errorReported;
+
+    /* error message of reportError call */
+    std::ostringstream errorMsg;
+
+    /* for noticing the parent thread of cancelation */
+    sharedControlInfo_t &control;
+
+    /* reactor driving this replay, NULL if it runs its own threads */
+    Reactor* reactor;
+
+    /* notified when packets are put into readBuffer (reactor mode) */
+    Reactor::Handler* peer;
+
+    /* the timer was canceled */
+    bool reactorCanceled;
+
+    /** Member functions */
+
+    /* needed to start pthreads */
+    friend void* replayCaptureThread(void* ob);
+    friend void* drainClientsThread(void* ob);
+
+private:
+    /* do not allow standard constructor */
+    ReplayComm();
+
+protected:
+    /* puts the packets that are due into readBuffer. Returns the usec
+       until it should be called again, -1 when the capture is done */
+    long long replayPackets();
+
+    /* replays the capture - producer thread */
+    void replayCapture();
+
+    /* drops packets from the clients - consumer thread */
+    void drainClients();
+
+    /* reports error to stderr */
+    int reportError(const char *msg, int result);
+
+public:
+    /* replays pFile, pSpeed times faster than it was recorded (as fast
+       as possible if 0), starting pStart seconds into it */
+    ReplayComm(const char* pFile, double pSpeed, double pStart, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, TCPComm &pServer, sharedControlInfo_t& pControl, Reactor* pReactor = NULL);
+
+    ~ReplayComm();
+
+    /* sets the handler to notify of packets put into the read buffer */
+    void setPeer(Reactor::Handler* pPeer) { peer = pPeer; }
+
+    /* reactor callbacks */
+    void handleEvent(int fd, int events) {}
+    void handleTimer();
+    void bufferChanged();
+
+    /* cancels all running threads */
+    void cancel();
+
+    /* returns "replay:" and the capture file */
+    std::string getDevice() const;
+
+    void reportStatus(std::ostream& os);
+
+    /* adds counters to metrics, labels identify the sf-server */
+    void reportMetrics(Metrics& metrics, const std::string& labels);
+
+    /* returns if error occurred */
+    bool isErrorReported() { return errorReported; }
+};
+
+#endif
@@ -38,6 +38,7 @@
 #include <cstring>
 #include <iostream>
 #include <fcntl.h>
+#include <unistd.h>
 #include <termios.h>
 #include <pthread.h>
 #include <sstream>
@@ -243,11 +244,15 @@ tcflag_t SerialComm::parseBaudrate(int requested)
     return baudrate;
 }
 
-SerialComm::SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl) : readBuffer(pReadBuffer), writeBuffer(pWriteBuffer), droppedReadPacketCount(0), droppedWritePacketCount(0), readPacketCount(0), writtenPacketCount(0), badPacketCount(0), sumRetries(0), device(pDevice), baudrate(pBaudrate), serialReadFD(-1), serialWriteFD(-1), errorReported(false), errorMsg(""), control(pControl)
+SerialComm::SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl, Reactor* pReactor, read_strategy_t pReadStrategy, int pWindow) : readBuffer(pReadBuffer), writeBuffer(pWriteBuffer), droppedReadPacketCount(0), droppedWritePacketCount(0), readPacketCount(0), writtenPacketCount(0), badPacketCount(0), sumRetries(0), device(pDevice), baudrate(pBaudrate), serialReadFD(-1), serialWriteFD(-1), errorReported(false), errorMsg(""), control(pControl), reactor(pReactor), peer(NULL), txOutstanding(0), txWindow(1), reactorCanceled(false), readStrategy(pReadStrategy), rxChunkTime(0), rxStartTime(0), avgFrameBytes(0), readCalls(0), readBytes(0), capture(NULL)
 {
     writerThreadRunning = false;
     readerThreadRunning = false;
     rawFifo.head = rawFifo.tail = 0;
+    hdlc_decoder_init(&rxDecoder, rxBuffer, sizeof(rxBuffer));
+    for (int i = 0; i < cMaxWindow; i++)
+        txSlots[i].used = false;
+    windowRequest = (pWindow < 1) ? 1 : (pWindow > cMaxWindow) ? cMaxWindow : pWindow;
     tcflag_t baudflag = parseBaudrate(pBaudrate);
 
     srand ( time(NULL) );
@@ -256,7 +261,7 @@ SerialComm::SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBu
     FD_ZERO(&wfds);
 
     serialReadFD = open(device.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
-    serialWriteFD = open(device.c_str(), O_WRONLY | O_NOCTTY);
+    serialWriteFD = open(device.c_str(), O_WRONLY | O_NOCTTY | (reactor ? O_NONBLOCK : 0));
 
     if (((serialReadFD < 0) || (serialWriteFD < 0) || (!baudflag)) && !(errorReported == true))
     {
@@ -276,6 +281,10 @@ SerialComm::SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBu
     /* Raw output_file */
     newtio.c_oflag = 0;
 
+    /* a blocking read returns as soon as one byte is available */
+    newtio.c_cc[VMIN] = 1;
+    newtio.c_cc[VTIME] = 0;
+
     if ((tcflush(serialReadFD, TCIFLUSH) >= 0 && tcsetattr(serialReadFD, TCSANOW, &newtio) >= 0)
         && (tcflush(serialWriteFD, TCIFLUSH) >= 0 && tcsetattr(serialWriteFD, TCSANOW, &newtio) >= 0)
         && !errorReported)
@@ -296,9 +305,29 @@ SerialComm::SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBu
 
     pthread_mutex_init(&ack.lock, NULL);
     pthread_cond_init(&ack.received, NULL);
+    pthread_mutex_init(&captureLock, NULL);
+
+    if (!errorReported && !reactor && (readStrategy == READ_VMIN))
+    {
+        // let read() do the waiting instead of select()
+        int flags = fcntl(serialReadFD, F_GETFL);
+        reportError("SerialComm::SerialComm : fcntl(serialReadFD, F_SETFL, flags & ~O_NONBLOCK)",
+                    (flags < 0) ? flags : fcntl(serialReadFD, F_SETFL, flags & ~O_NONBLOCK));
+    }
 
-    if (!errorReported)
+    SFPacket request(SF_WINDOW, seqno);
+    if (!errorReported && reactor)
     {
+        reactor->add(serialReadFD, this, Reactor::READABLE);
+        reactor->add(serialWriteFD, this, 0);
+        // nodes that do not know the request ignore it: stop-and-wait
+        if (windowRequest > 1)
+            queuePacket(request);
+    }
+    else if (!errorReported)
+    {
+        if (windowRequest > 1)
+            writePacket(request);
         // start thread for reading from serial line
         if (reportError("SerialComm::SerialComm : pthread_create( &readerThread, NULL, readSerialThread, this)", pthread_create( &readerThread, NULL, readSerialThread, this)) == 0)
             readerThreadRunning = true;
@@ -316,25 +345,13 @@ SerialComm::~SerialComm()
     pthread_mutex_destroy(&ack.lock);
     pthread_cond_destroy(&ack.received);
 
+    setCapture(NULL);
+    pthread_mutex_destroy(&captureLock);
+
     if(serialReadFD > 2) close(serialReadFD);
     if(serialWriteFD > 2) close(serialWriteFD);
 }
 
-int SerialComm::hdlcEncode(int count, const char* from, char *to) {
-    int offset = 0;
-    for(int i = 0; i < count; i++) {
-        if (from[i] == SYNC_BYTE || from[i] == ESCAPE_BYTE)
-        {
-            to[offset++] = ESCAPE_BYTE;
-            to[offset++] = from[i] ^ 0x20;
-        }
-        else {
-            to[offset++] = from[i];
-        }
-    }
-    return offset;
-}
-
 int SerialComm::writeFD(int fd, const char *buffer, int count, int *err)
 {
     int cnt = 0;
@@ -362,21 +379,35 @@ int SerialComm::writeFD(int fd, const char *buffer, int count, int *err)
 int SerialComm::readFD(int fd, char *buffer, int count, int maxCount, int *err)
 {
     int cnt = 0;
-    timeval tvold;
-    timeval tv;
-    unsigned to = (10000000 / baudrate) * count; // time out in usec
-    tvold.tv_sec = to / 1000000;
-    tvold.tv_usec = to % 1000000;
+    bool wait = (readStrategy != READ_VMIN);
     while (cnt == 0)
     {
-        // no FD_ZERO here because of performance issues. It is done in constructor...
-        FD_SET(serialReadFD, &rfds);
-        if (select(serialReadFD + 1, &rfds, NULL, NULL, NULL) < 0) {
-            return -1;
+        if (wait)
+        {
+            // no FD_ZERO here because of performance issues. It is done in constructor...
+            FD_SET(serialReadFD, &rfds);
+            if (select(serialReadFD + 1, &rfds, NULL, NULL, NULL) < 0) {
+                return -1;
+            }
+            FD_CLR(serialReadFD, &rfds);
+            rxChunkTime = Reactor::now();
+        }
+        long long delay = 0;
+        if (readStrategy == READ_DELAY)
+        {
+            delay = (10000000 / baudrate) * count;
+        }
+        else if (readStrategy == READ_ADAPTIVE)
+        {
+            delay = coalesceDelay();
+        }
+        if (delay > 0)
+        {
+            timeval tv;
+            tv.tv_sec = delay / 1000000;
+            tv.tv_usec = delay % 1000000;
+            select(0, NULL, NULL, NULL, &tv);
         }
-        FD_CLR(serialReadFD, &rfds);
-        tv = tvold;
-        select(0, NULL, NULL, NULL, &tv);
         int tmpCnt = read(fd, buffer, maxCount);
         if (tmpCnt < 0) {
             *err = errno;
@@ -385,168 +416,168 @@ int SerialComm::readFD(int fd, char *buffer, int count, int maxCount, int *err)
         else {
             cnt += tmpCnt;
         }
+        if (!wait)
+            rxChunkTime = Reactor::now();
+        // a blocking read returned nothing: the driver is one of the buggy ones
+        wait = true;
     }
+    ++readCalls;
+    readBytes += cnt;
     return cnt;
 }
 
-char SerialComm::nextRaw() {
-    char nextByte = 0;
-    int err = 0;
-    if(rawFifo.tail < rawFifo.head) {
-        nextByte = rawFifo.queue[rawFifo.tail++];
+/* the rest of a frame can not arrive faster than the line rate, so
+   waiting for it does not delay the packet but saves reads */
+long long SerialComm::coalesceDelay()
+{
+    if (!rxDecoder.in_sync || (rxDecoder.count == 0) || (avgFrameBytes <= (int)rxDecoder.count))
+    {
+        // between frames or the frame is about complete: read at once
+        return 0;
     }
-    else {
-        // fifo empty -- need to get some bytes
-        rawFifo.tail = 0;
-        rawFifo.head = readFD(serialReadFD, rawFifo.queue, rawReadBytes, maxMTU-1, &err);
-        if(rawFifo.head < 0) {
-            close(serialReadFD);
-            close(serialWriteFD);
-            serialReadFD = -1;
-            serialWriteFD = -1;
-            errno = err;
-        }
-        reportError("SerialComm::nextRaw: readFD(serialReadFD, rawFifo.queue, rawReadBytes, maxMTU-1)",
-                    rawFifo.head);
-        nextByte = rawFifo.queue[rawFifo.tail++];
+    long long byteTime = 10000000 / baudrate;
+    long long expectedEnd = rxStartTime + byteTime * avgFrameBytes;
+    long long delay = expectedEnd - Reactor::now();
+    if (delay > maxCoalesceDelay)
+        delay = maxCoalesceDelay;
+    return delay;
+}
+
+void SerialComm::readRaw() {
+    int err = 0;
+    rawFifo.tail = 0;
+    rawFifo.head = readFD(serialReadFD, rawFifo.queue, rawReadBytes, maxMTU-1, &err);
+    if(rawFifo.head < 0) {
+        close(serialReadFD);
+        close(serialWriteFD);
+        serialReadFD = -1;
+        serialWriteFD = -1;
+        errno = err;
     }
-    return nextByte;
+    reportError("SerialComm::readRaw: readFD(serialReadFD, rawFifo.queue, rawReadBytes, maxMTU-1)",
+                rawFifo.head);
 }
 
-/* reads packet */
-bool SerialComm::readPacket(SFPacket &pPacket)
+/* feeds bytes to the frame decoder */
+bool SerialComm::rxBytes(const char *bytes, int count, int &pos, SFPacket &pPacket)
 {
-    uint8_t buffer[maxMTU + 10];
-    int count = 0;
-    rx_states_t state = WAIT_FOR_SYNC;
-    for(;;) {
-        uint8_t nextByte = nextRaw();
-        if(state == WAIT_FOR_SYNC) {
-            if(nextByte == SYNC_BYTE) {
-                count = 0;
-                state = IN_SYNC;
-            }
-        }
-        else if(state == IN_SYNC) {
-            if(nextByte == SYNC_BYTE) {
-                if(count < minMTU) {
-                    DEBUG("SerialComm::readPacket : frame too short - size = " << count << " : resynchronising ");
-                    badPacketCount++; 
-                    count = 0;
-                }
-                else {
-                    bool dobreak = true;
-                    DEBUG("SerialComm::readPacket : frame size = " << count);
-                    if(checkCrc(buffer, count)) {
-                        pPacket.setType(buffer[typeOffset]);
-                        pPacket.setSeqno(buffer[seqnoOffset]);
-                        switch (buffer[typeOffset]) {
-                        case SF_ACK:
-                            break;
-                        case SF_PACKET_NO_ACK:
-                            pPacket.setPayload((char *)(&buffer[payloadOffset]-1), count+1+1 - serialHeaderBytes);
-                            break;
-                        case SF_PACKET_ACK:
-                            pPacket.setPayload((char *)(&buffer[payloadOffset]), count+1 - serialHeaderBytes);
-                            break;
-                        default:
-                            dobreak = false;
-                            DEBUG("SerialComm::readPacket : unknown packet type = " \
-                                  << static_cast<uint16_t>(buffer[typeOffset] & 0xff));
-                            break;
-                        }
-                        if(dobreak) break; // leave loop
-                    }
-                    else {
-                        DEBUG("SerialComm::readPacket : bad crc");
-                        count = 0;
-                        badPacketCount++;
-                    }
-                }
-            }
-            else if(nextByte == ESCAPE_BYTE) {
-                state = ESCAPED;
-            }
-            else {
-                buffer[count++] = nextByte;
-                if(count >= maxMTU) {
-                    DEBUG("SerialComm::readPacket : packet too long, resynchronizing");
-                    count = 0;
-                    badPacketCount++;
-                    state = WAIT_FOR_SYNC;
-                }
-            }
+    while (pos < count) {
+        hdlc_event event;
+        bool idle = (rxDecoder.count == 0);
+        pos += hdlc_decode(&rxDecoder, bytes + pos, count - pos, &event);
+        if (idle && ((rxDecoder.count > 0) || (event == hdlc_frame))) {
+            // the frame started in this chunk
+            rxStartTime = rxChunkTime;
         }
-        else if(state == ESCAPED) {
-            if(nextByte == SYNC_BYTE) {
-                DEBUG("SerialComm::readPacket : state ESCAPED, packet got sync byte, resynchronizing");
-                count = 0;
-                badPacketCount++;
-                state = IN_SYNC;
-            }
-            else {
-                buffer[count++] = nextByte ^ 0x20;
-                if(count >= maxMTU) {
-                    DEBUG("SerialComm::readPacket : state ESCAPED, packet too long, resynchronizing");
-                    count = 0;
-                    badPacketCount++;
-                    state = WAIT_FOR_SYNC;
-                }
-                else {
-                    state = IN_SYNC;
-                }
+        switch (event) {
+        case hdlc_too_long:
+            DEBUG("SerialComm::rxBytes : packet too long, resynchronizing");
+            badPacketCount++;
+            break;
+        case hdlc_bad_sync:
+            DEBUG("SerialComm::rxBytes : state ESCAPED, packet got sync byte, resynchronizing");
+            badPacketCount++;
+            break;
+        case hdlc_frame:
+            if (parseFrame(pPacket)) {
+                return true;
             }
+            break;
+        default:
+            break;
         }
     }
+    return false;
+}
+
+/* makes a packet of the frame in rxBuffer */
+bool SerialComm::parseFrame(SFPacket &pPacket)
+{
+    uint8_t *buffer = rxBuffer;
+    int count = rxDecoder.length;
+
+    if(count < minMTU) {
+        DEBUG("SerialComm::parseFrame : frame too short - size = " << count << " : resynchronising ");
+        badPacketCount++; 
+        return false;
+    }
+    DEBUG("SerialComm::parseFrame : frame size = " << count);
+    if(!hdlc_check(buffer, count)) {
+        DEBUG("SerialComm::parseFrame : bad crc");
+        badPacketCount++;
+        return false;
+    }
+    pPacket.setType(buffer[typeOffset]);
+    pPacket.setSeqno(buffer[seqnoOffset]);
+    switch (buffer[typeOffset]) {
+    case SF_ACK:
+        break;
+    case SF_WINDOW:
+        // the node has no seqno, the window is where it would be
+        break;
+    case SF_PACKET_NO_ACK:
+        pPacket.setPayload((char *)(&buffer[payloadOffset]-1), count+1+1 - serialHeaderBytes);
+        break;
+    case SF_PACKET_ACK:
+        pPacket.setPayload((char *)(&buffer[payloadOffset]), count+1 - serialHeaderBytes);
+        break;
+    default:
+        DEBUG("SerialComm::parseFrame : unknown packet type = " \
+              << static_cast<uint16_t>(buffer[typeOffset] & 0xff));
+        return false;
+    }
+    pPacket.setTimestamp(rxStartTime);
+    // 2 sync bytes, escaping is rare enough to ignore
+    avgFrameBytes = avgFrameBytes ? (7 * avgFrameBytes + count + 2) / 8 : count + 2;
     return true;
 }
 
-/* writes packet */
-bool SerialComm::writePacket(SFPacket &pPacket)
+/* reads packet */
+bool SerialComm::readPacket(SFPacket &pPacket)
 {
-    char type, byte = 0;
-    uint16_t crc = 0;
-    char buffer[2*pPacket.getLength() + 20];
-    int offset = 0;
-    int err = 0;
-    int written = 0;
-    
-    // put SFD into buffer 
-    buffer[offset++] = SYNC_BYTE;
+    while(!rxBytes(rawFifo.queue, rawFifo.head, rawFifo.tail, pPacket)) {
+        readRaw();
+    }
+    return true;
+}
 
-    // packet type
-    byte = type = pPacket.getType();
-    crc = byteCRC(byte, crc);
-    offset += hdlcEncode(1, &byte, buffer + offset);
+/* encodes packet */
+int SerialComm::encodePacket(SFPacket &pPacket, char *buffer)
+{
+    uint8_t frame[2 + SFPacket::cMaxPacketLength];
+    int length = 2;
 
-    // seqno
-    byte = pPacket.getSeqno();
-    crc = byteCRC(byte, crc);
-    offset += hdlcEncode(1, &byte, buffer + offset);
-    switch (type)
+    frame[typeOffset] = pPacket.getType();
+    frame[seqnoOffset] = pPacket.getSeqno();
+    switch (pPacket.getType())
     {
     case SF_ACK:
         break;
+    case SF_WINDOW:
+        frame[length++] = windowRequest;
+        break;
     case SF_PACKET_NO_ACK:
     case SF_PACKET_ACK:
-        // compute crc
-        for(int i = 0; i < pPacket.getLength(); i++) {
-            crc = byteCRC(pPacket.getPayload()[i], crc);
-        }
-        offset += hdlcEncode(pPacket.getLength(), pPacket.getPayload(), buffer + offset);
+        memcpy(frame + length, pPacket.getPayload(), pPacket.getLength());
+        length += pPacket.getLength();
         break;
     default:
-        return false;
+        return -1;
     }
+    return hdlc_encode(buffer, frame, length);
+}
 
-    // crc two bytes
-    byte = crc & 0xff;
-    offset += hdlcEncode(1, &byte, buffer + offset);
-    byte = (crc >> 8) & 0xff;
-    offset += hdlcEncode(1, &byte, buffer + offset);
-    
-    // put SFD into buffer
-    buffer[offset++] = SYNC_BYTE;
+/* writes packet */
+bool SerialComm::writePacket(SFPacket &pPacket)
+{
+    char buffer[maxFrameBytes];
+    int err = 0;
+    int written = 0;
+    int offset = encodePacket(pPacket, buffer);
+
+    if (offset < 0) {
+        return false;
+    }
     written = writeFD(serialWriteFD, buffer, offset, &err);
     if(written < 0) {
         if(err != EINTR) {
@@ -590,41 +621,282 @@ void SerialComm::readSerial()
     {
         SFPacket packet;
         readPacket(packet);
-        switch (packet.getType())
-	{
-	case SF_ACK:
-            // successful delivery
-            // FIXME: seqnos are not implemented on the node !
+        dispatchPacket(packet);
+    }
+}
+
+/* handles a packet read from the node */
+void SerialComm::dispatchPacket(SFPacket &packet)
+{
+    switch (packet.getType())
+    {
+    case SF_ACK:
+    case SF_WINDOW:
+        if (!reactor)
+            pthread_mutex_lock(&ack.lock);
+        if (packet.getType() == SF_ACK)
+            windowAck(packet.getSeqno());
+        else
+            windowGranted(packet.getSeqno());
+        if (reactor)
+        {
+            sendNext();
+        }
+        else
+        {
             pthread_cond_signal(&ack.received);
+            pthread_mutex_unlock(&ack.lock);
+        }
+        break;
+    case SF_PACKET_ACK:
+    {
+        // put ack in front of queue
+        SFPacket ack(SF_ACK, packet.getSeqno());
+        if (reactor)
+            queuePacket(ack);
+        else
+            writeBuffer.enqueueFront(ack);
+    }
+    case SF_PACKET_NO_ACK:
+        capturePacket(CAPTURE_FROM_NODE, packet);
+    default:
+        // put silently into buffer, dropping the oldest packets if it is full
+        unsigned dropped = readBuffer.enqueueBackDropOldest(packet);
+        if (dropped == 0)
+            ++readPacketCount;
+        droppedReadPacketCount += dropped;
+        if (peer)
+            reactor->notify(peer);
+    }
+}
+
+/* reactor mode: device readable or writable */
+void SerialComm::handleEvent(int fd, int events)
+{
+    if (fd == serialWriteFD)
+    {
+        flushQueue();
+        return;
+    }
+
+    char buf[maxMTU];
+    SFPacket packet;
+    while (!reactorCanceled)
+    {
+        rxChunkTime = Reactor::now();
+        int n = read(serialReadFD, buf, sizeof(buf));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                reportError("SerialComm::handleEvent : read(serialReadFD, buf, sizeof(buf))", n);
             break;
-	case SF_PACKET_ACK:
+        }
+        if (n == 0)
+        {
+            // buggy usb serial drivers return 0 when no data is
+            // available, but after a hangup there never will be
+            if (events & Reactor::FAILED)
+            {
+                errno = EIO;
+                reportError("SerialComm::handleEvent : device hung up", -1);
+            }
+            break;
+        }
+        ++readCalls;
+        readBytes += n;
+        int pos = 0;
+        while (rxBytes(buf, n, pos, packet))
         {
-	    // put ack in front of queue
-	    SFPacket ack(SF_ACK, packet.getSeqno());
-	    writeBuffer.enqueueFront(ack);
+            dispatchPacket(packet);
         }
-	case SF_PACKET_NO_ACK:
-            // do nothing - fall through
-	default:
-            if (!readBuffer.isFull())
-	    {
-                ++readPacketCount;
-                // put silently into buffer...
-                readBuffer.enqueueBack(packet);
-	    }
-            else
-	    {
-                while(readBuffer.isFull()) {
-                    readBuffer.dequeue();
-                    ++droppedReadPacketCount;
-                }
-                readBuffer.enqueueBack(packet);
-                // DEBUG("SerialComm::readSerial : dropped packet")
-	    }
-	}
     }
 }
 
+/* reactor mode: no ack within the timeout */
+void SerialComm::handleTimer()
+{
+    SFPacket resend[cMaxWindow + 1];
+    int count = windowExpire(Reactor::now(), resend);
+    for (int i = 0; i < count; i++)
+    {
+        queuePacket(resend[i]);
+    }
+    // dropped packets make room
+    sendNext();
+}
+
+/* reactor mode: the tcp side queued packets or took some out */
+void SerialComm::bufferChanged()
+{
+    sendNext();
+}
+
+/* reactor mode: sends packets while the window is open */
+void SerialComm::sendNext()
+{
+    PacketBuffer::claim_t claim;
+    SFPacket* packet;
+    bool dequeued = false;
+    while (!reactorCanceled && windowOpen() && (packet = writeBuffer.claimDequeue(claim)))
+    {
+        dequeued = true;
+        ++writtenPacketCount;
+        // FIXME: this is the only currently supported type by the mote
+        packet->setType(SF_PACKET_ACK);
+        windowAdd(*packet);
+        queuePacket(*packet);
+        writeBuffer.release(claim);
+    }
+    if (reactorCanceled)
+        return;
+    // there is room in the buffer again
+    if (dequeued && peer)
+        reactor->notify(peer);
+    reactor->setTimer(this, windowDeadline());
+}
+
+/* true if another packet may be sent before more acks arrive */
+bool SerialComm::windowOpen()
+{
+    if (txOutstanding >= txWindow)
+        return false;
+    // the node's receive window starts at the oldest seqno it has not
+    // delivered, which is at least the oldest unacked one, so the next
+    // seqno may not be txWindow or more ahead of any unacked one
+    for (int i = 0; i < cMaxWindow; i++)
+    {
+        if (txSlots[i].used && (uint8_t)(seqno + 1 - txSlots[i].packet.getSeqno()) >= txWindow)
+            return false;
+    }
+    return true;
+}
+
+/* assigns the next seqno to pPacket and waits for its ack */
+void SerialComm::windowAdd(SFPacket &pPacket)
+{
+    seqno = (seqno + 1) & 0xff;
+    pPacket.setSeqno(seqno);
+    for (int i = 0; i < cMaxWindow; i++)
+    {
+        if (!txSlots[i].used)
+        {
+            txSlots[i].packet = pPacket;
+            txSlots[i].sent = Reactor::now();
+            txSlots[i].deadline = txSlots[i].sent + (long long)ackTimeout / 1000;
+            txSlots[i].retries = 0;
+            txSlots[i].used = true;
+            ++txOutstanding;
+            // retransmissions are not recorded
+            capturePacket(CAPTURE_TO_NODE, pPacket);
+            return;
+        }
+    }
+}
+
+/* handles an ack from the node */
+void SerialComm::windowAck(int pSeqno)
+{
+    for (int i = 0; i < cMaxWindow; i++)
+    {
+        // stop-and-wait does not rely on the node echoing seqnos
+        if (txSlots[i].used && ((txWindow == 1) || (txSlots[i].packet.getSeqno() == pSeqno)))
+        {
+            // the ack of a retransmitted packet may be for any of its copies
+            if (txSlots[i].retries == 0)
+                ackRtt.record(Reactor::now() - txSlots[i].sent);
+            txSlots[i].used = false;
+            --txOutstanding;
+            return;
+        }
+    }
+}
+
+/* handles the node's answer to the window request */
+void SerialComm::windowGranted(int pWindow)
+{
+    txWindow = (pWindow < 1) ? 1 : (pWindow > windowRequest) ? windowRequest : pWindow;
+    DEBUG("SerialComm::windowGranted : window = " << txWindow);
+}
+
+/* collects packets whose ack timed out */
+int SerialComm::windowExpire(long long now, SFPacket *resend)
+{
+    int count = 0;
+    for (int i = 0; i < cMaxWindow; i++)
+    {
+        txSlot_t &slot = txSlots[i];
+        if (!slot.used || (slot.deadline > now))
+            continue;
+        if (slot.retries < maxRetries)
+        {
+            ++slot.retries;
+            DEBUG("SerialComm::windowExpire : packet retryCount = " << slot.retries);
+            ++sumRetries;
+            slot.deadline = now + (long long)ackTimeout * (slot.retries + 1) / 1000;
+            resend[count++] = slot.packet;
+        }
+        else
+        {
+            ++droppedWritePacketCount;
+            slot.used = false;
+            --txOutstanding;
+        }
+    }
+    // the node may have been resetting when the window was requested.
+    // After the retransmissions, so they are not taken for new packets.
+    if ((count > 0) && (txWindow == 1) && (windowRequest > 1))
+    {
+        resend[count++] = SFPacket(SF_WINDOW, seqno);
+    }
+    return count;
+}
+
+/* time of the next retransmission */
+long long SerialComm::windowDeadline()
+{
+    long long next = 0;
+    for (int i = 0; i < cMaxWindow; i++)
+    {
+        if (txSlots[i].used && (!next || (txSlots[i].deadline < next)))
+            next = txSlots[i].deadline;
+    }
+    return next;
+}
+
+/* reactor mode: queues a frame for the device */
+void SerialComm::queuePacket(SFPacket &pPacket)
+{
+    char buffer[maxFrameBytes];
+    int len = encodePacket(pPacket, buffer);
+    if (len > 0)
+    {
+        txQueue.append(buffer, len);
+        flushQueue();
+    }
+}
+
+/* reactor mode: writes queued frames until the device blocks */
+void SerialComm::flushQueue()
+{
+    while (!txQueue.empty() && !reactorCanceled)
+    {
+        int n = write(serialWriteFD, txQueue.data(), txQueue.size());
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                reportError("SerialComm::flushQueue : write(serialWriteFD, txQueue.data(), txQueue.size())", n);
+            break;
+        }
+        txQueue.erase(0, n);
+    }
+    if (!reactorCanceled)
+        reactor->modify(serialWriteFD, txQueue.empty() ? 0 : Reactor::WRITABLE);
+}
+
 /* helper function to start serial writer pthread */
 void* writeSerialThread(void* ob)
 {
@@ -636,17 +908,56 @@ void* writeSerialThread(void* ob)
 void SerialComm::writeSerial()
 {
     SFPacket packet;
-    bool retry = false;
-    int retryCount = 0;
-    long long timeout;
+    SFPacket resend[cMaxWindow + 1];
     
     while (true)
     {
-        if (!retry)
-	{
-            cerr << " serial deqeue packet, empty: " << writeBuffer.isEmpty() << endl;
-            packet = writeBuffer.dequeue();
-	}
+        int count = 0;
+        bool open = false;
+
+        pthread_testcancel();
+        pthread_mutex_lock(&ack.lock);
+        pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &ack.lock);
+        while (true)
+        {
+            long long now = Reactor::now();
+            count = windowExpire(now, resend);
+            open = windowOpen();
+            if ((count > 0) || (txOutstanding == 0) || (open && !writeBuffer.isEmpty()))
+                break;
+            // wait for acks or the next timeout; look for new packets
+            // now and then if the window is open
+            long long timeout = windowDeadline() - now;
+            if (open && (timeout > windowPollDelay))
+                timeout = windowPollDelay;
+            struct timeval currentTime;
+            struct timespec ackTime;
+            gettimeofday(&currentTime, NULL);
+            ackTime.tv_sec = currentTime.tv_sec + timeout / (1000*1000);
+            ackTime.tv_nsec = (currentTime.tv_usec + timeout % (1000*1000)) * 1000;
+            if (ackTime.tv_nsec >= 1000*1000*1000)
+            {
+                ackTime.tv_sec += 1;
+                ackTime.tv_nsec -= 1000*1000*1000;
+            }
+            pthread_cond_timedwait(&ack.received, &ack.lock, &ackTime);
+        }
+        // removes the cleanup handler and executes it (unlock mutex)
+        pthread_cleanup_pop(1);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (!writePacket(resend[i]))
+            {
+                DEBUG("SerialComm::writeSerial : writePacket failed (retry)")
+                    reportError("SerialComm::writeSerial : writeFD(retry)", -1);
+            }
+        }
+        if ((count > 0) || !open)
+            continue;
+
+        DEBUG("SerialComm::writeSerial : dequeue packet, empty: " << writeBuffer.isEmpty())
+        writeBuffer.dequeue(packet);
         switch (packet.getType())
 	{
 	case SF_ACK:
@@ -662,53 +973,82 @@ void SerialComm::writeSerial()
 	case SF_PACKET_NO_ACK:
             // do nothing - fall through
 	default:
-            if (!retry)
-                ++writtenPacketCount;
+            ++writtenPacketCount;
             // FIXME: this is the only currently supported type by the mote
             packet.setType(SF_PACKET_ACK);
+            pthread_mutex_lock(&ack.lock);
+            windowAdd(packet);
+            pthread_mutex_unlock(&ack.lock);
             if (!writePacket(packet))
 	    {
                 DEBUG("SerialComm::writeSerial : writePacket failed (SF_PACKET)")
                     reportError("SerialComm::writeSerial : writeFD(SF_PACKET)", -1);
 	    }
-            // wait for ack...
-            struct timeval currentTime;
-            struct timespec ackTime;
-            timeout = (long long)ackTimeout * (retryCount + 1);
-            
-            pthread_testcancel();
-            pthread_mutex_lock(&ack.lock);
-
-            gettimeofday(&currentTime, NULL);
-            ackTime.tv_sec = currentTime.tv_sec;
-            ackTime.tv_nsec = currentTime.tv_usec * 1000;
+	}
+    }
+}
 
-            ackTime.tv_sec  +=  timeout / (1000*1000*1000);
-            ackTime.tv_nsec += timeout % (1000*1000*1000);
+/* starts or stops recording packets */
+bool SerialComm::setCapture(const char* pFile)
+{
+    capture_writer newCapture = NULL;
+    if (pFile)
+    {
+        newCapture = open_capture_writer(pFile);
+        if (!newCapture)
+            return false;
+    }
+    pthread_mutex_lock(&captureLock);
+    capture_writer oldCapture = capture;
+    capture = newCapture;
+    captureFile = pFile ? pFile : "";
+    pthread_mutex_unlock(&captureLock);
+    if (oldCapture)
+        close_capture_writer(oldCapture);
+    return true;
+}
 
-            pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &ack.lock);
-            int retval = pthread_cond_timedwait(&ack.received, &ack.lock, &ackTime);
-            if (!((retryCount < maxRetries) && (retval == ETIMEDOUT)))
-	    {
-                if (retryCount >= maxRetries) ++droppedWritePacketCount;
-                retry = false;
-                retryCount = 0;
-	    }
-            else
-	    {
-                ++retryCount;
-                retry = true;
-                DEBUG("SerialComm::writeSerial : packet retryCount = " << retryCount);
-                ++sumRetries;
-	    }
-            // removes the cleanup handler and executes it (unlock mutex)
-            pthread_cleanup_pop(1);         }
+/* appends a packet to the capture */
+void SerialComm::capturePacket(int type, SFPacket &pPacket)
+{
+    if (!capture)
+        return;
+    // threads are canceled at the next cancellation point, not in here
+    int cancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+    pthread_mutex_lock(&captureLock);
+    if (capture)
+    {
+        uint64_t time = ((type == CAPTURE_FROM_NODE) && pPacket.getTimestamp()) ?
+            (uint64_t)pPacket.getTimestamp() * 1000 : capture_now();
+        if (capture_write(capture, type, time, pPacket.getPayload(), pPacket.getLength()) < 0)
+        {
+            cerr << "error : SF-Server ( SerialComm on device = " << device << " ) : "
+                 << "capture to " << captureFile << " stopped : " << strerror(errno) << endl;
+            close_capture_writer(capture);
+            capture = NULL;
+        }
     }
+    pthread_mutex_unlock(&captureLock);
+    pthread_setcancelstate(cancelState, NULL);
 }
 
 /* cancels all running threads */
 void SerialComm::cancel()
 {
+    if (reactor)
+    {
+        // there are no threads, just stop getting called
+        if (!reactorCanceled)
+        {
+            reactorCanceled = true;
+            reactor->remove(serialReadFD);
+            reactor->remove(serialWriteFD);
+            reactor->forget(this);
+            pthread_cond_signal(&control.cancel);
+        }
+        return;
+    }
     pthread_t callingThread = pthread_self();
     if(readerThreadRunning && pthread_equal(callingThread, readerThread))
     {
@@ -787,6 +1127,32 @@ void SerialComm::reportStatus(ostream& os)
        << ", bad = " << badPacketCount << " )"
        << " , packets written = " << writtenPacketCount
        << " ( dropped = " << droppedWritePacketCount 
-       << ", total retries: " << sumRetries << " )"
-       << endl;
+       << ", total retries: " << sumRetries
+       << ", window = " << txWindow << " )"
+       << " , reads = " << readCalls
+       << " ( bytes per read = " << ((readCalls > 0) ? (double)readBytes / readCalls : 0.0)
+       << ", mode = " << ((readStrategy == READ_VMIN) ? "vmin" : (readStrategy == READ_ADAPTIVE) ? "adaptive" : "delay")
+       << " )";
+    pthread_mutex_lock(&captureLock);
+    if (capture)
+        os << " , capture = " << captureFile;
+    pthread_mutex_unlock(&captureLock);
+    os << endl
+       << ">> ack round trip time : ";
+    ackRtt.print(os);
+    os << endl;
+}
+
+void SerialComm::reportMetrics(Metrics& metrics, const string& labels)
+{
+    metrics.counter("sf_serial_packets_read_total", "Packets read from the node.", labels, readPacketCount);
+    metrics.counter("sf_serial_packets_read_dropped_total", "Packets read from the node and dropped, the buffer to tcp was full.", labels, droppedReadPacketCount);
+    metrics.counter("sf_serial_bad_frames_total", "Frames from the node with a bad crc or framing (including resynchronizations).", labels, badPacketCount);
+    metrics.counter("sf_serial_packets_written_total", "Packets written to the node.", labels, writtenPacketCount);
+    metrics.counter("sf_serial_packets_write_dropped_total", "Packets to the node dropped after all retries.", labels, droppedWritePacketCount);
+    metrics.counter("sf_serial_retries_total", "Retransmissions to the node.", labels, sumRetries);
+    metrics.counter("sf_serial_reads_total", "Read calls on the serial device.", labels, readCalls);
+    metrics.counter("sf_serial_read_bytes_total", "Bytes read from the serial device.", labels, readBytes);
+    metrics.gauge("sf_serial_window", "Packets sent to the node before waiting for acks.", labels, txWindow);
+    metrics.histogram("sf_serial_ack_rtt_seconds", "Time from sending a packet to the node until its ack.", labels, ackRtt);
 }
@@ -37,6 +37,11 @@
 #include "sfpacket.h"
 #include "packetbuffer.h"
 #include "sharedinfo.h"
+#include "reactor.h"
+#include "hdlc.h"
+#include "capture.h"
+#include "histogram.h"
+#include "metrics.h"
 
 #include <sys/select.h>
 #include <pthread.h>
@@ -57,8 +62,23 @@
 #endif
 
 
-class SerialComm : public BaseComm
+class SerialComm : public BaseComm, public Reactor::Handler
 {
+public:
+    /* how the reader thread waits for bytes from the device */
+    enum read_strategy_t {
+        // blocking read (VMIN = 1, VTIME = 0), returns as soon as a byte is there
+        READ_VMIN,
+        // read at once, but wait for the rest of a frame that started arriving
+        READ_ADAPTIVE,
+        // sleep for the transmission time of count bytes before each read
+        READ_DELAY
+    };
+
+    /* unacked packets sent to the node, if it accepts a window */
+    static const int cDefaultWindow = 8;
+    // largest window that can be requested
+    static const int cMaxWindow = 16;
 
     /** Constants **/
 protected:
@@ -78,15 +98,15 @@ protected:
     static const int ackTimeout = 1000 * 1000 * 200;
     // max. reties for packets from pc to node
     static const int maxRetries = 25;
+    // how often the writer thread looks for new packets while waiting for acks (usec)
+    static const int windowPollDelay = 1000;
 
     // how many bytes do we attempt to read from the serial line in one go?
     static const int rawReadBytes = 20;
-
-    enum rx_states_t {
-        WAIT_FOR_SYNC,
-        IN_SYNC,
-        ESCAPED
-    };
+    // max. size of an encoded frame
+    static const int maxFrameBytes = 2 * SFPacket::cMaxPacketLength + 20;
+    // longest wait for the rest of a frame in READ_ADAPTIVE mode (usec)
+    static const int maxCoalesceDelay = 20000;
     
     /** Member vars */
 protected:
@@ -105,7 +125,7 @@ protected:
     {
         // mutex lock for any of this vars
         pthread_mutex_t lock;
-        // notempty cond
+        // signaled on acks and window replies
         pthread_cond_t received;
     } ackCondition_t;
 
@@ -173,6 +193,69 @@ protected:
     
     /* for noticing the parent thread of cancelation */
     sharedControlInfo_t &control;
+
+    /* frame receive state, kept across reads */
+    hdlc_decoder rxDecoder;
+    uint8_t rxBuffer[maxMTU];
+
+    /* reactor driving this device, NULL if it runs its own threads */
+    Reactor* reactor;
+
+    /* notified when packets are put into readBuffer (reactor mode) */
+    Reactor::Handler* peer;
+
+    /* encoded frames waiting for the device (reactor mode) */
+    std::string txQueue;
+
+    /* packet sent to the node, waiting for its ack */
+    typedef struct
+    {
+        SFPacket packet;
+        // time (usec) at which it is sent again
+        long long deadline;
+        // time (usec) it was first sent
+        long long sent;
+        int retries;
+        bool used;
+    } txSlot_t;
+
+    /* unacked packets, protected by ack.lock in threaded mode */
+    txSlot_t txSlots[cMaxWindow];
+    int txOutstanding;
+
+    /* unacked packets the node accepts, 1 until it answered the window request */
+    int txWindow;
+
+    /* window asked for in the window request, 1 for stop-and-wait */
+    int windowRequest;
+
+    /* fds were removed from the reactor */
+    bool reactorCanceled;
+
+    /* how readFD waits for data */
+    read_strategy_t readStrategy;
+
+    /* time (usec) the bytes currently parsed became readable */
+    long long rxChunkTime;
+
+    /* time (usec) the first byte of the current frame became readable */
+    long long rxStartTime;
+
+    /* running average of the frame size in bytes (READ_ADAPTIVE) */
+    int avgFrameBytes;
+
+    /* read calls and bytes they returned */
+    unsigned long readCalls;
+    unsigned long readBytes;
+
+    /* time from sending a packet until its ack, retransmitted ones aside */
+    LatencyHistogram ackRtt;
+
+    /* packets in both directions are recorded here, NULL if not capturing */
+    capture_writer capture;
+    std::string captureFile;
+    /* protects capture, it is written by the reader and writer threads */
+    pthread_mutex_t captureLock;
     
 /** Member functions */
 
@@ -185,56 +268,73 @@ private:
     SerialComm();
 
 protected:
-    char nextRaw();
-    
-    /* claculates crc byte-wise */
-    inline static uint16_t byteCRC(uint8_t byte, uint16_t crc) {
-        crc = (uint8_t)(crc >> 8) | (crc << 8);
-        crc ^= byte;
-        crc ^= (uint8_t)(crc & 0xff) >> 4;
-        crc ^= crc << 12;
-        crc ^= (crc & 0xff) << 5;
-        return crc;
-    }
-    
-    inline static uint16_t calcCRC(uint8_t *bytes, uint16_t len) {
-        uint16_t crc = 0;
-        for(unsigned i = 0; i < len; i++) {
-            crc = SerialComm::byteCRC(bytes[i], crc);
-        }
-        return crc;
-    }
-
-    inline static uint16_t checkCrc(uint8_t *bytes, uint16_t count) {
-        bool crcOk = false;
-        if(count > 2) {
-            uint16_t crc = calcCRC(bytes, count - 2);
-            uint16_t packetCrc = (bytes[count-1] << 8) | bytes[count-2];
-            if(crc == packetCrc) crcOk = true;
-        }
-        return crcOk;
-    }
-
-    /* HDLC encode (byte stuff) count bytes from buffer from into buffer to.
-     * to must be at least count * 2 bytes large. Returns the number of bytes
-     * written into to.
-     */
-    int hdlcEncode(int count, const char* from, char *to);
+    /* reads more bytes into rawFifo (blocking) */
+    void readRaw();
     
     /**
      *  try to read at least count bytes in one go, but may read up to maxCount bytes.
+     *  How long it waits for more than one byte depends on readStrategy.
      */
     virtual int readFD(int fd, char *buffer, int count, int maxCount, int *err);
 
+    /* READ_ADAPTIVE: usec until the frame being received should be complete */
+    long long coalesceDelay();
+
     /* enables byte escaping. overwrites method from base class.*/
     virtual int writeFD(int fd, const char *buffer, int count, int *err);
 
+    /* feeds bytes from pos on to the frame decoder, advancing pos.
+       returns true when pPacket holds a complete packet */
+    bool rxBytes(const char *bytes, int count, int &pos, SFPacket &pPacket);
+
+    /* makes a packet of the frame in rxBuffer, false for bad frames */
+    bool parseFrame(SFPacket &pPacket);
+
     /* reads a packet (blocking) */
     bool readPacket(SFPacket &pPacket);
 
+    /* encodes pPacket as a serial frame into buffer (maxFrameBytes
+       large), returns the frame length or -1 for unknown types */
+    int encodePacket(SFPacket &pPacket, char *buffer);
+
     /* writes a packet to serial source */
     bool writePacket(SFPacket &pPacket);
 
+    /* handles a packet read from the node */
+    void dispatchPacket(SFPacket &packet);
+
+    /* appends a packet to the capture, if there is one */
+    void capturePacket(int type, SFPacket &pPacket);
+
+    /* reactor mode: queues a frame for the device */
+    void queuePacket(SFPacket &pPacket);
+
+    /* reactor mode: writes queued frames until the device blocks */
+    void flushQueue();
+
+    /* reactor mode: sends packets while the window is open */
+    void sendNext();
+
+    /* true if another packet may be sent before more acks arrive */
+    bool windowOpen();
+
+    /* assigns the next seqno to pPacket and waits for its ack */
+    void windowAdd(SFPacket &pPacket);
+
+    /* handles an ack from the node */
+    void windowAck(int pSeqno);
+
+    /* handles the node's answer to the window request */
+    void windowGranted(int pWindow);
+
+    /* puts packets whose ack timed out into resend (cMaxWindow + 1
+       large) and drops those out of retries. Returns the number of
+       packets to send again */
+    int windowExpire(long long now, SFPacket *resend);
+
+    /* time (usec) of the next retransmission, 0 if nothing is unacked */
+    long long windowDeadline();
+
     /* returns tcflag of requested baudrate */
     static tcflag_t parseBaudrate(int requested);
 
@@ -247,19 +347,35 @@ protected:
     void writeSerial();
     
 public:
-    SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer,  sharedControlInfo_t& pControl);
+    SerialComm(const char* pDevice, int pBaudrate, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer,  sharedControlInfo_t& pControl, Reactor* pReactor = NULL, read_strategy_t pReadStrategy = READ_VMIN, int pWindow = cDefaultWindow);
 
     ~SerialComm();
 
+    /* sets the handler to notify of packets put into the read buffer */
+    void setPeer(Reactor::Handler* pPeer) { peer = pPeer; }
+
+    /* reactor callbacks */
+    void handleEvent(int fd, int events);
+    void handleTimer();
+    void bufferChanged();
+
     /* cancels all running threads */
     void cancel();
 
+    /* starts recording packets to the capture file pFile (replacing
+       the current one), stops recording if pFile is NULL. Returns false
+       and sets errno if the file cannot be created */
+    bool setCapture(const char* pFile);
+
     std::string getDevice() const;
 
     int getBaudRate() const;
 
     void reportStatus(std::ostream& os);
 
+    /* adds counters to metrics, labels identify the sf-server */
+    void reportMetrics(Metrics& metrics, const std::string& labels);
+
     /* returns if error occurred */
     bool isErrorReported() { return errorReported; }
 };
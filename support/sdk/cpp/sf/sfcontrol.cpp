@@ -40,6 +40,8 @@
 #include <netdb.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 #include <string>
 #include <cstdlib>
@@ -48,6 +50,9 @@
 #include <sstream>
 #include <fstream>
 #include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 
 using namespace std;
@@ -70,6 +75,12 @@ SFControl::SFControl()
     controlPort = -1;
     controlServerStarted = false;
     daemon = false;
+    reactorMode = false;
+    reactorCount = 1;
+    readStrategy = SerialComm::READ_VMIN;
+    window = SerialComm::cDefaultWindow;
+    clientQueue = TCPComm::cDefaultClientQueue;
+    overflowPolicy = TCPComm::OVERFLOW_DISCONNECT;
     reportError("SFControl::SFControl : pthread_create( &cancelThread, NULL, checkCancelThread, this)", pthread_create( &cancelThread, NULL, checkCancelThread, this));
 }
 
@@ -89,10 +100,25 @@ string SFControl::getHelpMessage(string msg)
         // genral help message for command line arguments
         helpMessage << "sf - Controls (starting/stopping) several SFs on one machine" << endl << endl
         << "Usage : sf" << endl
-        << "or    : sf control-port PORT_NUMBER daemon" << endl << endl
+        << "or    : sf control-port PORT_NUMBER daemon" << endl
+        << "or    : sf [control-port PORT_NUMBER] [daemon] [reactor[=THREADS]] [read=vmin|adaptive|delay] [window=N]" << endl
+        << "                [client-queue=N] [overflow=drop|disconnect|sample]" << endl << endl
         << "Arguments:" << endl
         << "        control-port PORT_NUMBER : TCP port on which commands are accepted" << endl 
-        << "        daemon : this switch (if present) makes sf aware that it may be running as a daemon " << endl << endl
+        << "        daemon : this switch (if present) makes sf aware that it may be running as a daemon " << endl
+        << "        reactor[=THREADS] : serve all sf-servers from THREADS event loops (default: one per CPU)" << endl
+        << "                            instead of running five threads per sf-server" << endl
+        << "        read=vmin|adaptive|delay : how the serial line is read (default: vmin)" << endl
+        << "                            vmin : pass bytes on as soon as the device has them" << endl
+        << "                            adaptive : wait for the rest of a frame that started arriving" << endl
+        << "                            delay : sleep for the transmission time of a few bytes before each read" << endl
+        << "        window=N : send up to N packets before waiting for acks, if the node accepts it" << endl
+        << "                            (default: " << SerialComm::cDefaultWindow << ", 1 disables the window request)" << endl
+        << "        client-queue=N : packets queued for each TCP client that does not keep up (default: " << TCPComm::cDefaultClientQueue << ")" << endl
+        << "        overflow=drop|disconnect|sample : what happens when the queue of a client is full (default: disconnect)" << endl
+        << "                            drop : the client misses the packets until it catches up" << endl
+        << "                            disconnect : the client is disconnected" << endl
+        << "                            sample : the client gets every " << TCPComm::cSampleInterval << "th packet once its queue is half full" << endl << endl
         << "Info:" << endl
         << "        If sf is started without arguments it listen on " << endl
         << "        standard input for commands (for a list type \"help\" when sf is running)." << endl
@@ -103,12 +129,31 @@ string SFControl::getHelpMessage(string msg)
     }
     else if (msg == "start")
     {
-        helpMessage << ">> start PORT DEVICE_NAME BAUDRATE:" << endl
+        helpMessage << ">> start PORT DEVICE_NAME BAUDRATE [BUFFER_SIZE]:" << endl
         << ">> Starts a sf-server on a given TCP port connecting to a given device with the given baudrate." << endl
+        << ">> BUFFER_SIZE is the number of packets buffered in each direction (default: " << PacketBuffer::cDefaultBufferSize << ")." << endl
         << ">> The TCP port device name must be specified and must not" << endl
         << ">> overlap with any other TCP port or device name pair of an already running sf-server." << endl
         << ">> (e.g: \"start 9002 /dev/ttyUSB2 115200\" starts server on port 9002 and device /dev/ttyUSB2 with baudrate 115200)" << endl;
     }
+    else if (msg == "replay")
+    {
+        helpMessage << ">> replay PORT CAPTURE_FILE [SPEED|max] [START]:" << endl
+        << ">> Starts a sf-server on a given TCP port that serves the packets read from the node" << endl
+        << ">> in a capture file (see \"help capture\") to its clients, SPEED times as fast as" << endl
+        << ">> they were captured (default: 1, max: as fast as the clients take them), starting" << endl
+        << ">> START seconds into the capture. Replaying starts when the first client connects;" << endl
+        << ">> packets from the clients are dropped." << endl
+        << ">> (e.g: \"replay 9003 incident.cap 10\" replays incident.cap ten times as fast on port 9003)" << endl;
+    }
+    else if (msg == "capture")
+    {
+        helpMessage << ">> capture ID | PORT | DEVICE_NAME CAPTURE_FILE | off:" << endl
+        << ">> Records the packets a sf-server exchanges with its node in both directions," << endl
+        << ">> with their times, into a capture file (replacing the file), or stops recording." << endl
+        << ">> (e.g: \"capture 1 /var/tmp/node1.cap\" records the packets of server with id 1" << endl
+        << ">>      \"capture 1 off\" stops recording them)" << endl;
+    }
     else if (msg == "stop")
     {
         helpMessage << ">> stop ID | PORT | DEVICE_NAME:" << endl
@@ -129,6 +174,14 @@ string SFControl::getHelpMessage(string msg)
         << ">>      \"info /dev/ttyUSB0\" prints out information about server connected to /dev/ttyUSB0" << endl
         << ">>      \"info 9002\" prints out information about server listening on TCPport 90002)" << endl;
     }
+    else if (msg == "metrics")
+    {
+        helpMessage << ">> metrics:" << endl
+        << ">> Prints the counters, buffer levels and latency histograms of all sf-servers" << endl
+        << ">> in the Prometheus text format. If the control-server is started, an HTTP" << endl
+        << ">> request for /metrics on the control port gets the same (e.g.: scrape" << endl
+        << ">> http://localhost:9009/metrics). Scraping does not slow down the packets." << endl;
+    }
     else if (msg == "list")
     {
         helpMessage << ">> list:" << endl
@@ -154,9 +207,12 @@ string SFControl::getHelpMessage(string msg)
         helpMessage << ">> Supported commands are:" << endl
         << ">> " << endl
         << ">> start - starts a sf-server on a given port and device" << endl
+        << ">> replay - starts a sf-server replaying a capture on a given port" << endl
+        << ">> capture - records the packets of a sf-server" << endl
         << ">> stop  - stops a running sf-server" << endl
         << ">> list  - lists all running sf-servers" << endl
-        << ">> info  - prints out some information about a given sf-server" << endl;
+        << ">> info  - prints out some information about a given sf-server" << endl
+        << ">> metrics - prints the metrics of all sf-servers" << endl;
         if (controlServerStarted) {
           helpMessage << ">> close - closes the TCP connection to the control-client" << endl;
         }
@@ -180,6 +236,14 @@ void SFControl::parseArgs(int argc, char *argv[])
         deliverOutput();
         // test standard port before
     }
+    else if ((strncmp(argv[1], "reactor", 7) == 0) || (strncmp(argv[1], "read=", 5) == 0) || (strncmp(argv[1], "window=", 7) == 0) ||
+             (strncmp(argv[1], "client-queue=", 13) == 0) || (strncmp(argv[1], "overflow=", 9) == 0))
+    {
+        parseOptions(argc, argv, 1);
+        os << ">> Starting sf-control." << endl;
+        os << ">> Accepting commands on standard input..." << endl;
+        deliverOutput();
+    }
     else if (argc >= 3)
     {
         int port = -1;
@@ -190,14 +254,13 @@ void SFControl::parseArgs(int argc, char *argv[])
         {
             controlPort = port;
             startControlServer();
+            parseOptions(argc, argv, 3);
             os << ">> Accepting commands on TCP port " << controlPort ;
-	    if(argc == 3) {
+	    if(!daemon) {
 	      os << " and on standard input..." << endl;
-	      daemon = false;
 	    }
 	    else {
 	      os << " but not on standard input..." << endl;
-	      daemon = true;
 	    }
             deliverOutput();
         }
@@ -216,21 +279,208 @@ void SFControl::parseArgs(int argc, char *argv[])
     }
 }
 
+/* parses "daemon", "reactor[=THREADS]", "read=", "window=", "client-queue=" and "overflow=" */
+void SFControl::parseOptions(int argc, char *argv[], int first)
+{
+    for (int i = first; i < argc; i++)
+    {
+        if (strncmp(argv[i], "reactor", 7) == 0)
+        {
+            reactorMode = true;
+            int threads = 0;
+            if (argv[i][7] == '=')
+            {
+                threads = atoi(argv[i] + 8);
+            }
+            if (threads <= 0)
+            {
+                threads = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            reactorCount = (threads > 0) ? threads : 1;
+        }
+        else if (strncmp(argv[i], "read=", 5) == 0)
+        {
+            string strategy(argv[i] + 5);
+            if (strategy == "vmin")
+                readStrategy = SerialComm::READ_VMIN;
+            else if (strategy == "adaptive")
+                readStrategy = SerialComm::READ_ADAPTIVE;
+            else if (strategy == "delay")
+                readStrategy = SerialComm::READ_DELAY;
+            else
+            {
+                os << getHelpMessage("help arguments");
+                deliverOutput();
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "window=", 7) == 0)
+        {
+            window = atoi(argv[i] + 7);
+            if ((window < 1) || (window > SerialComm::cMaxWindow))
+            {
+                os << getHelpMessage("help arguments");
+                deliverOutput();
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "client-queue=", 13) == 0)
+        {
+            int size = atoi(argv[i] + 13);
+            if (size < 1)
+            {
+                os << getHelpMessage("help arguments");
+                deliverOutput();
+                exit(1);
+            }
+            clientQueue = size;
+        }
+        else if (strncmp(argv[i], "overflow=", 9) == 0)
+        {
+            string policy(argv[i] + 9);
+            if (policy == "drop")
+                overflowPolicy = TCPComm::OVERFLOW_DROP;
+            else if (policy == "disconnect")
+                overflowPolicy = TCPComm::OVERFLOW_DISCONNECT;
+            else if (policy == "sample")
+                overflowPolicy = TCPComm::OVERFLOW_SAMPLE;
+            else
+            {
+                os << getHelpMessage("help arguments");
+                deliverOutput();
+                exit(1);
+            }
+        }
+        else
+        {
+            // any other switch keeps its old meaning
+            daemon = true;
+        }
+    }
+    if (reactorMode)
+    {
+        for (unsigned int i = 0; i < reactorCount; i++)
+        {
+            reactors.push_back(new Reactor());
+        }
+        os << ">> Running sf-servers on " << reactorCount << " reactor thread(s)." << endl;
+    }
+}
+
 /* starts a sf-server */
-void SFControl::startServer(int port, string device, int baudrate)
+void SFControl::startServer(int port, string device, int baudrate, unsigned bufferSize)
+{
+    pthread_testcancel();
+    pthread_mutex_lock(&sfControlInfo.lock);
+    sfServer_t newSFServer;
+    newSFServer.reactor = NULL;
+    if (reactorMode)
+    {
+        // least used event loop
+        vector<Reactor*>::iterator it;
+        for (it = reactors.begin(); it != reactors.end(); it++)
+        {
+            if (!newSFServer.reactor || ((*it)->getServerCount() < newSFServer.reactor->getServerCount()))
+                newSFServer.reactor = *it;
+        }
+        newSFServer.reactor->attach();
+        // no events are handled until both sides know each other
+        newSFServer.reactor->acquire();
+    }
+    newSFServer.serial2tcp = new PacketBuffer(bufferSize);
+    newSFServer.tcp2serial = new PacketBuffer(bufferSize);
+    newSFServer.TcpServer = new TCPComm(port, *(newSFServer.tcp2serial), *(newSFServer.serial2tcp), sfControlInfo, newSFServer.reactor);
+    newSFServer.TcpServer->setClientQueue(clientQueue, overflowPolicy);
+    newSFServer.SerialDevice = new SerialComm(device.c_str(), baudrate, *(newSFServer.serial2tcp), *(newSFServer.tcp2serial), sfControlInfo, newSFServer.reactor, readStrategy, window);
+    newSFServer.Replay = NULL;
+    if (newSFServer.reactor)
+    {
+        newSFServer.TcpServer->setPeer(newSFServer.SerialDevice);
+        newSFServer.SerialDevice->setPeer(newSFServer.TcpServer);
+        newSFServer.reactor->release();
+    }
+    newSFServer.id = ++uniqueId;
+    servers.push_back(newSFServer);
+    pthread_mutex_unlock(&sfControlInfo.lock);
+}
+
+/* starts a sf-server replaying a capture */
+void SFControl::startReplay(int port, string file, double speed, double start, unsigned bufferSize)
 {
     pthread_testcancel();
     pthread_mutex_lock(&sfControlInfo.lock);
     sfServer_t newSFServer;
-    newSFServer.serial2tcp = new PacketBuffer();
-    newSFServer.tcp2serial = new PacketBuffer();
-    newSFServer.TcpServer = new TCPComm(port, *(newSFServer.tcp2serial), *(newSFServer.serial2tcp), sfControlInfo);
-    newSFServer.SerialDevice = new SerialComm(device.c_str(), baudrate, *(newSFServer.serial2tcp), *(newSFServer.tcp2serial), sfControlInfo);
+    newSFServer.reactor = NULL;
+    if (reactorMode)
+    {
+        vector<Reactor*>::iterator it;
+        for (it = reactors.begin(); it != reactors.end(); it++)
+        {
+            if (!newSFServer.reactor || ((*it)->getServerCount() < newSFServer.reactor->getServerCount()))
+                newSFServer.reactor = *it;
+        }
+        newSFServer.reactor->attach();
+        newSFServer.reactor->acquire();
+    }
+    newSFServer.serial2tcp = new PacketBuffer(bufferSize);
+    newSFServer.tcp2serial = new PacketBuffer(bufferSize);
+    newSFServer.TcpServer = new TCPComm(port, *(newSFServer.tcp2serial), *(newSFServer.serial2tcp), sfControlInfo, newSFServer.reactor);
+    newSFServer.TcpServer->setClientQueue(clientQueue, overflowPolicy);
+    newSFServer.SerialDevice = NULL;
+    newSFServer.Replay = new ReplayComm(file.c_str(), speed, start, *(newSFServer.serial2tcp), *(newSFServer.tcp2serial), *(newSFServer.TcpServer), sfControlInfo, newSFServer.reactor);
+    if (newSFServer.reactor)
+    {
+        newSFServer.TcpServer->setPeer(newSFServer.Replay);
+        newSFServer.Replay->setPeer(newSFServer.TcpServer);
+        newSFServer.reactor->release();
+    }
     newSFServer.id = ++uniqueId;
     servers.push_back(newSFServer);
     pthread_mutex_unlock(&sfControlInfo.lock);
 }
 
+/* device or capture a sf-server is connected to */
+string SFControl::getDevice(const sfServer_t& server)
+{
+    return server.SerialDevice ? server.SerialDevice->getDevice() : server.Replay->getDevice();
+}
+
+/* returns if one side of a sf-server reported an error */
+bool SFControl::isErrorReported(const sfServer_t& server)
+{
+    return server.TcpServer->isErrorReported()
+        || (server.SerialDevice ? server.SerialDevice->isErrorReported() : server.Replay->isErrorReported());
+}
+
+/* cancels and deletes a sf-server, sfControlInfo.lock must be held */
+void SFControl::destroyServer(sfServer_t& server)
+{
+    Reactor* reactor = server.reactor;
+    if (reactor)
+    {
+        // the reactor thread must not be inside one side while the
+        // other one is deleted
+        reactor->acquire();
+    }
+    // cancel
+    server.TcpServer->cancel();
+    if (server.SerialDevice)
+        server.SerialDevice->cancel();
+    else
+        server.Replay->cancel();
+    // clean up
+    delete server.TcpServer;
+    delete server.SerialDevice;
+    delete server.Replay;
+    delete server.tcp2serial;
+    delete server.serial2tcp;
+    if (reactor)
+    {
+        reactor->detach();
+        reactor->release();
+    }
+}
+
 /* stops a given sf-server. returns false if specified server not running */
 bool SFControl::stopServer(int& id, int& port, string& device)
 {
@@ -242,20 +492,13 @@ bool SFControl::stopServer(int& id, int& port, string& device)
     while( (it != servers.end()) && (!found))
     {
         ++next;
-        if (((*it).SerialDevice->getDevice() == device) || ((*it).TcpServer->getPort() == port) || ((*it).id == id) )
+        if ((getDevice(*it) == device) || ((*it).TcpServer->getPort() == port) || ((*it).id == id) )
         {
-            // cancel
-            (*it).TcpServer->cancel();
-            (*it).SerialDevice->cancel();
             // set id, port and device accordingly
             id = (*it).id;
             port = (*it).TcpServer->getPort();
-            device = (*it).SerialDevice->getDevice();
-            // clean up
-            delete (*it).TcpServer;
-            delete (*it).SerialDevice;
-            delete (*it).tcp2serial;
-            delete (*it).serial2tcp;
+            device = getDevice(*it);
+            destroyServer(*it);
             servers.erase(it);
             found = true;
         }
@@ -265,6 +508,28 @@ bool SFControl::stopServer(int& id, int& port, string& device)
     return found;
 }
 
+/* starts or stops recording the packets of a sf-server */
+bool SFControl::captureServer(int& id, int& port, string& device, const char* pFile, bool& ok)
+{
+    pthread_testcancel();
+    pthread_mutex_lock(&sfControlInfo.lock);
+    bool found = false;
+    list<sfServer_t>::iterator it;
+    for (it = servers.begin(); (it != servers.end()) && !found; it++)
+    {
+        if ((*it).SerialDevice && (((*it).SerialDevice->getDevice() == device) || ((*it).TcpServer->getPort() == port) || ((*it).id == id)))
+        {
+            id = (*it).id;
+            port = (*it).TcpServer->getPort();
+            device = (*it).SerialDevice->getDevice();
+            ok = (*it).SerialDevice->setCapture(pFile);
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&sfControlInfo.lock);
+    return found;
+}
+
 /* prints out server info for specified server */
 bool SFControl::showServerInfo(ostream& pOs, int id, int port, string device)
 {
@@ -276,17 +541,31 @@ bool SFControl::showServerInfo(ostream& pOs, int id, int port, string device)
     while( it != servers.end() && (!found))
     {
         ++next;
-        if (((*it).SerialDevice->getDevice() == device) || ((*it).TcpServer->getPort() == port) || ((*it).id == id) )
+        if ((getDevice(*it) == device) || ((*it).TcpServer->getPort() == port) || ((*it).id == id) )
         {
             pOs << ">> info for sf-server with id = " << (*it).id
             << " ( port =  " << (*it).TcpServer->getPort()
-            << " , device = " << (*it).SerialDevice->getDevice()
-            << " , baudrate = " << (*it).SerialDevice->getBaudRate()
-            << " )" << endl;
+            << " , device = " << getDevice(*it);
+            if ((*it).SerialDevice)
+                pOs << " , baudrate = " << (*it).SerialDevice->getBaudRate();
+            pOs << " )" << endl;
+            if ((*it).reactor)
+                (*it).reactor->acquire();
             pOs << ">> ";
             (*it).TcpServer->reportStatus(os);
             pOs << ">> ";
-            (*it).SerialDevice->reportStatus(os);
+            if ((*it).SerialDevice)
+                (*it).SerialDevice->reportStatus(os);
+            else
+                (*it).Replay->reportStatus(os);
+            pOs << ">> buffers : serial to tcp = " << (*it).serial2tcp->getSize()
+            << " / " << (*it).serial2tcp->getCapacity()
+            << " ( dropped = " << (*it).serial2tcp->getDroppedCount() << " )"
+            << " , tcp to serial = " << (*it).tcp2serial->getSize()
+            << " / " << (*it).tcp2serial->getCapacity()
+            << " ( dropped = " << (*it).tcp2serial->getDroppedCount() << " )" << endl;
+            if ((*it).reactor)
+                (*it).reactor->release();
             found = true;
         }
         it = next;
@@ -305,8 +584,10 @@ void SFControl::listServers(ostream& pOs)
     {
         pOs << ">> sf-server id = " << (*it).id
         << " , port = " << (*it).TcpServer->getPort()
-        << " , device = " << (*it).SerialDevice->getDevice()
-        << " , baudrate = " << (*it).SerialDevice->getBaudRate() << endl;
+        << " , device = " << getDevice(*it);
+        if ((*it).SerialDevice)
+            pOs << " , baudrate = " << (*it).SerialDevice->getBaudRate();
+        pOs << endl;
     }
     if (servers.size() == 0)
     {
@@ -326,22 +607,29 @@ void SFControl::parseInput(std::string arg)
 
     if (tokens[0] == "start")
     {
-        if (tokens.size() == 4)
+        if ((tokens.size() == 4) || (tokens.size() == 5))
         {
             if (servers.size() < maxSFServers)
             {
                 os << ">> Trying to start sf-server with id = " << (uniqueId+1)
                 << " ( port = " << tokens[1]
                 << " , device = " << tokens[2]
-                << " , baudrate = " << tokens[3]
-                << " )" << endl;
+                << " , baudrate = " << tokens[3];
+                if (tokens.size() == 5)
+                    os << " , buffer = " << tokens[4];
+                os << " )" << endl;
                 deliverOutput();
                 stringstream helpInt;
                 int baudrate = 0;
                 int port = 0;
+                int bufferSize = PacketBuffer::cDefaultBufferSize;
                 helpInt << tokens[3] << " " << tokens[1];
-                helpInt >> baudrate >> port;
-                startServer(port, tokens[2], baudrate);
+                if (tokens.size() == 5)
+                    helpInt << " " << tokens[4];
+                helpInt >> baudrate >> port >> bufferSize;
+                if (bufferSize <= 0)
+                    bufferSize = PacketBuffer::cDefaultBufferSize;
+                startServer(port, tokens[2], baudrate, bufferSize);
             }
             else
             {
@@ -355,6 +643,81 @@ void SFControl::parseInput(std::string arg)
             deliverOutput();
         }
     }
+    else if (tokens[0] == "replay")
+    {
+        if ((tokens.size() >= 3) && (tokens.size() <= 5))
+        {
+            if (servers.size() < maxSFServers)
+            {
+                int port = 0;
+                double speed = 1;
+                double start = 0;
+                stringstream helpInt;
+                helpInt << tokens[1];
+                helpInt >> port;
+                if (tokens.size() >= 4)
+                {
+                    speed = (tokens[3] == "max") ? 0 : atof(tokens[3].c_str());
+                }
+                if (tokens.size() == 5)
+                {
+                    start = atof(tokens[4].c_str());
+                }
+                os << ">> Trying to start sf-server with id = " << (uniqueId+1)
+                << " ( port = " << tokens[1]
+                << " , capture = " << tokens[2]
+                << " , speed = " << ((tokens.size() >= 4) ? tokens[3] : string("1"))
+                << " )" << endl;
+                deliverOutput();
+                startReplay(port, tokens[2], speed, start);
+            }
+            else
+            {
+                os << ">> FAIL: Too many running servers (currently " << servers.size() << " servers running)" << endl;
+                deliverOutput();
+            }
+        }
+        else
+        {
+            os << getHelpMessage("replay");
+            deliverOutput();
+        }
+    }
+    else if (tokens[0] == "capture")
+    {
+        if (tokens.size() == 3)
+        {
+            stringstream helpInt;
+            int port = 0;
+            int id = -1;
+            bool ok = false;
+            helpInt << tokens[1] << " " << tokens[1];
+            helpInt >> id >> port;
+            const char* file = (tokens[2] == "off") ? NULL : tokens[2].c_str();
+            if (!captureServer(id, port, tokens[1], file, ok))
+            {
+                os << ">> no sf-server with id / device / baudrate = " << tokens[1] << " found!" << endl;
+            }
+            else if (!ok)
+            {
+                os << ">> FAIL: could not create capture file " << tokens[2] << " : " << strerror(errno) << endl;
+            }
+            else if (file)
+            {
+                os << ">> recording packets of sf-server with id = " << id << " to " << file << endl;
+            }
+            else
+            {
+                os << ">> stopped recording packets of sf-server with id = " << id << endl;
+            }
+            deliverOutput();
+        }
+        else
+        {
+            os << getHelpMessage("capture");
+            deliverOutput();
+        }
+    }
     else if (tokens[0] == "stop")
     {
         if (tokens.size() == 2)
@@ -417,6 +780,11 @@ void SFControl::parseInput(std::string arg)
         	clientFD = -1;
         }
     }
+    else if (tokens[0] == "metrics")
+    {
+        writeMetrics(os);
+        deliverOutput();
+    }
     else if (tokens[0] == "list")
     {
         os << ">> currently running sf-servers:" << endl;
@@ -450,14 +818,19 @@ bool SFControl::sendToClient(string message)
 {
     if (clientFD < 0)
         return false;
-    int length = message.size();
-    const char* buffer = message.c_str();
+    return sendAll(clientFD, message);
+}
+
+bool SFControl::sendAll(int fd, const string& data)
+{
+    int length = data.size();
+    const char* buffer = data.c_str();
     while (length > 0)
     {
 #ifdef __APPLE__
-        int n = send(clientFD, buffer, length, 0);
+        int n = send(fd, buffer, length, 0);
 #else
-        int n = send(clientFD, buffer, length, MSG_NOSIGNAL);
+        int n = send(fd, buffer, length, MSG_NOSIGNAL);
 #endif
         if (!(n > 0))
         {
@@ -474,24 +847,161 @@ bool SFControl::readFromClient(string& message)
 {
     if (clientFD < 0)
         return false;
-    int length = 0;
-    char buffer[256];
-    char* bufPtr = buffer;
-    *bufPtr = '\0';
-    do
+    // continue what was typed while the connection was pending
+    string line = clientInput;
+    clientInput.clear();
+    char c;
+    while (line.size() < 255)
     {
-        int n = read(clientFD, (void *) bufPtr, 1);
+        int n = read(clientFD, &c, 1);
         if (!(n > 0))
         {
             return false;
         }
+        if (c == '\n')
+            break;
+        line += c;
     }
-    while ((*bufPtr++ != '\n') && (length++ < 255));
-    buffer[length] = '\0';
-    message = (length == 1) ? "" : buffer;
+    message = (line.size() == 1) ? "" : line;
     return true;
 }
 
+void SFControl::readPendingClient(int fd)
+{
+    pendingClient_t &pending = pendingClients[fd];
+    char buffer[1024];
+    int n = read(fd, buffer, sizeof(buffer));
+    if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+        return;
+    if (n <= 0)
+    {
+        close(fd);
+        pendingClients.erase(fd);
+        return;
+    }
+    pending.input.append(buffer, n);
+    const string get("GET ");
+    if (get.compare(0, min(pending.input.size(), get.size()), pending.input, 0, get.size()) == 0)
+    {
+        // an HTTP request, answered once all of its header arrived
+        string::size_type end = pending.input.find("\r\n\r\n");
+        if (end == string::npos)
+            end = pending.input.find("\n\n");
+        if (end != string::npos)
+        {
+            string request = pending.input;
+            pendingClients.erase(fd);
+            serveMetrics(fd, request);
+        }
+        else if (pending.input.size() > 8192)
+        {
+            close(fd);
+            pendingClients.erase(fd);
+        }
+        return;
+    }
+    if (pending.input.find('\n') != string::npos)
+        acceptPendingClient(fd);
+}
+
+void SFControl::acceptPendingClient(int fd)
+{
+    pendingClient_t pending = pendingClients[fd];
+    pendingClients.erase(fd);
+    if (clientFD >= 0)
+    {
+        // one control-client at a time
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, 0);
+    clientFD = fd;
+    os << ">> accepted connection from control-client " << pending.address << endl;
+    deliverOutput();
+    // commands it sent already
+    clientInput = pending.input;
+    string::size_type end;
+    while ((clientFD == fd) && ((end = clientInput.find('\n')) != string::npos))
+    {
+        string input = clientInput.substr(0, end);
+        clientInput.erase(0, end + 1);
+        if (input.size() <= 1)
+            continue;
+        os << "control-client : " << input << endl;
+        cout << os.str();
+        os.str("");
+        os.clear();
+        parseInput(input);
+    }
+}
+
+void SFControl::serveMetrics(int fd, const string& request)
+{
+    string path;
+    string::size_type start = request.find(' ') + 1;
+    string::size_type end = request.find_first_of(" \r\n", start);
+    if (end != string::npos)
+        path = request.substr(start, end - start);
+
+    ostringstream body;
+    string status = "200 OK";
+    if ((path == "/metrics") || (path == "/"))
+        writeMetrics(body);
+    else
+    {
+        status = "404 Not Found";
+        body << "only /metrics is served here" << endl;
+    }
+    ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+    << "Content-Type: text/plain; version=0.0.4\r\n"
+    << "Content-Length: " << body.str().size() << "\r\n"
+    << "Connection: close\r\n\r\n"
+    << body.str();
+
+    // a scraper that does not read must not block the commands for long
+    struct timeval timeout;
+    timeout.tv_sec = 2;
+    timeout.tv_usec = 0;
+    fcntl(fd, F_SETFL, 0);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout));
+    sendAll(fd, response.str());
+    close(fd);
+}
+
+void SFControl::writeMetrics(ostream& pOs)
+{
+    Metrics metrics;
+    pthread_testcancel();
+    pthread_mutex_lock(&sfControlInfo.lock);
+    metrics.gauge("sf_servers", "Running sf-servers.", "", servers.size());
+    for (list<sfServer_t>::iterator it = servers.begin(); it != servers.end(); ++it)
+    {
+        ostringstream id, port;
+        id << (*it).id;
+        port << (*it).TcpServer->getPort();
+        string labels = Metrics::label("id", id.str()) + "," + Metrics::label("port", port.str())
+            + "," + Metrics::label("device", getDevice(*it));
+        // unlike info, the reactor is not acquired: the counters are
+        // read as they are while packets keep flowing
+        (*it).TcpServer->reportMetrics(metrics, labels);
+        if ((*it).SerialDevice)
+            (*it).SerialDevice->reportMetrics(metrics, labels);
+        else
+            (*it).Replay->reportMetrics(metrics, labels);
+        string toTcp = labels + "," + Metrics::label("direction", "serial_to_tcp");
+        string toSerial = labels + "," + Metrics::label("direction", "tcp_to_serial");
+        metrics.gauge("sf_buffer_packets", "Packets in the buffer between the serial and the tcp side.", toTcp, (*it).serial2tcp->getSize());
+        metrics.gauge("sf_buffer_packets", "", toSerial, (*it).tcp2serial->getSize());
+        metrics.gauge("sf_buffer_capacity", "Packets the buffer between the serial and the tcp side holds.", toTcp, (*it).serial2tcp->getCapacity());
+        metrics.gauge("sf_buffer_capacity", "", toSerial, (*it).tcp2serial->getCapacity());
+        metrics.counter("sf_buffer_dropped_total", "Packets dropped from the full buffer.", toTcp, (*it).serial2tcp->getDroppedCount());
+        metrics.counter("sf_buffer_dropped_total", "", toSerial, (*it).tcp2serial->getDroppedCount());
+    }
+    pthread_mutex_unlock(&sfControlInfo.lock);
+    metrics.print(pOs);
+}
+
 void SFControl::waitOnInput()
 {
     bool clientConnected = false;
@@ -519,8 +1029,27 @@ void SFControl::waitOnInput()
             FD_SET(clientFD, &rfds);
             maxfd = (clientFD > maxfd) ? clientFD : maxfd;
         }
+        // wake up when the oldest pending connection is due
+        struct timeval timeout;
+        struct timeval *wait = NULL;
+        long long now = Reactor::now();
+        map<int, pendingClient_t>::iterator pit;
+        for (pit = pendingClients.begin(); pit != pendingClients.end(); ++pit)
+        {
+            FD_SET(pit->first, &rfds);
+            maxfd = (pit->first > maxfd) ? pit->first : maxfd;
+            long long left = pit->second.since + pendingTimeout - now;
+            if (left < 0)
+                left = 0;
+            if (!wait || (left < (long long)timeout.tv_sec * 1000000 + timeout.tv_usec))
+            {
+                timeout.tv_sec = left / 1000000;
+                timeout.tv_usec = left % 1000000;
+                wait = &timeout;
+            }
+        }
 
-        reportError("SFControl::waitOnInput : select(maxfd+1, &rfds, NULL, NULL, NULL)", select(maxfd+1, &rfds, NULL, NULL, NULL));
+        reportError("SFControl::waitOnInput : select(maxfd+1, &rfds, NULL, NULL, wait)", select(maxfd+1, &rfds, NULL, NULL, wait));
 
         if (FD_ISSET(0, &rfds))
         {
@@ -546,18 +1075,37 @@ void SFControl::waitOnInput()
                 /* we got a new connection request */
                 FD_CLR(serverFD, &rfds);
                 int newClientFD = reportError("SFControl::waitOnInput : accept(serverFD, (struct sockaddr*) &client, &clientAddrLen)", accept(serverFD, (struct sockaddr*) &client, &clientAddrLen));
-                if ((newClientFD >= 0) && (!clientConnected))
+                if (newClientFD >= 0)
                 {
-                    clientFD = newClientFD;
-                    clientConnected = true;
-                    os << ">> accepted connection from control-client " << inet_ntoa(client.sin_addr) << endl;
-                    deliverOutput();
+                    // a control-client or a metrics scrape, its first line tells
+                    fcntl(newClientFD, F_SETFL, O_NONBLOCK);
+                    pendingClient_t &pending = pendingClients[newClientFD];
+                    pending.input.clear();
+                    pending.since = Reactor::now();
+                    pending.address = inet_ntoa(client.sin_addr);
                 }
-                else
+            }
+            vector<int> pendingFDs;
+            for (pit = pendingClients.begin(); pit != pendingClients.end(); ++pit)
+            {
+                pendingFDs.push_back(pit->first);
+            }
+            now = Reactor::now();
+            for (vector<int>::iterator it = pendingFDs.begin(); it != pendingFDs.end(); ++it)
+            {
+                if (FD_ISSET(*it, &rfds))
+                {
+                    FD_CLR(*it, &rfds);
+                    readPendingClient(*it);
+                }
+                // silent for a while: someone about to type commands
+                pit = pendingClients.find(*it);
+                if ((pit != pendingClients.end()) && (pit->second.since + pendingTimeout <= now))
                 {
-                    close(newClientFD);
+                    acceptPendingClient(*it);
                 }
             }
+            clientConnected = (clientFD >= 0);
         }
         if (clientConnected)
         {
@@ -610,22 +1158,15 @@ void SFControl::checkThreadCancel()
         while( it != servers.end() )
         {
             ++next;
-            if ((*it).TcpServer->isErrorReported() || (*it).SerialDevice->isErrorReported())
+            if (isErrorReported(*it))
             {
-                // cancel
-                (*it).TcpServer->cancel();
-                (*it).SerialDevice->cancel();
                 // inform user
                 os << ">> FAIL: sf-server with id = " << (*it).id
                 << " ( port =  " << (*it).TcpServer->getPort()
-                << " , device = " << (*it).SerialDevice->getDevice()
+                << " , device = " << getDevice(*it)
                 << " ) canceled" << endl;
                 deliverOutput();
-                // clean up
-                delete (*it).TcpServer;
-                delete (*it).SerialDevice;
-                delete (*it).tcp2serial;
-                delete (*it).serial2tcp;
+                destroyServer(*it);
                 servers.erase(it);
             }
             it = next;
@@ -37,7 +37,12 @@
 #include "packetbuffer.h"
 #include "tcpcomm.h"
 #include "serialcomm.h"
+#include "replaycomm.h"
+#include "reactor.h"
+#include "metrics.h"
 #include "pthread.h"
+#include <list>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -51,6 +56,10 @@ protected:
         PacketBuffer* tcp2serial;
         TCPComm* TcpServer;
         SerialComm* SerialDevice;
+        /* replays a capture in place of SerialDevice (NULL), NULL otherwise */
+        ReplayComm* Replay;
+        /* reactor the server runs on, NULL in thread mode */
+        Reactor* reactor;
         int id;
     }
     sfServer_t;
@@ -79,6 +88,26 @@ protected:
     /* in daemon mode: do not read from stdin */
     bool daemon;
 
+    /* in reactor mode: servers share a few event loops instead of
+       running five threads each */
+    bool reactorMode;
+
+    /* number of reactors to start in reactor mode */
+    unsigned int reactorCount;
+
+    /* running reactors (reactor mode) */
+    std::vector<Reactor*> reactors;
+
+    /* how serial devices are read */
+    SerialComm::read_strategy_t readStrategy;
+
+    /* window requested from the nodes */
+    int window;
+
+    /* packets queued per tcp client and what happens when a queue is full */
+    unsigned clientQueue;
+    TCPComm::overflow_policy_t overflowPolicy;
+
     /* tcp port the control server listens on */
     int controlPort;
 
@@ -88,6 +117,24 @@ protected:
     /* control-client fd */
     int clientFD;
 
+    /* what the control-client typed before it was taken for one */
+    std::string clientInput;
+
+    // connection to the control port that has not sent a line yet: an
+    // HTTP request for the metrics or a control-client
+    typedef struct
+    {
+        std::string input;
+        /* accepted at (usec) */
+        long long since;
+        std::string address;
+    } pendingClient_t;
+
+    std::map<int, pendingClient_t> pendingClients;
+
+    /* a pending connection becomes the control-client after this (usec) */
+    static const long long pendingTimeout = 500000;
+
     /* string stream for multiplexing output (cout and control-client) */
     std::ostringstream os;
 
@@ -127,8 +174,42 @@ protected:
     /* receive string from connected client... */
     bool readFromClient(std::string& message);
 
+    /* reads from a pending connection to the control port */
+    void readPendingClient(int fd);
+
+    /* makes a pending connection the control-client (closes it if there is one) */
+    void acceptPendingClient(int fd);
+
+    /* answers an HTTP request and closes the connection */
+    void serveMetrics(int fd, const std::string& request);
+
+    /* writes the metrics of all sf-servers in the Prometheus text format */
+    void writeMetrics(std::ostream& pOs);
+
+    /* blocking write of all of data */
+    static bool sendAll(int fd, const std::string& data);
+
     /* starts a sf-server */
-    void startServer(int port, std::string device, int baudrate);
+    void startServer(int port, std::string device, int baudrate, unsigned bufferSize = PacketBuffer::cDefaultBufferSize);
+
+    /* starts a sf-server replaying a capture */
+    void startReplay(int port, std::string file, double speed, double start, unsigned bufferSize = PacketBuffer::cDefaultBufferSize);
+
+    /* starts (pFile != NULL) or stops recording the packets of a
+       sf-server. returns false if specified server not running */
+    bool captureServer(int& id, int& port, std::string& device, const char* pFile, bool& ok);
+
+    /* device or capture a sf-server is connected to */
+    static std::string getDevice(const sfServer_t& server);
+
+    /* returns if one side of a sf-server reported an error */
+    static bool isErrorReported(const sfServer_t& server);
+
+    /* cancels and deletes a sf-server, sfControlInfo.lock must be held */
+    void destroyServer(sfServer_t& server);
+
+    /* parses the optional arguments following the control-port */
+    void parseOptions(int argc, char *argv[], int first);
 
     /* stops a given sf-server. returns false if specified server not running */
     bool stopServer(int& id, int& port, std::string& device);
@@ -37,6 +37,7 @@ SFPacket::SFPacket(int pType, int pSeqno) {
     length = 0;
     seqno = pSeqno;
     type = pType;
+    timestamp = 0;
 }
 
 // copy constructor
@@ -44,9 +45,21 @@ SFPacket::SFPacket(const SFPacket &pPacket) {
     length = pPacket.getLength();
     type = pPacket.getType();
     seqno = pPacket.getSeqno();
+    timestamp = pPacket.getTimestamp();
     setPayload(pPacket.getPayload(), length);
 }
 
+SFPacket& SFPacket::operator=(const SFPacket &pPacket) {
+    if (this != &pPacket) {
+        length = pPacket.getLength();
+        type = pPacket.getType();
+        seqno = pPacket.getSeqno();
+        timestamp = pPacket.getTimestamp();
+        setPayload(pPacket.getPayload(), length);
+    }
+    return *this;
+}
+
 SFPacket::~SFPacket()
 {
     // if (buffer) delete[] buffer;
@@ -54,6 +54,7 @@ enum {
   SF_ACK = SERIAL_SERIAL_PROTO_ACK,
   SF_PACKET_ACK = SERIAL_SERIAL_PROTO_PACKET_ACK,
   SF_PACKET_NO_ACK = SERIAL_SERIAL_PROTO_PACKET_NOACK,
+  SF_WINDOW = SERIAL_SERIAL_PROTO_WINDOW,
   SF_UNKNOWN = SERIAL_SERIAL_PROTO_PACKET_UNKNOWN
 };
 
@@ -75,6 +76,8 @@ protected:
     int type;
     /* sequence number */
     int seqno;
+    /* monotonic time (usec) the first byte was read, 0 if unknown */
+    long long timestamp;
 
 
 /** member functions **/
@@ -87,6 +90,9 @@ public:
 
     SFPacket(const SFPacket &pPacket);
 
+    /* like the copy constructor, copies only the bytes in use */
+    SFPacket& operator=(const SFPacket &pPacket);
+
     /* returns buffer */
     const char* getPayload() const;
 
@@ -114,6 +120,10 @@ public:
     /* sets the type */
     void setType(int pType);
 
+    /* returns / sets the time the packet was received from the node */
+    long long getTimestamp() const { return timestamp; }
+    void setTimestamp(long long pTimestamp) { timestamp = pTimestamp; }
+
     /* returns max payload length */
     static const int getMaxPayloadLength();
 
@@ -37,6 +37,7 @@
 
 #include <iostream>
 #include <set>
+#include <vector>
 
 #include <cstring>
 #include <sys/types.h>
@@ -45,19 +46,26 @@
 #include <netdb.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <pthread.h>
 
 
 
 using namespace std;
 
+#ifdef __APPLE__
+#define SEND_FLAGS MSG_DONTWAIT
+#else
+#define SEND_FLAGS (MSG_DONTWAIT | MSG_NOSIGNAL)
+#endif
+
 /* forward declarations of pthrad helper functions*/
 void* checkClientsThread(void*);
 void* readClientsThread(void*);
 void* writeClientsThread(void*);
 
 /* opens tcp server port for listening and start threads*/
-TCPComm::TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl) : readBuffer(pReadBuffer), writeBuffer(pWriteBuffer), errorReported(false), errorMsg(""), control(pControl)
+TCPComm::TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl, Reactor* pReactor) : pipeWriteFD(-1), pipeReadFD(-1), readBuffer(pReadBuffer), writeBuffer(pWriteBuffer), errorReported(false), errorMsg(""), control(pControl), reactor(pReactor), peer(NULL), clientQueueLimit(cDefaultClientQueue), overflowPolicy(OVERFLOW_DISCONNECT), readPaused(false), reactorCanceled(false)
 {   
     // init values
     writerThreadRunning = false;
@@ -67,8 +75,11 @@ TCPComm::TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffe
     clientInfo.FDs.clear();
     readPacketCount = 0;
     writtenPacketCount = 0;
+    droppedPacketCount = 0;
+    overflowCount = 0;
     port = pPort;
     
+    pthread_mutex_init(&queueLock, NULL);
     pthread_mutex_init(&clientInfo.sleeplock, NULL);
     pthread_mutex_init(&clientInfo.countlock, NULL);
     pthread_cond_init(&clientInfo.wakeup, NULL);
@@ -78,13 +89,13 @@ TCPComm::TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffe
     int rxBuf = 1024;
 
     /* create pipe to inform client reader of new clients */
-    if (!errorReported) {
+    if (!errorReported && !reactor) {
         int pipeFDPair[2];
         reportError("TCPComm::TCPComm : pipe(pipeFDPair)", pipe(pipeFDPair));
         pipeWriteFD = pipeFDPair[1];
         pipeReadFD = pipeFDPair[0];
     }
-    if (!errorReported) {
+    if (!errorReported && !reactor) {
         reportError("TCPComm::TCPComm : fcntl(pipeReadFD, F_SETFL, O_NONBLOCK);",
                     fcntl(pipeReadFD, F_SETFL, O_NONBLOCK));
     }
@@ -115,8 +126,15 @@ TCPComm::TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffe
                     listen(serverFD, 5));
     }
 
+    if (!errorReported && reactor)
+    {
+        reportError("TCPComm::TCPComm : fcntl(serverFD, F_SETFL, O_NONBLOCK)",
+                    fcntl(serverFD, F_SETFL, O_NONBLOCK));
+        if (!errorReported)
+            reactor->add(serverFD, this, Reactor::READABLE);
+    }
     // start thread for server socket (adding and removing clients)
-    if (!errorReported)
+    else if (!errorReported)
     {
         if (reportError("TCPComm::TCPComm : pthread_create( &serverThread, NULL, checkClientsThread, this)",
                         pthread_create( &serverThread, NULL, checkClientsThread, this)) == 0) {
@@ -146,8 +164,9 @@ TCPComm::~TCPComm()
     {
         close(*it);
     }
-    close(pipeWriteFD);
-    close(pipeReadFD);
+    if (pipeWriteFD >= 0) close(pipeWriteFD);
+    if (pipeReadFD >= 0) close(pipeReadFD);
+    pthread_mutex_destroy(&queueLock);
     pthread_mutex_destroy(&clientInfo.sleeplock);
     pthread_mutex_destroy(&clientInfo.countlock);
     pthread_cond_destroy(&clientInfo.wakeup);
@@ -158,6 +177,14 @@ int TCPComm::getPort()
     return port;
 }
 
+int TCPComm::getClientCount()
+{
+    pthread_mutex_lock( &clientInfo.countlock );
+    int count = clientInfo.count;
+    pthread_mutex_unlock( &clientInfo.countlock );
+    return count;
+}
+
 /* reads packet */
 bool TCPComm::readPacket(int pFD, SFPacket &pPacket)
 {
@@ -208,12 +235,83 @@ int TCPComm::writeFD(int fd, const char *buffer, int count, int *err)
     return actual;
 }
 
-/* writes packet */
-bool TCPComm::writePacket(int pFD, SFPacket &pPacket)
+/* appends packet to the queue of a client */
+bool TCPComm::queuePacket(clientQueue_t &queue, SFPacket &pPacket)
 {
+    unsigned lag = queue.lengths.size();
+    bool full = (lag >= clientQueueLimit);
+    if ((overflowPolicy == OVERFLOW_SAMPLE) && (lag >= clientQueueLimit / 2))
+    {
+        // a thinned out stream rather than a gap
+        full = full || (queue.sampled++ % cSampleInterval != 0);
+    }
+    else
+    {
+        queue.sampled = 0;
+    }
+    if (full)
+    {
+        if (overflowPolicy == OVERFLOW_DISCONNECT)
+        {
+            if (!queue.overflowed)
+            {
+                queue.overflowed = true;
+                ++overflowCount;
+            }
+            return false;
+        }
+        ++queue.dropped;
+        ++droppedPacketCount;
+        return true;
+    }
     int len = pPacket.getTcpLength();
-    int err;
-    return (writeFD(pFD, pPacket.getTcpPayload(), len, &err) == len);
+    queue.output.append(pPacket.getTcpPayload(), len);
+    queue.lengths.push_back(len);
+    if (lag + 1 > queue.maxLag)
+    {
+        queue.maxLag = lag + 1;
+    }
+    return true;
+}
+
+/* sends what the client takes without blocking */
+bool TCPComm::sendQueue(int clientFD, clientQueue_t &queue)
+{
+    unsigned used = 0;
+    bool ok = true;
+    while (used < queue.output.size())
+    {
+        int n = send(clientFD, queue.output.data() + used, queue.output.size() - used, SEND_FLAGS);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                ok = false;
+            break;
+        }
+        used += n;
+    }
+    queue.output.erase(0, used);
+
+    // count the packets that went out completely
+    if (used <= queue.unframed)
+    {
+        queue.unframed -= used;
+        return ok;
+    }
+    used -= queue.unframed;
+    queue.unframed = 0;
+    used += queue.partial;
+    while (!queue.lengths.empty() && (used >= queue.lengths.front()))
+    {
+        used -= queue.lengths.front();
+        queue.lengths.pop_front();
+        ++queue.sent;
+        ++writtenPacketCount;
+    }
+    queue.partial = used;
+    return ok;
 }
 
 /* checks for correct version of SF protocol */
@@ -261,6 +359,9 @@ void TCPComm::addClient(int clientFD)
 {
     DEBUG("TCPComm::addClient : lock")
     pthread_testcancel();
+    pthread_mutex_lock( &queueLock );
+    queues[clientFD] = clientQueue_t();
+    pthread_mutex_unlock( &queueLock );
     pthread_mutex_lock( &clientInfo.countlock );
     bool wakeupClientThreads = false;
     if (clientInfo.count == 0)
@@ -301,6 +402,9 @@ void TCPComm::removeClient(int clientFD)
         writeBuffer.clear();
     }
     pthread_mutex_unlock( &clientInfo.countlock );
+    pthread_mutex_lock( &queueLock );
+    queues.erase(clientFD);
+    pthread_mutex_unlock( &queueLock );
     stuffPipe();
     DEBUG("TCPComm::removeClient : unlock")
 }
@@ -364,8 +468,9 @@ void TCPComm::readClients()
         // removes the cleanup handler and executes it (unlock mutex)
         pthread_cleanup_pop(1);
         // check all fds (work with temp set)...
-        fd_set rfds;
+        fd_set rfds, wfds;
         FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
         int maxFD = pipeReadFD;
         FD_SET(pipeReadFD, &rfds);
         set<int>::iterator it;
@@ -377,7 +482,25 @@ void TCPComm::readClients()
             }
             FD_SET(*it, &rfds);
         }
-        if (select(maxFD + 1, &rfds, NULL, NULL, NULL) < 0 )
+        // the rest of the queues the writer thread could not send yet
+        FD_t writeFDs;
+        pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &queueLock);
+        pthread_mutex_lock( &queueLock );
+        for (clientQueues_t::iterator qit = queues.begin(); qit != queues.end(); ++qit)
+        {
+            qit->second.watched = !qit->second.output.empty();
+            if (qit->second.watched)
+            {
+                writeFDs.insert(qit->first);
+                if (qit->first > maxFD)
+                {
+                    maxFD = qit->first;
+                }
+                FD_SET(qit->first, &wfds);
+            }
+        }
+        pthread_cleanup_pop(1);
+        if (select(maxFD + 1, &rfds, &wfds, NULL, NULL) < 0 )
         {
             //             run = false;
             reportError("TCPComm::readClients : select(maxFD+1, &rfds, NULL, NULL, NULL)", -1);
@@ -403,6 +526,26 @@ void TCPComm::readClients()
                     }
                 }
             }
+            for (it = writeFDs.begin(); it != writeFDs.end(); it++)
+            {
+                if (FD_ISSET(*it, &wfds))
+                {
+                    bool ok = true;
+                    pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &queueLock);
+                    pthread_mutex_lock( &queueLock );
+                    clientQueues_t::iterator qit = queues.find(*it);
+                    if (qit != queues.end())
+                    {
+                        ok = sendQueue(*it, qit->second);
+                    }
+                    pthread_cleanup_pop(1);
+                    if (!ok)
+                    {
+                        DEBUG("TCPComm::readClients : removeClient")
+                        removeClient(*it);
+                    }
+                }
+            }
         }
     }
 }
@@ -417,7 +560,6 @@ void* writeClientsThread(void* ob)
 /* writes to connected clients */
 void TCPComm::writeClients()
 {
-    FD_t clientFDs;
     while (true)
     {
         pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &clientInfo.countlock);
@@ -432,34 +574,332 @@ void TCPComm::writeClients()
         pthread_cleanup_pop(1); 
 
         // blocks until buffer is not empty
-        SFPacket packet = writeBuffer.dequeue();
+        SFPacket first;
+        writeBuffer.dequeue(first);
         pthread_testcancel();
-        pthread_mutex_lock( &clientInfo.countlock );
-        // copy client fd set into temp set
-        clientFDs = clientInfo.FDs;
-        pthread_mutex_unlock( &clientInfo.countlock );
-
-        // check all fds (work with temp set)...
-        set<int>::iterator it;
-        // duplicate and send out packet to all connected clients
-        for( it = clientFDs.begin(); it != clientFDs.end(); it++ )
+        FD_t failedFDs;
+        bool wakeReader = false;
+        pthread_cleanup_push((void(*)(void*)) pthread_mutex_unlock, (void *) &queueLock);
+        pthread_mutex_lock( &queueLock );
+        // duplicate the packets waiting into the queues of all clients...
+        // (the rest of the batch is read in place)
+        unsigned batch = writeBuffer.getCapacity();
+        PacketBuffer::claim_t claim;
+        SFPacket* packet = &first;
+        do
         {
-            if (writePacket(*it, packet))
+            for (clientQueues_t::iterator it = queues.begin(); it != queues.end(); ++it)
             {
-                ++writtenPacketCount;
+                if (!queuePacket(it->second, *packet))
+                {
+                    failedFDs.insert(it->first);
+                }
             }
-            else
+            if (packet->getTimestamp() && !queues.empty())
             {
-                DEBUG("TCPComm::writeClients : removeClient")
-                removeClient(*it);
+                serialLatency.record(Reactor::now() - packet->getTimestamp());
+            }
+            if (packet != &first)
+            {
+                writeBuffer.release(claim);
             }
         }
+        while ((--batch > 0) && (packet = writeBuffer.claimDequeue(claim)));
+        // ...and send what each of them takes, a stalled client only
+        // falls behind on its own
+        for (clientQueues_t::iterator it = queues.begin(); it != queues.end(); ++it)
+        {
+            if (failedFDs.count(it->first))
+            {
+                continue;
+            }
+            if (!sendQueue(it->first, it->second))
+            {
+                failedFDs.insert(it->first);
+            }
+            else if (!it->second.output.empty() && !it->second.watched)
+            {
+                wakeReader = true;
+            }
+        }
+        pthread_cleanup_pop(1);
+        if (wakeReader)
+        {
+            // the reader thread sends the rest when the client takes it
+            stuffPipe();
+        }
+        for (FD_t::iterator it = failedFDs.begin(); it != failedFDs.end(); ++it)
+        {
+            DEBUG("TCPComm::writeClients : removeClient")
+            removeClient(*it);
+        }
+    }
+}
+
+/* reactor mode: server socket or client ready */
+void TCPComm::handleEvent(int fd, int events)
+{
+    if (fd == serverFD)
+    {
+        acceptClients();
+        return;
+    }
+    if (connections.find(fd) == connections.end())
+    {
+        return;
+    }
+    if ((events & Reactor::WRITABLE) && !flushConnection(fd))
+    {
+        DEBUG("TCPComm::handleEvent : removeClient")
+        closeConnection(fd);
+        return;
+    }
+    if (events & (Reactor::READABLE | Reactor::FAILED))
+    {
+        readConnection(fd);
+    }
+}
+
+/* reactor mode: packets to send or room in readBuffer again */
+void TCPComm::bufferChanged()
+{
+    broadcast();
+    if (readPaused && !readBuffer.isFull())
+    {
+        readPaused = false;
+        vector<int> clientFDs;
+        for (connections_t::iterator it = connections.begin(); it != connections.end(); ++it)
+        {
+            clientFDs.push_back(it->first);
+        }
+        for (vector<int>::iterator it = clientFDs.begin(); it != clientFDs.end(); ++it)
+        {
+            if (connections.find(*it) == connections.end())
+                continue;
+            // handle what was received while paused
+            if (parseConnection(*it))
+                updateConnection(*it);
+            else
+                closeConnection(*it);
+        }
+    }
+}
+
+void TCPComm::acceptClients()
+{
+    while (!reactorCanceled)
+    {
+        int clientFD = accept(serverFD, NULL, NULL);
+        if (clientFD < 0)
+        {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                reportError("TCPComm::acceptClients : accept(serverFD, NULL, NULL)", clientFD);
+            break;
+        }
+        fcntl(clientFD, F_SETFL, O_NONBLOCK);
+        connection_t &connection = connections[clientFD];
+        connection.versionChecked = false;
+        connection.input.clear();
+        // our half of the version check, see versionCheck()
+        clientQueue_t &queue = queues[clientFD] = clientQueue_t();
+        queue.output.assign("U ", 2);
+        queue.unframed = 2;
+        reactor->add(clientFD, this, Reactor::READABLE);
+        if (!flushConnection(clientFD))
+            closeConnection(clientFD);
+    }
+}
+
+void TCPComm::readConnection(int clientFD)
+{
+    char buffer[1024];
+    while (!readPaused)
+    {
+        int n = read(clientFD, buffer, sizeof(buffer));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return;
+        }
+        if (n <= 0)
+        {
+            DEBUG("TCPComm::readConnection : removeClient")
+            closeConnection(clientFD);
+            return;
+        }
+        connections[clientFD].input.append(buffer, n);
+        if (!parseConnection(clientFD))
+        {
+            DEBUG("TCPComm::readConnection : removeClient")
+            closeConnection(clientFD);
+            return;
+        }
+    }
+}
+
+bool TCPComm::parseConnection(int clientFD)
+{
+    connection_t &connection = connections[clientFD];
+    const string &input = connection.input;
+    unsigned used = 0;
+    bool enqueued = false;
+
+    if (!connection.versionChecked)
+    {
+        if (input.size() < 2)
+            return true;
+        // same checks as versionCheck()
+        if (input[0] != 'U')
+            return false;
+        int version = input[1];
+        if (' ' < version)
+            version = ' ';
+        switch (version)
+        {
+        case ' ':
+            break;
+        default:
+            return false;
+        }
+        used = 2;
+        connection.versionChecked = true;
+        ++clientInfo.count;
+        clientInfo.FDs.insert(clientFD);
+        // deliver what the serial side buffered while nobody listened
+        broadcast();
+        if (connections.find(clientFD) == connections.end())
+            return false;
+    }
+
+    while (!readPaused && (input.size() - used >= 1))
+    {
+        unsigned char l = input[used];
+        if (input.size() - used < 1u + l)
+            break;
+        SFPacket packet;
+        if (!packet.setPayload(input.data() + used + 1, l))
+            return false;
+        used += 1 + l;
+        readBuffer.enqueueBack(packet);
+        ++readPacketCount;
+        enqueued = true;
+        if (readBuffer.isFull())
+        {
+            // stop reading from all clients until the serial side
+            // took packets out of the buffer
+            readPaused = true;
+            for (connections_t::iterator it = connections.begin(); it != connections.end(); ++it)
+                updateConnection(it->first);
+        }
+    }
+    connection.input.erase(0, used);
+
+    if (enqueued && peer)
+        reactor->notify(peer);
+    return true;
+}
+
+bool TCPComm::flushConnection(int clientFD)
+{
+    if (!sendQueue(clientFD, queues[clientFD]))
+        return false;
+    updateConnection(clientFD);
+    return true;
+}
+
+void TCPComm::updateConnection(int clientFD)
+{
+    connection_t &connection = connections[clientFD];
+    int events = 0;
+    if (!readPaused || !connection.versionChecked)
+        events |= Reactor::READABLE;
+    if (!queues[clientFD].output.empty())
+        events |= Reactor::WRITABLE;
+    reactor->modify(clientFD, events);
+}
+
+void TCPComm::closeConnection(int clientFD)
+{
+    connections_t::iterator it = connections.find(clientFD);
+    if (it == connections.end())
+        return;
+    bool counted = it->second.versionChecked;
+    connections.erase(it);
+    queues.erase(clientFD);
+    reactor->remove(clientFD);
+    close(clientFD);
+    if (counted)
+    {
+        clientInfo.FDs.erase(clientFD);
+        --clientInfo.count;
+    }
+    if (clientInfo.count == 0)
+    {
+        // clear write buffer
+        writeBuffer.clear();
+    }
+}
+
+void TCPComm::broadcast()
+{
+    // like writeClients, keep packets until a client is connected
+    if (clientInfo.count == 0)
+        return;
+    PacketBuffer::claim_t claim;
+    SFPacket* packet;
+    set<int> slowFDs;
+    while ((packet = writeBuffer.claimDequeue(claim)))
+    {
+        for (connections_t::iterator it = connections.begin(); it != connections.end(); ++it)
+        {
+            if (it->second.versionChecked && !queuePacket(queues[it->first], *packet))
+                slowFDs.insert(it->first);
+        }
+        // the flush below follows right away
+        if (packet->getTimestamp())
+        {
+            serialLatency.record(Reactor::now() - packet->getTimestamp());
+        }
+        writeBuffer.release(claim);
+    }
+    for (connections_t::iterator it = connections.begin(); it != connections.end(); ++it)
+    {
+        if (!slowFDs.count(it->first) && !queues[it->first].output.empty() && !flushConnection(it->first))
+            slowFDs.insert(it->first);
+    }
+    for (set<int>::iterator it = slowFDs.begin(); it != slowFDs.end(); ++it)
+    {
+        DEBUG("TCPComm::broadcast : removeClient")
+        closeConnection(*it);
     }
 }
 
 /* cancels all running threads */
 void TCPComm::cancel()
 {
+    if (reactor)
+    {
+        // there are no threads, just stop getting called
+        if (!reactorCanceled)
+        {
+            reactorCanceled = true;
+            reactor->remove(serverFD);
+            for (connections_t::iterator it = connections.begin(); it != connections.end(); ++it)
+            {
+                reactor->remove(it->first);
+                // the destructor closes the clients in clientInfo.FDs
+                if (!it->second.versionChecked)
+                    close(it->first);
+            }
+            reactor->forget(this);
+            pthread_cond_signal(&control.cancel);
+        }
+        return;
+    }
     pthread_t callingThread = pthread_self();
     if (pthread_equal(callingThread, readerThread))
     {
@@ -577,7 +1017,55 @@ void TCPComm::reportStatus(ostream& os)
     os << "SF-Server ( TCPComm on port " << port << " )"
     << " : clients = " << clientInfo.count
     << " , packets read = " << readPacketCount
-    << " , packets written = " << writtenPacketCount << endl;
+    << " , packets written = " << writtenPacketCount
+    << " , packets dropped = " << droppedPacketCount
+    << " , overflow disconnects = " << overflowCount << endl
+    << ">> client queues : " << clientQueueLimit << " packets , overflow = "
+    << getPolicyName(overflowPolicy) << endl;
+    pthread_mutex_lock( &queueLock );
+    for (clientQueues_t::iterator it = queues.begin(); it != queues.end(); ++it)
+    {
+        os << ">> client " << it->first
+        << " : lag = " << it->second.lengths.size()
+        << " packets ( max = " << it->second.maxLag << " )"
+        << " , sent = " << it->second.sent
+        << " , dropped = " << it->second.dropped << endl;
+    }
+    pthread_mutex_unlock( &queueLock );
+    os << ">> serial to tcp latency : ";
+    serialLatency.print(os);
+    os << endl;
+}
+
+void TCPComm::reportMetrics(Metrics& metrics, const string& labels)
+{
+    metrics.gauge("sf_tcp_clients", "Connected tcp clients.", labels, clientInfo.count);
+    metrics.counter("sf_tcp_packets_read_total", "Packets read from the tcp clients.", labels, readPacketCount);
+    metrics.counter("sf_tcp_packets_written_total", "Packets written to the tcp clients (once per client).", labels, writtenPacketCount);
+    metrics.counter("sf_tcp_packets_dropped_total", "Packets dropped for clients with a full queue.", labels, droppedPacketCount);
+    metrics.counter("sf_tcp_overflow_disconnects_total", "Clients disconnected because their queue was full.", labels, overflowCount);
+    metrics.histogram("sf_serial_to_tcp_latency_seconds", "Time from reading a packet from the node until it is written to the clients.", labels, serialLatency);
+}
+
+void TCPComm::setClientQueue(unsigned pLimit, overflow_policy_t pPolicy)
+{
+    pthread_mutex_lock( &queueLock );
+    clientQueueLimit = (pLimit > 0) ? pLimit : 1;
+    overflowPolicy = pPolicy;
+    pthread_mutex_unlock( &queueLock );
+}
+
+const char* TCPComm::getPolicyName(overflow_policy_t pPolicy)
+{
+    switch (pPolicy)
+    {
+    case OVERFLOW_DROP:
+        return "drop";
+    case OVERFLOW_SAMPLE:
+        return "sample";
+    default:
+        return "disconnect";
+    }
 }
 
 void TCPComm::stuffPipe() 
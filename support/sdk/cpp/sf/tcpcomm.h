@@ -38,8 +38,13 @@
 #include "packetbuffer.h"
 #include "basecomm.h"
 #include "sharedinfo.h"
+#include "reactor.h"
+#include "histogram.h"
+#include "metrics.h"
 
 #include <pthread.h>
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <sstream>
@@ -54,8 +59,23 @@
 #define DEBUG(message) 
 #endif
 
-class TCPComm : public BaseComm
+class TCPComm : public BaseComm, public Reactor::Handler
 {
+    /** Constants **/
+public:
+    /* what happens to a packet for a client whose queue is full */
+    typedef enum
+    {
+        OVERFLOW_DROP,          /* the packet is dropped for that client */
+        OVERFLOW_DISCONNECT,    /* the client is disconnected */
+        OVERFLOW_SAMPLE         /* like drop, but once the queue is half full
+                                   only every cSampleInterval-th packet is queued */
+    } overflow_policy_t;
+
+    /* default number of packets queued per client */
+    static const unsigned cDefaultClientQueue = 1024;
+
+    static const unsigned cSampleInterval = 8;
 
     /** Member vars */
 protected:
@@ -100,6 +120,12 @@ protected:
     /* number of written packets */
     int writtenPacketCount;
 
+    /* packets dropped for clients with a full queue */
+    unsigned long droppedPacketCount;
+
+    /* clients disconnected because their queue was full */
+    unsigned long overflowCount;
+
     /* port of this sf */
     int port;
 
@@ -125,6 +151,71 @@ protected:
     /* for noticing the parent thread of cancelation */
     sharedControlInfo_t &control;
 
+    /* reactor driving this server, NULL if it runs its own threads */
+    Reactor* reactor;
+
+    /* notified when packets are put into readBuffer (reactor mode) */
+    Reactor::Handler* peer;
+
+    // per client output queue, so a slow client does not hold up the others
+    typedef struct
+    {
+        /* bytes waiting to be sent */
+        std::string output;
+        /* bytes at the start of output that are not packets (version check) */
+        unsigned unframed;
+        /* lengths of the packets in output */
+        std::deque<unsigned> lengths;
+        /* bytes of the first packet already sent */
+        unsigned partial;
+        /* packets sent and dropped */
+        unsigned long sent;
+        unsigned long dropped;
+        /* most packets queued at once */
+        unsigned maxLag;
+        /* packets seen while sampling */
+        unsigned sampled;
+        /* in the write set of the reader thread (thread mode) */
+        bool watched;
+        /* to be disconnected, its queue was full */
+        bool overflowed;
+    } clientQueue_t;
+
+    typedef std::map<int, clientQueue_t> clientQueues_t;
+
+    /* output queues of the clients (both modes) */
+    clientQueues_t queues;
+
+    /* mutex to protect queues and the counters of sent packets (thread mode) */
+    pthread_mutex_t queueLock;
+
+    /* max. packets queued per client */
+    unsigned clientQueueLimit;
+
+    overflow_policy_t overflowPolicy;
+
+    // per client input (reactor mode)
+    typedef struct
+    {
+        /* client passed the version check */
+        bool versionChecked;
+        /* received bytes not yet parsed */
+        std::string input;
+    } connection_t;
+
+    typedef std::map<int, connection_t> connections_t;
+
+    connections_t connections;
+
+    /* clients are not read while readBuffer is full (reactor mode) */
+    bool readPaused;
+
+    /* fds were removed from the reactor */
+    bool reactorCanceled;
+
+    /* time from reading a packet from the node until it is written to the clients */
+    LatencyHistogram serialLatency;
+
     /** Member functions */
 
     /* needed to start pthreads */
@@ -146,8 +237,13 @@ protected:
     /* reads packet */
     bool readPacket(int pFD, SFPacket &pPacket);
 
-    /* writes packet */
-    bool writePacket(int pFD, SFPacket &pPacket);
+    /* appends packet to the queue of a client, applying the overflow
+       policy. false if the client has to be disconnected */
+    bool queuePacket(clientQueue_t &queue, SFPacket &pPacket);
+
+    /* sends as much of the queue of a client as possible without
+       blocking, false if the connection failed */
+    bool sendQueue(int clientFD, clientQueue_t &queue);
 
     /* adds client to the list */
     void addClient(int clientFD);
@@ -173,9 +269,31 @@ protected:
     /* remove data written into pipe */
     void clearPipe();
 
+    /* reactor mode: accepts pending connections */
+    void acceptClients();
+
+    /* reactor mode: reads from a client */
+    void readConnection(int clientFD);
+
+    /* reactor mode: handles complete packets received from a client,
+       false if the client has to be dropped */
+    bool parseConnection(int clientFD);
+
+    /* reactor mode: sends queued data, false if the client has to be dropped */
+    bool flushConnection(int clientFD);
+
+    /* reactor mode: closes a client connection */
+    void closeConnection(int clientFD);
+
+    /* reactor mode: watches a client for the events it needs */
+    void updateConnection(int clientFD);
+
+    /* reactor mode: queues packets from writeBuffer for all clients */
+    void broadcast();
+
 public:
     /* create SF TCP server - init and start threads */
-    TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl);
+    TCPComm(int pPort, PacketBuffer &pReadBuffer, PacketBuffer &pWriteBuffer, sharedControlInfo_t& pControl, Reactor* pReactor = NULL);
 
     /* wait for threads, close fds and cleanup */
     ~TCPComm();
@@ -186,11 +304,30 @@ public:
     /* returns the TCP/IP port of this sf server */
     int getPort();
 
+    /* returns the number of connected clients */
+    int getClientCount();
+
     /* reports status info to stdout */
     void reportStatus(std::ostream& os);
 
+    /* adds counters to metrics, labels identify the sf-server */
+    void reportMetrics(Metrics& metrics, const std::string& labels);
+
+    /* sets the size of the client queues and what happens when one is full */
+    void setClientQueue(unsigned pLimit, overflow_policy_t pPolicy);
+
+    /* name of an overflow policy */
+    static const char* getPolicyName(overflow_policy_t pPolicy);
+
     /* returns if error occurred */
     bool isErrorReported() { return errorReported; }
+
+    /* sets the handler to notify of packets put into the read buffer */
+    void setPeer(Reactor::Handler* pPeer) { peer = pPeer; }
+
+    /* reactor callbacks */
+    void handleEvent(int fd, int events);
+    void bufferChanged();
 };
 
 #endif
@@ -8,6 +8,12 @@
 
 #include "blip_printf.h"
 
+/* bytes of each socket set aside to hold segments received out of
+   order; zero to drop them instead. */
+#ifndef BLIP_TCP_REASM_LEN
+#define BLIP_TCP_REASM_LEN 0
+#endif
+
 module TcpP {
   provides interface Tcp[uint8_t client];
   provides interface Init;
@@ -26,6 +32,16 @@ module TcpP {
 
 #include <libtcp/tcplib.h>
   struct tcplib_sock socks[N_CLIENTS];
+#if BLIP_TCP_REASM_LEN > 0
+  uint32_t rx_bufs[N_CLIENTS][(BLIP_TCP_REASM_LEN + 3) / 4];
+#endif
+
+  void set_rx_buf(int cid) {
+#if BLIP_TCP_REASM_LEN > 0
+    socks[cid].rx_buf = rx_bufs[cid];
+    socks[cid].rx_buf_len = sizeof(rx_bufs[cid]);
+#endif
+  }
 
   int find_client(struct tcplib_sock *conn) {
     int i;
@@ -77,6 +93,7 @@ module TcpP {
     if (cid == N_CLIENTS) return NULL;
     if (signal Tcp.accept[cid](from, &conn->tx_buf, &conn->tx_buf_len)) {
       if (conn->tx_buf == NULL) return NULL;
+      set_rx_buf(cid);
       return conn;
     }
     return NULL;
@@ -127,6 +144,7 @@ module TcpP {
     int rv;
     socks[client].tx_buf = tx_buf;
     socks[client].tx_buf_len = tx_buf_len;
+    set_rx_buf(client);
     rv = tcplib_connect(&socks[client], dest);
     return rv ? FAIL : SUCCESS;
   }
@@ -228,7 +228,8 @@ module CoapUdpServerP {
       }
 
       /* first, update the link-set */
-      for (node = ctx_server->resources; node; node = node->next) {
+      for (node = coap_first_resource(ctx_server); node;
+	   node = coap_next_resource(ctx_server, node)) {
 	  n = print_link(COAP_RESOURCE(node), resources + maxlen,
 			 RESOURCE_BUFLEN - maxlen);
 	  if (n <= 0) { 			/* error */
@@ -890,7 +891,6 @@ module CoapUdpServerP {
  int coap_save_splitphase(coap_context_t *ctx,
 			  coap_queue_t *node) {
    coap_queue_t *new_node;
-   coap_opt_t *opt;
 
    printf("coap_save_split %u\n", ntohs(node->pdu->hdr->id));
 
@@ -910,18 +910,14 @@ module CoapUdpServerP {
    memcpy( &new_node->remote, &node->remote, sizeof( struct sockaddr_in6 ) );
    printf("** coap: saving ctx and node details to send splitphase later\n");
 
-   /* "parse" received PDU by filling pdu structure */
+   /* copy received PDU and index its options */
    memcpy(new_node->pdu->hdr, node->pdu->hdr, node->pdu->length );
    new_node->pdu->length = node->pdu->length;
 
-   /* finally calculate beginning of data block */
-   options_end( new_node->pdu, &opt );
-
-   if ( (unsigned char *)new_node->pdu->hdr + new_node->pdu->length <
-	(unsigned char *)opt )
-     new_node->pdu->data = (unsigned char *)new_node->pdu->hdr + new_node->pdu->length;
-   else
-     new_node->pdu->data = (unsigned char *)opt;
+   if ( !coap_pdu_parse( new_node->pdu ) ) {
+     coap_delete_node( new_node );
+     return -1;
+   }
 
    /* and add new node to splitphasequeue */
    //printf("coap_split ins id %u\n", ntohs(new_node->pdu->hdr->id));
@@ -37,7 +37,6 @@ coap_read(coap_context_t *ctx,
 	  struct sockaddr_in6 *src, void *buf,
 	  uint16_t bytes_read, struct ip6_metadata *meta) {
   coap_queue_t *node;
-  coap_opt_t *opt;
 
   if ( bytes_read < 0 || bytes_read>=COAP_MAX_PDU_SIZE) {
     return -1;
@@ -69,18 +68,14 @@ coap_read(coap_context_t *ctx,
 
   memcpy( &node->remote, src, sizeof( *src ) );
 
-  /* "parse" received PDU by filling pdu structure */
+  /* parse received PDU in place, which also finds the data block */
   memcpy( node->pdu->hdr, buf, bytes_read );
   node->pdu->length = bytes_read;
 
-  /* finally calculate beginning of data block */
-  options_end( node->pdu, &opt );
-
-  if ( (unsigned char *)node->pdu->hdr + node->pdu->length <
-       (unsigned char *)opt )
-    node->pdu->data = (unsigned char *)node->pdu->hdr + node->pdu->length;
-  else
-    node->pdu->data = (unsigned char *)opt;
+  if ( !coap_pdu_parse( node->pdu ) ) {
+    coap_delete_node( node );
+    return -1;
+  }
 
   /* and add new node to receive queue */
   coap_insert_node( &ctx->recvqueue, node, order_transaction_id );
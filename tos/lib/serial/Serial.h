@@ -103,6 +103,11 @@ enum {
   SERIAL_PROTO_ACK = 67,
   SERIAL_PROTO_PACKET_ACK = 68,
   SERIAL_PROTO_PACKET_NOACK = 69,
+  // Window negotiation: the host sends [WINDOW][seqno][window], where
+  // seqno is the last one it used, and the mote answers [WINDOW][window
+  // it accepts]. Motes that do not know this frame drop it, so the
+  // host stays with stop-and-wait.
+  SERIAL_PROTO_WINDOW = 70,
   SERIAL_PROTO_PACKET_UNKNOWN = 255
 };
 
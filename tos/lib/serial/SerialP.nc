@@ -48,6 +48,18 @@
  * acknowledgement to the sender which serves as a crude form of
  * flow-control.
  *
+ * By default the host waits for the acknowledgement of each frame
+ * before it sends the next one. A host can ask for a window with a
+ * SERIAL_PROTO_WINDOW frame; the mote then accepts up to
+ * SERIAL_WINDOW_SIZE unacknowledged frames and acknowledges each
+ * frame by its token. Tokens are then consecutive and the mote keeps
+ * a selective repeat receive window: the oldest token not yet
+ * delivered and a bitmap of the tokens after it that were. A
+ * retransmission after a lost acknowledgement, whose token is either
+ * marked in the bitmap or just below the window, is acknowledged but
+ * not delivered again. Frames that follow a lost frame may be
+ * delivered before its retransmission.
+ *
  * @author Phil Buonadonna
  * @author Lewis Girod
  * @author Ben Greenstein
@@ -59,6 +71,14 @@
 #include "AM.h"
 #include "crc.h"
 
+#ifndef SERIAL_WINDOW_SIZE
+#define SERIAL_WINDOW_SIZE 4
+#endif
+
+#if SERIAL_WINDOW_SIZE < 1 || SERIAL_WINDOW_SIZE > 16
+#error "SERIAL_WINDOW_SIZE must be between 1 and 16"
+#endif
+
 module SerialP {
 
   provides {
@@ -83,7 +103,7 @@ implementation {
     TX_DATA_BUFFER_SIZE = 4,
     SERIAL_MTU = 255,
     SERIAL_VERSION = 1,
-    ACK_QUEUE_SIZE = 5,
+    ACK_QUEUE_SIZE = (SERIAL_WINDOW_SIZE < 5) ? 5 : SERIAL_WINDOW_SIZE + 1,
   };
 
   enum {
@@ -150,6 +170,17 @@ implementation {
   uint8_t  rxProto;
   uint8_t  rxSeqno;
   uint16_t rxCRC;
+  uint8_t  rxWindowRequest;
+  bool     rxDiscard;
+
+  /* Window State */
+
+  uint8_t  rxWindow;        // window granted to the host, 1 means stop-and-wait
+  uint8_t  rxWindowBase;    // oldest token not delivered yet
+  uint16_t rxWindowMask;    // bit i: token rxWindowBase + i was delivered
+  uint8_t  rxLastToken;     // token of the last delivered frame
+  bool     rxLastValid;     // a frame was delivered since the mote started
+  bool     windowReplyPending;
 
   /* Transmit State */
 
@@ -171,6 +202,7 @@ implementation {
   inline void txInit();
   inline void rxInit();
   inline void ackInit();
+  inline void windowInit();
 
   inline bool ack_queue_is_full(); 
   inline bool ack_queue_is_empty(); 
@@ -211,17 +243,29 @@ implementation {
     rxProto = 0;
     rxSeqno = 0;
     rxCRC = 0;
+    rxWindowRequest = 0;
+    rxDiscard = FALSE;
   }
 
   inline void ackInit(){
     ackQ.writePtr = ackQ.readPtr = 0;
   }
 
+  inline void windowInit(){
+    rxWindow = 1;
+    rxWindowBase = 0;
+    rxWindowMask = 0;
+    rxLastToken = 0;
+    rxLastValid = FALSE;
+    windowReplyPending = FALSE;
+  }
+
   command error_t Init.init() {
 
     txInit();
     rxInit();
     ackInit();
+    windowInit();
 
     return SUCCESS;
   }
@@ -319,6 +363,57 @@ implementation {
     return crc;
   }
 
+  /*
+   * Window
+   */
+
+  void rx_window_slide(){
+    while (rxWindowMask & 1) {
+      rxWindowMask >>= 1;
+      rxWindowBase++;
+    }
+  }
+
+  bool rx_window_delivered(uint8_t token){
+    uint8_t offset = token - rxWindowBase;
+    if (offset < rxWindow)
+      return (rxWindowMask >> offset) & 1;
+    // the host has at most rxWindow tokens outstanding, so tokens
+    // just below the window were delivered before
+    return offset >= (uint8_t)(0 - rxWindow);
+  }
+
+  void rx_window_deliver(uint8_t token){
+    uint8_t offset = token - rxWindowBase;
+    if (offset >= rxWindow) {
+      // the host gave up on the frames at the bottom of the window
+      offset -= rxWindow - 1;
+      rxWindowBase += offset;
+      rxWindowMask = (offset < 16) ? rxWindowMask >> offset : 0;
+      offset = rxWindow - 1;
+    }
+    rxWindowMask |= 1U << offset;
+    rxLastToken = token;
+    rxLastValid = TRUE;
+    rx_window_slide();
+  }
+
+  void window_request(uint8_t window, uint8_t token){
+    if (window < 1) window = 1;
+    if (window > SERIAL_WINDOW_SIZE) window = SERIAL_WINDOW_SIZE;
+    atomic {
+      rxWindow = window;
+      // the request carries the host's last token; the host has not
+      // sent any later one, and only waits for that one if it was not
+      // acknowledged
+      rxWindowBase = token;
+      rxWindowMask = (rxLastValid && rxLastToken == token) ? 1 : 0;
+      rx_window_slide();
+      windowReplyPending = TRUE;
+    }
+    MaybeScheduleTx();
+  }
+
   task void startDoneTask() {
     call SerialControl.start();
     atomic {
@@ -401,6 +496,7 @@ implementation {
   bool valid_rx_proto(uint8_t proto){
     switch (proto){
     case SERIAL_PROTO_PACKET_ACK: 
+    case SERIAL_PROTO_WINDOW:
       return TRUE;
     case SERIAL_PROTO_ACK:
     case SERIAL_PROTO_PACKET_NOACK:
@@ -427,13 +523,6 @@ implementation {
         rxProto = data;
         if (!valid_rx_proto(rxProto))
           goto nosync;
-        // only supports serial proto packet ack
-        if (rxProto != SERIAL_PROTO_PACKET_ACK){
-          goto nosync;
-        }
-        if (signal ReceiveBytePacket.startPacket() != SUCCESS){
-          goto nosync;
-        }
       }      
       break;
       
@@ -445,6 +534,15 @@ implementation {
         rxSeqno = data;
         rxCRC = crcByte(rxCRC,rxSeqno);
         rxState = RXSTATE_INFO;
+        if (rxProto == SERIAL_PROTO_PACKET_ACK){
+          if (rxWindow > 1 && rx_window_delivered(rxSeqno)) {
+            // retransmission of a frame whose ack was lost
+            rxDiscard = TRUE;
+          }
+          else if (signal ReceiveBytePacket.startPacket() != SUCCESS){
+            goto nosync;
+          }
+        }
       }
       break;
       
@@ -453,8 +551,17 @@ implementation {
         if (isDelimeter) { /* handle end of frame */
           if (rxByteCnt >= 2) {
             if (rx_current_crc() == rxCRC) {
-              signal ReceiveBytePacket.endPacket(SUCCESS);
-              ack_queue_push(rxSeqno);
+              if (rxProto == SERIAL_PROTO_WINDOW) {
+                if (rxByteCnt > 2)
+                  window_request(rxWindowRequest, rxSeqno);
+              }
+              else {
+                if (!rxDiscard) {
+                  signal ReceiveBytePacket.endPacket(SUCCESS);
+                  rx_window_deliver(rxSeqno);
+                }
+                ack_queue_push(rxSeqno);
+              }
 	      rxInit();
 	      call SerialFrameComm.resetReceive();
 	      if (offPending) {
@@ -473,7 +580,13 @@ implementation {
 	}
         else { /* handle new bytes to save */
           if (rxByteCnt >= 2){ 
-            signal ReceiveBytePacket.byteReceived(rx_buffer_top());
+            if (rxProto == SERIAL_PROTO_WINDOW) {
+              if (rxByteCnt == 2)
+                rxWindowRequest = rx_buffer_top();
+            }
+            else if (!rxDiscard) {
+              signal ReceiveBytePacket.byteReceived(rx_buffer_top());
+            }
             rxCRC = crcByte(rxCRC,rx_buffer_pop());
           }
 	  rx_buffer_push(data);
@@ -591,6 +704,10 @@ implementation {
 	if (txProto == SERIAL_PROTO_ACK){
 	  ack_queue_pop();
 	}
+	else if (txProto == SERIAL_PROTO_WINDOW){
+	  if (done)
+	    windowReplyPending = FALSE;
+	}
 	else {
 	  result = done ? SUCCESS : FAIL;
 	  send_completed = TRUE;
@@ -610,9 +727,11 @@ implementation {
         /* acks are top priority */
         uint8_t myAckState;
         uint8_t myDataState;
+        bool myWindowReply;
         atomic {
           myAckState = txBuf[TX_ACK_INDEX].state;
           myDataState = txBuf[TX_DATA_INDEX].state;
+          myWindowReply = windowReplyPending;
         }
         if (!ack_queue_is_empty() && myAckState == BUFFER_AVAILABLE) {
           atomic {
@@ -624,6 +743,16 @@ implementation {
 	    start_it = TRUE;
 	  }
         }
+        else if (myWindowReply && myAckState == BUFFER_AVAILABLE) {
+          atomic {
+            txBuf[TX_ACK_INDEX].state = BUFFER_COMPLETE;
+            txBuf[TX_ACK_INDEX].buf = rxWindow;
+
+	    txProto = SERIAL_PROTO_WINDOW;
+	    txIndex = TX_ACK_INDEX;
+	    start_it = TRUE;
+	  }
+        }
         else if (myDataState == BUFFER_FILLING || myDataState == BUFFER_COMPLETE){
 	  atomic {
 	    txProto = SERIAL_PROTO_PACKET_NOACK;
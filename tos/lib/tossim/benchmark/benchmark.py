@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#
+# Throughput benchmark for the TOSSIM event loop.
+#
+# Builds a set of reference applications for TOSSIM and runs each one
+# against the bundled topologies and noise traces with a fixed seed.
+# One JSON object is printed per scenario with the number of events
+# executed, wall time, events per second, peak RSS and the peak depth
+# of the event queue, so that runs before and after a change to the
+# simulator can be compared.
+#
+# Usage:
+#   python3 benchmark.py                      # build and run everything
+#   python3 benchmark.py -s ctp-15x15-medium  # a single scenario
+#   python3 benchmark.py --no-build -o results.jsonl
+#
+
+import argparse
+import json
+import os
+import random
+import resource
+import subprocess
+import sys
+import time
+
+TOSSIM_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TOSROOT = os.path.dirname(os.path.dirname(os.path.dirname(TOSSIM_DIR)))
+
+TOPOLOGY_DIR = os.path.join(TOSSIM_DIR, "topologies")
+NOISE_DIR = os.path.join(TOSSIM_DIR, "noise")
+
+# Number of noise trace readings given to each node. Matches the
+# TOSSIM tutorial and keeps setup time small compared to the run.
+NOISE_TRACE_READINGS = 100
+
+SCENARIOS = {
+    "radiocount-15x15-tight": {
+        "app": "apps/RadioCountToLeds",
+        "topology": "15-15-tight-mica2-grid.txt",
+        "noise": "meyer-heavy.txt",
+        "nodes": 225,
+        "seconds": 60,
+    },
+    "radiocount-15x15-sparse": {
+        "app": "apps/RadioCountToLeds",
+        "topology": "15-15-sparse-mica2-grid.txt",
+        "noise": "casino-lab.txt",
+        "nodes": 225,
+        "seconds": 60,
+    },
+    "ctp-15x15-medium": {
+        "app": "apps/tests/TestNetwork",
+        "topology": "15-15-medium-mica2-grid.txt",
+        "noise": "meyer-heavy.txt",
+        "nodes": 225,
+        "seconds": 120,
+    },
+    "timers-225": {
+        "app": "apps/tests/TestSimTimers",
+        "topology": None,
+        "noise": "meyer-heavy.txt",
+        "nodes": 225,
+        "seconds": 600,
+    },
+}
+
+
+def load_topology(radio, path):
+    with open(path, "r") as f:
+        for line in f:
+            s = line.split()
+            if not s:
+                continue
+            if s[0] == "gain":
+                radio.add(int(s[1]), int(s[2]), float(s[3]))
+            elif s[0] == "noise":
+                radio.setNoise(int(s[1]), float(s[2]), float(s[3]))
+
+
+def load_noise(path):
+    readings = []
+    with open(path, "r") as f:
+        for line in f:
+            line = line.strip()
+            if line:
+                readings.append(int(line))
+            if len(readings) == NOISE_TRACE_READINGS:
+                break
+    return readings
+
+
+def run_scenario(name, seed):
+    """Runs a scenario in this process. The TOSSIM module of the
+    scenario's application must be importable from the working directory."""
+    sys.path.insert(0, os.getcwd())
+    from TOSSIM import Tossim
+
+    scenario = SCENARIOS[name]
+    rng = random.Random(seed)
+
+    setup_start = time.perf_counter()
+
+    t = Tossim({})
+    t.randomSeed(seed)
+    r = t.radio()
+
+    if scenario["topology"] is not None:
+        load_topology(r, os.path.join(TOPOLOGY_DIR, scenario["topology"]))
+
+    noise = load_noise(os.path.join(NOISE_DIR, scenario["noise"]))
+
+    for i in range(scenario["nodes"]):
+        m = t.getNode(i)
+        m.addNoiseTraces(noise)
+        m.createNoiseModel()
+        m.bootAtTime(rng.randint(t.ticksPerSecond(), 2 * t.ticksPerSecond()))
+
+    setup_seconds = time.perf_counter() - setup_start
+
+    run_start = time.perf_counter()
+    events = t.runAllEventsWithTriggeredMaxTime(
+        scenario["seconds"], scenario["seconds"], lambda: True)
+    wall_seconds = time.perf_counter() - run_start
+
+    events = abs(events)
+
+    return {
+        "scenario": name,
+        "app": scenario["app"],
+        "topology": scenario["topology"],
+        "noise": scenario["noise"],
+        "nodes": scenario["nodes"],
+        "seed": seed,
+        "sim_seconds": t.timeInSeconds(),
+        "events": events,
+        "setup_seconds": setup_seconds,
+        "wall_seconds": wall_seconds,
+        "events_per_second": events / wall_seconds if wall_seconds > 0 else None,
+        # ru_maxrss is in kilobytes on Linux and bytes on macOS
+        "peak_rss_kb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss // (1024 if sys.platform == "darwin" else 1),
+        "peak_queue_depth": t.eventQueuePeakSize(),
+        "final_queue_depth": t.eventQueueSize(),
+    }
+
+
+def build(app_dir, platform):
+    subprocess.check_call(["make", platform, "sim"], cwd=app_dir,
+                          stdout=subprocess.DEVNULL)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="TOSSIM throughput benchmark")
+    parser.add_argument("-s", "--scenario", action="append", choices=sorted(SCENARIOS),
+                        help="scenario to run, may be repeated (default: all)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--platform", default="micaz")
+    parser.add_argument("--no-build", action="store_true",
+                        help="use the TOSSIM libraries already built in each app")
+    parser.add_argument("-o", "--output", help="also append results to this file")
+    parser.add_argument("--run-scenario", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.run_scenario:
+        print(json.dumps(run_scenario(args.run_scenario, args.seed)))
+        return 0
+
+    names = args.scenario or sorted(SCENARIOS)
+    built = set()
+    status = 0
+
+    for name in names:
+        app_dir = os.path.join(TOSROOT, SCENARIOS[name]["app"])
+
+        if not args.no_build and app_dir not in built:
+            build(app_dir, args.platform)
+            built.add(app_dir)
+
+        # Each scenario runs in its own process so the TOSSIM module
+        # state and peak RSS are not shared between scenarios.
+        proc = subprocess.run(
+            [sys.executable, os.path.abspath(__file__),
+             "--run-scenario", name, "--seed", str(args.seed)],
+            cwd=app_dir, stdout=subprocess.PIPE, universal_newlines=True)
+
+        if proc.returncode != 0:
+            print(json.dumps({"scenario": name, "error": proc.returncode}))
+            status = 1
+            continue
+
+        result = proc.stdout.strip().splitlines()[-1]
+        print(result)
+        sys.stdout.flush()
+
+        if args.output:
+            with open(args.output, "a") as f:
+                f.write(result + "\n")
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
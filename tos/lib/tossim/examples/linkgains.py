@@ -0,0 +1,54 @@
+# Times the native link gain generator on a large random layout.
+#
+# usage: python linkgains.py [nodes] [m^2 per node] [seed]
+#
+# The nodes are spread uniformly over a square whose area grows with
+# the number of nodes, so the density (and the number of links per
+# node) stays the same as the layout grows. The simulation must be
+# built with TOSSIM_MAX_NODES at least as large as the number of nodes,
+# e.g. CFLAGS=-DTOSSIM_MAX_NODES=10000 make micaz sim
+
+import os
+import random
+import sys
+import time
+
+from TOSSIM import *
+
+nodes = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+area = float(sys.argv[2]) if len(sys.argv) > 2 else 1000.0
+seed = int(sys.argv[3]) if len(sys.argv) > 3 else 1
+
+t = Tossim([])
+r = t.radio()
+m = LinkLayerModel()
+
+# The parameters of the sample configuration in the TOSSIM tutorial
+m.setPathLoss(3.0, 1.0, 55.0)
+m.setShadowing(4.0)
+m.setAsymmetry(3.7, -3.3, -3.3, 6.0)
+m.setNoise(-105.0, 4.0)
+
+side = (nodes * area) ** 0.5
+rng = random.Random(seed)
+for i in range(nodes):
+  m.addNode(i, rng.uniform(0, side), rng.uniform(0, side))
+
+start = time.time()
+links = m.generate(seed)
+generated = time.time() - start
+
+start = time.time()
+r.saveTopology("linkgains.bin")
+saved = time.time() - start
+
+start = time.time()
+r.loadTopology("linkgains.bin")
+loaded = time.time() - start
+
+print("%i nodes over %.0fx%.0f m: %i links, %.1f per node" %
+      (nodes, side, side, links, float(links) / nodes))
+print("generate %.3f s, save %.3f s, load %.3f s (%i bytes)" %
+      (generated, saved, loaded, os.path.getsize("linkgains.bin")))
+
+os.remove("linkgains.bin")
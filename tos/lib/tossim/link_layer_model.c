@@ -0,0 +1,650 @@
+/*
+ * Copyright (c) 2005 Stanford University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ * - Neither the name of the copyright holder nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * C++ implementation of the log-normal shadowing link layer model.
+ * See net.tinyos.sim.LinkLayerModel for the model this follows.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <link_layer_model.h>
+#include <sim_gain.h>
+
+namespace {
+
+enum {
+  TOPOLOGY_GRID = 1,
+  TOPOLOGY_UNIFORM = 2,
+  TOPOLOGY_RANDOM = 3,
+  TOPOLOGY_FILE = 4,
+};
+
+// The number of standard deviations of the random terms that are
+// allowed for when deciding whether a link could be above the threshold.
+const double SIGMA_BOUND = 3.0;
+
+const char BINARY_MAGIC[8] = {'T', 'O', 'S', 'G', 'A', 'I', 'N', '\0'};
+const uint32_t BINARY_VERSION = 1;
+
+struct binary_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t noise_count;
+  uint64_t gain_count;
+};
+
+struct binary_noise_t {
+  int32_t node;
+  int32_t reserved;
+  double mean;
+  double range;
+};
+
+struct binary_gain_t {
+  int32_t src;
+  int32_t dest;
+  double gain;
+};
+
+bool validNode(int32_t node) noexcept {
+  return node >= 0 && node < TOSSIM_MAX_NODES;
+}
+
+// Buckets node indexes into square cells so neighbours within one cell
+// width can be found by looking at the surrounding 3x3 cells.
+class SpatialGrid {
+ public:
+  template <typename Nodes>
+  SpatialGrid(const Nodes& nodes, double cell_size)
+  {
+    double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+
+    if (!nodes.empty()) {
+      min_x = max_x = nodes[0].x;
+      min_y = max_y = nodes[0].y;
+    }
+
+    for (const auto& node : nodes) {
+      min_x = std::min(min_x, node.x);
+      max_x = std::max(max_x, node.x);
+      min_y = std::min(min_y, node.y);
+      max_y = std::max(max_y, node.y);
+    }
+
+    // Avoid huge empty grids for sparse deployments over large areas
+    // by never having many more cells than nodes.
+    const double max_cells = 4.0 * nodes.size() + 16.0;
+
+    cell = cell_size;
+    if (!std::isfinite(cell) || cell <= 0) {
+      cell = std::max(max_x - min_x, max_y - min_y) + 1.0;
+    }
+    while (((max_x - min_x) / cell + 1) * ((max_y - min_y) / cell + 1) > max_cells) {
+      cell *= 2;
+    }
+
+    origin_x = min_x;
+    origin_y = min_y;
+    cols = static_cast<int>((max_x - min_x) / cell) + 1;
+    rows = static_cast<int>((max_y - min_y) / cell) + 1;
+
+    // Counting sort of node indexes by cell
+    start.assign(static_cast<size_t>(cols) * rows + 1, 0);
+    for (const auto& node : nodes) {
+      start[cellOf(node.x, node.y) + 1] += 1;
+    }
+    for (size_t i = 1; i != start.size(); ++i) {
+      start[i] += start[i - 1];
+    }
+
+    std::vector<size_t> fill(start.begin(), start.end() - 1);
+    order.resize(nodes.size());
+    for (size_t i = 0; i != nodes.size(); ++i) {
+      order[fill[cellOf(nodes[i].x, nodes[i].y)]++] = i;
+    }
+  }
+
+  // Calls fn(index) for every node in the cells surrounding (x, y).
+  template <typename Fn>
+  void forNeighbours(double x, double y, Fn fn) const
+  {
+    const int cx = column(x);
+    const int cy = row(y);
+
+    for (int j = std::max(cy - 1, 0); j <= std::min(cy + 1, rows - 1); ++j) {
+      for (int i = std::max(cx - 1, 0); i <= std::min(cx + 1, cols - 1); ++i) {
+        const size_t c = static_cast<size_t>(j) * cols + i;
+        for (size_t k = start[c]; k != start[c + 1]; ++k) {
+          fn(order[k]);
+        }
+      }
+    }
+  }
+
+ private:
+  int column(double x) const noexcept {
+    return std::min(std::max(static_cast<int>((x - origin_x) / cell), 0), cols - 1);
+  }
+  int row(double y) const noexcept {
+    return std::min(std::max(static_cast<int>((y - origin_y) / cell), 0), rows - 1);
+  }
+  size_t cellOf(double x, double y) const noexcept {
+    return static_cast<size_t>(row(y)) * cols + column(x);
+  }
+
+  double cell;
+  double origin_x, origin_y;
+  int cols, rows;
+  std::vector<size_t> start;
+  std::vector<size_t> order;
+};
+
+double parseDouble(const std::string& key, const std::string& value)
+{
+  try {
+    return std::stod(value);
+  }
+  catch (const std::exception&) {
+    throw std::runtime_error("Bad value '" + value + "' for " + key);
+  }
+}
+
+int parseInt(const std::string& key, const std::string& value)
+{
+  try {
+    return std::stoi(value);
+  }
+  catch (const std::exception&) {
+    throw std::runtime_error("Bad value '" + value + "' for " + key);
+  }
+}
+
+} // namespace
+
+LinkLayerModel::LinkLayerModel() noexcept
+  : pathLossExponent(3)
+  , shadowingSigma(3)
+  , d0(1)
+  , pld0(55)
+  , noiseFloor(-105)
+  , whiteGaussianNoise(4)
+  , s11(3.7), s12(-3.3), s21(-3.3), s22(6.0)
+  , hasGainThreshold(false)
+  , threshold(0)
+{
+}
+
+void LinkLayerModel::readConfig(const char* path, unsigned int seed) {
+  std::ifstream input(path);
+  if (!input) {
+    throw std::runtime_error(std::string("Failed to open configuration file ") + path);
+  }
+
+  int topology = 0;
+  int num_nodes = 0;
+  double grid_unit = 0;
+  double terrain_x = 0, terrain_y = 0;
+  std::string topology_file;
+
+  double n = pathLossExponent, sigma = shadowingSigma, ref_d0 = d0, ref_pld0 = pld0;
+  double a11 = s11, a12 = s12, a21 = s21, a22 = s22;
+
+  std::string line;
+  while (std::getline(input, line)) {
+    if (line.empty() || line[0] == '%') {
+      continue;
+    }
+
+    std::replace_if(line.begin(), line.end(),
+      [](char c) { return c == '=' || c == ';' || c == '\t'; }, ' ');
+
+    std::istringstream tokens(line);
+    std::string key, value;
+    if (!(tokens >> key)) {
+      continue;
+    }
+    if (!(tokens >> value)) {
+      throw std::runtime_error("Missing value for " + key);
+    }
+
+    if (key == "PATH_LOSS_EXPONENT") n = parseDouble(key, value);
+    else if (key == "SHADOWING_STANDARD_DEVIATION") sigma = parseDouble(key, value);
+    else if (key == "PL_D0") ref_pld0 = parseDouble(key, value);
+    else if (key == "D0") ref_d0 = parseDouble(key, value);
+    else if (key == "NOISE_FLOOR") noiseFloor = parseDouble(key, value);
+    else if (key == "WHITE_GAUSSIAN_NOISE") whiteGaussianNoise = parseDouble(key, value);
+    else if (key == "S11") a11 = parseDouble(key, value);
+    else if (key == "S12") a12 = parseDouble(key, value);
+    else if (key == "S21") a21 = parseDouble(key, value);
+    else if (key == "S22") a22 = parseDouble(key, value);
+    else if (key == "NUMBER_OF_NODES") num_nodes = parseInt(key, value);
+    else if (key == "TOPOLOGY") topology = parseInt(key, value);
+    else if (key == "GRID_UNIT") grid_unit = parseDouble(key, value);
+    else if (key == "TOPOLOGY_FILE") topology_file = value;
+    else if (key == "TERRAIN_DIMENSIONS_X") terrain_x = parseDouble(key, value);
+    else if (key == "TERRAIN_DIMENSIONS_Y") terrain_y = parseDouble(key, value);
+    else if (key == "LINK_GAIN_THRESHOLD") setGainThreshold(parseDouble(key, value));
+    else {
+      throw std::runtime_error("Undefined parameter " + key);
+    }
+  }
+
+  if (whiteGaussianNoise < 0) {
+    throw std::runtime_error("WHITE_GAUSSIAN_NOISE must be greater than or equal to 0");
+  }
+
+  setPathLoss(n, ref_d0, ref_pld0);
+  setShadowing(sigma);
+  setAsymmetry(a11, a12, a21, a22);
+
+  if (topology == TOPOLOGY_FILE) {
+    readTopologyFile(topology_file.c_str());
+  }
+  else {
+    placeNodes(topology, num_nodes, grid_unit, terrain_x, terrain_y, seed);
+  }
+}
+
+void LinkLayerModel::readTopologyFile(const char* path) {
+  std::ifstream input(path);
+  if (!input) {
+    throw std::runtime_error(std::string("Failed to open TOPOLOGY_FILE ") + path);
+  }
+
+  std::string line;
+  while (std::getline(input, line)) {
+    if (line.empty() || line[0] == '%' || line[0] == ' ') {
+      continue;
+    }
+
+    std::istringstream tokens(line);
+    int node;
+    double x, y;
+    if (!(tokens >> node >> x >> y)) {
+      throw std::runtime_error("Bad line in TOPOLOGY_FILE: " + line);
+    }
+
+    addNode(node, x, y);
+  }
+}
+
+void LinkLayerModel::placeNodes(int topology, int num_nodes, double grid_unit,
+                                double terrain_x, double terrain_y, unsigned int seed) {
+  if (num_nodes <= 0) {
+    throw std::runtime_error("NUMBER_OF_NODES must be positive");
+  }
+
+  const int side = static_cast<int>(sqrt(num_nodes));
+
+  // Salted so placement is independent of the gains generated from the same seed
+  std::seed_seq seq{seed, 0x70706f74u};
+  std::mt19937 rng(seq);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  switch (topology) {
+  case TOPOLOGY_GRID:
+    if (grid_unit < d0) {
+      throw std::runtime_error("GRID_UNIT must be equal or greater than D0");
+    }
+    if (side * side != num_nodes) {
+      throw std::runtime_error("On GRID topology, NUMBER_OF_NODES should be the square of a natural number");
+    }
+    for (int i = 0; i < num_nodes; ++i) {
+      addNode(i, (i % side) * grid_unit, (i / side) * grid_unit);
+    }
+    break;
+
+  case TOPOLOGY_UNIFORM:
+  case TOPOLOGY_RANDOM: {
+    if (terrain_x <= 0 || terrain_y <= 0) {
+      throw std::runtime_error("Values of TERRAIN_DIMENSIONS must be positive");
+    }
+    if (topology == TOPOLOGY_UNIFORM) {
+      if (side * side != num_nodes) {
+        throw std::runtime_error("On UNIFORM topology, NUMBER_OF_NODES should be the square of a natural number");
+      }
+      if (terrain_x != terrain_y) {
+        throw std::runtime_error("Values of TERRAIN_DIMENSIONS_X and TERRAIN_DIMENSIONS_Y must be equal");
+      }
+    }
+
+    const double cell_length = sqrt(terrain_x * terrain_y / num_nodes);
+    if (cell_length < d0 * 1.4) {
+      throw std::runtime_error("Density is too high, increase physical terrain");
+    }
+
+    // Nodes may not be placed closer than d0 to one another. Previously
+    // placed nodes are bucketed in d0 sized cells so each placement only
+    // has to be checked against its immediate neighbours.
+    const long long cols = static_cast<long long>(terrain_x / d0) + 3;
+    std::unordered_map<long long, std::vector<size_t>> placed;
+
+    for (int i = 0; i < num_nodes; ++i) {
+      double x, y;
+      long long cx, cy;
+      bool too_close;
+
+      do {
+        if (topology == TOPOLOGY_UNIFORM) {
+          x = (i % side) * cell_length + unit(rng) * cell_length;
+          y = (i / side) * cell_length + unit(rng) * cell_length;
+        }
+        else {
+          x = unit(rng) * terrain_x;
+          y = unit(rng) * terrain_y;
+        }
+
+        cx = static_cast<long long>(x / d0);
+        cy = static_cast<long long>(y / d0);
+        too_close = false;
+
+        for (long long j = cy - 1; j <= cy + 1 && !too_close; ++j) {
+          for (long long k = cx - 1; k <= cx + 1 && !too_close; ++k) {
+            auto find = placed.find(j * cols + k + 1);
+            if (find == placed.end()) {
+              continue;
+            }
+            for (size_t other : find->second) {
+              const double dx = nodes[other].x - x;
+              const double dy = nodes[other].y - y;
+              if (dx * dx + dy * dy < d0 * d0) {
+                too_close = true;
+                break;
+              }
+            }
+          }
+        }
+      } while (too_close);
+
+      placed[cy * cols + cx + 1].push_back(nodes.size());
+      addNode(i, x, y);
+    }
+  } break;
+
+  default:
+    throw std::runtime_error("TOPOLOGY must be between 1 and 4");
+  }
+}
+
+void LinkLayerModel::setPathLoss(double exponent, double ref_d0, double ref_pld0) {
+  if (exponent < 0) {
+    throw std::invalid_argument("PATH_LOSS_EXPONENT must be positive");
+  }
+  if (ref_d0 <= 0) {
+    throw std::invalid_argument("D0 must be greater than zero");
+  }
+  if (ref_pld0 < 0) {
+    throw std::invalid_argument("PL_D0 must be positive");
+  }
+  pathLossExponent = exponent;
+  d0 = ref_d0;
+  pld0 = ref_pld0;
+}
+
+void LinkLayerModel::setShadowing(double sigma) {
+  if (sigma < 0) {
+    throw std::invalid_argument("SHADOWING_STANDARD_DEVIATION must be positive");
+  }
+  shadowingSigma = sigma;
+}
+
+void LinkLayerModel::setAsymmetry(double a11, double a12, double a21, double a22) {
+  if (a11 < 0 || a22 < 0) {
+    throw std::invalid_argument("S11 and S22 must be greater than or equal to 0");
+  }
+  if (a11 == 0 && a22 != 0) {
+    throw std::invalid_argument("Symmetric links require both S11 and S22 to be 0, not only S11");
+  }
+  if (a11 != 0) {
+    if (a12 != a21) {
+      throw std::invalid_argument("S12 and S21 must have the same value");
+    }
+    if (fabs(a12) > sqrt(a11 * a22)) {
+      throw std::invalid_argument("S12 (and S21) must be less than sqrt(S11 x S22)");
+    }
+  }
+  s11 = a11;
+  s12 = a12;
+  s21 = a21;
+  s22 = a22;
+}
+
+void LinkLayerModel::setNoise(double noise_floor, double white_gaussian_noise) noexcept {
+  noiseFloor = noise_floor;
+  whiteGaussianNoise = white_gaussian_noise;
+}
+
+void LinkLayerModel::setGainThreshold(double value) noexcept {
+  hasGainThreshold = true;
+  threshold = value;
+}
+
+double LinkLayerModel::gainThreshold() const noexcept {
+  if (hasGainThreshold) {
+    return threshold;
+  }
+  return noiseFloor - SIGMA_BOUND * sqrt(s11) - whiteGaussianNoise;
+}
+
+void LinkLayerModel::addNode(int node, double x, double y) {
+  if (node < 0 || node >= TOSSIM_MAX_NODES) {
+    throw std::out_of_range("Node id " + std::to_string(node) + " is outside of the TOSSIM node range");
+  }
+  nodes.push_back(Node{node, x, y});
+}
+
+size_t LinkLayerModel::numNodes() const noexcept {
+  return nodes.size();
+}
+
+double LinkLayerModel::maxLinkDistance(double gain_threshold, double max_output_power) const noexcept {
+  if (pathLossExponent == 0) {
+    return INFINITY;
+  }
+
+  // Solve -pld0 - 10 n log10(d / d0) + shadowing + output power = threshold for d
+  const double margin = -pld0 + SIGMA_BOUND * shadowingSigma + max_output_power - gain_threshold;
+
+  return d0 * pow(10.0, margin / (10.0 * pathLossExponent));
+}
+
+size_t LinkLayerModel::generate(unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gaussian(0.0, 1.0);
+
+  double t11 = 0, t12 = 0, t22 = 0;
+  if (s11 != 0) {
+    t11 = sqrt(s11);
+    t12 = s12 / sqrt(s11);
+    t22 = sqrt((s11 * s22 - s12 * s12) / s11);
+  }
+
+  // Per node noise floor and output power variation
+  std::vector<double> output_power(nodes.size());
+  double max_output_power = 0;
+
+  for (size_t i = 0; i != nodes.size(); ++i) {
+    const double rn1 = gaussian(rng);
+    const double rn2 = gaussian(rng);
+
+    sim_gain_set_noise_floor(nodes[i].id, noiseFloor + t11 * rn1, whiteGaussianNoise);
+
+    output_power[i] = t12 * rn1 + t22 * rn2;
+    max_output_power = std::max(max_output_power, output_power[i]);
+  }
+
+  const double gain_threshold = gainThreshold();
+  const double max_distance = maxLinkDistance(gain_threshold, max_output_power);
+
+  const SpatialGrid grid(nodes, max_distance);
+
+  size_t links = 0;
+
+  for (size_t i = 0; i != nodes.size(); ++i) {
+    const Node& a = nodes[i];
+
+    grid.forNeighbours(a.x, a.y, [&](size_t j) {
+      if (j <= i) {
+        return;
+      }
+
+      const Node& b = nodes[j];
+      const double dx = a.x - b.x;
+      const double dy = a.y - b.y;
+      const double dist = sqrt(dx * dx + dy * dy);
+
+      if (dist > max_distance) {
+        return;
+      }
+
+      // Nodes closer than d0 are treated as being d0 apart
+      const double pathloss = -pld0
+        - 10.0 * pathLossExponent * log10(std::max(dist, d0) / d0)
+        + gaussian(rng) * shadowingSigma;
+
+      // Asymmetric links come from the per node output power variation
+      const double gain_ab = output_power[i] + pathloss;
+      const double gain_ba = output_power[j] + pathloss;
+
+      if (gain_ab >= gain_threshold) {
+        sim_gain_add(a.id, b.id, gain_ab);
+        links += 1;
+      }
+      if (gain_ba >= gain_threshold) {
+        sim_gain_add(b.id, a.id, gain_ba);
+        links += 1;
+      }
+    });
+  }
+
+  return links;
+}
+
+size_t LinkLayerModel::save(const char* path) {
+  std::vector<binary_noise_t> noise;
+  std::vector<binary_gain_t> gains;
+
+  for (int node = 0; node != TOSSIM_MAX_NODES; ++node) {
+    const double mean = sim_gain_noise_mean(node);
+    const double range = sim_gain_noise_range(node);
+
+    if (mean != 0 || range != 0) {
+      noise.push_back(binary_noise_t{node, 0, mean, range});
+    }
+
+    for (const void* iter = sim_gain_iter(node); iter != NULL; iter = sim_gain_next(node, iter)) {
+      const gain_entry_t* entry = sim_gain_iter_get(iter);
+      gains.push_back(binary_gain_t{node, entry->mote, entry->gain});
+    }
+  }
+
+  binary_header_t header;
+  memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+  header.version = BINARY_VERSION;
+  header.noise_count = static_cast<uint32_t>(noise.size());
+  header.gain_count = gains.size();
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    throw std::runtime_error(std::string("Failed to open ") + path + " for writing");
+  }
+
+  const bool ok =
+    fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(noise.data(), sizeof(binary_noise_t), noise.size(), file) == noise.size() &&
+    fwrite(gains.data(), sizeof(binary_gain_t), gains.size(), file) == gains.size();
+
+  if (fclose(file) != 0 || !ok) {
+    throw std::runtime_error(std::string("Failed to write ") + path);
+  }
+
+  return gains.size();
+}
+
+size_t LinkLayerModel::load(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    throw std::runtime_error(std::string("Failed to open ") + path);
+  }
+
+  binary_header_t header;
+  std::vector<binary_noise_t> noise;
+  std::vector<binary_gain_t> gains;
+
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+    memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) == 0 &&
+    header.version == BINARY_VERSION;
+
+  if (ok) {
+    noise.resize(header.noise_count);
+    gains.resize(header.gain_count);
+
+    ok = fread(noise.data(), sizeof(binary_noise_t), noise.size(), file) == noise.size() &&
+         fread(gains.data(), sizeof(binary_gain_t), gains.size(), file) == gains.size();
+  }
+
+  fclose(file);
+
+  for (const binary_noise_t& n : noise) {
+    ok = ok && validNode(n.node);
+  }
+
+  for (const binary_gain_t& g : gains) {
+    ok = ok && validNode(g.src) && validNode(g.dest);
+  }
+
+  if (!ok) {
+    throw std::runtime_error(std::string(path) + " is not a valid binary topology file");
+  }
+
+  for (const binary_noise_t& n : noise) {
+    sim_gain_set_noise_floor(n.node, n.mean, n.range);
+  }
+
+  for (const binary_gain_t& g : gains) {
+    sim_gain_add(g.src, g.dest, g.gain);
+  }
+
+  return gains.size();
+}
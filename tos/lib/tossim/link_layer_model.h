@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2005 Stanford University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the
+ *   distribution.
+ * - Neither the name of the copyright holder nor the names of
+ *   its contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * Native version of the log-normal shadowing link layer model that
+ * net.tinyos.sim.LinkLayerModel implements. Instead of printing a
+ * gain file that then has to be parsed, the generated gains and noise
+ * floors are placed directly into the TOSSIM gain tables.
+ *
+ * Candidate links are found with a uniform grid whose cells are as
+ * wide as the longest distance at which a link can still be above
+ * the gain threshold, so only pairs in neighbouring cells are
+ * considered rather than all n^2 pairs.
+ *
+ * The gain tables can also be saved to and loaded from a binary file,
+ * which is much faster to load than the text "gain"/"noise" format.
+ */
+
+#ifndef LINK_LAYER_MODEL_H_INCLUDED
+#define LINK_LAYER_MODEL_H_INCLUDED
+
+#include <stddef.h>
+
+#include <vector>
+
+class LinkLayerModel {
+ public:
+  LinkLayerModel() noexcept;
+  ~LinkLayerModel() = default;
+
+  // Reads the configuration file format used by net.tinyos.sim.LinkLayerModel.
+  // The nodes described by TOPOLOGY are added to the model. An extra
+  // LINK_GAIN_THRESHOLD key sets the gain below which links are pruned.
+  void readConfig(const char* path, unsigned int seed);
+
+  void setPathLoss(double exponent, double d0, double pld0);
+  void setShadowing(double sigma);
+  void setAsymmetry(double s11, double s12, double s21, double s22);
+  void setNoise(double noise_floor, double white_gaussian_noise) noexcept;
+
+  // Links with a gain below the threshold are not added to the gain
+  // tables. Defaults to three standard deviations below the noise floor.
+  void setGainThreshold(double threshold) noexcept;
+  double gainThreshold() const noexcept;
+
+  void addNode(int node, double x, double y);
+  size_t numNodes() const noexcept;
+
+  // Generates the noise floors and link gains for all added nodes and
+  // places them in the TOSSIM gain tables. Returns the number of links added.
+  size_t generate(unsigned int seed);
+
+  // Saves / loads the current TOSSIM gain tables in a binary format.
+  // The file uses host byte order. Returns the number of links.
+  static size_t save(const char* path);
+  static size_t load(const char* path);
+
+ private:
+  struct Node {
+    int id;
+    double x;
+    double y;
+  };
+
+  void readTopologyFile(const char* path);
+  void placeNodes(int topology, int num_nodes, double grid_unit,
+                  double terrain_x, double terrain_y, unsigned int seed);
+  double maxLinkDistance(double threshold, double max_output_power) const noexcept;
+
+  std::vector<Node> nodes;
+
+  double pathLossExponent;
+  double shadowingSigma;
+  double d0;
+  double pld0;
+  double noiseFloor;
+  double whiteGaussianNoise;
+  double s11, s12, s21, s22;
+
+  bool hasGainThreshold;
+  double threshold;
+};
+
+#endif // LINK_LAYER_MODEL_H_INCLUDED
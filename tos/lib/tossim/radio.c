@@ -38,6 +38,7 @@
  */
 
 #include <radio.h>
+#include <link_layer_model.h>
 #include <sim_gain.h>
 
 void Radio::add(int src, int dest, double radio_gain) noexcept {
@@ -63,3 +64,17 @@ void Radio::setNoise(int node, double mean, double range) noexcept {
 void Radio::setSensitivity(double sensitivity) noexcept {
   sim_gain_set_sensitivity(sensitivity);
 }
+
+long long int Radio::generateLinkGains(const char* config_file, int seed) {
+  LinkLayerModel model;
+  model.readConfig(config_file, seed);
+  return model.generate(seed);
+}
+
+long long int Radio::saveTopology(const char* path) {
+  return LinkLayerModel::save(path);
+}
+
+long long int Radio::loadTopology(const char* path) {
+  return LinkLayerModel::load(path);
+}
@@ -51,6 +51,11 @@ class Radio {
   void remove(int src, int dest) noexcept;
   void setNoise(int node, double mean, double range) noexcept;
   void setSensitivity(double sensitivity) noexcept;
+
+  // See link_layer_model.h
+  long long int generateLinkGains(const char* config_file, int seed);
+  long long int saveTopology(const char* path);
+  long long int loadTopology(const char* path);
 };
 
 #endif
@@ -48,6 +48,7 @@
 
 %{
 #include <radio.h>
+#include <link_layer_model.h>
 %}
 
 class Radio {
@@ -61,5 +62,51 @@ class Radio {
   void remove(int src, int dest) noexcept;
   void setNoise(int node, double mean, double range) noexcept;
   void setSensitivity(double sensitivity) noexcept;   
+
+  %exception {
+    try {
+      $action
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+
+  long long int generateLinkGains(const char* config_file, int seed);
+  long long int saveTopology(const char* path);
+  long long int loadTopology(const char* path);
+
+  %exception;
 };
 
+
+class LinkLayerModel {
+ public:
+  LinkLayerModel() noexcept;
+  ~LinkLayerModel() = default;
+
+  %exception {
+    try {
+      $action
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+
+  void readConfig(const char* path, unsigned int seed);
+  void setPathLoss(double exponent, double d0, double pld0);
+  void setShadowing(double sigma);
+  void setAsymmetry(double s11, double s12, double s21, double s22);
+  void addNode(int node, double x, double y);
+  size_t generate(unsigned int seed);
+
+  %exception;
+
+  void setNoise(double noise_floor, double white_gaussian_noise) noexcept;
+  void setGainThreshold(double threshold) noexcept;
+  double gainThreshold() const noexcept;
+  size_t numNodes() const noexcept;
+};
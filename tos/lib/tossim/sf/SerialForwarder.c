@@ -68,3 +68,23 @@ void SerialForwarder::process ()
 {
     sim_sf_process();
 }
+
+void SerialForwarder::flush()
+{
+    sim_sf_flush();
+}
+
+void SerialForwarder::setPollInterval(sim_time_t ticks)
+{
+    sim_sf_set_poll_interval(ticks);
+}
+
+void SerialForwarder::setQueueDepth(const int frames)
+{
+    sim_sf_set_queue_depth(frames);
+}
+
+void SerialForwarder::setDisconnectSlowClients(const bool disconnect)
+{
+    sim_sf_set_overflow_policy(disconnect ? SIM_SF_DISCONNECT : SIM_SF_DROP_OLDEST);
+}
@@ -40,6 +40,8 @@
 #ifndef  _SERIALFORWARDER_H_
 #define  _SERIALFORWARDER_H_
 
+#include "sim_tossim.h"
+
 class SerialForwarder {
 
     public: 
@@ -51,6 +53,11 @@ class SerialForwarder {
     void dispatchPacket(const void *packet, const int len);
     void forwardPacket(const void *packet, const int len);
     void openServerSocket(const int port);
+    void flush();
+
+    void setPollInterval(sim_time_t ticks);
+    void setQueueDepth(const int frames);
+    void setDisconnectSlowClients(const bool disconnect);
 
 };
 #endif   // ----- #ifndef _SERIALFORWARDER_H_  ----- 
@@ -52,5 +52,10 @@ class SerialForwarder {
         void process ();
         void dispatchPacket(const void *packet, const int len);
         void forwardPacket(const void *packet, const int len);
+        void flush();
+
+        void setPollInterval(long long int ticks);
+        void setQueueDepth(const int frames);
+        void setDisconnectSlowClients(const bool disconnect);
 
 };
@@ -178,6 +178,10 @@ class SerialForwarder(_object):
     def process(*args): return _TOSSIM.SerialForwarder_process(*args)
     def dispatchPacket(*args): return _TOSSIM.SerialForwarder_dispatchPacket(*args)
     def forwardPacket(*args): return _TOSSIM.SerialForwarder_forwardPacket(*args)
+    def flush(*args): return _TOSSIM.SerialForwarder_flush(*args)
+    def setPollInterval(*args): return _TOSSIM.SerialForwarder_setPollInterval(*args)
+    def setQueueDepth(*args): return _TOSSIM.SerialForwarder_setQueueDepth(*args)
+    def setDisconnectSlowClients(*args): return _TOSSIM.SerialForwarder_setDisconnectSlowClients(*args)
 SerialForwarder_swigregister = _TOSSIM.SerialForwarder_swigregister
 SerialForwarder_swigregister(SerialForwarder)
 
@@ -195,8 +199,14 @@ class Throttle(_object):
     __del__ = lambda self : None;
     def initialize(*args): return _TOSSIM.Throttle_initialize(*args)
     def finalize(*args): return _TOSSIM.Throttle_finalize(*args)
+    def setRate(*args): return _TOSSIM.Throttle_setRate(*args)
     def checkThrottle(*args): return _TOSSIM.Throttle_checkThrottle(*args)
+    def run(*args): return _TOSSIM.Throttle_run(*args)
     def printStatistics(*args): return _TOSSIM.Throttle_printStatistics(*args)
+    def lateEvents(*args): return _TOSSIM.Throttle_lateEvents(*args)
+    def maxLag(*args): return _TOSSIM.Throttle_maxLag(*args)
+    def meanLag(*args): return _TOSSIM.Throttle_meanLag(*args)
+    def jitter(*args): return _TOSSIM.Throttle_jitter(*args)
 Throttle_swigregister = _TOSSIM.Throttle_swigregister
 Throttle_swigregister(Throttle)
 
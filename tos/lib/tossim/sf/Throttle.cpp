@@ -33,85 +33,191 @@
  * Author: Chad Metcalf
  * Date: July 9, 2007
  *
- * A simple Throttle to slow a simulation to near real time.
+ * Paces a simulation to real time, or to a multiple of real time.
  *
  */
 
+#include <math.h>
+#include <stdio.h>
+
 #include "Throttle.h"
+#include "sim_serial_forwarder.h"
+#include "sim_event_queue.h"
 
 Throttle::Throttle(Tossim* tossim, const int ms = 10) : 
-    sim(tossim), simStartTime(0.0), simEndTime(0.0), simPace(0), throttleCount(0) {
+    simStartTime(0.0), simEndTime(0.0), simStart(0), lagTolerance(0), rate(1.0),
+    started(false), sim(tossim), throttleCount(0), earlyWakeups(0),
+    eventCount(0), lateCount(0), lagSum(0.0), lagMax(0.0),
+    wakeCount(0), wakeMean(0.0), wakeM2(0.0), wakeMax(0.0) {
 
         // Convert milliseconds to sim_time_t 
-        simPace =  ms * 10000000ULL;
+        lagTolerance = ms * (sim->ticksPerSecond() / 1000);
+        wallStart.tv_sec = wallStart.tv_nsec = 0;
 }
 
 Throttle::~Throttle() {}
 
 void Throttle::initialize() {
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
     simStartTime = getTime();
+    simEndTime = 0.0;
+    simStart = sim->time();
+    started = true;
+
+    throttleCount = earlyWakeups = 0;
+    eventCount = lateCount = 0;
+    lagSum = lagMax = 0.0;
+    wakeCount = 0;
+    wakeMean = wakeM2 = wakeMax = 0.0;
 }
 
 void Throttle::finalize() {
     simEndTime = getTime();
 }
 
+void Throttle::setRate(double r) {
+    if (r <= 0.0) {
+        return;
+    }
+    // Keep the events already run on schedule at the old rate
+    if (started) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        simStart = simTimeAt(&now);
+        wallStart = now;
+    }
+    rate = r;
+}
+
+struct timespec Throttle::deadline(sim_time_t t) {
+    double offset = (double)(t - simStart) / sim->ticksPerSecond() / rate;
+    long long ns = wallStart.tv_nsec + (long long)llround(offset * 1e9);
+    struct timespec ts;
+
+    ts.tv_sec = wallStart.tv_sec + ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    if (ts.tv_nsec < 0) {
+        ts.tv_sec--;
+        ts.tv_nsec += 1000000000L;
+    }
+    return ts;
+}
+
+sim_time_t Throttle::simTimeAt(const struct timespec* now) {
+    return simStart + (sim_time_t)(difference(now, &wallStart) * rate * sim->ticksPerSecond());
+}
+
+double Throttle::difference(const struct timespec* a, const struct timespec* b) {
+    return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
 void Throttle::checkThrottle() {
-    
-    double secondsElasped = getTime() - simStartTime;
-    sim_time_t ticksElasped = (sim_time_t) secondsElasped*sim->ticksPerSecond();
 
-    sim_time_t difference = sim->time() - ticksElasped;
+    if (!started) {
+        initialize();
+    }
+
+    while (!sim_queue_is_empty()) {
+        sim_time_t next = sim_queue_peek_time();
+        struct timespec due = deadline(next);
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double late = difference(&now, &due);
+
+        if (late >= 0.0) {
+            // The simulation is behind the wall clock
+            eventCount++;
+            lagSum += late;
+            if (late > lagMax) {
+                lagMax = late;
+            }
+            if (late * sim->ticksPerSecond() > lagTolerance) {
+                lateCount++;
+            }
+            return;
+        }
 
-    if (difference > simPace) {
         throttleCount++;
-        double sleepDifference = (double) difference / sim->ticksPerSecond();
-        simSleep(sleepDifference);
+        if (sim_sf_wait(&due)) {
+            // Input from a serial forwarder client: advance the clock to
+            // now so it is delivered at the right sim time, then pick
+            // up any event it scheduled before waiting again
+            earlyWakeups++;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            sim_time_t t = simTimeAt(&now);
+            if (t > sim->time() && t < next) {
+                sim->setTime(t);
+            }
+            sim_sf_process();
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double error = difference(&now, &due);
+
+        // Running mean and variance of the wakeup error
+        wakeCount++;
+        double delta = error - wakeMean;
+        wakeMean += delta / wakeCount;
+        wakeM2 += delta * (error - wakeMean);
+        if (error > wakeMax) {
+            wakeMax = error;
+        }
+
+        eventCount++;
+        lagSum += error;
+        if (error > lagMax) {
+            lagMax = error;
+        }
+        return;
     }
+}
 
+long long int Throttle::run(double seconds) {
+    sim_time_t end = sim->time() + (sim_time_t)llround(seconds * sim->ticksPerSecond());
+    long long int count = 0;
+
+    while (!sim_queue_is_empty() && sim_queue_peek_time() <= end) {
+        checkThrottle();
+        if (!sim->runNextEvent()) {
+            break;
+        }
+        sim_sf_process();
+        count++;
+    }
+    return count;
 }
 
-inline double Throttle::toDouble(struct timeval* tv) {
-    return tv->tv_sec + tv->tv_usec/1e6;
+unsigned long Throttle::lateEvents() {
+    return lateCount;
 }
 
-double Throttle::getTime() {
-    struct timeval tv;
-    gettimeofday (&tv, NULL);
-    return toDouble(&tv);  
+double Throttle::maxLag() {
+    return lagMax;
 }
 
-int Throttle::simSleep(double seconds) {
-
-     struct timespec tv;
-     /* Construct the timespec from the number of whole seconds... */
-     tv.tv_sec = (time_t) seconds;
-     /* ... and the remainder in nanoseconds. */
-     tv.tv_nsec = (long) ((seconds - tv.tv_sec) * 1e+9);
-
-     while (1)
-     {
-         /* Sleep for the time specified in tv. If interrupted by a
-         signal, place the remaining time left to sleep back into tv. */
-         int rval = nanosleep (&tv, &tv);
-
-         if (rval == 0)
-             /* Completed the entire sleep time; all done. */
-             return 0;
-         else if (errno == EINTR)
-             /* Interrupted by a signal. Try again. */
-             continue;
-         else 
-             /* Some other error; bail out. */
-             return rval;
-     }
-
-     return 0;
+double Throttle::meanLag() {
+    return eventCount > 0 ? lagSum / eventCount : 0.0;
+}
+
+double Throttle::jitter() {
+    return wakeCount > 1 ? sqrt(wakeM2 / (wakeCount - 1)) : 0.0;
+}
+
+double Throttle::getTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 void Throttle::printStatistics() {
 
     printf("Number of throttle events %lu\n", throttleCount);
+    printf("Woken early by the serial forwarder %lu\n", earlyWakeups);
+    printf("Late events %lu of %lu\n", lateCount, eventCount);
+    printf("Lag mean %.6f max %.6f\n", meanLag(), maxLag());
+    printf("Wakeup jitter %.6f max %.6f\n", jitter(), wakeMax);
 
     if (simEndTime > 0.0) {
         printf("Total Sim Time: %.6f\n", simEndTime - simStartTime);
@@ -33,7 +33,13 @@
  * Author: Chad Metcalf
  * Date: July 9, 2007
  *
- * A simple Throttle to slow a simulation to near real time.
+ * Paces a simulation to real time, or to a multiple of real time.
+ *
+ * Each event is given a wall clock deadline from its sim time and the
+ * throttle sleeps until that deadline with an absolute CLOCK_MONOTONIC
+ * sleep, so errors do not accumulate over a run. While sleeping it
+ * wakes early if a serial forwarder client connects or sends a packet,
+ * and the packet is injected at the sim time matching the wall clock.
  *
  */
 #ifndef  _THROTTLE_H_
@@ -42,34 +48,66 @@
 
 #include <errno.h>
 #include <time.h>
-#include <sys/time.h>
 #include "tossim.h"
 
 class Throttle {
 
     public:
 
+        // Events that start more than ms milliseconds after their
+        // deadline are counted as late.
         Throttle(Tossim* tossim, const int ms);
         ~Throttle();
 
         void initialize();
         void finalize();
 
+        // Simulated seconds per wall clock second, 1.0 by default
+        void setRate(double rate);
+
+        // Sleeps until the next event is due
         void checkThrottle();
+
+        // Runs paced events for the given number of simulated seconds,
+        // processing the serial forwarder after each one. Returns the
+        // number of events run.
+        long long int run(double seconds);
+
         void printStatistics();
 
+        unsigned long lateEvents();
+        double maxLag();        // seconds
+        double meanLag();       // seconds
+        double jitter();        // standard deviation of wakeup error, seconds
+
     private:
 
+        struct timespec wallStart;
         double simStartTime;
         double simEndTime;
-        sim_time_t simPace;
+        sim_time_t simStart;
+        sim_time_t lagTolerance;
+        double rate;
+        bool started;
 
         Tossim* sim;
 
         unsigned long throttleCount;
+        unsigned long earlyWakeups;
+
+        unsigned long eventCount;
+        unsigned long lateCount;
+        double lagSum;
+        double lagMax;
+
+        unsigned long wakeCount;
+        double wakeMean;
+        double wakeM2;
+        double wakeMax;
 
         double getTime();
-        double toDouble(struct timeval* tv);
-        int simSleep(double seconds);
+        struct timespec deadline(sim_time_t t);
+        sim_time_t simTimeAt(const struct timespec* now);
+        static double difference(const struct timespec* a, const struct timespec* b);
 };
 #endif   // ----- #ifndef _THROTTLE_H_  ----- 
@@ -54,7 +54,16 @@ class Throttle {
         void initialize();
         void finalize();
 
+        void setRate(double rate);
+
         void checkThrottle();
+        long long int run(double seconds);
+
         void printStatistics();
 
+        unsigned long lateEvents();
+        double maxLag();
+        double meanLag();
+        double jitter();
+
 };
@@ -75,9 +75,7 @@ int main() {
 sf.process();
 
  throttle.initialize();
- while(t->time() < 600 * t->ticksPerSecond()) {
-   throttle.checkThrottle();
-   sf.process();
-   t->runNextEvent();
- }
+ throttle.run(600);
+ throttle.finalize();
+ throttle.printStatistics();
 }
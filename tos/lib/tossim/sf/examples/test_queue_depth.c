@@ -0,0 +1,131 @@
+/*
+ * Checks that a client whose queue overflows while a frame is half
+ * written still receives whole frames. The forwarder is asked for a
+ * queue depth of 1 and the client takes fewer bytes per write than
+ * the packets dispatched meanwhile.
+ *
+ * Built without the rest of TOSSIM, from this directory:
+ *   g++ -I.. -I../.. -o test_queue_depth test_queue_depth.c ../sim_serial_forwarder.c
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_serial_forwarder.h"
+#include "sim_serial_packet.h"
+
+#define PORT       9123
+#define PKT_LEN    200
+#define PACKETS    2000
+#define SLOW_BYTES 37
+
+extern struct sim_sf_client_list *sim_sf_clients;
+
+/* A slow client: the socket takes at most SLOW_BYTES per write, so
+   most writes end in the middle of a frame */
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int count)
+{
+    return write(fd, iov[0].iov_base, iov[0].iov_len < SLOW_BYTES ? iov[0].iov_len : SLOW_BYTES);
+}
+
+/* The parts of TOSSIM the forwarder calls */
+sim_time_t sim_time(void) { return 0; }
+uint16_t sim_serial_packet_destination(sim_serial_packet_t *msg) { return 0; }
+void sim_serial_packet_deliver(int node, sim_serial_packet_t *msg, sim_time_t t) {}
+
+static void make_packet(unsigned char *p, unsigned int seq)
+{
+    int i;
+
+    for (i = 0; i < PKT_LEN; i++)
+        p[i] = seq * 31 + i;
+    memcpy(p, &seq, sizeof seq);
+}
+
+int main(void)
+{
+    struct sockaddr_in addr;
+    unsigned char pkt[PKT_LEN], expect[PKT_LEN], *stream;
+    unsigned int seq, last = 0;
+    int fd, i, n, len = 0, midframe = 0, frames = 0, errors = 0;
+
+    sim_sf_set_queue_depth(1);
+    sim_sf_open_server_socket(PORT);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        return 2;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    write(fd, "U ", 2);
+    for (i = 0; i < 100 && !(sim_sf_clients && sim_sf_clients->state); i++)
+    {
+        usleep(1000);
+        sim_sf_process();
+    }
+    if (!sim_sf_clients || !sim_sf_clients->state)
+    {
+        fprintf(stderr, "handshake failed\n");
+        return 2;
+    }
+
+    /* Packets come in faster than the client takes them, so the queue
+       overflows, often with the head frame partly written */
+    stream = (unsigned char *)malloc(PACKETS * (PKT_LEN + 2) + 2);
+    for (seq = 1; seq <= PACKETS; seq++)
+    {
+        make_packet(pkt, seq);
+        if (sim_sf_clients->head_sent > 0 &&
+            sim_sf_clients->queue_count == sim_sf_clients->queue_size)
+            midframe++;
+        sim_sf_dispatch_packet(pkt, PKT_LEN);
+        sim_sf_flush();
+        while ((n = read(fd, stream + len, 4096)) > 0)
+            len += n;
+    }
+
+    /* Then it catches up */
+    for (i = 0; i < 1000 && sim_sf_clients->queue_count > 0; i++)
+        sim_sf_flush();
+    usleep(10000);
+    while ((n = read(fd, stream + len, 4096)) > 0)
+        len += n;
+
+    if (len < 2 || stream[0] != 'U')
+        errors++;
+    for (i = 2; i < len && !errors; i += 1 + stream[i])
+    {
+        /* every frame whole, in order and undamaged */
+        memcpy(&seq, stream + i + 2, sizeof seq);
+        make_packet(expect, seq);
+        if (stream[i] != PKT_LEN + 1 || i + 1 + stream[i] > len || stream[i + 1] != 0 ||
+            seq <= last || memcmp(stream + i + 2, expect, PKT_LEN) != 0)
+            errors++;
+        last = seq;
+        frames++;
+    }
+
+    printf("%d frames received, %d dropped, %d overflows mid-frame\n",
+           frames, sim_sf_clients->dropped, midframe);
+    if (errors || midframe == 0)
+    {
+        printf("FAILED: %s\n", errors ? "framing lost" : "no overflow mid-frame");
+        return 1;
+    }
+    return 0;
+}
@@ -35,10 +35,18 @@
  *
  * The serial forwarder for TOSSIM
  *
+ * Clients are non-blocking and are watched with epoll (poll on
+ * platforms without it). Packets dispatched to the clients are queued
+ * in a bounded per-client queue and written out in batches with
+ * writev, so a slow client never stalls the simulation. When a
+ * client's queue is full either its oldest queued packet is dropped or
+ * the client is disconnected, see sim_sf_set_overflow_policy().
+ *
  */
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <errno.h>
@@ -48,14 +56,37 @@
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
 
 #include "sim_serial_forwarder.h"
 #include "sim_serial_packet.h"
 #include "sim_tossim.h"
 
+/* Frames handed to writev in one call */
+#define SIM_SF_IOV_MAX 64
+/* Readiness events handled per sim_sf_process() */
+#define SIM_SF_MAX_EVENTS 64
+
+enum {
+    SIM_SF_CLIENT_VERSION,      /* waiting for the client's "U " */
+    SIM_SF_CLIENT_READY,
+};
+
 struct sim_sf_client_list *sim_sf_clients;
-int sim_sf_server_socket;
+int sim_sf_server_socket = -1;
 int sim_sf_packets_read, sim_sf_packets_written, sim_sf_num_clients;
+int sim_sf_packets_dropped;
+
+static int sim_sf_poll_fd = -1;
+static int sim_sf_queue_depth = SIM_SF_DEFAULT_QUEUE_DEPTH;
+static int sim_sf_overflow_policy = SIM_SF_DROP_OLDEST;
+static sim_time_t sim_sf_poll_interval = 0;
+static sim_time_t sim_sf_next_poll = 0;
 
 int sim_sf_unix_check(const char *msg, int result)
 {
@@ -80,29 +111,175 @@ void *sim_sf_xmalloc(size_t s)
     return p;
 }
 
-void sim_sf_fd_wait(fd_set *fds, int *maxfd, int fd)
+void sim_sf_pstatus(void)
 {
-    if (fd > *maxfd)
-        *maxfd = fd;
-    FD_SET(fd, fds);
+    printf("clients %d, read %d, wrote %d, dropped %d\n", sim_sf_num_clients,
+           sim_sf_packets_read, sim_sf_packets_written, sim_sf_packets_dropped);
 }
 
-void sim_sf_pstatus(void)
+void sim_sf_set_poll_interval(sim_time_t ticks)
+{
+    sim_sf_poll_interval = ticks > 0 ? ticks : 0;
+    sim_sf_next_poll = 0;
+}
+
+void sim_sf_set_queue_depth(int frames)
+{
+    /* Only affects clients that connect afterwards. A partially
+       written frame keeps its slot, so at least one more is needed
+       for the frames behind it. */
+    sim_sf_queue_depth = frames > 2 ? frames : 2;
+}
+
+void sim_sf_set_overflow_policy(int policy)
+{
+    sim_sf_overflow_policy = policy;
+}
+
+/* Readiness notification. Client events carry the client, the server
+   socket carries NULL. */
+
+#ifdef __linux__
+
+static void sim_sf_poll_init(void)
+{
+    if (sim_sf_poll_fd < 0)
+        sim_sf_poll_fd = sim_sf_unix_check("epoll_create", epoll_create(16));
+}
+
+static void sim_sf_poll_ctl(int op, int fd, void *data, int writable)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+    ev.data.ptr = data;
+    epoll_ctl(sim_sf_poll_fd, op, fd, &ev);
+}
+
+static void sim_sf_poll_add(int fd, void *data)
 {
-    printf("clients %d, read %d, wrote %d\n", sim_sf_num_clients, sim_sf_packets_read,
-           sim_sf_packets_written);
+    sim_sf_poll_ctl(EPOLL_CTL_ADD, fd, data, 0);
 }
 
+static void sim_sf_poll_del(int fd)
+{
+    struct epoll_event ev;
+
+    /* Kernels before 2.6.9 want a non-NULL event */
+    epoll_ctl(sim_sf_poll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+static void sim_sf_poll_writable(struct sim_sf_client_list *c, int writable)
+{
+    if (c->want_write != writable)
+    {
+        c->want_write = writable;
+        sim_sf_poll_ctl(EPOLL_CTL_MOD, c->fd, c, writable);
+    }
+}
+
+static int sim_sf_poll_wait(void **ready, int *events, int max)
+{
+    struct epoll_event ev[SIM_SF_MAX_EVENTS];
+    int i, n;
+
+    if (max > SIM_SF_MAX_EVENTS)
+        max = SIM_SF_MAX_EVENTS;
+
+    do
+        n = epoll_wait(sim_sf_poll_fd, ev, max, 0);
+    while (n < 0 && errno == EINTR);
+
+    for (i = 0; i < n; i++)
+    {
+        ready[i] = ev[i].data.ptr;
+        events[i] = 0;
+        if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            events[i] |= SIM_SF_READABLE;
+        if (ev[i].events & EPOLLOUT)
+            events[i] |= SIM_SF_WRITABLE;
+    }
+    return n;
+}
+
+#else
+
+static void sim_sf_poll_init(void)
+{
+}
+
+static void sim_sf_poll_add(int fd, void *data)
+{
+}
+
+static void sim_sf_poll_del(int fd)
+{
+}
+
+static void sim_sf_poll_writable(struct sim_sf_client_list *c, int writable)
+{
+    c->want_write = writable;
+}
+
+static int sim_sf_poll_wait(void **ready, int *events, int max)
+{
+    struct pollfd fds[SIM_SF_MAX_EVENTS];
+    void *data[SIM_SF_MAX_EVENTS];
+    struct sim_sf_client_list *c;
+    int i, n = 0, count = 0;
+
+    if (max > SIM_SF_MAX_EVENTS)
+        max = SIM_SF_MAX_EVENTS;
+
+    if (sim_sf_server_socket >= 0)
+    {
+        fds[n].fd = sim_sf_server_socket;
+        fds[n].events = POLLIN;
+        data[n++] = NULL;
+    }
+    for (c = sim_sf_clients; c && n < max; c = c->next)
+    {
+        fds[n].fd = c->fd;
+        fds[n].events = POLLIN | (c->want_write ? POLLOUT : 0);
+        data[n++] = c;
+    }
+
+    if (poll(fds, n, 0) <= 0)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        if (fds[i].revents)
+        {
+            ready[count] = data[i];
+            events[count] = 0;
+            if (fds[i].revents & (POLLIN | POLLERR | POLLHUP))
+                events[count] |= SIM_SF_READABLE;
+            if (fds[i].revents & POLLOUT)
+                events[count] |= SIM_SF_WRITABLE;
+            count++;
+        }
+    return count;
+}
+
+#endif
+
 void sim_sf_add_client(int fd)
 {
     struct sim_sf_client_list *c = (struct sim_sf_client_list*)sim_sf_xmalloc(sizeof *c);
 
+    memset(c, 0, sizeof *c);
+    c->fd = fd;
+    c->state = SIM_SF_CLIENT_VERSION;
+    c->queue_size = sim_sf_queue_depth;
+    c->queue = (struct sim_sf_frame*)sim_sf_xmalloc(c->queue_size * sizeof *c->queue);
+
     c->next = sim_sf_clients;
     sim_sf_clients = c;
     sim_sf_num_clients++;
     sim_sf_pstatus();
 
-    c->fd = fd;
+    sim_sf_poll_add(fd, c);
 }
 
 void sim_sf_rem_client(struct sim_sf_client_list **c)
@@ -112,75 +289,261 @@ void sim_sf_rem_client(struct sim_sf_client_list **c)
     *c = dead->next;
     sim_sf_num_clients--;
     sim_sf_pstatus();
+    sim_sf_poll_del(dead->fd);
     close(dead->fd);
+    free(dead->queue);
     free(dead);
 }
 
+static void sim_sf_remove_dead_clients(void)
+{
+    struct sim_sf_client_list **c;
+
+    for (c = &sim_sf_clients; *c; )
+        if ((*c)->dead)
+            sim_sf_rem_client(c);
+        else
+            c = &(*c)->next;
+}
+
+/* Writes out as much of c's queue as the socket takes */
+static void sim_sf_client_flush(struct sim_sf_client_list *c)
+{
+    struct iovec iov[SIM_SF_IOV_MAX];
+    int i, n, count;
+
+    while (c->queue_count > 0 && !c->dead)
+    {
+        count = c->queue_count < SIM_SF_IOV_MAX ? c->queue_count : SIM_SF_IOV_MAX;
+        for (i = 0; i < count; i++)
+        {
+            struct sim_sf_frame *f = &c->queue[(c->queue_head + i) % c->queue_size];
+            int skip = i == 0 ? c->head_sent : 0;
+
+            iov[i].iov_base = f->data + skip;
+            iov[i].iov_len = f->size - skip;
+        }
+
+        n = writev(c->fd, iov, count);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                c->dead = 1;
+            break;
+        }
+
+        /* Retire the frames that went out completely */
+        n += c->head_sent;
+        while (c->queue_count > 0 && n >= c->queue[c->queue_head].size)
+        {
+            if (c->queue[c->queue_head].packet)
+                sim_sf_packets_written++;
+            n -= c->queue[c->queue_head].size;
+            c->queue_head = (c->queue_head + 1) % c->queue_size;
+            c->queue_count--;
+        }
+        c->head_sent = n;
+        if (n > 0)
+            break;  /* short write, the socket is full */
+    }
+
+    if (!c->dead)
+        sim_sf_poll_writable(c, c->queue_count > 0);
+}
+
+static void sim_sf_client_queue(struct sim_sf_client_list *c, const unsigned char *data,
+                                int size, int packet)
+{
+    struct sim_sf_frame *f;
+
+    if (c->queue_count == c->queue_size)
+    {
+        if (sim_sf_overflow_policy == SIM_SF_DISCONNECT)
+        {
+            c->dead = 1;
+            return;
+        }
+
+        /* Drop the oldest frame that has not started going out. A
+           partially written head frame has to be finished first or the
+           stream would lose framing, so move it up over its successor. */
+        if (c->head_sent > 0)
+        {
+            int next = (c->queue_head + 1) % c->queue_size;
+            c->queue[next] = c->queue[c->queue_head];
+            c->queue_head = next;
+        }
+        else
+        {
+            c->queue_head = (c->queue_head + 1) % c->queue_size;
+            c->head_sent = 0;
+        }
+        c->queue_count--;
+        c->dropped++;
+        sim_sf_packets_dropped++;
+    }
+
+    f = &c->queue[(c->queue_head + c->queue_count) % c->queue_size];
+    memcpy(f->data, data, size);
+    f->size = size;
+    f->packet = packet;
+    c->queue_count++;
+}
+
 void sim_sf_new_client(int fd)
 {
-    fcntl(fd, F_SETFL, 0);
-    if (sim_sf_init_source(fd) < 0)
-        close(fd);
-    else
-        sim_sf_add_client(fd);
+    static const unsigned char us[2] = { 'U', ' ' };
+    struct sim_sf_client_list *c;
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    sim_sf_add_client(fd);
+
+    /* Send our half of the version handshake; the client's half is
+       checked when it arrives */
+    c = sim_sf_clients;
+    sim_sf_client_queue(c, us, sizeof us, 0);
+    sim_sf_client_flush(c);
 }
 
-void sim_sf_check_clients(fd_set *fds)
+/* Consumes the complete handshake and packets in c's input buffer */
+static void sim_sf_client_parse(struct sim_sf_client_list *c)
 {
-    struct sim_sf_client_list **c;
+    int used = 0;
 
-    for (c = &sim_sf_clients; *c; )
+    if (c->state == SIM_SF_CLIENT_VERSION)
     {
-        int isNext = 1;
+        if (c->in_len < 2)
+            return;
 
-        if (FD_ISSET((*c)->fd, fds))
+        /* Only version ' ' exists; a client with a later version drops
+           back to ours */
+        if (c->in[0] != 'U' || c->in[1] < ' ')
         {
-            int len;
-            const void *packet = sim_sf_read_packet((*c)->fd, &len);
-
-            if (packet)
-            {
-                sim_sf_forward_packet(packet, len);
-                free((void *)packet);
-            }
-            else
-            {
-                sim_sf_rem_client(c);
-                isNext = 0;
-            }
+            c->dead = 1;
+            return;
         }
-        if (isNext)
-            c = &(*c)->next;
+        c->state = SIM_SF_CLIENT_READY;
+        used = 2;
+    }
+
+    while (c->in_len - used >= 1 && c->in_len - used >= 1 + c->in[used])
+    {
+        int len = c->in[used];
+
+        if (len > 0)
+            sim_sf_forward_packet(c->in + used + 1, len);
+        used += 1 + len;
     }
+
+    memmove(c->in, c->in + used, c->in_len - used);
+    c->in_len -= used;
 }
 
-void sim_sf_wait_clients(fd_set *fds, int *maxfd)
+static void sim_sf_client_read(struct sim_sf_client_list *c)
+{
+    while (!c->dead)
+    {
+        int n = read(c->fd, c->in + c->in_len, sizeof c->in - c->in_len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                c->dead = 1;
+            return;
+        }
+        if (n == 0)
+        {
+            c->dead = 1;
+            return;
+        }
+
+        c->in_len += n;
+        sim_sf_client_parse(c);
+    }
+}
+
+void sim_sf_flush(void)
 {
     struct sim_sf_client_list *c;
 
     for (c = sim_sf_clients; c; c = c->next)
-        sim_sf_fd_wait(fds, maxfd, c->fd);
+        if (c->queue_count > 0)
+            sim_sf_client_flush(c);
+    sim_sf_remove_dead_clients();
 }
 
 void sim_sf_dispatch_packet(const void *packet, int len)
 {
-    struct sim_sf_client_list **c;
+    struct sim_sf_client_list *c;
+    unsigned char frame[SIM_SF_MAX_FRAME];
 
-    char* dispatchPacket = (char*) sim_sf_xmalloc(len+1);
-    
-    memset(dispatchPacket, 0, len+1);
-    memcpy(dispatchPacket+1, packet, len);
+    /* The length byte counts the leading dispatch byte too */
+    if (len > SIM_SF_MAX_FRAME - 2)
+        len = SIM_SF_MAX_FRAME - 2;
+    frame[0] = len + 1;
+    frame[1] = 0;
+    memcpy(frame + 2, packet, len);
 
-    for (c = &sim_sf_clients; *c; )
-        if (sim_sf_write_packet((*c)->fd, dispatchPacket, len+1) >= 0)
+    for (c = sim_sf_clients; c; c = c->next)
+        if (c->state == SIM_SF_CLIENT_READY && !c->dead)
         {
-            sim_sf_packets_written++;
-            c = &(*c)->next;
+            sim_sf_client_queue(c, frame, len + 2, 1);
+
+            /* Let a batch build up between polls, but do not sit on a
+               large backlog until the next one */
+            if (c->queue_count >= SIM_SF_IOV_MAX)
+                sim_sf_client_flush(c);
         }
-        else
-            sim_sf_rem_client(c);
 
-    free(dispatchPacket);
+    sim_sf_remove_dead_clients();
+}
+
+int sim_sf_wait(const struct timespec *deadline)
+{
+#ifdef __linux__
+    /* Clients are only watched when sim_sf_process() would look at
+       them, otherwise pending input would wake us over and over */
+    if (sim_sf_server_socket >= 0 && sim_time() >= sim_sf_next_poll)
+    {
+        struct epoll_event ev;
+        struct timespec now;
+        long long ns;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ns = (deadline->tv_sec - now.tv_sec) * 1000000000LL + (deadline->tv_nsec - now.tv_nsec);
+
+        /* epoll only has millisecond resolution, so wait for the whole
+           milliseconds and sleep the remainder below */
+        if (ns >= 1000000 && epoll_wait(sim_sf_poll_fd, &ev, 1, ns / 1000000) > 0)
+            return 1;
+    }
+#endif
+
+#ifdef __APPLE__
+    for (;;)
+    {
+        struct timespec now, rem;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        rem.tv_sec = deadline->tv_sec - now.tv_sec;
+        rem.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (rem.tv_nsec < 0)
+        {
+            rem.tv_sec--;
+            rem.tv_nsec += 1000000000L;
+        }
+        if (rem.tv_sec < 0 || nanosleep(&rem, NULL) == 0)
+            break;
+    }
+#else
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR)
+        ;
+#endif
+    return 0;
 }
 
 void sim_sf_open_server_socket(int port)
@@ -188,6 +551,8 @@ void sim_sf_open_server_socket(int port)
     struct sockaddr_in me;
     int opt;
 
+    sim_sf_poll_init();
+
     sim_sf_server_socket = sim_sf_unix_check("socket", socket(AF_INET, SOCK_STREAM, 0));
     sim_sf_unix_check("socket", fcntl(sim_sf_server_socket, F_SETFL, O_NONBLOCK));
     memset(&me, 0, sizeof me);
@@ -200,14 +565,24 @@ void sim_sf_open_server_socket(int port)
 
     sim_sf_unix_check("bind", bind(sim_sf_server_socket, (struct sockaddr *)&me, sizeof me));
     sim_sf_unix_check("listen", listen(sim_sf_server_socket, 5));
+
+    sim_sf_poll_add(sim_sf_server_socket, NULL);
 }
 
 void sim_sf_check_new_client(void)
 {
-    int clientfd = accept(sim_sf_server_socket, NULL, NULL);
+    for (;;)
+    {
+        int clientfd = accept(sim_sf_server_socket, NULL, NULL);
 
-    if (clientfd >= 0)
+        if (clientfd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
         sim_sf_new_client(clientfd);
+    }
 }
 
 void sim_sf_forward_packet(const void *packet, int len)
@@ -224,26 +599,32 @@ void sim_sf_forward_packet(const void *packet, int len)
 
 void sim_sf_process ()
 {
+    void *ready[SIM_SF_MAX_EVENTS];
+    int events[SIM_SF_MAX_EVENTS];
+    int i, n;
+    sim_time_t now = sim_time();
 
-        fd_set rfds;
-        int maxfd = -1;
-        struct timeval zero;
-        int ret;
+    if (sim_sf_server_socket < 0 || now < sim_sf_next_poll)
+        return;
+    sim_sf_next_poll = now + sim_sf_poll_interval;
 
-        zero.tv_sec = zero.tv_usec = 0;
-
-        FD_ZERO(&rfds);
-        sim_sf_fd_wait(&rfds, &maxfd, sim_sf_server_socket);
-        sim_sf_wait_clients(&rfds, &maxfd);
+    n = sim_sf_poll_wait(ready, events, SIM_SF_MAX_EVENTS);
+    for (i = 0; i < n; i++)
+    {
+        struct sim_sf_client_list *c = (struct sim_sf_client_list*)ready[i];
 
-        ret = select(maxfd + 1, &rfds, NULL, NULL, &zero);
-        if (ret >= 0)
+        if (!c)
+            sim_sf_check_new_client();
+        else if (!c->dead)
         {
-            if (FD_ISSET(sim_sf_server_socket, &rfds))
-                sim_sf_check_new_client();
-
-            sim_sf_check_clients(&rfds);
+            if (events[i] & SIM_SF_READABLE)
+                sim_sf_client_read(c);
         }
+    }
+
+    /* Writes everything queued since the last poll, including clients
+       that just became writable again */
+    sim_sf_flush();
 }
 
 int sim_sf_saferead(int fd, void *buffer, int count)
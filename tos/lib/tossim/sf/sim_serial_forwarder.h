@@ -40,31 +40,79 @@
 #ifndef  _SIM_SERIAL_FORWARDER_H_
 #define  _SIM_SERIAL_FORWARDER_H_
 #include <sys/types.h>
+#include <time.h>
+
+#include "sim_tossim.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Largest frame on the wire: the length byte and up to 255 bytes */
+#define SIM_SF_MAX_FRAME 256
+/* Default number of frames queued for each client */
+#define SIM_SF_DEFAULT_QUEUE_DEPTH 1024
+
+/* What to do when a client's queue is full */
+enum {
+    SIM_SF_DROP_OLDEST,     /* drop the client's oldest queued packet */
+    SIM_SF_DISCONNECT,      /* disconnect the client */
+};
+
+enum {
+    SIM_SF_READABLE = 1,
+    SIM_SF_WRITABLE = 2,
+};
+
+struct sim_sf_frame
+{
+    unsigned char data[SIM_SF_MAX_FRAME];
+    short size;
+    short packet;           /* counts as a written packet when sent */
+};
+
 struct sim_sf_client_list
 {
     struct sim_sf_client_list *next;
     int fd;
+    int state;
+    int dead;
+    int want_write;
+
+    /* Bytes received but not yet forwarded; holds a full frame */
+    unsigned char in[2 * SIM_SF_MAX_FRAME];
+    int in_len;
+
+    /* Ring of frames waiting to be written */
+    struct sim_sf_frame *queue;
+    int queue_size, queue_head, queue_count;
+    int head_sent;          /* bytes of the head frame already written */
+    int dropped;
 };
 
 void sim_sf_forward_packet(const void *packet, int len);
 void sim_sf_dispatch_packet(const void *packet, int len);
 void sim_sf_open_server_socket(int port);
 void sim_sf_process ();
+void sim_sf_flush(void);
+
+/* Clients are only polled once every interval ticks of sim time (0: on
+   every call to sim_sf_process) */
+void sim_sf_set_poll_interval(sim_time_t ticks);
+/* Frames queued for each client that connects afterwards, at least 2 */
+void sim_sf_set_queue_depth(int frames);
+void sim_sf_set_overflow_policy(int policy);
+
+/* Sleeps until the CLOCK_MONOTONIC time deadline, or until a client
+   connects or sends data. Returns 1 if woken early, 0 otherwise. */
+int sim_sf_wait(const struct timespec *deadline);
 
 int sim_sf_unix_check(const char *msg, int result);
 void *sim_sf_xmalloc(size_t s);
-void sim_sf_fd_wait(fd_set *fds, int *maxfd, int fd);
 void sim_sf_pstatus(void);
 void sim_sf_add_client(int fd);
 void sim_sf_rem_client(struct sim_sf_client_list **c);
 void sim_sf_new_client(int fd);
-void sim_sf_check_clients(fd_set *fds);
-void sim_sf_wait_clients(fd_set *fds, int *maxfd);
 void sim_sf_check_new_client(void);
 void sim_sf_forward_packet(const void *packet, int len);
 int sim_sf_saferead(int fd, void *buffer, int count);
@@ -42,9 +42,11 @@
 #include <sim_event_queue.h>
 
 static heap_t eventHeap;
+static int eventHeapPeak;
 
 void sim_queue_init(void) __attribute__ ((C, spontaneous)) {
   init_heap(&eventHeap);
+  eventHeapPeak = 0;
 }
 
 void sim_queue_free(void) __attribute__ ((C, spontaneous)) {
@@ -54,6 +56,10 @@ void sim_queue_free(void) __attribute__ ((C, spontaneous)) {
 void sim_queue_insert(sim_event_t* event) __attribute__ ((C, spontaneous)) {
   //dbg("Queue", "Inserting 0x%p\n", event);
   heap_insert(&eventHeap, event, event->time);
+
+  if (heap_size(&eventHeap) > eventHeapPeak) {
+    eventHeapPeak = heap_size(&eventHeap);
+  }
 }
 
 sim_event_t* sim_queue_pop(void) __attribute__ ((C, spontaneous)) {
@@ -64,6 +70,15 @@ bool sim_queue_is_empty(void) __attribute__ ((C, spontaneous)) {
   return heap_is_empty(&eventHeap);
 }
 
+int sim_queue_size(void) __attribute__ ((C, spontaneous)) {
+  return heap_size(&eventHeap);
+}
+
+// The largest number of events that have been queued at once
+int sim_queue_peak_size(void) __attribute__ ((C, spontaneous)) {
+  return eventHeapPeak;
+}
+
 long long int sim_queue_peek_time(void) __attribute__ ((C, spontaneous)) {
   // If the heap is empty this returns -1
   return heap_get_min_key(&eventHeap);
@@ -47,6 +47,10 @@
 
 #include <sim_tossim.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 struct sim_event;
 typedef struct sim_event sim_event_t;
 
@@ -72,6 +76,8 @@ void sim_queue_free(void) __attribute__ ((cold));
 
 void sim_queue_insert(sim_event_t* event);
 bool sim_queue_is_empty(void);
+int sim_queue_size(void);
+int sim_queue_peak_size(void);
 long long int sim_queue_peek_time(void);
 sim_event_t* sim_queue_pop(void);
 
@@ -80,5 +86,8 @@ void sim_queue_cleanup_event(sim_event_t* e);
 void sim_queue_cleanup_data(sim_event_t* e) ;
 void sim_queue_cleanup_total(sim_event_t* e);
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif // EVENT_QUEUE_H_INCLUDED
@@ -56,7 +56,7 @@ void sim_gain_free(void) __attribute__ ((C, spontaneous)) {
 // To maintain backwards compatibility we need to iterate in reverse
 
 const void* sim_gain_iter(int src) __attribute__ ((C, spontaneous)) {
-  if (src > TOSSIM_MAX_NODES) {
+  if (src >= TOSSIM_MAX_NODES) {
     return NULL;
   }
 
@@ -75,7 +75,7 @@ void sim_gain_add(int src, int dest, double gain) __attribute__ ((C, spontaneous
   gain_entry_t* item;
 
   const int temp = sim_node();
-  if (src > TOSSIM_MAX_NODES) {
+  if (src >= TOSSIM_MAX_NODES) {
     return;
   }
   sim_set_node(src);
@@ -119,7 +119,7 @@ void sim_gain_remove(int src, int dest) __attribute__ ((C, spontaneous)) {
 
   const int temp = sim_node();
   
-  if (src > TOSSIM_MAX_NODES) {
+  if (src >= TOSSIM_MAX_NODES) {
     return;
   }
 
@@ -142,14 +142,14 @@ void sim_gain_set_noise_floor(int node, double mean, double range) __attribute__
   localNoise[node].range = range;
 }
 
-double sim_gain_noise_mean(int node) {
+double sim_gain_noise_mean(int node) __attribute__ ((C, spontaneous)) {
   if (node >= TOSSIM_MAX_NODES) {
     return NAN;
   }
   return localNoise[node].mean;
 }
 
-double sim_gain_noise_range(int node) {
+double sim_gain_noise_range(int node) __attribute__ ((C, spontaneous)) {
   if (node >= TOSSIM_MAX_NODES) {
     return NAN;
   }
@@ -55,6 +55,7 @@
 
 #include <mac.c>
 #include <radio.c>
+#include <link_layer_model.c>
 #include <packet.c>
 
 uint16_t TOS_NODE_ID = 1;
@@ -397,6 +398,14 @@ bool Tossim::runNextEvent() {
   return sim_run_next_event();
 }
 
+int Tossim::eventQueueSize() const noexcept {
+  return sim_queue_size();
+}
+
+int Tossim::eventQueuePeakSize() const noexcept {
+  return sim_queue_peak_size();
+}
+
 void Tossim::triggerRunDurationStart() {
   if (!duration_started)
   {
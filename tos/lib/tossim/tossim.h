@@ -159,6 +159,9 @@ class Tossim {
   
   bool runNextEvent();
 
+  int eventQueueSize() const noexcept;
+  int eventQueuePeakSize() const noexcept;
+
   void triggerRunDurationStart();
 
   long long int runAllEventsWithTriggeredMaxTime(
@@ -144,6 +144,45 @@ PyObject* listFromArray(const char* type, const void* ptr, size_t len) noexcept
     return list;
 }
 
+// Holds the GIL for the lifetime of the guard. Safe to use whether or not
+// the calling thread already holds the GIL.
+class PyGILGuard
+{
+private:
+    PyGILState_STATE state;
+private:
+    PyGILGuard(const PyGILGuard&) = delete; // Not allowed
+    PyGILGuard& operator=(const PyGILGuard&) = delete; // Not allowed
+public:
+    PyGILGuard() noexcept : state(PyGILState_Ensure())
+    {
+    }
+    ~PyGILGuard() noexcept
+    {
+        PyGILState_Release(state);
+    }
+};
+
+// Releases the GIL for the lifetime of the object, so other Python threads
+// can run while TOSSIM is executing C++ code. Any PyCallback invoked in the
+// meantime reacquires the GIL itself.
+class PyAllowThreads
+{
+private:
+    PyThreadState *save;
+private:
+    PyAllowThreads(const PyAllowThreads&) = delete; // Not allowed
+    PyAllowThreads& operator=(const PyAllowThreads&) = delete; // Not allowed
+public:
+    PyAllowThreads() noexcept : save(PyEval_SaveThread())
+    {
+    }
+    ~PyAllowThreads() noexcept
+    {
+        PyEval_RestoreThread(save);
+    }
+};
+
 // From: https://stackoverflow.com/questions/11516809/c-back-end-call-the-python-level-defined-callbacks-with-swig-wrapper#new-answer
 class PyCallback
 {
@@ -158,6 +197,7 @@ public:
     }
     PyCallback(const PyCallback& o) noexcept : func(o.func)
     {
+        PyGILGuard gil;
         Py_XINCREF(func);
     }
     PyCallback(PyObject *pfunc) : func(pfunc)
@@ -171,10 +211,13 @@ public:
     }
     ~PyCallback() noexcept
     {
+        PyGILGuard gil;
         Py_XDECREF(func);
     }
 
     bool operator()() const {
+        PyGILGuard gil;
+
         PyObject *result = PyObject_CallObject(func, NULL);
 
         if (!result) {
@@ -189,6 +232,8 @@ public:
     }
 
     void operator()(double t) const {
+        PyGILGuard gil;
+
         PyObject *args = PyTuple_New(1);
 
         if (!args) {
@@ -209,6 +254,8 @@ public:
     }
 
     void operator()(long long int i) const {
+        PyGILGuard gil;
+
         PyObject *args = PyTuple_New(1);
 
         if (!args) {
@@ -229,6 +276,8 @@ public:
     }
 
     void operator()(const char* str, size_t length) const {
+        PyGILGuard gil;
+
 #if PY_VERSION_HEX < 0x03000000
         PyObject *pystring = PyString_FromStringAndSize(str, length);
 #else
@@ -294,6 +343,14 @@ FILE* object_to_file(PyObject* o) noexcept
 
 %}
 
+%init %{
+%#if PY_VERSION_HEX < 0x03070000
+    // PyGILState_Ensure needs the GIL to have been created before
+    // TOSSIM releases it for the first time.
+    PyEval_InitThreads();
+%#endif
+%}
+
 %include mac.i
 %include radio.i
 %include packet.i
@@ -624,8 +681,13 @@ class Mote {
     {
         try
         {
-            long long int result = $self->runAllEventsWithTriggeredMaxTime(
-                duration, duration_upper_bound, PyCallback(continue_events));
+            PyCallback continue_events_callback(continue_events);
+            long long int result;
+            {
+                PyAllowThreads allow_threads;
+                result = $self->runAllEventsWithTriggeredMaxTime(
+                    duration, duration_upper_bound, std::move(continue_events_callback));
+            }
             return PyLong_FromLongLong(result);
         }
         catch (std::runtime_error ex)
@@ -642,8 +704,15 @@ class Mote {
     {
         try
         {
-            long long int result = $self->runAllEventsWithTriggeredMaxTimeAndCallback(
-                duration, duration_upper_bound, PyCallback(continue_events), PyCallback(callback));
+            PyCallback continue_events_callback(continue_events);
+            PyCallback event_callback(callback);
+            long long int result;
+            {
+                PyAllowThreads allow_threads;
+                result = $self->runAllEventsWithTriggeredMaxTimeAndCallback(
+                    duration, duration_upper_bound,
+                    std::move(continue_events_callback), std::move(event_callback));
+            }
             return PyLong_FromLongLong(result);
         }
         catch (std::runtime_error ex)
@@ -678,8 +747,21 @@ class Tossim {
 
     void register_event_callback(std::function<bool(double)> callback, double current_time);
 
+    %exception runNextEvent() {
+        try {
+            PyAllowThreads allow_threads;
+            $action
+        }
+        catch (std::runtime_error ex) {
+            SWIG_fail;
+        }
+    }
+
     bool runNextEvent();
 
+    int eventQueueSize() const noexcept;
+    int eventQueuePeakSize() const noexcept;
+
     void triggerRunDurationStart();
 
     long long int runAllEventsWithTriggeredMaxTime(
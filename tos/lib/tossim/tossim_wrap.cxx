@@ -3735,24 +3735,25 @@ SwigPyBuiltin_iternextfunc_closure(SwigPyWrapperFunction wrapper, PyObject *a) {
 /* -------- TYPES TABLE (BEGIN) -------- */
 
 #define SWIGTYPE_p_FILE swig_types[0]
-#define SWIGTYPE_p_MAC swig_types[1]
-#define SWIGTYPE_p_Mote swig_types[2]
-#define SWIGTYPE_p_NescApp swig_types[3]
-#define SWIGTYPE_p_Packet swig_types[4]
-#define SWIGTYPE_p_Radio swig_types[5]
-#define SWIGTYPE_p_SwigPyObject swig_types[6]
-#define SWIGTYPE_p_Tossim swig_types[7]
-#define SWIGTYPE_p_Variable swig_types[8]
-#define SWIGTYPE_p_char swig_types[9]
-#define SWIGTYPE_p_std__functionT_bool_fF_t swig_types[10]
-#define SWIGTYPE_p_std__functionT_bool_fdoubleF_t swig_types[11]
-#define SWIGTYPE_p_std__functionT_void_fchar_const_p_size_tF_t swig_types[12]
-#define SWIGTYPE_p_std__functionT_void_flong_longF_t swig_types[13]
-#define SWIGTYPE_p_std__shared_ptrT_Packet_t swig_types[14]
-#define SWIGTYPE_p_std__shared_ptrT_Variable_t swig_types[15]
-#define SWIGTYPE_p_std__string swig_types[16]
-static swig_type_info *swig_types[18];
-static swig_module_info swig_module = {swig_types, 17, 0, 0, 0, 0};
+#define SWIGTYPE_p_LinkLayerModel swig_types[1]
+#define SWIGTYPE_p_MAC swig_types[2]
+#define SWIGTYPE_p_Mote swig_types[3]
+#define SWIGTYPE_p_NescApp swig_types[4]
+#define SWIGTYPE_p_Packet swig_types[5]
+#define SWIGTYPE_p_Radio swig_types[6]
+#define SWIGTYPE_p_SwigPyObject swig_types[7]
+#define SWIGTYPE_p_Tossim swig_types[8]
+#define SWIGTYPE_p_Variable swig_types[9]
+#define SWIGTYPE_p_char swig_types[10]
+#define SWIGTYPE_p_std__functionT_bool_fF_t swig_types[11]
+#define SWIGTYPE_p_std__functionT_bool_fdoubleF_t swig_types[12]
+#define SWIGTYPE_p_std__functionT_void_fchar_const_p_size_tF_t swig_types[13]
+#define SWIGTYPE_p_std__functionT_void_flong_longF_t swig_types[14]
+#define SWIGTYPE_p_std__shared_ptrT_Packet_t swig_types[15]
+#define SWIGTYPE_p_std__shared_ptrT_Variable_t swig_types[16]
+#define SWIGTYPE_p_std__string swig_types[17]
+static swig_type_info *swig_types[19];
+static swig_module_info swig_module = {swig_types, 18, 0, 0, 0, 0};
 #define SWIG_TypeQuery(name) SWIG_TypeQueryModule(&swig_module, &swig_module, name)
 #define SWIG_MangledTypeQuery(name) SWIG_MangledTypeQueryModule(&swig_module, &swig_module, name)
 
@@ -3977,6 +3978,45 @@ PyObject* listFromArray(const char* type, const void* ptr, size_t len) noexcept
     return list;
 }
 
+// Holds the GIL for the lifetime of the guard. Safe to use whether or not
+// the calling thread already holds the GIL.
+class PyGILGuard
+{
+private:
+    PyGILState_STATE state;
+private:
+    PyGILGuard(const PyGILGuard&) = delete; // Not allowed
+    PyGILGuard& operator=(const PyGILGuard&) = delete; // Not allowed
+public:
+    PyGILGuard() noexcept : state(PyGILState_Ensure())
+    {
+    }
+    ~PyGILGuard() noexcept
+    {
+        PyGILState_Release(state);
+    }
+};
+
+// Releases the GIL for the lifetime of the object, so other Python threads
+// can run while TOSSIM is executing C++ code. Any PyCallback invoked in the
+// meantime reacquires the GIL itself.
+class PyAllowThreads
+{
+private:
+    PyThreadState *save;
+private:
+    PyAllowThreads(const PyAllowThreads&) = delete; // Not allowed
+    PyAllowThreads& operator=(const PyAllowThreads&) = delete; // Not allowed
+public:
+    PyAllowThreads() noexcept : save(PyEval_SaveThread())
+    {
+    }
+    ~PyAllowThreads() noexcept
+    {
+        PyEval_RestoreThread(save);
+    }
+};
+
 // From: https://stackoverflow.com/questions/11516809/c-back-end-call-the-python-level-defined-callbacks-with-swig-wrapper#new-answer
 class PyCallback
 {
@@ -3991,6 +4031,7 @@ public:
     }
     PyCallback(const PyCallback& o) noexcept : func(o.func)
     {
+        PyGILGuard gil;
         Py_XINCREF(func);
     }
     PyCallback(PyObject *pfunc) : func(pfunc)
@@ -4004,10 +4045,13 @@ public:
     }
     ~PyCallback() noexcept
     {
+        PyGILGuard gil;
         Py_XDECREF(func);
     }
 
     bool operator()() const {
+        PyGILGuard gil;
+
         PyObject *result = PyObject_CallObject(func, NULL);
 
         if (!result) {
@@ -4022,6 +4066,8 @@ public:
     }
 
     void operator()(double t) const {
+        PyGILGuard gil;
+
         PyObject *args = PyTuple_New(1);
 
         if (!args) {
@@ -4042,6 +4088,8 @@ public:
     }
 
     void operator()(long long int i) const {
+        PyGILGuard gil;
+
         PyObject *args = PyTuple_New(1);
 
         if (!args) {
@@ -4062,6 +4110,8 @@ public:
     }
 
     void operator()(const char* str, size_t length) const {
+        PyGILGuard gil;
+
 #if PY_VERSION_HEX < 0x03000000
         PyObject *pystring = PyString_FromStringAndSize(str, length);
 #else
@@ -4282,6 +4332,7 @@ SWIG_AsVal_int (PyObject * obj, int *val)
 
 
 #include <radio.h>
+#include <link_layer_model.h>
 
 
   #define SWIG_From_double   PyFloat_FromDouble 
@@ -4770,6 +4821,48 @@ SWIG_AsVal_size_t (PyObject * obj, size_t *val)
   return res;
 }
 
+
+SWIGINTERN int
+SWIG_AsVal_unsigned_SS_int (PyObject * obj, unsigned int *val)
+{
+  unsigned long v;
+  int res = SWIG_AsVal_unsigned_SS_long (obj, &v);
+  if (SWIG_IsOK(res)) {
+    if ((v > UINT_MAX)) {
+      return SWIG_OverflowError;
+    } else {
+      if (val) *val = static_cast< unsigned int >(v);
+    }
+  }  
+  return res;
+}
+
+
+#ifdef SWIG_LONG_LONG_AVAILABLE
+SWIGINTERNINLINE PyObject* 
+SWIG_From_unsigned_SS_long_SS_long  (unsigned long long value)
+{
+  return (value > LONG_MAX) ?
+    PyLong_FromUnsignedLongLong(value) : PyInt_FromLong(static_cast< long >(value));
+}
+#endif
+
+
+SWIGINTERNINLINE PyObject * 
+SWIG_From_size_t  (size_t value)
+{    
+#ifdef SWIG_LONG_LONG_AVAILABLE
+  if (sizeof(size_t) <= sizeof(unsigned long)) {
+#endif
+    return SWIG_From_unsigned_SS_long  (static_cast< unsigned long >(value));
+#ifdef SWIG_LONG_LONG_AVAILABLE
+  } else {
+    /* assume sizeof(size_t) <= sizeof(unsigned long long) */
+    return SWIG_From_unsigned_SS_long_SS_long  (static_cast< unsigned long long >(value));
+  }
+#endif
+}
+
 SWIGINTERN PyObject *Mote_addNoiseTraces(Mote *self,PyObject *traces){
             if (!PyList_Check(traces)) {
                 PyErr_SetString(PyExc_TypeError, "Requires a list as a parameter.");
@@ -4849,8 +4942,13 @@ SWIGINTERN PyObject *Tossim_register_event_callback__SWIG_1(Tossim *self,PyObjec
 SWIGINTERN PyObject *Tossim_runAllEventsWithTriggeredMaxTime__SWIG_1(Tossim *self,double duration,double duration_upper_bound,PyObject *continue_events){
         try
         {
-            long long int result = self->runAllEventsWithTriggeredMaxTime(
-                duration, duration_upper_bound, PyCallback(continue_events));
+            PyCallback continue_events_callback(continue_events);
+            long long int result;
+            {
+                PyAllowThreads allow_threads;
+                result = self->runAllEventsWithTriggeredMaxTime(
+                    duration, duration_upper_bound, std::move(continue_events_callback));
+            }
             return PyLong_FromLongLong(result);
         }
         catch (std::runtime_error ex)
@@ -4861,8 +4959,15 @@ SWIGINTERN PyObject *Tossim_runAllEventsWithTriggeredMaxTime__SWIG_1(Tossim *sel
 SWIGINTERN PyObject *Tossim_runAllEventsWithTriggeredMaxTimeAndCallback__SWIG_1(Tossim *self,double duration,double duration_upper_bound,PyObject *continue_events,PyObject *callback){
         try
         {
-            long long int result = self->runAllEventsWithTriggeredMaxTimeAndCallback(
-                duration, duration_upper_bound, PyCallback(continue_events), PyCallback(callback));
+            PyCallback continue_events_callback(continue_events);
+            PyCallback event_callback(callback);
+            long long int result;
+            {
+                PyAllowThreads allow_threads;
+                result = self->runAllEventsWithTriggeredMaxTimeAndCallback(
+                    duration, duration_upper_bound,
+                    std::move(continue_events_callback), std::move(event_callback));
+            }
             return PyLong_FromLongLong(result);
         }
         catch (std::runtime_error ex)
@@ -5800,168 +5905,168 @@ fail:
 }
 
 
-SWIGPY_DESTRUCTOR_CLOSURE(_wrap_delete_Radio) /* defines _wrap_delete_Radio_destructor_closure */
-
-SWIGINTERN int _wrap_new_Packet(PyObject *self, PyObject *args) {
-  PyObject *resultobj = 0;
-  Packet *result = 0 ;
-  
-  if (!SWIG_Python_UnpackTuple(args,"new_Packet",0,0,0)) SWIG_fail;
-  result = (Packet *)new Packet();
-  {
-    std::shared_ptr<  Packet > *smartresult = result ? new std::shared_ptr<  Packet >(result SWIG_NO_NULL_DELETER_SWIG_BUILTIN_INIT) : 0;
-    resultobj = SWIG_NewPointerObj(SWIG_as_voidptr(smartresult), SWIGTYPE_p_std__shared_ptrT_Packet_t, SWIG_BUILTIN_INIT | SWIG_POINTER_OWN);
-  }
-  return resultobj == Py_None ? -1 : 0;
-fail:
-  return -1;
-}
-
-
-SWIGINTERN PyObject *_wrap_delete_Packet(PyObject *self, PyObject *args) {
+SWIGINTERN PyObject *_wrap_Radio_generateLinkGains(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
-  Packet *arg1 = (Packet *) 0 ;
+  Radio *arg1 = (Radio *) 0 ;
+  char *arg2 = (char *) 0 ;
+  int arg3 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  std::shared_ptr< Packet > tempshared1 ;
-  std::shared_ptr< Packet > *smartarg1 = 0 ;
-  PyObject *swig_obj[1] ;
+  int res2 ;
+  char *buf2 = 0 ;
+  int alloc2 = 0 ;
+  int val3 ;
+  int ecode3 = 0 ;
+  PyObject *swig_obj[3] ;
+  long long result;
   
-  if (!SWIG_Python_UnpackTuple(args,"delete_Packet",0,0,0)) SWIG_fail;
+  if (!SWIG_Python_UnpackTuple(args,"Radio_generateLinkGains",2,2,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Radio, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Radio_generateLinkGains" "', argument " "1"" of type '" "Radio *""'"); 
+  }
+  arg1 = reinterpret_cast< Radio * >(argp1);
+  res2 = SWIG_AsCharPtrAndSize(swig_obj[0], &buf2, NULL, &alloc2);
+  if (!SWIG_IsOK(res2)) {
+    SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "Radio_generateLinkGains" "', argument " "2"" of type '" "char const *""'");
+  }
+  arg2 = reinterpret_cast< char * >(buf2);
+  ecode3 = SWIG_AsVal_int(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "Radio_generateLinkGains" "', argument " "3"" of type '" "int""'");
+  } 
+  arg3 = static_cast< int >(val3);
   {
-    int newmem = 0;
-    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
-    if (!SWIG_IsOK(res1)) {
-      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "delete_Packet" "', argument " "1"" of type '" "Packet *""'"); 
+    try {
+      result = (long long)(arg1)->generateLinkGains((char const *)arg2,arg3);
     }
-    if (newmem & SWIG_CAST_NEW_MEMORY) {
-      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >(tempshared1.get());
-    } else {
-      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
     }
   }
-  (void)arg1; delete smartarg1;
-  resultobj = SWIG_Py_Void();
+  resultobj = SWIG_From_long_SS_long(static_cast< long long >(result));
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return resultobj;
 fail:
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return NULL;
 }
 
 
-SWIGINTERN PyObject *_wrap_Packet_setSource(PyObject *self, PyObject *args) {
+SWIGINTERN PyObject *_wrap_Radio_saveTopology(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
-  Packet *arg1 = (Packet *) 0 ;
-  int arg2 ;
+  Radio *arg1 = (Radio *) 0 ;
+  char *arg2 = (char *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  std::shared_ptr< Packet > tempshared1 ;
-  std::shared_ptr< Packet > *smartarg1 = 0 ;
-  int val2 ;
-  int ecode2 = 0 ;
+  int res2 ;
+  char *buf2 = 0 ;
+  int alloc2 = 0 ;
   PyObject *swig_obj[2] ;
+  long long result;
   
   if (!args) SWIG_fail;
   swig_obj[0] = args;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Radio, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Radio_saveTopology" "', argument " "1"" of type '" "Radio *""'"); 
+  }
+  arg1 = reinterpret_cast< Radio * >(argp1);
+  res2 = SWIG_AsCharPtrAndSize(swig_obj[0], &buf2, NULL, &alloc2);
+  if (!SWIG_IsOK(res2)) {
+    SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "Radio_saveTopology" "', argument " "2"" of type '" "char const *""'");
+  }
+  arg2 = reinterpret_cast< char * >(buf2);
   {
-    int newmem = 0;
-    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
-    if (!SWIG_IsOK(res1)) {
-      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_setSource" "', argument " "1"" of type '" "Packet *""'"); 
+    try {
+      result = (long long)(arg1)->saveTopology((char const *)arg2);
     }
-    if (newmem & SWIG_CAST_NEW_MEMORY) {
-      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >(tempshared1.get());
-    } else {
-      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
     }
   }
-  ecode2 = SWIG_AsVal_int(swig_obj[0], &val2);
-  if (!SWIG_IsOK(ecode2)) {
-    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Packet_setSource" "', argument " "2"" of type '" "int""'");
-  } 
-  arg2 = static_cast< int >(val2);
-  (arg1)->setSource(arg2);
-  resultobj = SWIG_Py_Void();
+  resultobj = SWIG_From_long_SS_long(static_cast< long long >(result));
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return resultobj;
 fail:
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return NULL;
 }
 
 
-SWIGINTERN PyObject *_wrap_Packet_source(PyObject *self, PyObject *args) {
+SWIGINTERN PyObject *_wrap_Radio_loadTopology(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
-  Packet *arg1 = (Packet *) 0 ;
+  Radio *arg1 = (Radio *) 0 ;
+  char *arg2 = (char *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  std::shared_ptr< Packet > tempshared1 ;
-  std::shared_ptr< Packet > *smartarg1 = 0 ;
-  PyObject *swig_obj[1] ;
-  int result;
+  int res2 ;
+  char *buf2 = 0 ;
+  int alloc2 = 0 ;
+  PyObject *swig_obj[2] ;
+  long long result;
   
-  if (!SWIG_Python_UnpackTuple(args,"Packet_source",0,0,0)) SWIG_fail;
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Radio, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Radio_loadTopology" "', argument " "1"" of type '" "Radio *""'"); 
+  }
+  arg1 = reinterpret_cast< Radio * >(argp1);
+  res2 = SWIG_AsCharPtrAndSize(swig_obj[0], &buf2, NULL, &alloc2);
+  if (!SWIG_IsOK(res2)) {
+    SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "Radio_loadTopology" "', argument " "2"" of type '" "char const *""'");
+  }
+  arg2 = reinterpret_cast< char * >(buf2);
   {
-    int newmem = 0;
-    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
-    if (!SWIG_IsOK(res1)) {
-      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_source" "', argument " "1"" of type '" "Packet *""'"); 
+    try {
+      result = (long long)(arg1)->loadTopology((char const *)arg2);
     }
-    if (newmem & SWIG_CAST_NEW_MEMORY) {
-      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >(tempshared1.get());
-    } else {
-      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
     }
   }
-  result = (int)(arg1)->source();
-  resultobj = SWIG_From_int(static_cast< int >(result));
+  resultobj = SWIG_From_long_SS_long(static_cast< long long >(result));
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return resultobj;
 fail:
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
   return NULL;
 }
 
 
-SWIGINTERN PyObject *_wrap_Packet_setDestination(PyObject *self, PyObject *args) {
+SWIGPY_DESTRUCTOR_CLOSURE(_wrap_delete_Radio) /* defines _wrap_delete_Radio_destructor_closure */
+
+SWIGINTERN int _wrap_new_LinkLayerModel(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
-  Packet *arg1 = (Packet *) 0 ;
-  int arg2 ;
+  LinkLayerModel *result = 0 ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"new_LinkLayerModel",0,0,0)) SWIG_fail;
+  result = (LinkLayerModel *)new LinkLayerModel();
+  resultobj = SWIG_NewPointerObj(SWIG_as_voidptr(result), SWIGTYPE_p_LinkLayerModel, SWIG_BUILTIN_INIT |  0 );
+  return resultobj == Py_None ? -1 : 0;
+fail:
+  return -1;
+}
+
+
+SWIGINTERN PyObject *_wrap_delete_LinkLayerModel(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  std::shared_ptr< Packet > tempshared1 ;
-  std::shared_ptr< Packet > *smartarg1 = 0 ;
-  int val2 ;
-  int ecode2 = 0 ;
-  PyObject *swig_obj[2] ;
+  PyObject *swig_obj[1] ;
   
-  if (!args) SWIG_fail;
-  swig_obj[0] = args;
-  {
-    int newmem = 0;
-    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
-    if (!SWIG_IsOK(res1)) {
-      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_setDestination" "', argument " "1"" of type '" "Packet *""'"); 
-    }
-    if (newmem & SWIG_CAST_NEW_MEMORY) {
-      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >(tempshared1.get());
-    } else {
-      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
-      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
-    }
+  if (!SWIG_Python_UnpackTuple(args,"delete_LinkLayerModel",0,0,0)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, SWIG_POINTER_DISOWN |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "delete_LinkLayerModel" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
   }
-  ecode2 = SWIG_AsVal_int(swig_obj[0], &val2);
-  if (!SWIG_IsOK(ecode2)) {
-    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Packet_setDestination" "', argument " "2"" of type '" "int""'");
-  } 
-  arg2 = static_cast< int >(val2);
-  (arg1)->setDestination(arg2);
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  delete arg1;
   resultobj = SWIG_Py_Void();
   return resultobj;
 fail:
@@ -5969,13 +6074,585 @@ fail:
 }
 
 
-SWIGINTERN PyObject *_wrap_Packet_destination(PyObject *self, PyObject *args) {
+SWIGINTERN PyObject *_wrap_LinkLayerModel_readConfig(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
-  Packet *arg1 = (Packet *) 0 ;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  char *arg2 = (char *) 0 ;
+  unsigned int arg3 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  int res2 ;
+  char *buf2 = 0 ;
+  int alloc2 = 0 ;
+  unsigned int val3 ;
+  int ecode3 = 0 ;
+  PyObject *swig_obj[3] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_readConfig",2,2,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_readConfig" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  res2 = SWIG_AsCharPtrAndSize(swig_obj[0], &buf2, NULL, &alloc2);
+  if (!SWIG_IsOK(res2)) {
+    SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "LinkLayerModel_readConfig" "', argument " "2"" of type '" "char const *""'");
+  }
+  arg2 = reinterpret_cast< char * >(buf2);
+  ecode3 = SWIG_AsVal_unsigned_SS_int(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "LinkLayerModel_readConfig" "', argument " "3"" of type '" "unsigned int""'");
+  } 
+  arg3 = static_cast< unsigned int >(val3);
+  {
+    try {
+      (arg1)->readConfig((char const *)arg2,arg3);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
+  return resultobj;
+fail:
+  if (alloc2 == SWIG_NEWOBJ) delete[] buf2;
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_setPathLoss(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  double arg2 ;
+  double arg3 ;
+  double arg4 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  double val2 ;
+  int ecode2 = 0 ;
+  double val3 ;
+  int ecode3 = 0 ;
+  double val4 ;
+  int ecode4 = 0 ;
+  PyObject *swig_obj[4] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_setPathLoss",3,3,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_setPathLoss" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_double(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_setPathLoss" "', argument " "2"" of type '" "double""'");
+  } 
+  arg2 = static_cast< double >(val2);
+  ecode3 = SWIG_AsVal_double(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "LinkLayerModel_setPathLoss" "', argument " "3"" of type '" "double""'");
+  } 
+  arg3 = static_cast< double >(val3);
+  ecode4 = SWIG_AsVal_double(swig_obj[2], &val4);
+  if (!SWIG_IsOK(ecode4)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode4), "in method '" "LinkLayerModel_setPathLoss" "', argument " "4"" of type '" "double""'");
+  } 
+  arg4 = static_cast< double >(val4);
+  {
+    try {
+      (arg1)->setPathLoss(arg2,arg3,arg4);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_setShadowing(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  double arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  double val2 ;
+  int ecode2 = 0 ;
+  PyObject *swig_obj[2] ;
+  
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_setShadowing" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_double(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_setShadowing" "', argument " "2"" of type '" "double""'");
+  } 
+  arg2 = static_cast< double >(val2);
+  {
+    try {
+      (arg1)->setShadowing(arg2);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_setAsymmetry(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  double arg2 ;
+  double arg3 ;
+  double arg4 ;
+  double arg5 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  double val2 ;
+  int ecode2 = 0 ;
+  double val3 ;
+  int ecode3 = 0 ;
+  double val4 ;
+  int ecode4 = 0 ;
+  double val5 ;
+  int ecode5 = 0 ;
+  PyObject *swig_obj[5] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_setAsymmetry",4,4,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_setAsymmetry" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_double(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_setAsymmetry" "', argument " "2"" of type '" "double""'");
+  } 
+  arg2 = static_cast< double >(val2);
+  ecode3 = SWIG_AsVal_double(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "LinkLayerModel_setAsymmetry" "', argument " "3"" of type '" "double""'");
+  } 
+  arg3 = static_cast< double >(val3);
+  ecode4 = SWIG_AsVal_double(swig_obj[2], &val4);
+  if (!SWIG_IsOK(ecode4)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode4), "in method '" "LinkLayerModel_setAsymmetry" "', argument " "4"" of type '" "double""'");
+  } 
+  arg4 = static_cast< double >(val4);
+  ecode5 = SWIG_AsVal_double(swig_obj[3], &val5);
+  if (!SWIG_IsOK(ecode5)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode5), "in method '" "LinkLayerModel_setAsymmetry" "', argument " "5"" of type '" "double""'");
+  } 
+  arg5 = static_cast< double >(val5);
+  {
+    try {
+      (arg1)->setAsymmetry(arg2,arg3,arg4,arg5);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_addNode(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  int arg2 ;
+  double arg3 ;
+  double arg4 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  int val2 ;
+  int ecode2 = 0 ;
+  double val3 ;
+  int ecode3 = 0 ;
+  double val4 ;
+  int ecode4 = 0 ;
+  PyObject *swig_obj[4] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_addNode",3,3,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_addNode" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_int(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_addNode" "', argument " "2"" of type '" "int""'");
+  } 
+  arg2 = static_cast< int >(val2);
+  ecode3 = SWIG_AsVal_double(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "LinkLayerModel_addNode" "', argument " "3"" of type '" "double""'");
+  } 
+  arg3 = static_cast< double >(val3);
+  ecode4 = SWIG_AsVal_double(swig_obj[2], &val4);
+  if (!SWIG_IsOK(ecode4)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode4), "in method '" "LinkLayerModel_addNode" "', argument " "4"" of type '" "double""'");
+  } 
+  arg4 = static_cast< double >(val4);
+  {
+    try {
+      (arg1)->addNode(arg2,arg3,arg4);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_generate(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  unsigned int arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  unsigned int val2 ;
+  int ecode2 = 0 ;
+  PyObject *swig_obj[2] ;
+  size_t result;
+  
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_generate" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_unsigned_SS_int(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_generate" "', argument " "2"" of type '" "unsigned int""'");
+  } 
+  arg2 = static_cast< unsigned int >(val2);
+  {
+    try {
+      result = (arg1)->generate(arg2);
+    }
+    catch (const std::exception& ex) {
+      PyErr_SetString(PyExc_RuntimeError, ex.what());
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_From_size_t(static_cast< size_t >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_setNoise(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  double arg2 ;
+  double arg3 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  double val2 ;
+  int ecode2 = 0 ;
+  double val3 ;
+  int ecode3 = 0 ;
+  PyObject *swig_obj[3] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_setNoise",2,2,swig_obj)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_setNoise" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_double(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_setNoise" "', argument " "2"" of type '" "double""'");
+  } 
+  arg2 = static_cast< double >(val2);
+  ecode3 = SWIG_AsVal_double(swig_obj[1], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "LinkLayerModel_setNoise" "', argument " "3"" of type '" "double""'");
+  } 
+  arg3 = static_cast< double >(val3);
+  (arg1)->setNoise(arg2,arg3);
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_setGainThreshold(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  double arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  double val2 ;
+  int ecode2 = 0 ;
+  PyObject *swig_obj[2] ;
+  
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_setGainThreshold" "', argument " "1"" of type '" "LinkLayerModel *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  ecode2 = SWIG_AsVal_double(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "LinkLayerModel_setGainThreshold" "', argument " "2"" of type '" "double""'");
+  } 
+  arg2 = static_cast< double >(val2);
+  (arg1)->setGainThreshold(arg2);
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_gainThreshold(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  PyObject *swig_obj[1] ;
+  double result;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_gainThreshold",0,0,0)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_gainThreshold" "', argument " "1"" of type '" "LinkLayerModel const *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  result = (double)((LinkLayerModel const *)arg1)->gainThreshold();
+  resultobj = SWIG_From_double(static_cast< double >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_LinkLayerModel_numNodes(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  LinkLayerModel *arg1 = (LinkLayerModel *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  std::shared_ptr< Packet > tempshared1 ;
-  std::shared_ptr< Packet > *smartarg1 = 0 ;
+  PyObject *swig_obj[1] ;
+  size_t result;
+  
+  if (!SWIG_Python_UnpackTuple(args,"LinkLayerModel_numNodes",0,0,0)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_LinkLayerModel, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "LinkLayerModel_numNodes" "', argument " "1"" of type '" "LinkLayerModel const *""'"); 
+  }
+  arg1 = reinterpret_cast< LinkLayerModel * >(argp1);
+  result = ((LinkLayerModel const *)arg1)->numNodes();
+  resultobj = SWIG_From_size_t(static_cast< size_t >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGPY_DESTRUCTOR_CLOSURE(_wrap_delete_LinkLayerModel) /* defines _wrap_delete_LinkLayerModel_destructor_closure */
+
+SWIGINTERN int _wrap_new_Packet(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *result = 0 ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"new_Packet",0,0,0)) SWIG_fail;
+  result = (Packet *)new Packet();
+  {
+    std::shared_ptr<  Packet > *smartresult = result ? new std::shared_ptr<  Packet >(result SWIG_NO_NULL_DELETER_SWIG_BUILTIN_INIT) : 0;
+    resultobj = SWIG_NewPointerObj(SWIG_as_voidptr(smartresult), SWIGTYPE_p_std__shared_ptrT_Packet_t, SWIG_BUILTIN_INIT | SWIG_POINTER_OWN);
+  }
+  return resultobj == Py_None ? -1 : 0;
+fail:
+  return -1;
+}
+
+
+SWIGINTERN PyObject *_wrap_delete_Packet(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *arg1 = (Packet *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  std::shared_ptr< Packet > tempshared1 ;
+  std::shared_ptr< Packet > *smartarg1 = 0 ;
+  PyObject *swig_obj[1] ;
+  
+  if (!SWIG_Python_UnpackTuple(args,"delete_Packet",0,0,0)) SWIG_fail;
+  {
+    int newmem = 0;
+    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
+    if (!SWIG_IsOK(res1)) {
+      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "delete_Packet" "', argument " "1"" of type '" "Packet *""'"); 
+    }
+    if (newmem & SWIG_CAST_NEW_MEMORY) {
+      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >(tempshared1.get());
+    } else {
+      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    }
+  }
+  (void)arg1; delete smartarg1;
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Packet_setSource(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *arg1 = (Packet *) 0 ;
+  int arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  std::shared_ptr< Packet > tempshared1 ;
+  std::shared_ptr< Packet > *smartarg1 = 0 ;
+  int val2 ;
+  int ecode2 = 0 ;
+  PyObject *swig_obj[2] ;
+  
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  {
+    int newmem = 0;
+    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
+    if (!SWIG_IsOK(res1)) {
+      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_setSource" "', argument " "1"" of type '" "Packet *""'"); 
+    }
+    if (newmem & SWIG_CAST_NEW_MEMORY) {
+      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >(tempshared1.get());
+    } else {
+      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    }
+  }
+  ecode2 = SWIG_AsVal_int(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Packet_setSource" "', argument " "2"" of type '" "int""'");
+  } 
+  arg2 = static_cast< int >(val2);
+  (arg1)->setSource(arg2);
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Packet_source(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *arg1 = (Packet *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  std::shared_ptr< Packet > tempshared1 ;
+  std::shared_ptr< Packet > *smartarg1 = 0 ;
+  PyObject *swig_obj[1] ;
+  int result;
+  
+  if (!SWIG_Python_UnpackTuple(args,"Packet_source",0,0,0)) SWIG_fail;
+  {
+    int newmem = 0;
+    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
+    if (!SWIG_IsOK(res1)) {
+      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_source" "', argument " "1"" of type '" "Packet *""'"); 
+    }
+    if (newmem & SWIG_CAST_NEW_MEMORY) {
+      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >(tempshared1.get());
+    } else {
+      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    }
+  }
+  result = (int)(arg1)->source();
+  resultobj = SWIG_From_int(static_cast< int >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Packet_setDestination(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *arg1 = (Packet *) 0 ;
+  int arg2 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  std::shared_ptr< Packet > tempshared1 ;
+  std::shared_ptr< Packet > *smartarg1 = 0 ;
+  int val2 ;
+  int ecode2 = 0 ;
+  PyObject *swig_obj[2] ;
+  
+  if (!args) SWIG_fail;
+  swig_obj[0] = args;
+  {
+    int newmem = 0;
+    res1 = SWIG_ConvertPtrAndOwn(self, &argp1, SWIGTYPE_p_std__shared_ptrT_Packet_t, 0 |  0 , &newmem);
+    if (!SWIG_IsOK(res1)) {
+      SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Packet_setDestination" "', argument " "1"" of type '" "Packet *""'"); 
+    }
+    if (newmem & SWIG_CAST_NEW_MEMORY) {
+      tempshared1 = *reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      delete reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >(tempshared1.get());
+    } else {
+      smartarg1 = reinterpret_cast< std::shared_ptr<  Packet > * >(argp1);
+      arg1 = const_cast< Packet * >((smartarg1 ? smartarg1->get() : 0));
+    }
+  }
+  ecode2 = SWIG_AsVal_int(swig_obj[0], &val2);
+  if (!SWIG_IsOK(ecode2)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode2), "in method '" "Packet_setDestination" "', argument " "2"" of type '" "int""'");
+  } 
+  arg2 = static_cast< int >(val2);
+  (arg1)->setDestination(arg2);
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Packet_destination(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Packet *arg1 = (Packet *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  std::shared_ptr< Packet > tempshared1 ;
+  std::shared_ptr< Packet > *smartarg1 = 0 ;
   PyObject *swig_obj[1] ;
   int result;
   
@@ -7492,63 +8169,115 @@ fail:
 SWIGINTERN PyObject *_wrap_Tossim_register_event_callback__SWIG_0(PyObject *self, int nobjs, PyObject **swig_obj) {
   PyObject *resultobj = 0;
   Tossim *arg1 = (Tossim *) 0 ;
-  std::function< bool (double) > arg2 ;
-  double arg3 ;
+  std::function< bool (double) > arg2 ;
+  double arg3 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  void *argp2 ;
+  int res2 = 0 ;
+  double val3 ;
+  int ecode3 = 0 ;
+  
+  if ((nobjs < 3) || (nobjs > 3)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Tossim, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_register_event_callback" "', argument " "1"" of type '" "Tossim *""'"); 
+  }
+  arg1 = reinterpret_cast< Tossim * >(argp1);
+  {
+    res2 = SWIG_ConvertPtr(swig_obj[1], &argp2, SWIGTYPE_p_std__functionT_bool_fdoubleF_t,  0  | 0);
+    if (!SWIG_IsOK(res2)) {
+      SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "Tossim_register_event_callback" "', argument " "2"" of type '" "std::function< bool (double) >""'"); 
+    }  
+    if (!argp2) {
+      SWIG_exception_fail(SWIG_ValueError, "invalid null reference " "in method '" "Tossim_register_event_callback" "', argument " "2"" of type '" "std::function< bool (double) >""'");
+    } else {
+      std::function< bool (double) > * temp = reinterpret_cast< std::function< bool (double) > * >(argp2);
+      arg2 = *temp;
+      if (SWIG_IsNewObj(res2)) delete temp;
+    }
+  }
+  ecode3 = SWIG_AsVal_double(swig_obj[2], &val3);
+  if (!SWIG_IsOK(ecode3)) {
+    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "Tossim_register_event_callback" "', argument " "3"" of type '" "double""'");
+  } 
+  arg3 = static_cast< double >(val3);
+  (arg1)->register_event_callback(arg2,arg3);
+  resultobj = SWIG_Py_Void();
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Tossim_runNextEvent(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Tossim *arg1 = (Tossim *) 0 ;
+  void *argp1 = 0 ;
+  int res1 = 0 ;
+  PyObject *swig_obj[1] ;
+  bool result;
+  
+  if (!SWIG_Python_UnpackTuple(args,"Tossim_runNextEvent",0,0,0)) SWIG_fail;
+  res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Tossim, 0 |  0 );
+  if (!SWIG_IsOK(res1)) {
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_runNextEvent" "', argument " "1"" of type '" "Tossim *""'"); 
+  }
+  arg1 = reinterpret_cast< Tossim * >(argp1);
+  {
+    try {
+      PyAllowThreads allow_threads;
+      result = (bool)(arg1)->runNextEvent();
+    }
+    catch (std::runtime_error ex) {
+      SWIG_fail;
+    }
+  }
+  resultobj = SWIG_From_bool(static_cast< bool >(result));
+  return resultobj;
+fail:
+  return NULL;
+}
+
+
+SWIGINTERN PyObject *_wrap_Tossim_eventQueueSize(PyObject *self, PyObject *args) {
+  PyObject *resultobj = 0;
+  Tossim *arg1 = (Tossim *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
-  void *argp2 ;
-  int res2 = 0 ;
-  double val3 ;
-  int ecode3 = 0 ;
+  PyObject *swig_obj[1] ;
+  int result;
   
-  if ((nobjs < 3) || (nobjs > 3)) SWIG_fail;
+  if (!SWIG_Python_UnpackTuple(args,"Tossim_eventQueueSize",0,0,0)) SWIG_fail;
   res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Tossim, 0 |  0 );
   if (!SWIG_IsOK(res1)) {
-    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_register_event_callback" "', argument " "1"" of type '" "Tossim *""'"); 
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_eventQueueSize" "', argument " "1"" of type '" "Tossim const *""'"); 
   }
   arg1 = reinterpret_cast< Tossim * >(argp1);
-  {
-    res2 = SWIG_ConvertPtr(swig_obj[1], &argp2, SWIGTYPE_p_std__functionT_bool_fdoubleF_t,  0  | 0);
-    if (!SWIG_IsOK(res2)) {
-      SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "Tossim_register_event_callback" "', argument " "2"" of type '" "std::function< bool (double) >""'"); 
-    }  
-    if (!argp2) {
-      SWIG_exception_fail(SWIG_ValueError, "invalid null reference " "in method '" "Tossim_register_event_callback" "', argument " "2"" of type '" "std::function< bool (double) >""'");
-    } else {
-      std::function< bool (double) > * temp = reinterpret_cast< std::function< bool (double) > * >(argp2);
-      arg2 = *temp;
-      if (SWIG_IsNewObj(res2)) delete temp;
-    }
-  }
-  ecode3 = SWIG_AsVal_double(swig_obj[2], &val3);
-  if (!SWIG_IsOK(ecode3)) {
-    SWIG_exception_fail(SWIG_ArgError(ecode3), "in method '" "Tossim_register_event_callback" "', argument " "3"" of type '" "double""'");
-  } 
-  arg3 = static_cast< double >(val3);
-  (arg1)->register_event_callback(arg2,arg3);
-  resultobj = SWIG_Py_Void();
+  result = (int)((Tossim const *)arg1)->eventQueueSize();
+  resultobj = SWIG_From_int(static_cast< int >(result));
   return resultobj;
 fail:
   return NULL;
 }
 
 
-SWIGINTERN PyObject *_wrap_Tossim_runNextEvent(PyObject *self, PyObject *args) {
+SWIGINTERN PyObject *_wrap_Tossim_eventQueuePeakSize(PyObject *self, PyObject *args) {
   PyObject *resultobj = 0;
   Tossim *arg1 = (Tossim *) 0 ;
   void *argp1 = 0 ;
   int res1 = 0 ;
   PyObject *swig_obj[1] ;
-  bool result;
+  int result;
   
-  if (!SWIG_Python_UnpackTuple(args,"Tossim_runNextEvent",0,0,0)) SWIG_fail;
+  if (!SWIG_Python_UnpackTuple(args,"Tossim_eventQueuePeakSize",0,0,0)) SWIG_fail;
   res1 = SWIG_ConvertPtr(self, &argp1,SWIGTYPE_p_Tossim, 0 |  0 );
   if (!SWIG_IsOK(res1)) {
-    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_runNextEvent" "', argument " "1"" of type '" "Tossim *""'"); 
+    SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "Tossim_eventQueuePeakSize" "', argument " "1"" of type '" "Tossim const *""'"); 
   }
   arg1 = reinterpret_cast< Tossim * >(argp1);
-  result = (bool)(arg1)->runNextEvent();
-  resultobj = SWIG_From_bool(static_cast< bool >(result));
+  result = (int)((Tossim const *)arg1)->eventQueuePeakSize();
+  resultobj = SWIG_From_int(static_cast< int >(result));
   return resultobj;
 fail:
   return NULL;
@@ -8320,6 +9049,9 @@ SWIGINTERN PyMethodDef SwigPyBuiltin__Radio_methods[] = {
   { "remove", (PyCFunction) _wrap_Radio_remove, METH_VARARGS, (char *) "" },
   { "setNoise", (PyCFunction) _wrap_Radio_setNoise, METH_VARARGS, (char *) "" },
   { "setSensitivity", (PyCFunction) _wrap_Radio_setSensitivity, METH_O, (char *) "" },
+  { "generateLinkGains", (PyCFunction) _wrap_Radio_generateLinkGains, METH_VARARGS, (char *) "" },
+  { "saveTopology", (PyCFunction) _wrap_Radio_saveTopology, METH_O, (char *) "" },
+  { "loadTopology", (PyCFunction) _wrap_Radio_loadTopology, METH_O, (char *) "" },
   { NULL, NULL, 0, NULL } /* Sentinel */
 };
 
@@ -8513,6 +9245,231 @@ static PyHeapTypeObject SwigPyBuiltin__Radio_type = {
 
 SWIGINTERN SwigPyClientData SwigPyBuiltin__Radio_clientdata = {0, 0, 0, 0, 0, 0, (PyTypeObject *)&SwigPyBuiltin__Radio_type};
 
+static SwigPyGetSet LinkLayerModel___dict___getset = { SwigPyObject_get___dict__, 0 };
+SWIGINTERN PyGetSetDef SwigPyBuiltin__LinkLayerModel_getset[] = {
+    { (char *) "__dict__", (getter) SwigPyBuiltin_FunpackGetterClosure, (setter) 0, (char *)"LinkLayerModel.__dict__", (void *) &LinkLayerModel___dict___getset }
+,
+    {NULL, NULL, NULL, NULL, NULL} /* Sentinel */
+};
+
+SWIGINTERN PyObject *
+SwigPyBuiltin__LinkLayerModel_richcompare(PyObject *self, PyObject *other, int op) {
+  PyObject *result = NULL;
+  if (!result) {
+    if (SwigPyObject_Check(self) && SwigPyObject_Check(other)) {
+      result = SwigPyObject_richcompare((SwigPyObject *)self, (SwigPyObject *)other, op);
+    } else {
+      result = Py_NotImplemented;
+      Py_INCREF(result);
+    }
+  }
+  return result;
+}
+
+SWIGINTERN PyMethodDef SwigPyBuiltin__LinkLayerModel_methods[] = {
+  { "readConfig", (PyCFunction) _wrap_LinkLayerModel_readConfig, METH_VARARGS, (char *) "" },
+  { "setPathLoss", (PyCFunction) _wrap_LinkLayerModel_setPathLoss, METH_VARARGS, (char *) "" },
+  { "setShadowing", (PyCFunction) _wrap_LinkLayerModel_setShadowing, METH_O, (char *) "" },
+  { "setAsymmetry", (PyCFunction) _wrap_LinkLayerModel_setAsymmetry, METH_VARARGS, (char *) "" },
+  { "addNode", (PyCFunction) _wrap_LinkLayerModel_addNode, METH_VARARGS, (char *) "" },
+  { "generate", (PyCFunction) _wrap_LinkLayerModel_generate, METH_O, (char *) "" },
+  { "setNoise", (PyCFunction) _wrap_LinkLayerModel_setNoise, METH_VARARGS, (char *) "" },
+  { "setGainThreshold", (PyCFunction) _wrap_LinkLayerModel_setGainThreshold, METH_O, (char *) "" },
+  { "gainThreshold", (PyCFunction) _wrap_LinkLayerModel_gainThreshold, METH_NOARGS, (char *) "" },
+  { "numNodes", (PyCFunction) _wrap_LinkLayerModel_numNodes, METH_NOARGS, (char *) "" },
+  { NULL, NULL, 0, NULL } /* Sentinel */
+};
+
+static PyHeapTypeObject SwigPyBuiltin__LinkLayerModel_type = {
+  {
+#if PY_VERSION_HEX >= 0x03000000
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL)
+    0,                                        /* ob_size */
+#endif
+    "TOSSIM.LinkLayerModel",                  /* tp_name */
+    sizeof(SwigPyObject),                     /* tp_basicsize */
+    0,                                        /* tp_itemsize */
+    (destructor) (destructor) _wrap_delete_LinkLayerModel_destructor_closure, /* tp_dealloc */
+    (printfunc) 0,                            /* tp_print */
+    (getattrfunc) 0,                          /* tp_getattr */
+    (setattrfunc) 0,                          /* tp_setattr */
+#if PY_VERSION_HEX >= 0x03000000
+    0,                                        /* tp_compare */
+#else
+    (cmpfunc) 0,                              /* tp_compare */
+#endif
+    (reprfunc) 0,                             /* tp_repr */
+    &SwigPyBuiltin__LinkLayerModel_type.as_number, /* tp_as_number */
+    &SwigPyBuiltin__LinkLayerModel_type.as_sequence, /* tp_as_sequence */
+    &SwigPyBuiltin__LinkLayerModel_type.as_mapping, /* tp_as_mapping */
+    (hashfunc) SwigPyObject_hash,             /* tp_hash */
+    (ternaryfunc) 0,                          /* tp_call */
+    (reprfunc) 0,                             /* tp_str */
+    (getattrofunc) 0,                         /* tp_getattro */
+    (setattrofunc) 0,                         /* tp_setattro */
+    &SwigPyBuiltin__LinkLayerModel_type.as_buffer, /* tp_as_buffer */
+#if PY_VERSION_HEX >= 0x03000000
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,   /* tp_flags */
+#else
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE|Py_TPFLAGS_CHECKTYPES, /* tp_flags */
+#endif
+    "::LinkLayerModel",                       /* tp_doc */
+    (traverseproc) 0,                         /* tp_traverse */
+    (inquiry) 0,                              /* tp_clear */
+    (richcmpfunc) SwigPyBuiltin__LinkLayerModel_richcompare,      /* tp_richcompare */
+    0,                                        /* tp_weaklistoffset */
+    (getiterfunc) 0,                          /* tp_iter */
+    (iternextfunc) 0,                         /* tp_iternext */
+    SwigPyBuiltin__LinkLayerModel_methods,    /* tp_methods */
+    0,                                        /* tp_members */
+    SwigPyBuiltin__LinkLayerModel_getset,     /* tp_getset */
+    0,                                        /* tp_base */
+    0,                                        /* tp_dict */
+    (descrgetfunc) 0,                         /* tp_descr_get */
+    (descrsetfunc) 0,                         /* tp_descr_set */
+    (Py_ssize_t) offsetof(SwigPyObject, dict),/* tp_dictoffset */
+    (initproc) _wrap_new_LinkLayerModel,      /* tp_init */
+    (allocfunc) 0,                            /* tp_alloc */
+    (newfunc) 0,                              /* tp_new */
+    (freefunc) 0,                             /* tp_free */
+    (inquiry) 0,                              /* tp_is_gc */
+    (PyObject *) 0,                           /* tp_bases */
+    (PyObject *) 0,                           /* tp_mro */
+    (PyObject *) 0,                           /* tp_cache */
+    (PyObject *) 0,                           /* tp_subclasses */
+    (PyObject *) 0,                           /* tp_weaklist */
+    (destructor) 0,                           /* tp_del */
+#if PY_VERSION_HEX >= 0x02060000
+    (int) 0,                                  /* tp_version_tag */
+#endif
+#if PY_VERSION_HEX >= 0x03040000
+    (destructor) 0,                           /* tp_finalize */
+#endif
+#ifdef COUNT_ALLOCS
+    (Py_ssize_t) 0,                           /* tp_allocs */
+    (Py_ssize_t) 0,                           /* tp_frees */
+    (Py_ssize_t) 0,                           /* tp_maxalloc */
+#if PY_VERSION_HEX >= 0x02050000
+    0,                                        /* tp_prev */
+#endif
+    0,                                        /* tp_next */
+#endif
+  },
+#if PY_VERSION_HEX >= 0x03050000
+  {
+    (unaryfunc) 0,                            /* am_await */
+    (unaryfunc) 0,                            /* am_aiter */
+    (unaryfunc) 0,                            /* am_anext */
+  },
+#endif
+  {
+    (binaryfunc) 0,                           /* nb_add */
+    (binaryfunc) 0,                           /* nb_subtract */
+    (binaryfunc) 0,                           /* nb_multiply */
+#if PY_VERSION_HEX < 0x03000000
+    (binaryfunc) 0,                           /* nb_divide */
+#endif
+    (binaryfunc) 0,                           /* nb_remainder */
+    (binaryfunc) 0,                           /* nb_divmod */
+    (ternaryfunc) 0,                          /* nb_power */
+    (unaryfunc) 0,                            /* nb_negative */
+    (unaryfunc) 0,                            /* nb_positive */
+    (unaryfunc) 0,                            /* nb_absolute */
+    (inquiry) 0,                              /* nb_nonzero */
+    (unaryfunc) 0,                            /* nb_invert */
+    (binaryfunc) 0,                           /* nb_lshift */
+    (binaryfunc) 0,                           /* nb_rshift */
+    (binaryfunc) 0,                           /* nb_and */
+    (binaryfunc) 0,                           /* nb_xor */
+    (binaryfunc) 0,                           /* nb_or */
+#if PY_VERSION_HEX < 0x03000000
+    (coercion) 0,                             /* nb_coerce */
+#endif
+    (unaryfunc) 0,                            /* nb_int */
+#if PY_VERSION_HEX >= 0x03000000
+    (void *) 0,                               /* nb_reserved */
+#else
+    (unaryfunc) 0,                            /* nb_long */
+#endif
+    (unaryfunc) 0,                            /* nb_float */
+#if PY_VERSION_HEX < 0x03000000
+    (unaryfunc) 0,                            /* nb_oct */
+    (unaryfunc) 0,                            /* nb_hex */
+#endif
+    (binaryfunc) 0,                           /* nb_inplace_add */
+    (binaryfunc) 0,                           /* nb_inplace_subtract */
+    (binaryfunc) 0,                           /* nb_inplace_multiply */
+#if PY_VERSION_HEX < 0x03000000
+    (binaryfunc) 0,                           /* nb_inplace_divide */
+#endif
+    (binaryfunc) 0,                           /* nb_inplace_remainder */
+    (ternaryfunc) 0,                          /* nb_inplace_power */
+    (binaryfunc) 0,                           /* nb_inplace_lshift */
+    (binaryfunc) 0,                           /* nb_inplace_rshift */
+    (binaryfunc) 0,                           /* nb_inplace_and */
+    (binaryfunc) 0,                           /* nb_inplace_xor */
+    (binaryfunc) 0,                           /* nb_inplace_or */
+    (binaryfunc) 0,                           /* nb_floor_divide */
+    (binaryfunc) 0,                           /* nb_true_divide */
+    (binaryfunc) 0,                           /* nb_inplace_floor_divide */
+    (binaryfunc) 0,                           /* nb_inplace_true_divide */
+#if PY_VERSION_HEX >= 0x02050000
+    (unaryfunc) 0,                            /* nb_index */
+#endif
+#if PY_VERSION_HEX >= 0x03050000
+    (binaryfunc) 0,                           /* nb_matrix_multiply */
+    (binaryfunc) 0,                           /* nb_inplace_matrix_multiply */
+#endif
+  },
+  {
+    (lenfunc) 0,                              /* mp_length */
+    (binaryfunc) 0,                           /* mp_subscript */
+    (objobjargproc) 0,                        /* mp_ass_subscript */
+  },
+  {
+    (lenfunc) 0,                              /* sq_length */
+    (binaryfunc) 0,                           /* sq_concat */
+    (ssizeargfunc) 0,                         /* sq_repeat */
+    (ssizeargfunc) 0,                         /* sq_item */
+#if PY_VERSION_HEX >= 0x03000000
+    (void *) 0,                               /* was_sq_slice */
+#else
+    (ssizessizeargfunc) 0,                    /* sq_slice */
+#endif
+    (ssizeobjargproc) 0,                      /* sq_ass_item */
+#if PY_VERSION_HEX >= 0x03000000
+    (void *) 0,                               /* was_sq_ass_slice */
+#else
+    (ssizessizeobjargproc) 0,                 /* sq_ass_slice */
+#endif
+    (objobjproc) 0,                           /* sq_contains */
+    (binaryfunc) 0,                           /* sq_inplace_concat */
+    (ssizeargfunc) 0,                         /* sq_inplace_repeat */
+  },
+  {
+#if PY_VERSION_HEX < 0x03000000
+    (readbufferproc) 0,                       /* bf_getreadbuffer */
+    (writebufferproc) 0,                      /* bf_getwritebuffer */
+    (segcountproc) 0,                         /* bf_getsegcount */
+    (charbufferproc) 0,                       /* bf_getcharbuffer */
+#endif
+#if PY_VERSION_HEX >= 0x02060000
+    (getbufferproc) 0,                        /* bf_getbuffer */
+    (releasebufferproc) 0,                    /* bf_releasebuffer */
+#endif
+  },
+    (PyObject *) 0,                           /* ht_name */
+    (PyObject *) 0,                           /* ht_slots */
+#if PY_VERSION_HEX >= 0x03030000
+    (PyObject *) 0,                           /* ht_qualname */
+    0,                                        /* ht_cached_keys */
+#endif
+};
+
+SWIGINTERN SwigPyClientData SwigPyBuiltin__LinkLayerModel_clientdata = {0, 0, 0, 0, 0, 0, (PyTypeObject *)&SwigPyBuiltin__LinkLayerModel_type};
+
 static SwigPyGetSet Packet___dict___getset = { SwigPyObject_get___dict__, 0 };
 SWIGINTERN PyGetSetDef SwigPyBuiltin__Packet_getset[] = {
     { (char *) "__dict__", (getter) SwigPyBuiltin_FunpackGetterClosure, (setter) 0, (char *)"Packet.__dict__", (void *) &Packet___dict___getset }
@@ -9227,6 +10184,8 @@ SWIGINTERN PyMethodDef SwigPyBuiltin__Tossim_methods[] = {
   { "randomSeed", (PyCFunction) _wrap_Tossim_randomSeed, METH_O, (char *) "" },
   { "register_event_callback", (PyCFunction) _wrap_Tossim_register_event_callback, METH_VARARGS, (char *) "" },
   { "runNextEvent", (PyCFunction) _wrap_Tossim_runNextEvent, METH_NOARGS, (char *) "" },
+  { "eventQueueSize", (PyCFunction) _wrap_Tossim_eventQueueSize, METH_NOARGS, (char *) "" },
+  { "eventQueuePeakSize", (PyCFunction) _wrap_Tossim_eventQueuePeakSize, METH_NOARGS, (char *) "" },
   { "triggerRunDurationStart", (PyCFunction) _wrap_Tossim_triggerRunDurationStart, METH_NOARGS, (char *) "" },
   { "runAllEventsWithTriggeredMaxTime", (PyCFunction) _wrap_Tossim_runAllEventsWithTriggeredMaxTime, METH_VARARGS, (char *) "" },
   { "runAllEventsWithTriggeredMaxTimeAndCallback", (PyCFunction) _wrap_Tossim_runAllEventsWithTriggeredMaxTimeAndCallback, METH_VARARGS, (char *) "" },
@@ -9430,6 +10389,7 @@ SWIGINTERN SwigPyClientData SwigPyBuiltin__Tossim_clientdata = {0, 0, 0, 0, 0, 0
 /* -------- TYPE CONVERSION AND EQUIVALENCE RULES (BEGIN) -------- */
 
 static swig_type_info _swigt__p_FILE = {"_p_FILE", "FILE *", 0, 0, (void*)0, 0};
+static swig_type_info _swigt__p_LinkLayerModel = {"_p_LinkLayerModel", "LinkLayerModel *", 0, 0, (void*)&SwigPyBuiltin__LinkLayerModel_clientdata, 0};
 static swig_type_info _swigt__p_MAC = {"_p_MAC", "MAC *", 0, 0, (void*)&SwigPyBuiltin__MAC_clientdata, 0};
 static swig_type_info _swigt__p_Mote = {"_p_Mote", "Mote *", 0, 0, (void*)&SwigPyBuiltin__Mote_clientdata, 0};
 static swig_type_info _swigt__p_NescApp = {"_p_NescApp", "NescApp *", 0, 0, (void*)0, 0};
@@ -9449,6 +10409,7 @@ static swig_type_info _swigt__p_std__string = {"_p_std__string", "std::string *"
 
 static swig_type_info *swig_type_initial[] = {
   &_swigt__p_FILE,
+  &_swigt__p_LinkLayerModel,
   &_swigt__p_MAC,
   &_swigt__p_Mote,
   &_swigt__p_NescApp,
@@ -9468,6 +10429,7 @@ static swig_type_info *swig_type_initial[] = {
 };
 
 static swig_cast_info _swigc__p_FILE[] = {  {&_swigt__p_FILE, 0, 0, 0},{0, 0, 0, 0}};
+static swig_cast_info _swigc__p_LinkLayerModel[] = {  {&_swigt__p_LinkLayerModel, 0, 0, 0},{0, 0, 0, 0}};
 static swig_cast_info _swigc__p_MAC[] = {  {&_swigt__p_MAC, 0, 0, 0},{0, 0, 0, 0}};
 static swig_cast_info _swigc__p_Mote[] = {  {&_swigt__p_Mote, 0, 0, 0},{0, 0, 0, 0}};
 static swig_cast_info _swigc__p_NescApp[] = {  {&_swigt__p_NescApp, 0, 0, 0},{0, 0, 0, 0}};
@@ -9487,6 +10449,7 @@ static swig_cast_info _swigc__p_std__string[] = {  {&_swigt__p_std__string, 0, 0
 
 static swig_cast_info *swig_cast_initial[] = {
   _swigc__p_FILE,
+  _swigc__p_LinkLayerModel,
   _swigc__p_MAC,
   _swigc__p_Mote,
   _swigc__p_NescApp,
@@ -10243,6 +11206,29 @@ SWIG_init(void) {
   SwigPyBuiltin_AddPublicSymbol(public_interface, "Radio");
   d = md;
   
+  /* type '::LinkLayerModel' */
+  builtin_pytype = (PyTypeObject *)&SwigPyBuiltin__LinkLayerModel_type;
+  builtin_pytype->tp_dict = d = PyDict_New();
+  SwigPyBuiltin_SetMetaType(builtin_pytype, metatype);
+  builtin_pytype->tp_new = PyType_GenericNew;
+  builtin_base_count = 0;
+  builtin_bases[builtin_base_count] = NULL;
+  SwigPyBuiltin_InitBases(builtin_pytype, builtin_bases);
+  PyDict_SetItemString(d, "this", this_descr);
+  PyDict_SetItemString(d, "thisown", thisown_descr);
+  if (PyType_Ready(builtin_pytype) < 0) {
+    PyErr_SetString(PyExc_TypeError, "Could not create type 'LinkLayerModel'.");
+#if PY_VERSION_HEX >= 0x03000000
+    return NULL;
+#else
+    return;
+#endif
+  }
+  Py_INCREF(builtin_pytype);
+  PyModule_AddObject(m, "LinkLayerModel", (PyObject *)builtin_pytype);
+  SwigPyBuiltin_AddPublicSymbol(public_interface, "LinkLayerModel");
+  d = md;
+  
   /* type '::Packet' */
   builtin_pytype = (PyTypeObject *)&SwigPyBuiltin__Packet_type;
   builtin_pytype->tp_dict = d = PyDict_New();
@@ -10334,6 +11320,13 @@ SWIG_init(void) {
   PyModule_AddObject(m, "Tossim", (PyObject *)builtin_pytype);
   SwigPyBuiltin_AddPublicSymbol(public_interface, "Tossim");
   d = md;
+  
+#if PY_VERSION_HEX < 0x03070000
+  // PyGILState_Ensure needs the GIL to have been created before
+  // TOSSIM releases it for the first time.
+  PyEval_InitThreads();
+#endif
+  
 #if PY_VERSION_HEX >= 0x03000000
   return m;
 #else